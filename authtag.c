@@ -30,6 +30,7 @@
 extern int debug;
 
 static uint8_t key[AUTHTAG_KEY_LEN];
+static authtag_ctx_t ctx;			/* key made ready for signing */
 
 
 /*
@@ -44,30 +45,69 @@ static uint8_t key[AUTHTAG_KEY_LEN];
  *
  * An observer (watching the wire protocol) and without the source can't see this trick. 
  *
+ * The key is processed once (see authtag_prepare()), not for every message.
+ *
  */
 void authtag_sign(uint8_t *out, int outlen, void *in, int inlen)
+{
+        authtag_sign_ctx(&ctx, out, outlen, in, inlen);
+}
+
+
+/*
+ * authtag_sign_ctx() - sign with a key made ready by authtag_prepare(), for a sender
+ * that signs for more than one destination
+ */
+void authtag_sign_ctx(const authtag_ctx_t *c, uint8_t *out, int outlen, void *in, int inlen)
 {
         uint8_t hmac[HMAC_SHA256_SIZE];
         int mod = HMAC_SHA256_SIZE - outlen;
         int idx;
 
-        hmac_sha256(hmac, key, AUTHTAG_KEY_LEN, in, inlen);
+        hmac_sha256_with(hmac, c, in, inlen);
         idx = hmac[22] % mod;
         memcpy(out, &hmac[idx], outlen);
 }
 
 
 /*
- * authtag_check() - check an authentication tag
+ * authtag_prepare() - process an expanded key (see authtag_expand()) once, so that signing
+ * with it costs two SHA256 blocks fewer per message
  */
-int authtag_check(uint8_t *tag, int taglen, uint8_t *in, int inlen)
+void authtag_prepare(authtag_ctx_t *c, const uint8_t *hkey)
+{
+        hmac_sha256_prepare(c, hkey, AUTHTAG_KEY_LEN);
+}
+
+
+/*
+ * authtag_sign_with() - sign with a given expanded key (see authtag_expand()), for receivers
+ * that answer many stations
+ */
+void authtag_sign_with(const uint8_t *hkey, uint8_t *out, int outlen, void *in, int inlen)
+{
+        uint8_t hmac[HMAC_SHA256_SIZE];
+        int mod = HMAC_SHA256_SIZE - outlen;
+        int idx;
+
+        hmac_sha256(hmac, hkey, AUTHTAG_KEY_LEN, in, inlen);
+        idx = hmac[22] % mod;
+        memcpy(out, &hmac[idx], outlen);
+}
+
+
+/*
+ * authtag_verify() - check an authentication tag against a given expanded key (see
+ * authtag_expand()), for receivers that hold the keys of many stations
+ */
+int authtag_verify(const uint8_t *hkey, uint8_t *tag, int taglen, uint8_t *in, int inlen)
 {
         uint8_t hmac[HMAC_SHA256_SIZE];
         int mod = HMAC_SHA256_SIZE - taglen;
         int idx;
         int i, j = 0, k = 0;
         
-        hmac_sha256(hmac, key, AUTHTAG_KEY_LEN, in, inlen);
+        hmac_sha256(hmac, hkey, AUTHTAG_KEY_LEN, in, inlen);
 
         idx = hmac[22] % mod;
 
@@ -83,6 +123,35 @@ int authtag_check(uint8_t *tag, int taglen, uint8_t *in, int inlen)
 }
 
 
+/*
+ * authtag_check() - check an authentication tag
+ */
+int authtag_check(uint8_t *tag, int taglen, uint8_t *in, int inlen)
+{
+        return authtag_verify(key, tag, taglen, in, inlen);
+}
+
+
+/*
+ * authtag_expand() - expand a pass-phrase into an HMAC key without making it ours
+ */
+void authtag_expand(uint8_t *hkey, char *secret)
+{
+        sha512(hkey, (uint8_t *)secret, strlen(secret));
+}
+
+
+/*
+ * authtag_key() - sign with an expanded key (see authtag_expand()) from now on, for a
+ * sender that speaks for more than one station
+ */
+void authtag_key(const uint8_t *hkey)
+{
+        memcpy(key, hkey, AUTHTAG_KEY_LEN);
+        authtag_prepare(&ctx, key);
+}
+
+
 /*
  * authtag_init() - create key for ue by HMAC-256 functions later
  *
@@ -95,7 +164,8 @@ int authtag_check(uint8_t *tag, int taglen, uint8_t *in, int inlen)
  */
 void authtag_init(char *secret)
 {
-        sha512(key, (uint8_t *)secret, strlen(secret));
+        authtag_expand(key, secret);
+        authtag_prepare(&ctx, key);
 
         if (debug)
                 hex_dump("Key", key, AUTHTAG_KEY_LEN);
@@ -7,14 +7,27 @@
 
 #include <stdint.h>
 
+#include "hmac-sha256.h"
+
 #define AUTHTAG_LEN		8
 #define AUTHTAG_KEY_LEN		64		/* inpuit to HMAC-SHA256 */
 
+/*
+ * an expanded key made ready for signing (see authtag_prepare())
+ */
+typedef hmac_sha256_ctx authtag_ctx_t;
+
 /*
  * exported functions
  */
 void authtag_init(char *);
 void authtag_sign(uint8_t *, int, void *, int);
+void authtag_sign_with(const uint8_t *, uint8_t *, int, void *, int);
 int authtag_check(uint8_t *, int, uint8_t *, int);
+int authtag_verify(const uint8_t *, uint8_t *, int, uint8_t *, int);
+void authtag_expand(uint8_t *, char *);
+void authtag_key(const uint8_t *);
+void authtag_prepare(authtag_ctx_t *, const uint8_t *);
+void authtag_sign_ctx(const authtag_ctx_t *, uint8_t *, int, void *, int);
 
 #endif
@@ -0,0 +1,85 @@
+/*
+ * avr.c -- Decode the AVR (raw ASCII hex) ADS-B protocol
+ * Author: Michael J. Tubby B.Sc. MIET  mike@tubby.org
+ *
+ * ABSTRACT
+ *
+ * Some receivers can only provide the AVR protocol on TCP port 30002 which
+ * is one message per line in ASCII hex, either:
+ *
+ *	*8D4CADE699147A2218680A7BF7F9;		no MLAT timestamp
+ *	@1FC43F331AD28D4CADE699147A2218680A7BF7F9;	12 digit (48-bit) MLAT timestamp
+ *
+ * with 4, 14 or 28 hex digits of Mode-A/C, Mode-S Short or Mode-S Extended
+ * data.  AVR doesn't carry RSSI so this is sent as zero.
+ *
+ * Lines are split in beast.c and each one is converted here into the same
+ * frame layout as a de-escaped BEAST frame (type, MLAT, RSSI, data) so the
+ * rest of the pipeline is shared.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "defs.h"
+#include "avr.h"
+#include "hex.h"
+
+
+/*
+ * avr_decode() - decode one AVR line of 'len' characters (excluding the ';') into
+ * a BEAST format frame at 'out', returns the frame size or zero if it's not valid
+ */
+int avr_decode(uint8_t *out, const char *line, int len)
+{
+        int digits, size;
+        uint8_t type;
+
+        /* skip the CR/LF left over from the end of the previous line */
+        while (len && (*line == '\r' || *line == '\n' || *line == ' ')) {
+                ++line;
+                --len;
+        }
+
+        if (len < 1)
+                return 0;
+
+        memset(out, 0, 1 + MLAT_LEN + 1);
+
+        if (*line == '@') {
+                /* MLAT timestamped */
+                if (len < 1 + 2*MLAT_LEN || !hex_decode(&out[1], &line[1], MLAT_LEN))
+                        return 0;
+
+                line += 1 + 2*MLAT_LEN;
+                len -= 1 + 2*MLAT_LEN;
+
+        } else if (*line == '*') {
+                /* no timestamp */
+                ++line;
+                --len;
+
+        } else {
+                return 0;
+        }
+
+        digits = len;
+
+        switch (digits) {
+                case 2 * MODE_AC_LEN:	type = 0x31;	break;
+                case 2 * MODE_SS_LEN:	type = 0x32;	break;
+                case 2 * MODE_ES_LEN:	type = 0x33;	break;
+                default:		return 0;
+        }
+
+        size = digits / 2;
+
+        if (!hex_decode(&out[1 + MLAT_LEN + 1], line, size))
+                return 0;
+
+        out[0] = type;
+
+        return 1 + MLAT_LEN + 1 + size;
+}
@@ -0,0 +1,20 @@
+/*
+ * avr.h -- AVR (raw ASCII hex) ADS-B protocol
+ * Author: Michael J. Tubby B.Sc. MIET  mike@tubby.org
+ */
+
+#ifndef _AVR_H
+#define _AVR_H
+
+#include <stdint.h>
+
+#define AVR_TCP_PORT			30002		/* AVR protocol port */
+#define AVR_MAX_LINE			64		/* longest line we accept - "@" + 12 + 28 + ";" is 42 */
+
+
+/*
+ * exported functions
+ */
+int avr_decode(uint8_t *, const char *, int);
+
+#endif
@@ -7,7 +7,7 @@
  * Implement he BEAST binary block-mode protocol over a TCP/IP
  * connection, a USB serial connection or a physical serial port.
  *
- * Make a TCP/IP connection to a source of the BEAST protocol on 
+ * Make a TCP/IP connection to a source of the BEAST protocol on
  * TCP/localhost.30005 as provided by Readsb and Dump1090 or from a
  * read or virtual serial port for Mode-S-Beast hardware.
  *
@@ -15,11 +15,82 @@
  * (message type 0x33) which is MLAT + RSSI + 14-byrtes of data and pass
  * these up to radar_send() for forwarding to the aggregator.
  *
+ *
+ * HOT-STANDBY SOURCES
+ *
+ * Up to BEAST_MAX_SOURCES sources can be configured in order of preference.
+ * All of them are connected and parsed all of the time but only frames from
+ * the active source are passed up to radar_process().
+ *
+ * A wedged SDR leaves its readsb TCP connection up but silent so we run a
+ * stall detector: if the active source produces no frames for 'stall' mS
+ * then we switch to the most preferred standby that is producing frames.
+ * We fail back to a more preferred source once it has been producing frames
+ * continuously for BEAST_FAILBACK_HOLD mS so that we don't flap.
+ *
+ *
+ * HARDWARE CONFIGURATION
+ *
+ * A Mode-S Beast on USB sends everything it receives over the 3Mbps link
+ * unless told otherwise.  After each (re)connect we send it configuration
+ * commands (1A 31 <c>) so that Mode-A/C, DF0/4/5 and optionally everything
+ * other than DF11/17 are filtered out in hardware when we wouldn't forward
+ * them anyway, and so that it checks CRCs before sending.
+ *
+ *
+ * LOCAL SOURCES
+ *
+ * Co-located deployments can avoid the loopback TCP connection by giving
+ * a source as "-" (standard input), "fifo:<path>" (named pipe) or
+ * "unix:<path>" (AF_UNIX stream socket).  These use the same parser and
+ * the same re-connect logic as TCP, except that standard input cannot be
+ * re-opened so it is closed for good at end of file.
+ *
+ *
+ * CONNECTING
+ *
+ * Nothing here may hold up the event loop while frames are flowing from the
+ * active source, so a TCP source that is (re)connected - a standby or one
+ * that failed - never blocks: a host name is looked up in the background
+ * with getaddrinfo_a() and checked on each beast_second(), and the connect()
+ * is non-blocking and finished when poll() says the socket is writable, or
+ * given up after BEAST_CONNECT_TIMEOUT.  An IPv4 address needs no look-up.
+ *
+ *
+ * ARRIVAL TIMES
+ *
+ * Each read is stamped with its arrival time which travels with the frames
+ * through radar_process() to the sender.  TCP and unix domain sockets have
+ * SO_TIMESTAMPNS enabled and are read with recvmsg() so this is the time the
+ * kernel received the data rather than the time we got round to reading it;
+ * serial ports, pipes and standard input are stamped with ustime() after
+ * the read.
+ *
+ *
+ * AVR SOURCES
+ *
+ * TCP sources can also provide the AVR ASCII protocol (port 30002) for older
+ * receivers.  Lines are split here and converted by avr_decode() into the same
+ * frame layout as a de-escaped BEAST frame before process_frame().
+ *
+ *
+ * INPUT BACKLOG
+ *
+ * beast_backlog() reports how much input is queued in the kernel in front of
+ * the active source (FIONREAD: SIOCINQ on sockets, TIOCINQ on ttys) which is
+ * how far behind the receiver we are.  When overload protection (overload.c)
+ * has nothing left to give, beast_discard() throws the backlog away and the
+ * parser re-synchronises on the next frame.
+ *
  */
 
+#define _GNU_SOURCE
 #include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/uio.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/ioctl.h>
 #include <fcntl.h>
 #include <sys/select.h>
 #include <netinet/in.h>
@@ -38,6 +109,14 @@
 #include "defs.h"
 #include "beast.h"
 #include "telemetry.h"
+#include "mstime.h"
+#include "ustime.h"
+#include "capture.h"
+#include "serial.h"
+#include "latency.h"
+#include "trace.h"
+#include "probes.h"
+#include "avr.h"
 #include "hex.h"
 #include "qerror.h"
 
@@ -54,59 +133,114 @@ extern int debug;
 
 
 /*
- * global variables
+ * a TCP host name look-up running in the background, by source
  */
-int beast_fd = 0;
+typedef struct {
+        struct gaicb gai;
+        struct addrinfo hints;
+        int pending;					/* outstanding, the glibc resolver owns gai */
+} lookup_t;
+
 
 /*
  * local variables
  */
-static enum beast_mode mode = BEAST_MODE_NONE;
-static int state;
-static uint16_t pps = 0;
-static enum beast_state constate;
-static char hostname[HOSTNAME_LEN+1];
-static uint16_t port;
-static struct sockaddr_in saddr;
-static int retry_count;
-static char dev[BEAST_SERIAL_PORT_NAME+1];
-static speed_t speed;
+static beast_source_t sources[BEAST_MAX_SOURCES];
+static lookup_t lookups[BEAST_MAX_SOURCES];
+static int nsources = 0;
+static int active = 0;
+static int stall = BEAST_STALL_TIMEOUT;
+static beast_output_t output = radar_process;		/* where decoded frames go */
 
 
 /*
  * chgconstate() - change connection state with optional debugging
  */
-static void chgconstate(enum beast_state new)
+static void chgconstate(beast_source_t *src, enum beast_state new)
 {
 #ifdef DEBUG_BEAST
         if (debug > 4)
-                printf("chgstate(): %d -> %d\n", constate, new);
+                printf("chgconstate(): source %d: %d -> %d\n", (int)(src - sources), src->constate, new);
 #endif
-        constate = new;
+        PROBE3(beast_state, (int)(src - sources), src->constate, new);
+        src->constate = new;
 }
 
 
 /*
  * chgstate() - change beast protocol state with optional debugging
  */
-static void chgstate(int new)
+static void chgstate(beast_source_t *src, int new)
 {
 #ifdef DEBUG_BEAST
         if (debug > 4)
-                printf("chgstate(): %d -> %d\n", state, new);
+                printf("chgstate(): source %d: %d -> %d\n", (int)(src - sources), src->state, new);
 #endif
-        state = new;
+        src->state = new;
+}
+
+
+/*
+ * add_source() - add a source to the end of the preference list
+ */
+static beast_source_t *add_source(enum beast_mode mode)
+{
+        beast_source_t *src;
+
+        if (nsources >= BEAST_MAX_SOURCES)
+                qerror("radar: too many BEAST sources (max %d)\n", BEAST_MAX_SOURCES);
+
+        src = &sources[nsources++];
+        memset(src, 0, sizeof(beast_source_t));
+        src->mode = mode;
+        src->fd = -1;
+        src->hwconfig = -1;
+        chgconstate(src, BEAST_STATE_DISCONNECTED);
+
+        return src;
+}
+
+
+/*
+ * switch_source() - make a different source the active one
+ */
+static void switch_source(int new, const char *why)
+{
+        if (new != active) {
+                if (debug)
+                        printf("switch_source(): %s: source %d (%s) -> %d (%s)\n", why, active, sources[active].addr, new, sources[new].addr);
+
+                PROBE2(source_switch, active, new);
+                active = new;
+                ++telemetry.source_switch;
+                trace_event(TRACE_EV_SOURCE_SWITCH, 0, new);
+        }
 }
 
 
 /*
  * process_frame() - process a decoded (de-escaped) BEAST frame
  */
-static void process_frame(uint8_t *bp, int size)
+static void process_frame(beast_source_t *src, uint8_t *bp, int size)
 {
         if (bp[0] >= 0x31 && bp[0] <= 0x33) {
-                radar_process(&bp[1], bp[7], &bp[8], size-8);
-                ++pps;
+                uint64_t now = mstime();
+
+                /* a frame after a gap longer than the stall timeout starts a new healthy run */
+                if (now - src->last_frame > stall)
+                        src->healthy_since = now;
+
+                src->last_frame = now;
+                ++src->pps;
+
+                if (src == &sources[active]) {
+                        latency_frame();
+
+                        if (src->mode == BEAST_MODE_SERIAL)
+                                serial_arrival(src->rx_time, &bp[1]);
+
+                        output(&bp[1], bp[7], &bp[8], size-8, src->rx_time);
+                }
         }
 }
 
@@ -114,126 +248,221 @@ static void process_frame(uint8_t *bp, int size)
 /*
  * process_input() - process a chunk of BEAST protocol input from a TCP or serial connection
  */
-static void process_input(uint8_t *bp, int size)
+static void process_input(beast_source_t *src, uint8_t *bp, int size)
 {
-        static uint8_t buf[BEAST_MAX_FRAME];
-        static uint8_t *op = buf;
         uint8_t b;
-        int sz;
 
 #ifdef DEBUG_BEAST
         printf("process_input(): size: %d\n", size);
 #endif
 
-        ++telemetry.socket_reads;
-        telemetry.bytes_read += size;
-
         /*
-         * process a hunk of data from the Beast TCP connection and decode and 
+         * process a hunk of data from the Beast TCP connection and decode and
          * pass frames up to process_frame()
          */
          while (size--) {
                 b = *bp++;
 
-                sz = op - buf;
-
-                if (sz > sizeof(buf)) {
-                        op = buf;
-                        chgstate(0);
+                /* frame too long - corrupt or not BEAST so wait for the next Escape */
+                if (src->len >= BEAST_MAX_FRAME && ((src->state == 2 && b != BEAST_ESC) || (src->state == 3 && b == BEAST_ESC))) {
+                        src->len = 0;
+                        chgstate(src, 0);
+                        ++telemetry.frames_bad;
+                        trace_event(TRACE_EV_BAD_FRAME, 0, src - sources);
+                        continue;
                 }
-                
+
 #ifdef DEBUG_BEAST
-                printf("process_input(): b=%02X sz=%d state=%d\n", b, sz, state);
+                printf("process_input(): b=%02X len=%d state=%d\n", b, src->len, src->state);
 #endif
 
-                switch (state) {
+                switch (src->state) {
                         case 0:							/* wait for first instance of Escape */
                                 if (b == BEAST_ESC) {
-                                        chgstate(1);
-                                        op = buf;
+                                        chgstate(src, 1);
+                                        src->len = 0;
                                 } else {
                                         ;
                                 }
                                 break;
-                        
+
                         case 1:							/* look for start of frame */
                                 if (b >= 0x31 && b <= 0x33) {
-                                        *op++ = b;
-                                        chgstate(2);				/* start of frame */
+                                        src->buf[src->len++] = b;
+                                        chgstate(src, 2);			/* start of frame */
                                 } else {
-                                        chgstate(0);				/* all other chars including Escape */
+                                        chgstate(src, 0);			/* all other chars including Escape */
                                 }
                                 break;
-                                
+
                         case 2:							/* inside frame */
                                 if (b == BEAST_ESC) {
-                                        chgstate(3);				/* seen an Escape inside the frame */
+                                        chgstate(src, 3);			/* seen an Escape inside the frame */
                                 } else {
-                                        *op++ = b;				/* copy bytes */
+                                        src->buf[src->len++] = b;		/* copy bytes */
                                 }
                                 break;
-                                
+
                         case 3:
                                 if (b == BEAST_ESC) {				/* Escaped, Escape or end of frame ? */
-                                        *op++ = BEAST_ESC;
-                                        chgstate(2);
+                                        src->buf[src->len++] = BEAST_ESC;
+                                        chgstate(src, 2);
                                 } else {
-                                        if (sz) {
-                                                process_frame(buf, sz);		/* process frame */
-                                                op = buf;
+                                        if (src->len) {
+                                                process_frame(src, src->buf, src->len);	/* process frame */
+                                                src->len = 0;
                                                 ++telemetry.frames_good;
 
                                                 if (b >= 0x31 && b <= 0x33) {
-                                                        *op++ = b;
-                                                        chgstate(2);		/* next frame */
+                                                        src->buf[src->len++] = b;
+                                                        chgstate(src, 2);	/* next frame */
                                                 } else {
-                                                        chgstate(1);
+                                                        chgstate(src, 1);
                                                 }
                                         } else {
-                                                chgstate(0);			/* error reset */
+                                                chgstate(src, 0);		/* error reset */
                                                 ++telemetry.frames_bad;
+                                                trace_event(TRACE_EV_BAD_FRAME, 0, src - sources);
                                         }
                                 }
                                 break;
-                }                
+                }
         }
 }
 
 
 /*
- * beast_reset_connection() - reset the TCP connection after an error
+ * process_avr() - split a chunk of AVR protocol input into lines and process them
  */
-void beast_reset_connection(void)
+static void process_avr(beast_source_t *src, uint8_t *bp, int size)
+{
+        uint8_t *end = bp + size;
+        uint8_t frame[BEAST_MAX_FRAME];
+
+        while (bp < end) {
+                uint8_t *p = memchr(bp, ';', end - bp);			/* end of this line */
+                int n = (p ? p : end) - bp;
+
+                if (src->len + n <= AVR_MAX_LINE) {
+                        memcpy(&src->line[src->len], bp, n);
+                        src->len += n;
+                } else {
+                        src->len = AVR_MAX_LINE + 1;			/* too long - discard up to the next ';' */
+                }
+
+                if (!p)
+                        break;						/* partial line - wait for more */
+
+                if (src->len <= AVR_MAX_LINE && (n = avr_decode(frame, src->line, src->len)) > 0) {
+                        process_frame(src, frame, n);
+                        ++telemetry.frames_good;
+                } else {
+                        ++telemetry.frames_bad;
+                        trace_event(TRACE_EV_BAD_FRAME, 0, src - sources);
+                }
+
+                src->len = 0;
+                bp = p + 1;
+        }
+}
+
+
+/*
+ * reset_connection() - reset a source connection after an error
+ */
+static void reset_connection(beast_source_t *src)
+{
+        if (src->fd >= 0) {
+                close(src->fd);
+                src->fd = -1;
+        }
+
+        if (debug)
+                printf("reset_connection(): BEAST connection to %s reset... start retry timer...\n", src->addr);
+
+        src->retry_count = BEAST_CONNECT_RETRY;
+        src->state = src->len = 0;
+        src->kernel_ts = 0;
+
+        trace_event(TRACE_EV_BEAST_RESET, 0, src - sources);
+
+        chgconstate(src, BEAST_STATE_RETRY_WAIT);
+}
+
+
+/*
+ * end_of_input() - the peer has gone away, standard input is finished rather than retried
+ */
+static void end_of_input(beast_source_t *src)
 {
-        if (beast_fd) {
-                close(beast_fd);
-                beast_fd = 0;
+        ++telemetry.disconnect;
+
+        if (src->mode != BEAST_MODE_STDIN) {
+                reset_connection(src);
+                return;
         }
 
+        qlog("radar: end of BEAST input on stdin, source closed\n");
+
+        close(src->fd);
+        src->fd = -1;
+        src->state = src->len = 0;
+
+        trace_event(TRACE_EV_BEAST_RESET, 0, src - sources);
+
+        chgconstate(src, BEAST_STATE_CLOSED);
+}
+
+
+/*
+ * write_option() - send a Mode-S Beast configuration command
+ */
+static int write_option(beast_source_t *src, char c)
+{
+        uint8_t cmd[3] = { BEAST_ESC, 0x31, (uint8_t)c };
+
+        return write(src->fd, cmd, sizeof(cmd)) == sizeof(cmd);
+}
+
+
+/*
+ * write_config() - configure a Mode-S Beast to only send what we need
+ */
+static void write_config(beast_source_t *src)
+{
+        int flags = src->hwconfig;
+        int ok = 1;
+
+        ok &= write_option(src, 'C');					/* binary format */
+        ok &= write_option(src, 'H');					/* RTS handshake */
+        ok &= write_option(src, 'E');					/* MLAT timestamps */
+        ok &= write_option(src, (flags & BEAST_HW_CRC) ? 'f' : 'F');	/* CRC checks */
+        ok &= write_option(src, (flags & BEAST_HW_DF1117) ? 'D' : 'd');	/* DF11/17 only filter */
+        ok &= write_option(src, (flags & BEAST_HW_DF045) ? 'g' : 'G');	/* DF0/4/5 filter */
+        ok &= write_option(src, (flags & BEAST_HW_MODE_AC) ? 'J' : 'j');	/* Mode-A/C */
+
         if (debug)
-                printf("beast_reset_connection(): BEAST connection reset... start retry timer...\n");
-        
-        retry_count = BEAST_CONNECT_RETRY;
+                printf("write_config(): %s flags=0x%02X %s\n", src->addr, flags, ok ? "ok" : "FAILED");
 
-        chgconstate(BEAST_STATE_RETRY_WAIT);
+        stats.hw_filter = ok ? (uint32_t)flags : 0;
 }
 
 
 /*
  * connect_serial() - attempt to make a connection
  */
-static int connect_serial(void)
+static int connect_serial(beast_source_t *src)
 {
-        beast_fd = open(dev, O_RDWR | O_NOCTTY | O_NDELAY | O_NONBLOCK);
+        src->fd = open(src->addr, O_RDWR | O_NOCTTY | O_NDELAY | O_NONBLOCK);
 
-        if (beast_fd > 0) {
+        if (src->fd >= 0) {
                 struct termios term;
-        
-                tcgetattr(beast_fd, &term);			/* get old port settings */
-                        
+
+                tcgetattr(src->fd, &term);			/* get old port settings */
+
                 term.c_iflag = term.c_oflag = term.c_lflag = 0;
-                        
-                term.c_cflag |= speed;				/* speed is stored at start-up */
+
+                term.c_cflag |= src->speed;			/* speed is stored at start-up */
                 term.c_cflag |= CREAD;				/* enable receiver */
                 term.c_cflag |= CS8;				/* 8-bit data */
                 term.c_cflag |= CLOCAL;				/* No modem controls */
@@ -243,12 +472,18 @@ static int connect_serial(void)
                 term.c_cc[VMIN] = 0;				/* we're using non-blocking so don't set these */
                 term.c_cc[VTIME] = 0;
 
-                tcsetattr(beast_fd, TCSAFLUSH, &term);		/* set attribues and flush input */
-                tcflush(beast_fd, TCIFLUSH);
+                tcsetattr(src->fd, TCSAFLUSH, &term);		/* set attribues and flush input */
+                tcflush(src->fd, TCIFLUSH);
+
+                src->rdsize = serial_tune(src->fd, src->addr, src->speed);
+
+                if (src->hwconfig >= 0)
+                        write_config(src);
 
                 ++telemetry.connect_success;
-                return beast_fd;
+                return 1;
         } else {
+                src->fd = -1;
                 ++telemetry.connect_fail;
                 return 0;
         }
@@ -256,70 +491,308 @@ static int connect_serial(void)
 
 
 /*
- * connect_socket() - attempt to make a TCP connection
+ * enable_timestamps() - ask the kernel for receive timestamps on a socket
+ */
+static void enable_timestamps(beast_source_t *src)
+{
+        int on = 1;
+
+        src->kernel_ts = setsockopt(src->fd, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on)) == 0;
+
+        if (debug && !src->kernel_ts)
+                printf("enable_timestamps(): SO_TIMESTAMPNS failed on %s: %s (%d)\n", src->addr, strerror(errno), errno);
+}
+
+
+/*
+ * connected() - a TCP connection has been made
+ */
+static void connected(beast_source_t *src)
+{
+        enable_timestamps(src);
+        ++telemetry.connect_success;
+
+        if (debug)
+                printf("connect_socket(): Connected to BEAST source %s:%u\n", src->addr, src->port);
+
+        chgconstate(src, BEAST_STATE_CONNECTED);
+}
+
+
+/*
+ * connect_failed() - a TCP host look-up or connection has failed, errno says why
+ */
+static void connect_failed(beast_source_t *src)
+{
+        ++telemetry.connect_fail;
+
+        if (debug)
+                printf("connect_socket(): Connect to BEAST source %s:%u FAILED: %s (%d)\n", src->addr, src->port, strerror(errno), errno);
+
+        reset_connection(src);
+}
+
+
+/*
+ * start_connect() - start a non-blocking TCP connection to an address, finished by
+ * connect_done() or timed out by beast_second()
  */
-static int connect_socket(void)
+static void start_connect(beast_source_t *src, struct in_addr addr)
 {
-        struct hostent *hostinfo;
+        struct sockaddr_in saddr;
 
-        beast_fd = socket(AF_INET, SOCK_STREAM, 0);
+        src->fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
 
-        if (beast_fd < 0)
+        if (src->fd < 0)
                 qerror("connect_socket(): Could not create socket\n");
 
-        memset(&saddr, 0, sizeof(saddr)); 
+        memset(&saddr, 0, sizeof(saddr));
         saddr.sin_family = AF_INET;
-        saddr.sin_port = htons(port);
+        saddr.sin_port = htons(src->port);
+        saddr.sin_addr = addr;
 
-        hostinfo = gethostbyname(hostname);
+        if (connect(src->fd, (struct sockaddr *)&saddr, sizeof(saddr)) == 0) {
+                connected(src);
+        } else if (errno == EINPROGRESS) {
+                src->retry_count = BEAST_CONNECT_TIMEOUT;
+                chgconstate(src, BEAST_STATE_CONNECTING);
+        } else {
+                connect_failed(src);
+        }
+}
 
-        if (hostinfo != NULL) {
-        
-                memcpy(&saddr.sin_addr.s_addr, hostinfo->h_addr, hostinfo->h_length);
 
-                if (connect(beast_fd, (struct sockaddr *)&saddr, sizeof(saddr)) >= 0) {
-                        ++telemetry.connect_success;
-                        
-                        if (debug)
-                                printf("connect_socket(): Connected to BEAST source\n");
+/*
+ * connect_socket() - start to make a TCP connection, looking the host up in the background
+ * if it is a name
+ */
+static void connect_socket(beast_source_t *src)
+{
+        lookup_t *l = &lookups[src - sources];
+        struct gaicb *list[1] = { &l->gai };
+        struct in_addr addr;
+
+        if (inet_pton(AF_INET, src->addr, &addr) == 1) {
+                start_connect(src, addr);
+                return;
+        }
+
+        /* a look-up still running from before a reset is as good as a new one */
+        if (!l->pending) {
+                memset(l, 0, sizeof(*l));
+                l->hints.ai_family = AF_INET;
+                l->hints.ai_socktype = SOCK_STREAM;
+                l->gai.ar_name = src->addr;
+                l->gai.ar_request = &l->hints;
+
+                if (getaddrinfo_a(GAI_NOWAIT, list, 1, NULL) != 0) {
+                        connect_failed(src);
+                        return;
+                }
+
+                l->pending = 1;
+        }
+
+        chgconstate(src, BEAST_STATE_CONNECTING);
+}
+
+
+/*
+ * connect_check() - carry on with a TCP connection: connect once the host look-up is
+ * done and give up on a connect() that has taken too long, called every second
+ */
+static void connect_check(beast_source_t *src)
+{
+        lookup_t *l = &lookups[src - sources];
+        int rc;
+
+        if (l->pending) {
+                if ((rc = gai_error(&l->gai)) == EAI_INPROGRESS)
+                        return;
+
+                l->pending = 0;
 
-                        return beast_fd;
+                if (rc == 0) {
+                        struct in_addr addr = ((struct sockaddr_in *)l->gai.ar_result->ai_addr)->sin_addr;
+
+                        freeaddrinfo(l->gai.ar_result);
+                        start_connect(src, addr);
                 } else {
-                        ++telemetry.connect_fail;
-                        
                         if (debug)
-                                printf("connect_socket(): Connect to BEAST source FAILED: %s (%d)\n", strerror(errno), errno);
+                                printf("connect_socket(): look-up of BEAST source %s FAILED: %s\n", src->addr, gai_strerror(rc));
+
+                        errno = EHOSTUNREACH;
+                        connect_failed(src);
+                }
+                return;
+        }
+
+        if (src->retry_count && !--src->retry_count) {
+                errno = ETIMEDOUT;
+                connect_failed(src);
+        }
+}
+
+
+/*
+ * connect_done() - poll() says a non-blocking connect() has finished, one way or the other
+ */
+static void connect_done(beast_source_t *src)
+{
+        socklen_t len = sizeof(int);
+        int err = 0;
+
+        if (getsockopt(src->fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0)
+                err = errno;
+
+        if (err) {
+                errno = err;
+                connect_failed(src);
+        } else {
+                connected(src);
+        }
+}
+
+
+/*
+ * connect_local() - attempt to open standard input, a named pipe or a unix domain socket
+ */
+static int connect_local(beast_source_t *src)
+{
+        if (src->mode == BEAST_MODE_STDIN) {
+                /* a duplicate, so that closing it at end of file leaves fd 0 alone */
+                src->fd = dup(STDIN_FILENO);
+
+        } else if (src->mode == BEAST_MODE_FIFO) {
+                src->fd = open(src->addr, O_RDONLY | O_NONBLOCK);
+
+        } else if (src->mode == BEAST_MODE_UNIX) {
+                struct sockaddr_un uaddr;
+
+                src->fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+                if (src->fd < 0)
+                        qerror("connect_local(): Could not create socket\n");
+
+                memset(&uaddr, 0, sizeof(uaddr));
+                uaddr.sun_family = AF_UNIX;
+                strncpy(uaddr.sun_path, src->addr, sizeof(uaddr.sun_path) - 1);
+
+                if (connect(src->fd, (struct sockaddr *)&uaddr, sizeof(uaddr)) < 0) {
+                        close(src->fd);
+                        src->fd = -1;
+                } else {
+                        enable_timestamps(src);
                 }
         }
-        
-        return 0;
+
+        if (src->fd >= 0) {
+                /*
+                 * the duplicate of stdin shares the file status flags with whoever gave it to us,
+                 * so leave it blocking - it is only read when poll() says it is readable and
+                 * beast_discard() never asks for more than FIONREAD reports
+                 */
+                if (src->mode != BEAST_MODE_STDIN)
+                        fcntl(src->fd, F_SETFL, fcntl(src->fd, F_GETFL) | O_NONBLOCK);
+
+                ++telemetry.connect_success;
+
+                if (debug)
+                        printf("connect_local(): Connected to BEAST source %s\n", src->mode == BEAST_MODE_STDIN ? "stdin" : src->addr);
+
+                return 1;
+        } else {
+                src->fd = -1;
+                ++telemetry.connect_fail;
+
+                if (debug)
+                        printf("connect_local(): Connect to BEAST source %s FAILED: %s (%d)\n", src->addr, strerror(errno), errno);
+
+                return 0;
+        }
 }
 
 
 /*
- * beast_read() - called from main when poll() indicates that there's something
+ * recv_stamped() - read from a socket with recvmsg() and pick up the kernel receive
+ * timestamp, which is that of the most recent segment when several are read at once
+ */
+static int recv_stamped(beast_source_t *src, uint8_t *buf, int len)
+{
+        char control[CMSG_SPACE(sizeof(struct timespec))];
+        struct iovec iov = { buf, len };
+        struct msghdr msg;
+        struct cmsghdr *cmsg;
+        int size;
+
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+
+        size = recvmsg(src->fd, &msg, 0);
+        src->rx_time = 0;
+
+        for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+                if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPNS) {
+                        struct timespec ts;
+
+                        memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+                        src->rx_time = (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+                }
+        }
+
+        /* no timestamp delivered (e.g. AF_UNIX on older kernels) so use our own */
+        if (!src->rx_time)
+                src->rx_time = ustime();
+        else
+                telemetry.kernel_timestamps = 1;
+
+        return size;
+}
+
+
+/*
+ * beast_read() - called when poll() indicates that there's something
  * to be read from a Beast device (TCP or serial)
  */
-void beast_read(void)
+static void beast_read(beast_source_t *src)
 {
         int size;
         uint8_t buf[BEAST_BUF_SIZE];
-        
+        int len = src->rdsize ? src->rdsize : sizeof(buf);
+
         /* data available or connection closed - do a read to find out which */
-        size = read(beast_fd, buf, sizeof(buf));
+        if (src->kernel_ts) {
+                size = recv_stamped(src, buf, len);
+        } else {
+                size = read(src->fd, buf, len);
+                src->rx_time = ustime();
+        }
 
         if (size > 0) {
-                /* we have data - call beast common input handler to decode */
-                process_input(buf, size);
+                latency_start();
+
                 ++telemetry.socket_reads;
+                telemetry.bytes_read += size;
+
+                /* -W: record what the active source sent */
+                if (src == &sources[active])
+                        capture_write(src->rx_time, buf, size);
+
+                /* we have data - call beast common input handler to decode */
+                if (src->format == BEAST_FORMAT_AVR)
+                        process_avr(src, buf, size);
+                else
+                        process_input(src, buf, size);
 
         } else if (size == 0) {
                 /* size is zero -> EOF -> connection closed by peer */
-                beast_reset_connection();
-                ++telemetry.disconnect;
+                end_of_input(src);
         } else {
                 /* size is negative -> error on socket */
-                beast_reset_connection();
+                reset_connection(src);
                 ++telemetry.socket_error;
         }
 }
@@ -330,34 +803,247 @@ void beast_read(void)
  */
 void beast_serial_init(char *port, speed_t spd)
 {
-        mode = BEAST_MODE_SERIAL;
-        strncpy(dev, port, BEAST_SERIAL_PORT_NAME);
-        speed = spd;
-        chgconstate(BEAST_STATE_DISCONNECTED);
+        beast_source_t *src = add_source(BEAST_MODE_SERIAL);
+
+        strncpy(src->addr, port, BEAST_SERIAL_PORT_NAME);
+        src->speed = spd;
 }
 
 
 /*
- * beast_tcp_init() - initialise BEAST conenction over TCP
+ * beast_tcp_init() - add a BEAST conenction, the first call sets up the primary
+ * and further calls add hot-standby sources in order of preference.
+ *
+ * The address is a hostname or IP address with an optional ":port" suffix to
+ * override the default port, "-" for standard input, "fifo:<path>" for a named
+ * pipe or "unix:<path>" for a unix domain socket.
  */
 void beast_tcp_init(char *addr, uint16_t prt)
 {
-        mode = BEAST_MODE_TCP;
-        strncpy(hostname, addr, HOSTNAME_LEN);
-        port = prt;
-        chgconstate(BEAST_STATE_DISCONNECTED);
+        beast_source_t *src;
+        char *p;
+
+        if (strcmp(addr, "-") == 0) {
+                src = add_source(BEAST_MODE_STDIN);
+                strcpy(src->addr, "-");
+
+        } else if (strncmp(addr, "fifo:", 5) == 0) {
+                src = add_source(BEAST_MODE_FIFO);
+                strncpy(src->addr, addr + 5, HOSTNAME_LEN);
+
+        } else if (strncmp(addr, "unix:", 5) == 0) {
+                src = add_source(BEAST_MODE_UNIX);
+                strncpy(src->addr, addr + 5, HOSTNAME_LEN);
+
+        } else {
+                src = add_source(BEAST_MODE_TCP);
+                strncpy(src->addr, addr, HOSTNAME_LEN);
+                src->port = prt;
+
+                if ((p = strrchr(src->addr, ':')) != NULL) {
+                        *p++ = '\0';
+                        src->port = (uint16_t)atoi(p);
+                }
+        }
+}
+
+
+/*
+ * beast_avr_init() - add an AVR connection, as beast_tcp_init()
+ */
+void beast_avr_init(char *addr, uint16_t prt)
+{
+        beast_tcp_init(addr, prt);
+        sources[nsources-1].format = BEAST_FORMAT_AVR;
+}
+
+
+/*
+ * beast_replay_init() - add a source for a capture file being replayed, format is
+ * the enum beast_format of the capture; it is always connected and never read
+ * from here as radar.c feeds it with beast_input()
+ */
+void beast_replay_init(int format)
+{
+        beast_source_t *src = add_source(BEAST_MODE_REPLAY);
+
+        strcpy(src->addr, "replay");
+        src->format = format;
+        chgconstate(src, BEAST_STATE_CONNECTED);
+}
+
+
+/*
+ * beast_stall_init() - set the stall detector timeout (milliseconds)
+ */
+void beast_stall_init(int ms)
+{
+        stall = ms;
+}
+
+
+/*
+ * beast_hw_init() - configure the Mode-S Beast on the last serial source added with BEAST_HW_xxx flags
+ */
+void beast_hw_init(int flags)
+{
+        if (nsources && sources[nsources-1].mode == BEAST_MODE_SERIAL)
+                sources[nsources-1].hwconfig = flags;
+}
+
+
+/*
+ * beast_hw_update() - reconfigure the Mode-S Beasts with new BEAST_HW_xxx flags, now if connected
+ * or else when they next connect
+ */
+void beast_hw_update(int flags)
+{
+        int i;
+
+        for (i = 0; i < nsources; i++) {
+                beast_source_t *src = &sources[i];
+
+                if (src->hwconfig < 0 || src->hwconfig == flags)
+                        continue;
+
+                src->hwconfig = flags;
+
+                if (src->fd >= 0)
+                        write_config(src);
+        }
+}
+
+
+/*
+ * beast_reset_connection() - reset all BEAST connections
+ */
+void beast_reset_connection(void)
+{
+        int i;
+
+        for (i = 0; i < nsources; i++) {
+                if (sources[i].constate != BEAST_STATE_CLOSED)
+                        reset_connection(&sources[i]);
+        }
 }
 
 
 /*
- * beast_close() - shutdown the BEAST connection
+ * beast_close() - shutdown the BEAST connections
  */
 void beast_close(void)
 {
-        if (beast_fd) {
-                close(beast_fd);
-                beast_fd = 0;
-        }                
+        int i;
+
+        for (i = 0; i < nsources; i++) {
+                if (sources[i].fd >= 0) {
+                        close(sources[i].fd);
+                        sources[i].fd = -1;
+                }
+        }
+}
+
+
+/*
+ * beast_poll_setup() - fill in pollfd entries for open sources, returns the count
+ */
+int beast_poll_setup(struct pollfd *fds)
+{
+        int i, n = 0;
+
+        for (i = 0; i < nsources; i++) {
+                if (sources[i].fd >= 0) {
+                        fds[n].fd = sources[i].fd;
+                        fds[n].events = (sources[i].constate == BEAST_STATE_CONNECTING) ? POLLOUT : POLLIN|POLLHUP|POLLERR;
+                        fds[n].revents = 0;
+                        ++n;
+                }
+        }
+
+        return n;
+}
+
+
+/*
+ * beast_poll_events() - handle poll() results for the entries made by beast_poll_setup()
+ */
+void beast_poll_events(struct pollfd *fds, int n)
+{
+        int i, j;
+
+        for (i = 0; i < n; i++) {
+                for (j = 0; j < nsources; j++) {
+                        beast_source_t *src = &sources[j];
+
+                        if (src->fd >= 0 && src->fd == fds[i].fd) {
+                                if (src->constate == BEAST_STATE_CONNECTING) {
+                                        if (fds[i].revents)
+                                                connect_done(src);
+                                } else if (fds[i].revents & POLLIN) {
+                                        beast_read(src);
+                                } else if (fds[i].revents & POLLHUP || fds[i].revents & POLLERR) {
+                                        end_of_input(src);
+                                }
+                                break;
+                        }
+                }
+        }
+}
+
+
+/*
+ * beast_poll_timeout() - poll() timeout needed to run the stall detector often enough
+ */
+int beast_poll_timeout(void)
+{
+        if (nsources > 1)
+                return min(250, max(stall / 4, 20));
+        else
+                return 250;
+}
+
+
+/*
+ * healthy() - a source is healthy if connected and has produced a frame recently
+ */
+static int healthy(beast_source_t *src, uint64_t now)
+{
+        return src->constate == BEAST_STATE_CONNECTED && now - src->last_frame <= stall;
+}
+
+
+/*
+ * beast_check() - run the stall detector and fail-over/fail-back, called after every poll()
+ */
+void beast_check(void)
+{
+        uint64_t now;
+        int i;
+
+        if (nsources < 2)
+                return;
+
+        now = mstime();
+
+        if (!healthy(&sources[active], now)) {
+                /* active source has stalled or gone away - fail over to the most preferred healthy source */
+                for (i = 0; i < nsources; i++) {
+                        if (i != active && healthy(&sources[i], now)) {
+                                switch_source(i, "stalled");
+                                ++telemetry.source_stall;
+                                break;
+                        }
+                }
+
+        } else {
+                /* fail back to a more preferred source once it has been healthy for long enough */
+                for (i = 0; i < active; i++) {
+                        if (healthy(&sources[i], now) && now - sources[i].healthy_since >= BEAST_FAILBACK_HOLD) {
+                                switch_source(i, "fail back");
+                                break;
+                        }
+                }
+        }
 }
 
 
@@ -366,47 +1052,174 @@ void beast_close(void)
  */
 void beast_second(void)
 {
-        switch (constate) {
+        int i;
 
-                case BEAST_STATE_DISCONNECTED:
-                         /* attempt to connect or reconnect to the BEAST source */
-                        if (mode == BEAST_MODE_TCP) {
-                                if (connect_socket()) {
-                                        /* connect success */
-                                        chgconstate(BEAST_STATE_CONNECTED);
-                                } else {
-                                        /* connect failed */
-                                        beast_reset_connection();
-                                }
+        for (i = 0; i < nsources; i++) {
+                beast_source_t *src = &sources[i];
+
+                switch (src->constate) {
+
+                        case BEAST_STATE_DISCONNECTED:
+                                 /* attempt to connect or reconnect to the BEAST source */
+                                if (src->mode == BEAST_MODE_TCP) {
+                                        /* in the background, see connect_check() and connect_done() */
+                                        connect_socket(src);
+
+                                } else if (src->mode == BEAST_MODE_SERIAL) {
+                                        if (connect_serial(src)) {
+                                                /* connect success */
+                                                chgconstate(src, BEAST_STATE_CONNECTED);
+                                        } else {
+                                                /* connect failed */
+                                                reset_connection(src);
+                                        }
 
-                        } else if (mode == BEAST_MODE_SERIAL) {
-                                if (connect_serial()) {
-                                        /* connect success */
-                                        chgconstate(BEAST_STATE_CONNECTED);
                                 } else {
-                                        /* connect failed */
-                                        beast_reset_connection();
+                                        if (connect_local(src)) {
+                                                /* connect success */
+                                                chgconstate(src, BEAST_STATE_CONNECTED);
+                                        } else {
+                                                /* connect failed */
+                                                reset_connection(src);
+                                        }
                                 }
-                        }
-                        break;
+                                break;
 
-                case BEAST_STATE_CONNECTED:
-                        /* nothing to do */
-                        break;
+                        case BEAST_STATE_CONNECTED:
+                                /* nothing to do - stall detection is done in beast_check() */
+                                break;
 
-                case BEAST_STATE_RETRY_WAIT:
-                        /* count down and retry */                
-                        if (retry_count) {
-                                --retry_count;
-                                if (!retry_count) {
-                                        if (debug)
-                                                printf("beast_second(): change state to allow re-connect\n");
-                                        chgconstate(BEAST_STATE_DISCONNECTED);
+                        case BEAST_STATE_CONNECTING:
+                                connect_check(src);
+                                break;
+
+                        case BEAST_STATE_CLOSED:
+                                /* standard input has ended, nothing to re-open */
+                                break;
+
+                        case BEAST_STATE_RETRY_WAIT:
+                                /* count down and retry */
+                                if (src->retry_count) {
+                                        --src->retry_count;
+                                        if (!src->retry_count) {
+                                                if (debug)
+                                                        printf("beast_second(): change state to allow re-connect to %s\n", src->addr);
+                                                chgconstate(src, BEAST_STATE_DISCONNECTED);
+                                        }
                                 }
-                        }
+                                break;
+                }
+        }
+
+        if (nsources) {
+                telemetry.packets_per_second = sources[active].pps;
+                telemetry.active_source = (uint8_t)active;
+        }
+
+        for (i = 0; i < nsources; i++)
+                sources[i].pps = 0;
+}
+
+
+/*
+ * beast_sources() - number of configured sources
+ */
+int beast_sources(void)
+{
+        return nsources;
+}
+
+
+/*
+ * beast_source() - read-only access to a source for status reporting
+ */
+const beast_source_t *beast_source(int i)
+{
+        return (i >= 0 && i < nsources) ? &sources[i] : NULL;
+}
+
+
+/*
+ * beast_active() - index of the active source
+ */
+int beast_active(void)
+{
+        return active;
+}
+
+
+/*
+ * beast_backlog() - bytes queued in the kernel for the active source, zero if not known
+ */
+int beast_backlog(void)
+{
+        beast_source_t *src = &sources[active];
+        int n;
+
+        if (!nsources || src->fd < 0 || src->constate != BEAST_STATE_CONNECTED)
+                return 0;
+
+        if (ioctl(src->fd, FIONREAD, &n) < 0)
+                return 0;
+
+        return n;
+}
+
+
+/*
+ * beast_discard() - read and throw away up to 'bytes' of input queued for the active
+ * source, returns the number discarded
+ */
+int beast_discard(int bytes)
+{
+        beast_source_t *src = &sources[active];
+        uint8_t buf[BEAST_BUF_SIZE];
+        int n, total = 0;
+
+        if (!nsources || src->fd < 0 || src->constate != BEAST_STATE_CONNECTED)
+                return 0;
+
+        while (total < bytes) {
+                n = read(src->fd, buf, min(bytes - total, (int)sizeof(buf)));
+
+                if (n <= 0)
                         break;
+
+                total += n;
         }
-        
-        telemetry.packets_per_second = pps;
-        pps = 0;
+
+        /* we are now part way through a frame or line so start again */
+        src->state = src->len = 0;
+
+        return total;
+}
+
+
+/*
+ * beast_input() - feed a chunk of input to the active source's parser as if it had
+ * just been read, used for capture replay and by the benchmarks (see bench.c)
+ */
+void beast_input(uint8_t *bp, int size)
+{
+        beast_source_t *src = &sources[active];
+
+        src->rx_time = ustime();
+        latency_start();
+
+        ++telemetry.socket_reads;
+        telemetry.bytes_read += size;
+
+        if (src->format == BEAST_FORMAT_AVR)
+                process_avr(src, bp, size);
+        else
+                process_input(src, bp, size);
+}
+
+
+/*
+ * beast_output() - send decoded frames somewhere other than radar_process() (see sim.c)
+ */
+void beast_output(beast_output_t fn)
+{
+        output = fn;
 }
@@ -1,6 +1,6 @@
 /*
  * beast.h -- Common header file for ADS-B Beast Protocol
- * Author: Michael J. Tubby B.Sc. MIET  mike@tubby.org   
+ * Author: Michael J. Tubby B.Sc. MIET  mike@tubby.org
  *
  */
 
@@ -9,13 +9,30 @@
 
 #include <stdint.h>
 #include <termios.h>
+#include <poll.h>
+
+#include "defs.h"
+#include "avr.h"
 
 #define BEAST_MAX_FRAME			22		/* maximum size of a Beast data frame */
 #define BEAST_BUF_SIZE			1024		/* Beast buffer size */
 #define BEAST_ESC			0x1A		/* Escape character used in BEAST frames */
 #define BEAST_CONNECT_RETRY		5		/* connection retry interval - 5 seconds */
+#define BEAST_CONNECT_TIMEOUT		5		/* TCP connect must complete within this (seconds) */
 #define BEAST_SERIAL_PORT_NAME		64		/* size of a serial port device name */
 #define BEAST_TCP_PORT			30005		/* BEAST protocol port */
+#define BEAST_MAX_SOURCES		4		/* primary plus up to three hot-standby sources */
+#define BEAST_STALL_TIMEOUT		500		/* default "no frames" stall detector (milliseconds) */
+#define BEAST_FAILBACK_HOLD		5000		/* preferred source must be healthy this long before fail back (milliseconds) */
+
+/*
+ * Mode-S Beast hardware configuration - sent as 1A 31 <c> after each (re)connect,
+ * upper case turns a DIP switch function on and lower case turns it off
+ */
+#define BEAST_HW_MODE_AC		0x01		/* Mode-A/C output enabled ('J') */
+#define BEAST_HW_DF045			0x02		/* DF0/4/5 output enabled (not 'G' filter) */
+#define BEAST_HW_DF1117			0x04		/* DF11/17 only filter ('D') */
+#define BEAST_HW_CRC			0x08		/* CRC checking in hardware ('f') */
 
 
 /*
@@ -24,7 +41,20 @@
 enum beast_mode {
         BEAST_MODE_NONE,
         BEAST_MODE_SERIAL,
-        BEAST_MODE_TCP
+        BEAST_MODE_TCP,
+        BEAST_MODE_STDIN,				/* standard input, e.g. "readsb ... | radar" */
+        BEAST_MODE_FIFO,				/* named pipe */
+        BEAST_MODE_UNIX,				/* AF_UNIX stream socket */
+        BEAST_MODE_REPLAY				/* capture file, fed by radar.c with beast_input() */
+};
+
+
+/*
+ * enumerated list of input formats
+ */
+enum beast_format {
+        BEAST_FORMAT_BINARY,				/* BEAST binary frames */
+        BEAST_FORMAT_AVR				/* AVR ASCII hex lines */
 };
 
 
@@ -34,14 +64,43 @@ enum beast_mode {
 enum beast_state {
         BEAST_STATE_DISCONNECTED,			/* disconnected state */
         BEAST_STATE_CONNECTED,				/* connected and receiving data */
-        BEAST_STATE_RETRY_WAIT				/* waiting to reconnect */
+        BEAST_STATE_RETRY_WAIT,				/* waiting to reconnect */
+        BEAST_STATE_CONNECTING,				/* TCP host look-up or connect() in progress */
+        BEAST_STATE_CLOSED				/* standard input has ended, not re-opened */
 };
 
 
 /*
- * exported global variables
+ * a BEAST source - the primary is index zero and the others are hot-standby
+ * sources in order of preference; each has its own connection and parser state
+ */
+typedef struct {
+        enum beast_mode mode;				/* TCP, serial or local */
+        enum beast_format format;			/* BEAST binary or AVR */
+        char addr[HOSTNAME_LEN+1];			/* hostname, serial device or path */
+        uint16_t port;					/* TCP port */
+        speed_t speed;					/* serial port speed */
+        int fd;						/* file descriptor or -1 if not open */
+        int rdsize;					/* read size, zero for BEAST_BUF_SIZE */
+        int hwconfig;					/* BEAST_HW_xxx flags, -1 for don't configure */
+        int kernel_ts;					/* SO_TIMESTAMPNS enabled, read with recvmsg() */
+        uint64_t rx_time;				/* arrival time of the last read (uS) */
+        enum beast_state constate;			/* connection state */
+        int retry_count;				/* re-connect or connect timeout countdown (seconds) */
+        int state;					/* protocol parser state */
+        int len;					/* bytes in frame or line buffer */
+        uint8_t buf[BEAST_MAX_FRAME];			/* frame buffer */
+        char line[AVR_MAX_LINE];			/* AVR line buffer */
+        uint16_t pps;					/* frames this second */
+        uint64_t last_frame;				/* time of last good frame (mS) */
+        uint64_t healthy_since;				/* start of current run of frames (mS) */
+} beast_source_t;
+
+
+/*
+ * receiver of decoded frames: MLAT timestamp, RSSI, data, length and arrival time (uS)
  */
-extern int beast_fd;
+typedef void (*beast_output_t)(uint8_t *, uint8_t, uint8_t *, int, uint64_t);
 
 
 /*
@@ -49,9 +108,24 @@ extern int beast_fd;
  */
 void beast_serial_init(char *, speed_t);
 void beast_tcp_init(char *, uint16_t);
+void beast_avr_init(char *, uint16_t);
+void beast_replay_init(int);
+void beast_stall_init(int);
+void beast_hw_init(int);
+void beast_hw_update(int);
 void beast_reset_connection(void);
 void beast_second(void);
-void beast_read(void);
+void beast_check(void);
+int beast_poll_timeout(void);
+int beast_poll_setup(struct pollfd *);
+void beast_poll_events(struct pollfd *, int);
 void beast_close(void);
+int beast_sources(void);
+const beast_source_t *beast_source(int);
+int beast_active(void);
+void beast_input(uint8_t *, int);
+void beast_output(beast_output_t);
+int beast_backlog(void);
+int beast_discard(int);
 
 #endif
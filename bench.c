@@ -0,0 +1,504 @@
+/*
+ * bench.c -- Micro-benchmarks for the forwarding path
+ * Author: Michael J. Tubby B.Sc. MIET  mike@tubby.org
+ *
+ *
+ * ABSTRACT
+ *
+ * Standalone benchmarks for the code every frame goes through, so that a
+ * performance change can be justified with numbers on both x86 and ARM:
+ *
+ *	beast_input		the BEAST parser and everything behind it (radar_process(),
+ *				duplicate check, signing) on a generated stream of DF17, DF11/4/5
+ *				and Mode-A/C frames with escapes and about 30% duplicates
+ *	dupe_check_es		hit and miss/insert at several duplicate table sizes
+ *	dupe_clean		one walk of the table at several sizes (nothing expires)
+ *	hmac_sha256		one ES message worth of data
+ *	authtag_sign		an ES message and a full 32 frame multiframe message
+ *	multiframe		radar_send_multiframe() assembly and signing of 32 frames
+ *	ustime, nstime		the clocks read on every frame
+ *
+ * radar.c is linked in compiled with -DRADAR_NO_MAIN.  UDP is never started so
+ * nothing is sent: the figures are the cost up to but not including sendto().
+ *
+ * Each benchmark is run untimed for the warm-up count and then timed for the
+ * repetition count; the best and median ns per operation are reported along
+ * with operations per second at the median.
+ *
+ *
+ * USAGE
+ *
+ *	make bench, or: radar-bench [-r <reps>] [-w <warm-up>] [-l] [name ...]
+ *
+ * where:
+ *
+ *	-r <reps>	  timed repetitions of each benchmark (default 10)
+ *	-w <warm-up>	  untimed repetitions first (default 2)
+ *	-l		  list the benchmarks and exit
+ *	name		  only run benchmarks whose name contains one of these strings
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/utsname.h>
+
+#include "radar.h"
+#include "beast.h"
+#include "dupe.h"
+#include "authtag.h"
+#include "hmac-sha256.h"
+#include "ustime.h"
+#include "nstime.h"
+
+
+#define BENCH_REPS		10		/* default timed repetitions */
+#define BENCH_WARMUP		2		/* default untimed repetitions */
+#define BENCH_MAX_REPS		1000
+#define BENCH_FRAMES		16384		/* frames in the generated BEAST stream */
+#define BENCH_MAX_TABLE		100000		/* largest duplicate table */
+#define BENCH_INSERTS		10000		/* new entries per miss/insert repetition */
+
+
+/*
+ * radar.c and dupe.c
+ */
+extern int num;
+extern dupe_ss_t *dupe_ss;
+extern dupe_es_t *dupe_es;
+
+
+/*
+ * a benchmark - setup() is not timed, run() performs ops operations
+ */
+typedef struct {
+        const char *name;
+        void (*setup)(int);
+        void (*run)(int, int);
+        int arg;
+        int ops;
+} bench_t;
+
+
+static uint8_t *stream;				/* generated BEAST input */
+static int stream_len;
+static uint8_t (*keys)[MODE_ES_LEN];		/* unique ES frames for the duplicate table */
+static uint8_t msg[sizeof(radar_multiframe_t)];	/* something to sign */
+static uint8_t hmac_key[AUTHTAG_KEY_LEN];
+static volatile uint64_t sink;			/* stop the compiler discarding results */
+static uint32_t rnd = 0x1090;
+
+
+/*
+ * next() - cheap repeatable pseudo-random numbers
+ */
+static uint32_t next(void)
+{
+        rnd = rnd * 1664525 + 1013904223;
+        return rnd >> 8;
+}
+
+
+/*
+ * put() - add a byte to the stream doubling an Escape
+ */
+static void put(uint8_t b)
+{
+        stream[stream_len++] = b;
+
+        if (b == BEAST_ESC)
+                stream[stream_len++] = b;
+}
+
+
+/*
+ * make_stream() - build the BEAST stream: about 60% DF17, 35% short squitters and
+ * 5% Mode-A/C, with 30% of the ES frames repeating a recent one as a second
+ * receiver path or a retransmission would
+ */
+static void make_stream(void)
+{
+        uint8_t recent[64][MODE_ES_LEN];
+        int i, j, type, len;
+
+        stream = malloc(BENCH_FRAMES * (2 + 2 * (6 + 1 + MODE_ES_LEN)));
+        memset(recent, 0, sizeof(recent));
+
+        for (i=0; i<BENCH_FRAMES; ++i) {
+                uint8_t data[MODE_ES_LEN];
+                uint32_t r = next() % 100;
+
+                if (r < 60) {
+                        type = 0x33;
+                        len = MODE_ES_LEN;
+
+                        if (i >= 64 && next() % 100 < 30) {
+                                memcpy(data, recent[next() % 64], MODE_ES_LEN);
+                        } else {
+                                for (j=0; j<MODE_ES_LEN; ++j)
+                                        data[j] = next();
+
+                                data[0] = (17 << 3) | (data[0] & 7);
+                                memcpy(recent[i % 64], data, MODE_ES_LEN);
+                        }
+                } else if (r < 95) {
+                        static const uint8_t df[] = { 11, 4, 5 };
+
+                        type = 0x32;
+                        len = MODE_SS_LEN;
+
+                        for (j=0; j<MODE_SS_LEN; ++j)
+                                data[j] = next();
+
+                        data[0] = (df[next() % 3] << 3) | (data[0] & 7);
+                } else {
+                        type = 0x31;
+                        len = MODE_AC_LEN;
+
+                        for (j=0; j<MODE_AC_LEN; ++j)
+                                data[j] = next();
+                }
+
+                stream[stream_len++] = BEAST_ESC;
+                stream[stream_len++] = type;
+
+                for (j=0; j<6; ++j)			/* MLAT timestamp */
+                        put(next());
+
+                put(next());				/* RSSI */
+
+                for (j=0; j<len; ++j)
+                        put(data[j]);
+        }
+
+        stream[stream_len++] = BEAST_ESC;		/* terminate the last frame */
+        stream[stream_len++] = 0x31;
+}
+
+
+/*
+ * make_keys() - unique ES frames to fill the duplicate table with
+ */
+static void make_keys(void)
+{
+        int i, j;
+
+        keys = malloc((BENCH_MAX_TABLE + BENCH_INSERTS) * MODE_ES_LEN);
+
+        for (i=0; i<BENCH_MAX_TABLE + BENCH_INSERTS; ++i) {
+                for (j=0; j<MODE_ES_LEN; ++j)
+                        keys[i][j] = next();
+
+                memcpy(&keys[i][0], &i, sizeof(i));	/* guarantee they are unique */
+        }
+}
+
+
+/*
+ * dupe_empty() - delete everything from the duplicate tables
+ */
+static void dupe_empty(void)
+{
+        dupe_ss_t *sp, *stmp;
+        dupe_es_t *ep, *etmp;
+
+        HASH_ITER(hh, dupe_ss, sp, stmp) {
+                HASH_DEL(dupe_ss, sp);
+                free(sp);
+        }
+
+        HASH_ITER(hh, dupe_es, ep, etmp) {
+                HASH_DEL(dupe_es, ep);
+                free(ep);
+        }
+}
+
+
+/*
+ * dupe_fill() - empty the ES duplicate table and put size entries in it
+ */
+static void dupe_fill(int size)
+{
+        int i;
+
+        dupe_empty();
+
+        for (i=0; i<size; ++i)
+                dupe_check_es(keys[i]);
+}
+
+
+static void setup_nothing(int arg)
+{
+        (void)arg;
+}
+
+
+static void setup_empty(int arg)
+{
+        (void)arg;
+        dupe_empty();
+}
+
+
+static void run_beast_input(int arg, int ops)
+{
+        (void)arg;
+        (void)ops;
+        beast_input(stream, stream_len);
+}
+
+
+static void run_dupe_hit(int size, int ops)
+{
+        int i, n = 0;
+
+        for (i=0; i<ops; ++i)
+                n += dupe_check_es(keys[i % size]);
+
+        sink += n;
+}
+
+
+static void run_dupe_insert(int size, int ops)
+{
+        int i, n = 0;
+
+        for (i=0; i<ops; ++i)
+                n += dupe_check_es(keys[size + i]);
+
+        sink += n;
+}
+
+
+static void run_dupe_clean(int size, int ops)
+{
+        int i, n = 0;
+
+        (void)size;
+
+        for (i=0; i<ops; ++i)
+                n += dupe_clean();
+
+        sink += n;
+}
+
+
+static void run_hmac(int len, int ops)
+{
+        uint8_t out[HMAC_SHA256_SIZE];
+        int i;
+
+        for (i=0; i<ops; ++i) {
+                msg[0] = i;
+                hmac_sha256(out, hmac_key, sizeof(hmac_key), msg, len);
+                sink += out[0];
+        }
+}
+
+
+static void run_authtag(int len, int ops)
+{
+        uint8_t tag[AUTHTAG_LEN];
+        int i;
+
+        for (i=0; i<ops; ++i) {
+                msg[0] = i;
+                authtag_sign(tag, AUTHTAG_LEN, msg, len);
+                sink += tag[0];
+        }
+}
+
+
+static void run_multiframe(int frames, int ops)
+{
+        int i;
+
+        for (i=0; i<ops; ++i) {
+                num = frames;
+                radar_send_multiframe();
+        }
+}
+
+
+static void run_ustime(int arg, int ops)
+{
+        uint64_t t = 0;
+        int i;
+
+        (void)arg;
+
+        for (i=0; i<ops; ++i)
+                t += ustime();
+
+        sink += t;
+}
+
+
+static void run_nstime(int arg, int ops)
+{
+        uint64_t t = 0;
+        int i;
+
+        (void)arg;
+
+        for (i=0; i<ops; ++i)
+                t += nstime();
+
+        sink += t;
+}
+
+
+#define ES_SIGNED	(sizeof(radar_mode_es_t) - AUTHTAG_LEN)
+#define MULTI_SIGNED	(sizeof(radar_multiframe_t) - AUTHTAG_LEN)
+
+static bench_t benchmarks[] = {
+        { "beast_input",		setup_empty,	run_beast_input,	0,			BENCH_FRAMES },
+        { "dupe_check_es hit 1000",	dupe_fill,	run_dupe_hit,		1000,			1000000 },
+        { "dupe_check_es hit 10000",	dupe_fill,	run_dupe_hit,		10000,			1000000 },
+        { "dupe_check_es hit 100000",	dupe_fill,	run_dupe_hit,		100000,			1000000 },
+        { "dupe_check_es miss 1000",	dupe_fill,	run_dupe_insert,	1000,			BENCH_INSERTS },
+        { "dupe_check_es miss 10000",	dupe_fill,	run_dupe_insert,	10000,			BENCH_INSERTS },
+        { "dupe_check_es miss 100000",	dupe_fill,	run_dupe_insert,	100000,			BENCH_INSERTS },
+        { "dupe_clean 1000",		dupe_fill,	run_dupe_clean,		1000,			1000 },
+        { "dupe_clean 10000",		dupe_fill,	run_dupe_clean,		10000,			100 },
+        { "dupe_clean 100000",		dupe_fill,	run_dupe_clean,		100000,			10 },
+        { "hmac_sha256 es",		setup_nothing,	run_hmac,		ES_SIGNED,		100000 },
+        { "authtag_sign es",		setup_nothing,	run_authtag,		ES_SIGNED,		100000 },
+        { "authtag_sign multiframe",	setup_nothing,	run_authtag,		MULTI_SIGNED,		20000 },
+        { "multiframe",			setup_nothing,	run_multiframe,		RADAR_MAX_MULTIFRAME,	20000 },
+        { "ustime",			setup_nothing,	run_ustime,		0,			1000000 },
+        { "nstime",			setup_nothing,	run_nstime,		0,			1000000 },
+};
+
+#define NBENCH	(int)(sizeof(benchmarks) / sizeof(bench_t))
+
+
+/*
+ * compare() - qsort() comparison for doubles
+ */
+static int compare(const void *a, const void *b)
+{
+        double x = *(const double *)a, y = *(const double *)b;
+
+        return (x > y) - (x < y);
+}
+
+
+/*
+ * bench() - run one benchmark and print its result
+ */
+static void bench(bench_t *b, int warmup, int reps)
+{
+        double ns[BENCH_MAX_REPS];
+        double median;
+        int i;
+
+        for (i=0; i<warmup; ++i) {
+                b->setup(b->arg);
+                b->run(b->arg, b->ops);
+        }
+
+        for (i=0; i<reps; ++i) {
+                uint64_t start;
+
+                b->setup(b->arg);
+                start = nstime();
+                b->run(b->arg, b->ops);
+                ns[i] = (double)(nstime() - start) / b->ops;
+        }
+
+        qsort(ns, reps, sizeof(double), compare);
+        median = (reps & 1) ? ns[reps / 2] : (ns[reps / 2 - 1] + ns[reps / 2]) / 2;
+
+        printf("%-28s %9d %12.1f %12.1f %14.0f\n", b->name, b->ops, ns[0], median, median > 0 ? 1e9 / median : 0);
+}
+
+
+/*
+ * selected() - is a benchmark selected by the names on the command line
+ */
+static int selected(const char *name, int argc, char *argv[])
+{
+        int i;
+
+        if (argc == 0)
+                return 1;
+
+        for (i=0; i<argc; ++i) {
+                if (strstr(name, argv[i]))
+                        return 1;
+        }
+
+        return 0;
+}
+
+
+/*
+ * main program
+ */
+int main(int argc, char *argv[])
+{
+        struct utsname un;
+        int reps = BENCH_REPS;
+        int warmup = BENCH_WARMUP;
+        int c, i;
+
+        while ((c = getopt(argc, argv, "r:w:l?")) != -1) {
+                switch (c) {
+                        case 'r':
+                                reps = atoi(optarg);
+
+                                if (reps < 1 || reps > BENCH_MAX_REPS) {
+                                        fprintf(stderr, "radar-bench: repetitions must be 1 to %d\n", BENCH_MAX_REPS);
+                                        exit(EXIT_FAILURE);
+                                }
+                                break;
+
+                        case 'w':
+                                warmup = atoi(optarg);
+                                break;
+
+                        case 'l':
+                                for (i=0; i<NBENCH; ++i)
+                                        printf("%s\n", benchmarks[i].name);
+
+                                exit(EXIT_SUCCESS);
+
+                        case '?':
+                        default:
+                                fprintf(stderr, "usage: radar-bench [-r <reps>] [-w <warm-up>] [-l] [name ...]\n");
+                                exit(EXIT_FAILURE);
+                }
+        }
+
+        argc -= optind;
+        argv += optind;
+
+        /* the same key as radar uses by default, a single source to parse for */
+        authtag_init("secret");
+        beast_tcp_init("127.0.0.1", BEAST_TCP_PORT);
+
+        for (i=0; i<(int)sizeof(msg); ++i)
+                msg[i] = next();
+
+        memcpy(hmac_key, msg, sizeof(hmac_key));
+        make_stream();
+        make_keys();
+
+        uname(&un);
+        printf("radar benchmarks: %s %s, %d repetitions after %d warm-up\n\n", un.machine, __VERSION__, reps, warmup);
+        printf("%-28s %9s %12s %12s %14s\n", "benchmark", "ops", "best ns/op", "median ns/op", "ops/s");
+
+        for (i=0; i<NBENCH; ++i) {
+                if (selected(benchmarks[i].name, argc, argv))
+                        bench(&benchmarks[i], warmup, reps);
+        }
+
+        dupe_empty();
+
+        return 0;
+}
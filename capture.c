@@ -0,0 +1,217 @@
+/*
+ * capture.c -- BEAST input capture to file and replay
+ * Author: Michael J. Tubby B.Sc. MIET  mike@tubby.org
+ *
+ * ABSTRACT
+ *
+ * With -W <file> every read from the active BEAST/AVR source is written to a
+ * capture file exactly as read, with its arrival time.  The file is a header
+ * followed by one record per read: a 6 byte record header (the time since the
+ * previous read in uS and the length) and the bytes themselves, so a busy
+ * feeder's capture is only a few percent larger than the BEAST stream.
+ *
+ * With -R <file> radar reads its input from a capture instead of a receiver.
+ * The records are fed to the same parser in the same chunks and radar's clock
+ * (ustime(), mstime() and the housekeeping and multiframe timers) follows the
+ * capture's arrival times, so duplicate expiry, multiframe flushes and the
+ * once a second housekeeping fall exactly as they did live.  By default the
+ * replay runs in real time; with -F it runs as fast as radar can go.  The
+ * destination has to be given with -h, a replay never goes to UDP_HOST.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+
+#include "radar.h"
+#include "ustime.h"
+#include "capture.h"
+#include "qerror.h"
+
+
+/*
+ * external variables
+ */
+extern int debug;
+
+
+/*
+ * local variables
+ */
+static FILE *cfp = NULL;			/* capture file */
+static uint64_t last;				/* arrival time of the last record written */
+static FILE *rfp = NULL;			/* replay file */
+static uint64_t rnow;				/* time of the pending replay record */
+static int pending = -1;			/* length of the pending replay record, -1 if none */
+static uint32_t records = 0;
+
+
+/*
+ * capture_open() - start capturing to a file, format is the enum beast_format of the input
+ */
+void capture_open(const char *path, int format)
+{
+        capture_header_t hdr;
+
+        if ((cfp = fopen(path, "w")) == NULL)
+                qerror("radar: can't create capture file %s: %s (%d)\n", path, strerror(errno), errno);
+
+        setvbuf(cfp, NULL, _IOFBF, CAPTURE_BUF_SIZE);
+
+        memset(&hdr, 0, sizeof(hdr));
+        hdr.magic = CAPTURE_MAGIC;
+        hdr.version = CAPTURE_VERSION;
+        hdr.format = (uint8_t)format;
+        hdr.start = last = ustime();
+
+        if (fwrite(&hdr, sizeof(hdr), 1, cfp) != 1)
+                qerror("radar: can't write capture file %s: %s (%d)\n", path, strerror(errno), errno);
+}
+
+
+/*
+ * capture_write() - add a read to the capture, rx is its arrival time (uS)
+ */
+void capture_write(uint64_t rx, const uint8_t *buf, int len)
+{
+        capture_record_t rec;
+        uint64_t delta;
+
+        if (!cfp)
+                return;
+
+        delta = (rx > last) ? rx - last : 0;
+        last += delta;
+
+        /* gaps of more than 71 minutes need filler records */
+        while (delta > UINT32_MAX) {
+                rec.delta = UINT32_MAX;
+                rec.len = 0;
+                fwrite(&rec, sizeof(rec), 1, cfp);
+                delta -= UINT32_MAX;
+        }
+
+        rec.delta = (uint32_t)delta;
+        rec.len = (uint16_t)len;
+
+        if (fwrite(&rec, sizeof(rec), 1, cfp) != 1 || fwrite(buf, len, 1, cfp) != 1) {
+                qlog("radar: capture stopped, write failed: %s (%d)\n", strerror(errno), errno);
+                fclose(cfp);
+                cfp = NULL;
+        }
+}
+
+
+/*
+ * capture_second() - flush the capture file once a second
+ */
+void capture_second(void)
+{
+        if (cfp)
+                fflush(cfp);
+}
+
+
+/*
+ * capture_close() - finish the capture
+ */
+void capture_close(void)
+{
+        if (cfp) {
+                fclose(cfp);
+                cfp = NULL;
+        }
+}
+
+
+/*
+ * replay_open() - open a capture to replay, returns the enum beast_format of its input
+ * and the time the capture was started in 'start'
+ */
+int replay_open(const char *path, uint64_t *start)
+{
+        capture_header_t hdr;
+
+        if ((rfp = fopen(path, "r")) == NULL)
+                qerror("radar: can't open capture file %s: %s (%d)\n", path, strerror(errno), errno);
+
+        setvbuf(rfp, NULL, _IOFBF, CAPTURE_BUF_SIZE);
+
+        if (fread(&hdr, sizeof(hdr), 1, rfp) != 1 || hdr.magic != CAPTURE_MAGIC)
+                qerror("radar: %s is not a capture file\n", path);
+
+        if (hdr.version != CAPTURE_VERSION)
+                qerror("radar: capture file %s is version %u, expected %u\n", path, hdr.version, CAPTURE_VERSION);
+
+        rnow = *start = hdr.start;
+
+        return hdr.format;
+}
+
+
+/*
+ * replay_peek() - arrival time of the next record, zero at the end of the file
+ */
+uint64_t replay_peek(void)
+{
+        capture_record_t rec;
+
+        while (pending < 0 && rfp) {
+                if (fread(&rec, sizeof(rec), 1, rfp) != 1) {
+                        if (debug)
+                                printf("replay_peek(): end of capture after %u records\n", records);
+                        replay_close();
+                        return 0;
+                }
+
+                rnow += rec.delta;
+
+                if (rec.len > CAPTURE_MAX_READ)
+                        qerror("radar: capture file is corrupt (record of %u bytes)\n", rec.len);
+
+                if (rec.len)
+                        pending = rec.len;
+        }
+
+        return rfp ? rnow : 0;
+}
+
+
+/*
+ * replay_read() - read the record returned by replay_peek() into buf, returns its length
+ */
+int replay_read(uint8_t *buf)
+{
+        int len = pending;
+
+        if (len < 0 || !rfp)
+                return 0;
+
+        pending = -1;
+
+        if (fread(buf, len, 1, rfp) != 1) {
+                replay_close();
+                return 0;
+        }
+
+        ++records;
+
+        return len;
+}
+
+
+/*
+ * replay_close() - finish the replay
+ */
+void replay_close(void)
+{
+        if (rfp) {
+                fclose(rfp);
+                rfp = NULL;
+        }
+
+        pending = -1;
+}
@@ -0,0 +1,50 @@
+/*
+ * capture.h -- BEAST input capture to file and replay
+ * Author: Michael J. Tubby B.Sc. MIET  mike@tubby.org
+ */
+
+#ifndef _CAPTURE_H
+#define _CAPTURE_H
+
+#include <stdint.h>
+
+#define CAPTURE_MAGIC		0x50414352		/* "RCAP" */
+#define CAPTURE_VERSION		1
+#define CAPTURE_MAX_READ	4096			/* largest record we write or accept */
+#define CAPTURE_BUF_SIZE	(1 << 20)		/* stdio buffer */
+
+
+/*
+ * file header
+ */
+typedef struct {
+        uint32_t magic;					/* CAPTURE_MAGIC */
+        uint16_t version;				/* CAPTURE_VERSION */
+        uint8_t format;					/* enum beast_format */
+        uint8_t spare;
+        uint64_t start;					/* arrival time of the first read (uS) */
+} __attribute__((packed)) capture_header_t;
+
+
+/*
+ * each read() is a record header followed by len bytes of input exactly as read
+ */
+typedef struct {
+        uint32_t delta;					/* arrival time since the previous record (uS) */
+        uint16_t len;					/* bytes that follow, zero for a filler to span a long gap */
+} __attribute__((packed)) capture_record_t;
+
+
+/*
+ * exported functions
+ */
+void capture_open(const char *, int);
+void capture_write(uint64_t, const uint8_t *, int);
+void capture_second(void);
+void capture_close(void);
+int replay_open(const char *, uint64_t *);
+uint64_t replay_peek(void);
+int replay_read(uint8_t *);
+void replay_close(void);
+
+#endif
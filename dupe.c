@@ -14,6 +14,7 @@
 #include "qerror.h"
 #include "uthash.h"
 #include "dupe.h"
+#include "probes.h"
 
 
 extern int debug;
@@ -26,6 +27,13 @@ dupe_ss_t *dupe_ss = NULL;
 dupe_es_t *dupe_es = NULL;
 
 
+/*
+ * how long entries are kept (uS)
+ */
+static uint64_t max_ss = DUPE_MAX_SS;
+static uint64_t max_es = DUPE_MAX_ES;
+
+
 /*
  * dupe_check_ss() - duplicate message checking for Extended Squitter
  */
@@ -36,10 +44,11 @@ int dupe_check_ss(uint8_t *ss)
         HASH_FIND(hh, dupe_ss, ss, MODE_SS_LEN, dp);
 
         if (dp) {
-
+                PROBE1(dupe_hit, MODE_SS_LEN);
                 return 1;
 
         } else {
+                PROBE1(dupe_miss, MODE_SS_LEN);
                 dp = malloc(sizeof(dupe_ss_t));
 
                 if (dp) {
@@ -65,10 +74,11 @@ int dupe_check_es(uint8_t *es)
         HASH_FIND(hh, dupe_es, es, MODE_ES_LEN, dp);
 
         if (dp) {
-
+                PROBE1(dupe_hit, MODE_ES_LEN);
                 return 1;
 
         } else {
+                PROBE1(dupe_miss, MODE_ES_LEN);
                 dp = malloc(sizeof(dupe_es_t));
 
                 if (dp) {
@@ -98,7 +108,7 @@ static int clean_ss(uint64_t now)
         
                 uint64_t age = now - dp->ts;			/* age of message */
         
-                if (age > DUPE_MAX_SS) {			/* too old then delete it */
+                if (age > max_ss) {			/* too old then delete it */
                         HASH_DEL(dupe_ss, dp);
                         free(dp);
                         ++count;
@@ -122,7 +132,7 @@ static int clean_es(uint64_t now)
         
                 uint64_t age = now - dp->ts;			/* age of message */
         
-                if (age > DUPE_MAX_ES) {			/* too old then delete it */
+                if (age > max_es) {			/* too old then delete it */
                         HASH_DEL(dupe_es, dp);
                         free(dp);
                         ++count;
@@ -147,6 +157,8 @@ int dupe_clean(void)
         count_es = clean_es(now);
 
         count = count_ss + count_es;
+
+        PROBE3(dedup_clean, count_ss, count_es, ustime() - now);
         
         if (debug > 2 && count)
                 printf("dupe_clean(): deleted %d SS and %d ES\n", count_ss, count_es);
@@ -154,3 +166,11 @@ int dupe_clean(void)
         return count;
 }
 
+
+/*
+ * dupe_window() - set how long a message is remembered for (uS), e.g. to simulate a shorter window
+ */
+void dupe_window(uint64_t us)
+{
+        max_ss = max_es = us;
+}
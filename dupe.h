@@ -2,7 +2,7 @@
  * dupe.h -- input de-duplicator
  */
 
-#ifndef _DEPE_H
+#ifndef _DUPE_H
 #define _DUPE_H
 
 #include <string.h>
@@ -38,5 +38,6 @@ typedef struct {
 int dupe_check_ss(uint8_t *);
 int dupe_check_es(uint8_t *);
 int dupe_clean(void);
+void dupe_window(uint64_t);
 
 #endif
@@ -0,0 +1,125 @@
+/*
+ * fec.c -- Forward error correction: XOR parity over groups of data messages
+ * Author: Michael J. Tubby B.Sc. MIET  mike@tubby.org
+ *
+ * ABSTRACT
+ *
+ * Our UDP is fire and forget and a 4G uplink loses 1-3% of datagrams, and
+ * with them positions and MLAT samples.  A retransmission would arrive far
+ * too late to be useful so with -K <k> we send a parity message (opcode 0x05)
+ * after every k data messages (Mode-A/C, Mode-S, ES and multiframe) instead.
+ *
+ * The parity is the XOR of the k messages exactly as they were sent, header
+ * and auth tag included, each zero padded to the longest, with the XOR of
+ * their lengths.  The receiver XORs the parity with the k-1 messages it did
+ * get to rebuild the one it didn't, checks the rebuilt message's auth tag and
+ * uses it as if it had arrived.  Two or more losses in a group can't be
+ * repaired.  The parity message carries the sequence number of the first
+ * message covered and a bitmap of those that follow, as keepalives and
+ * statistics are not covered and can come in between.
+ *
+ * The cost is one message per k as long as the longest in the group plus a
+ * 10 byte FEC header.  With multiframe that is a little over 1/k more bytes;
+ * single ES messages are small next to the header so k = 4 adds about 45%.
+ * k = 4 turns 2% random loss into about 0.2%, but losses that come in runs
+ * take out several messages of a group and can't be repaired.  A group that
+ * is still open at the end of a second is closed and its parity sent so that
+ * a quiet station's last messages are protected without waiting.  radar-sink
+ * has the decoder and a loss simulator (-L) to measure the trade-off.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "radar.h"
+#include "fec.h"
+#include "stats.h"
+
+
+/*
+ * local variables
+ */
+static int k = 0;					/* data messages per parity message, zero if off */
+static int count = 0;					/* data messages in the open group */
+static uint32_t first;					/* sequence number of the first */
+static uint32_t covers;					/* bitmap of the sequence numbers covered */
+static uint16_t lens;					/* XOR of their lengths */
+static int longest;
+static uint8_t parity[sizeof(radar_multiframe_t)];
+
+
+/*
+ * fec_init() - send a parity message after every n data messages, after stats_init() as
+ * the group size is reported in the stats
+ */
+void fec_init(int n)
+{
+        k = n;
+        count = 0;
+        stats.fec_k = (uint8_t)n;
+}
+
+
+/*
+ * fec_add() - add a data message that has been signed and sent to the open group,
+ * returns 1 if the group is complete and its parity should be sent
+ */
+int fec_add(const void *buf, int len, uint32_t seq)
+{
+        const uint8_t *bp = buf;
+        int i;
+
+        if (!k || len > (int)sizeof(parity))
+                return 0;
+
+        /* too many other messages in between to describe - give up on the group */
+        if (count && (uint32_t)(seq - first) >= RADAR_FEC_SPAN)
+                count = 0;
+
+        if (!count) {
+                memset(parity, 0, sizeof(parity));
+                first = seq;
+                covers = lens = longest = 0;
+        }
+
+        for (i = 0; i < len; i++)
+                parity[i] ^= bp[i];
+
+        covers |= 1U << (seq - first);
+        lens ^= (uint16_t)len;
+        longest = max(longest, len);
+
+        return ++count >= k;
+}
+
+
+/*
+ * fec_pending() - there is an open group with data messages in it
+ */
+int fec_pending(void)
+{
+        return count > 0;
+}
+
+
+/*
+ * fec_parity() - fill in the body of a parity message for the open group and close
+ * it, returns the length of the parity (zero if there is no open group)
+ */
+int fec_parity(radar_fec_t *msg)
+{
+        if (!count)
+                return 0;
+
+        msg->first = first;
+        msg->covers = covers;
+        msg->len = lens;
+        memcpy(msg->parity, parity, longest);
+
+        count = 0;
+
+        return longest;
+}
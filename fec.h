@@ -0,0 +1,22 @@
+/*
+ * fec.h -- Forward error correction: XOR parity over groups of data messages
+ * Author: Michael J. Tubby B.Sc. MIET  mike@tubby.org
+ */
+
+#ifndef _FEC_H
+#define _FEC_H
+
+#include <stdint.h>
+
+#include "radar.h"
+
+
+/*
+ * exported functions
+ */
+void fec_init(int);
+int fec_add(const void *, int, uint32_t);
+int fec_pending(void);
+int fec_parity(radar_fec_t *);
+
+#endif
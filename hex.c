@@ -1,34 +1,56 @@
-/*
- * hex.c -- simple utilities for working with hexadecial
- */
-
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-#include <stdint.h>
-#include <ctype.h>
-
-#include "hex.h"
-
-
-/*
- * hex_dump() - dump out a buffer in hex with a prompt
- */
-void hex_dump(const char * prompt, uint8_t * bp, int size)
-{
-	int i;
-
-	printf("%s (size %d): ", prompt, size);
-
-	for (i=0; i<size; ++i)
-		printf("%02X ", bp[i]);
-
-	printf("\n");
-}
-
-
-/*
- * hex_digits() - test is a string contains only hex digits
+/*
+ * hex.c -- simple utilities for working with hexadecial
+ *
+ * hex_decode() is on the hot path for AVR input so it converts 16 characters
+ * at a time using SSE2 on x86 or NEON on ARM, with a table driven fall-back
+ * for other processors and for the tail of each string.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <ctype.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+#include "hex.h"
+
+
+/*
+ * nibble values for ASCII characters, 0xFF for not a hex digit
+ */
+static const uint8_t nibble[256] = {
+        [0 ... 255] = 0xFF,
+        ['0'] = 0, ['1'] = 1, ['2'] = 2, ['3'] = 3, ['4'] = 4,
+        ['5'] = 5, ['6'] = 6, ['7'] = 7, ['8'] = 8, ['9'] = 9,
+        ['A'] = 10, ['B'] = 11, ['C'] = 12, ['D'] = 13, ['E'] = 14, ['F'] = 15,
+        ['a'] = 10, ['b'] = 11, ['c'] = 12, ['d'] = 13, ['e'] = 14, ['f'] = 15
+};
+
+
+/*
+ * hex_dump() - dump out a buffer in hex with a prompt
+ */
+void hex_dump(const char * prompt, uint8_t * bp, int size)
+{
+	int i;
+
+	printf("%s (size %d): ", prompt, size);
+
+	for (i=0; i<size; ++i)
+		printf("%02X ", bp[i]);
+
+	printf("\n");
+}
+
+
+/*
+ * hex_digits() - test is a string contains only hex digits
  */
 int hex_digits(char * buf, int max)
 {
@@ -41,7 +63,7 @@ int hex_digits(char * buf, int max)
 
         return 1;
 }
-
+
 
 /*
  * hex_parse() - parse a hexaecimal string from 'in' and put the binary
@@ -49,12 +71,104 @@ int hex_digits(char * buf, int max)
  */
 int hex_parse(uint8_t * out, char *in)
 {
-        char * p;
-        uint8_t * q;
-
+        char * p;
+        uint8_t * q;
+
         for (p=in, q=out; *p; p+=2, q++) {
                 if (sscanf(p, "%02hhx", q) != 1)
                         return 0;
         }
         return (q - out);
 }
+
+
+#if defined(__SSE2__)
+/*
+ * decode16() - convert 16 hex characters to 8 bytes with SSE2, returns 0 if any aren't hex
+ */
+static inline int decode16(uint8_t *out, const char *in)
+{
+        __m128i v = _mm_loadu_si128((const __m128i *)in);
+        __m128i d = _mm_sub_epi8(v, _mm_set1_epi8('0'));
+        __m128i l = _mm_sub_epi8(_mm_or_si128(v, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+        __m128i isdig = _mm_and_si128(_mm_cmpgt_epi8(d, _mm_set1_epi8(-1)), _mm_cmplt_epi8(d, _mm_set1_epi8(10)));
+        __m128i islet = _mm_and_si128(_mm_cmpgt_epi8(l, _mm_set1_epi8(-1)), _mm_cmplt_epi8(l, _mm_set1_epi8(6)));
+        __m128i val, hi, lo;
+
+        if (_mm_movemask_epi8(_mm_or_si128(isdig, islet)) != 0xFFFF)
+                return 0;
+
+        val = _mm_or_si128(_mm_and_si128(isdig, d), _mm_and_si128(islet, _mm_add_epi8(l, _mm_set1_epi8(10))));
+
+        /* each 16-bit lane holds the high nibble in its low byte and the low nibble in its high byte */
+        hi = _mm_slli_epi16(_mm_and_si128(val, _mm_set1_epi16(0x00FF)), 4);
+        lo = _mm_srli_epi16(val, 8);
+        _mm_storel_epi64((__m128i *)out, _mm_packus_epi16(_mm_or_si128(hi, lo), _mm_setzero_si128()));
+
+        return 1;
+}
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+/*
+ * nibbles8() - convert 8 hex characters to nibble values with NEON, flagging valid ones in *ok
+ */
+static inline uint8x8_t nibbles8(uint8x8_t c, uint8x8_t *ok)
+{
+        uint8x8_t d = vsub_u8(c, vdup_n_u8('0'));
+        uint8x8_t l = vsub_u8(vorr_u8(c, vdup_n_u8(0x20)), vdup_n_u8('a'));
+        uint8x8_t isdig = vclt_u8(d, vdup_n_u8(10));
+        uint8x8_t islet = vclt_u8(l, vdup_n_u8(6));
+
+        *ok = vorr_u8(isdig, islet);
+
+        return vorr_u8(vand_u8(isdig, d), vand_u8(islet, vadd_u8(l, vdup_n_u8(10))));
+}
+
+
+/*
+ * decode16() - convert 16 hex characters to 8 bytes with NEON, returns 0 if any aren't hex
+ */
+static inline int decode16(uint8_t *out, const char *in)
+{
+        uint8x8x2_t c = vld2_u8((const uint8_t *)in);		/* de-interleave high and low nibble characters */
+        uint8x8_t okh, okl, hi, lo;
+
+        hi = nibbles8(c.val[0], &okh);
+        lo = nibbles8(c.val[1], &okl);
+
+        if (vget_lane_u64(vreinterpret_u64_u8(vand_u8(okh, okl)), 0) != ~(uint64_t)0)
+                return 0;
+
+        vst1_u8(out, vorr_u8(vshl_n_u8(hi, 4), lo));
+
+        return 1;
+}
+#endif
+
+
+/*
+ * hex_decode() - convert 'len' bytes worth of hex characters (2 x len) at 'in' to binary
+ * at 'out', returns the number of bytes converted or zero if 'in' has a non-hex character
+ */
+int hex_decode(uint8_t *out, const char *in, int len)
+{
+        int i = 0;
+
+#if defined(__SSE2__) || defined(__ARM_NEON) || defined(__ARM_NEON__)
+        for (; i + 8 <= len; i += 8) {
+                if (!decode16(&out[i], &in[2*i]))
+                        return 0;
+        }
+#endif
+
+        for (; i < len; i++) {
+                uint8_t hi = nibble[(uint8_t)in[2*i]];
+                uint8_t lo = nibble[(uint8_t)in[2*i+1]];
+
+                if ((hi | lo) & 0xF0)
+                        return 0;
+
+                out[i] = (hi << 4) | lo;
+        }
+
+        return len;
+}
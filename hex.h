@@ -10,5 +10,6 @@
 extern void hex_dump(const char *, uint8_t *, int);
 extern int hex_parse(uint8_t * out, char *);
 extern int hex_digits(char *, int);
+extern int hex_decode(uint8_t *, const char *, int);
 
 #endif
@@ -23,12 +23,11 @@
 #define IPAD 0x36
 #define OPAD 0x5c
 
-void hmac_sha256(uint8_t out[SHA256_DIGEST_SIZE], const uint8_t *key, size_t key_len, const uint8_t *data, size_t data_len)
+void hmac_sha256_prepare(hmac_sha256_ctx *ctx, const uint8_t *key, size_t key_len)
 {
     uint8_t lkey[SHA256_BLOCK_SIZE];		/* local key */
     uint8_t okey[SHA256_BLOCK_SIZE];		/* outer key */
     uint8_t ikey[SHA256_BLOCK_SIZE];		/* inner key */
-    uint8_t hash[SHA256_DIGEST_SIZE];		/* inner/temporary hash */
     size_t i;
 
     /* Step 1: process the key */
@@ -47,28 +46,46 @@ void hmac_sha256(uint8_t out[SHA256_DIGEST_SIZE], const uint8_t *key, size_t key
         okey[i] = lkey[i] ^ OPAD;
     }
 
-    /* Step 3: inner hash = SHA256(ikey || data) */
-    {
-        sha256_ctx ctx;
-        sha256_init(&ctx);
-        sha256_update(&ctx, ikey, SHA256_BLOCK_SIZE);
-        sha256_update(&ctx, data, data_len);
-        sha256_final(&ctx, hash);
-    }
+    /* Step 3: hash them once, a whole block each */
+    sha256_init(&ctx->inner);
+    sha256_update(&ctx->inner, ikey, SHA256_BLOCK_SIZE);
 
-    /* Step 4: outer hash = SHA256(okey || hash) */
-    {
-        sha256_ctx ctx;
-        sha256_init(&ctx);
-        sha256_update(&ctx, okey, SHA256_BLOCK_SIZE);
-        sha256_update(&ctx, hash, SHA256_DIGEST_SIZE);
-        sha256_final(&ctx, out);
-    }
+    sha256_init(&ctx->outer);
+    sha256_update(&ctx->outer, okey, SHA256_BLOCK_SIZE);
 
     /* clean up - don't leave sensitive data in memory */
     memset(lkey, 0, sizeof(lkey));
     memset(ikey, 0, sizeof(ikey));
     memset(okey, 0, sizeof(okey));
+}
+
+void hmac_sha256_with(uint8_t out[SHA256_DIGEST_SIZE], const hmac_sha256_ctx *key, const uint8_t *data, size_t data_len)
+{
+    uint8_t hash[SHA256_DIGEST_SIZE];		/* inner/temporary hash */
+    sha256_ctx ctx;
+
+    /* inner hash = SHA256(ikey || data) */
+    ctx = key->inner;
+    sha256_update(&ctx, data, data_len);
+    sha256_final(&ctx, hash);
+
+    /* outer hash = SHA256(okey || hash) */
+    ctx = key->outer;
+    sha256_update(&ctx, hash, SHA256_DIGEST_SIZE);
+    sha256_final(&ctx, out);
+
+    /* clean up - don't leave sensitive data in memory */
+    memset(&ctx, 0, sizeof(ctx));
     memset(hash, 0, sizeof(hash));
 }
 
+void hmac_sha256(uint8_t out[SHA256_DIGEST_SIZE], const uint8_t *key, size_t key_len, const uint8_t *data, size_t data_len)
+{
+    hmac_sha256_ctx ctx;
+
+    hmac_sha256_prepare(&ctx, key, key_len);
+    hmac_sha256_with(out, &ctx, data, data_len);
+
+    /* clean up - don't leave sensitive data in memory */
+    memset(&ctx, 0, sizeof(ctx));
+}
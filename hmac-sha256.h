@@ -24,6 +24,15 @@
 
 #define HMAC_SHA256_SIZE SHA256_DIGEST_SIZE
 
+/*
+ * HMAC-SHA256 with the key already processed: the SHA256 state after the inner
+ * and outer padded key blocks, so each message costs two blocks fewer
+ */
+typedef struct {
+    sha256_ctx inner;		/* state after (key XOR ipad) */
+    sha256_ctx outer;		/* state after (key XOR opad) */
+} hmac_sha256_ctx;
+
 /*
  * Compute HMAC-SHA256
  *
@@ -39,4 +48,23 @@
  */
 void hmac_sha256(uint8_t out[SHA256_DIGEST_SIZE], const uint8_t *key, size_t key_len, const uint8_t *data, size_t data_len);
 
+/*
+ * Process a key once for many messages
+ *
+ * ctx: state to fill in
+ * key: pointer to key bytes
+ * key_len: length of key in bytes
+ */
+void hmac_sha256_prepare(hmac_sha256_ctx *ctx, const uint8_t *key, size_t key_len);
+
+/*
+ * Compute HMAC-SHA256 with a key processed by hmac_sha256_prepare(), which is not changed
+ *
+ * out: pointer to output buffer (must be at least 32 bytes)
+ * ctx: processed key
+ * data: pointer to input message
+ * data_len: length of input message in bytes
+ */
+void hmac_sha256_with(uint8_t out[SHA256_DIGEST_SIZE], const hmac_sha256_ctx *ctx, const uint8_t *data, size_t data_len);
+
 #endif
@@ -0,0 +1,477 @@
+/*
+ * impair.c -- Network impairment simulator at the udp_send() boundary
+ * Author: Michael J. Tubby B.Sc. MIET  mike@tubby.org
+ *
+ * ABSTRACT
+ *
+ * Multiframe, FEC (-K) and the uplink budget (-U) are there for bad links,
+ * and to see what they are worth we need a bad link on the bench.  With
+ * -X <spec> every message radar sends goes through here in place of
+ * sendto(), where it can be lost, held back, reordered, duplicated,
+ * corrupted or refused, before the real sendto().  The spec is a comma
+ * separated list of (percentages may be fractions and the % is optional):
+ *
+ *	loss=<%>		drop messages at random (Bernoulli)
+ *	burst=<n>		with loss=, drop them in runs of mean length n
+ *				(a Gilbert model with the same overall loss)
+ *	ge=<p>:<r>[:<h>[:<k>]]	Gilbert-Elliott: p% chance a good message is
+ *				followed by a bad one, r% the other way, h%
+ *				lost in the bad state (default 100) and k% in
+ *				the good state (default 0)
+ *	delay=<mS>		hold every message this long
+ *	jitter=<mS>		plus or minus up to this much, which reorders
+ *	reorder=<%>		send this share straight away, overtaking the
+ *				delayed ones (held IMPAIR_REORDER_HOLD mS and
+ *				overtaken if there is no delay=)
+ *	dup=<%>			send this share twice
+ *	corrupt=<%>		flip one bit at random in this share
+ *	enobufs=<%>		fail this share of sendto()s with ENOBUFS
+ *	seed=<n>		random number seed (default 1)
+ *
+ * for example "-X loss=2,burst=3,delay=40,jitter=15,dup=0.1".
+ *
+ * Each impairment draws from its own random number stream, seeded from the
+ * seed and the impairment, so a run is repeatable and adding one impairment
+ * does not change the decisions made by the others.  Held messages wait in
+ * a heap ordered by the time they are due and are sent by impair_run(),
+ * which the main loop calls after every poll() with a timeout from
+ * impair_timeout(); times are ustime() so they follow a replay's clock.
+ * Each is sent on the socket it was given on, so a message for a fan-out
+ * destination or a path that is no longer in use goes where it would have;
+ * impair_forget() drops those for a socket that is about to be closed.
+ *
+ * This replaces the "interference monkey" that used to be compiled out in
+ * send_mode_es().
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/socket.h>
+
+#include "radar.h"
+#include "impair.h"
+#include "ustime.h"
+#include "qerror.h"
+
+
+/*
+ * a message held back
+ */
+typedef struct {
+        uint64_t due;					/* when to send it (uS) */
+        int fd;						/* socket it was given on, -1 if since closed */
+        struct sockaddr_in dest;
+        int len;
+        uint8_t buf[IMPAIR_MSG_SIZE];
+} held_t;
+
+
+/*
+ * local variables
+ */
+static int enabled = 0;
+static double loss = 0;					/* Bernoulli loss */
+static int ge = 0;					/* Gilbert-Elliott loss instead */
+static double ge_p, ge_r, ge_h = 1, ge_k = 0;
+static int bad = 0;					/* Gilbert-Elliott state */
+static double burst = 0;
+static uint64_t delay = 0;				/* uS */
+static uint64_t jitter = 0;				/* uS */
+static double reorder = 0, dup = 0, corrupt = 0, enobufs = 0;
+static uint64_t seed = 1;
+static uint64_t rng[IMPAIR_KINDS];
+static uint64_t counts[IMPAIR_KINDS];
+static held_t *pool = NULL;				/* allocated if anything is ever held */
+static held_t *heap[IMPAIR_QUEUE];			/* held messages, soonest due first */
+static held_t *spare[IMPAIR_QUEUE];
+static int nheld = 0, nspare = 0;
+static uint64_t overflow = 0;				/* sent on time because the queue was full */
+
+static const char *names[IMPAIR_KINDS] = {
+        "loss", "delay", "reorder", "duplicate", "corrupt", "enobufs"
+};
+
+
+/*
+ * splitmix() - seed a stream
+ */
+static uint64_t splitmix(uint64_t x)
+{
+        x += 0x9E3779B97F4A7C15ULL;
+        x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+
+        return (x ^ (x >> 31)) | 1;
+}
+
+
+/*
+ * uniform() - next number in [0, 1) from an impairment's stream (xorshift64*)
+ */
+static double uniform(int kind)
+{
+        uint64_t x = rng[kind];
+
+        x ^= x >> 12;
+        x ^= x << 25;
+        x ^= x >> 27;
+        rng[kind] = x;
+
+        return ((x * 0x2545F4914F6CDD1DULL) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+
+/*
+ * percent() - parse a percentage into a probability
+ */
+static double percent(const char *s, const char *spec)
+{
+        char *end;
+        double v = strtod(s, &end);
+
+        if (end == s || (*end && strcmp(end, "%") != 0) || v < 0 || v > 100)
+                qerror("radar: bad percentage \"%s\" in impairment \"%s\"\n", s, spec);
+
+        return v / 100;
+}
+
+
+/*
+ * lost() - is this message lost?
+ */
+static int lost(void)
+{
+        if (ge) {
+                double u = uniform(IMPAIR_LOSS);
+
+                if (bad ? u < ge_r : u < ge_p)
+                        bad = !bad;
+
+                return uniform(IMPAIR_LOSS) < (bad ? ge_h : ge_k);
+        }
+
+        return loss && uniform(IMPAIR_LOSS) < loss;
+}
+
+
+/*
+ * hold_time() - how long to hold a message back (uS), zero to send it now
+ */
+static uint64_t hold_time(void)
+{
+        uint64_t us = delay;
+
+        if (jitter) {
+                double j = (uniform(IMPAIR_DELAY) * 2 - 1) * jitter;
+
+                us = (j < -(double)us) ? 0 : (uint64_t)(us + j);
+        }
+
+        if (reorder && uniform(IMPAIR_REORDER) < reorder) {
+                ++counts[IMPAIR_REORDER];
+                us = delay ? 0 : IMPAIR_REORDER_HOLD * 1000;
+        }
+
+        if (us)
+                ++counts[IMPAIR_DELAY];
+
+        return us;
+}
+
+
+/*
+ * hold() - put a message in the heap to be sent at 'due', returns 0 if there is no room
+ */
+static int hold(int fd, const void *buf, int len, const struct sockaddr_in *dest, uint64_t due)
+{
+        held_t *h;
+        int i;
+
+        if (len > IMPAIR_MSG_SIZE)
+                return 0;
+
+        if (!pool) {
+                if ((pool = malloc(IMPAIR_QUEUE * sizeof(held_t))) == NULL)
+                        qerror("radar: can't allocate the impairment queue\n");
+
+                for (i = 0; i < IMPAIR_QUEUE; i++)
+                        spare[nspare++] = &pool[i];
+        }
+
+        if (!nspare) {
+                ++overflow;
+                return 0;
+        }
+
+        h = spare[--nspare];
+        h->due = due;
+        h->fd = fd;
+        h->dest = *dest;
+        h->len = len;
+        memcpy(h->buf, buf, len);
+
+        /* sift up */
+        for (i = nheld++; i && heap[(i - 1) / 2]->due > due; i = (i - 1) / 2)
+                heap[i] = heap[(i - 1) / 2];
+
+        heap[i] = h;
+
+        return 1;
+}
+
+
+/*
+ * unhold() - take the soonest due message off the heap
+ */
+static held_t *unhold(void)
+{
+        held_t *top = heap[0], *last = heap[--nheld];
+        int i = 0, c;
+
+        /* sift down */
+        while ((c = 2 * i + 1) < nheld) {
+                if (c + 1 < nheld && heap[c + 1]->due < heap[c]->due)
+                        ++c;
+
+                if (heap[c]->due >= last->due)
+                        break;
+
+                heap[i] = heap[c];
+                i = c;
+        }
+
+        heap[i] = last;
+
+        return top;
+}
+
+
+/*
+ * impair_init() - parse an impairment spec (see above) and enable impairment
+ */
+void impair_init(const char *spec)
+{
+        char buf[256], *tok, *save, *val;
+        int i;
+
+        if (strlen(spec) >= sizeof(buf))
+                qerror("radar: impairment \"%s\" too long\n", spec);
+
+        strcpy(buf, spec);
+
+        for (tok = strtok_r(buf, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+                if ((val = strchr(tok, '=')) == NULL)
+                        qerror("radar: impairment \"%s\" has no value in \"%s\"\n", tok, spec);
+
+                *val++ = '\0';
+
+                if (strcmp(tok, "loss") == 0) {
+                        loss = percent(val, spec);
+                } else if (strcmp(tok, "burst") == 0) {
+                        burst = atof(val);
+                        if (burst < 1)
+                                qerror("radar: impairment burst must be at least 1\n");
+                } else if (strcmp(tok, "ge") == 0) {
+                        double p, r, h = 100, k = 0;
+
+                        if (sscanf(val, "%lf:%lf:%lf:%lf", &p, &r, &h, &k) < 2 || p < 0 || p > 100 ||
+                            r <= 0 || r > 100 || h < 0 || h > 100 || k < 0 || k > 100)
+                                qerror("radar: impairment ge= must be <p%%>:<r%%>[:<h%%>[:<k%%>]]\n");
+
+                        ge = 1;
+                        ge_p = p / 100;
+                        ge_r = r / 100;
+                        ge_h = h / 100;
+                        ge_k = k / 100;
+                } else if (strcmp(tok, "delay") == 0) {
+                        delay = (uint64_t)atoi(val) * 1000;
+                } else if (strcmp(tok, "jitter") == 0) {
+                        jitter = (uint64_t)atoi(val) * 1000;
+                } else if (strcmp(tok, "reorder") == 0) {
+                        reorder = percent(val, spec);
+                } else if (strcmp(tok, "dup") == 0) {
+                        dup = percent(val, spec);
+                } else if (strcmp(tok, "corrupt") == 0) {
+                        corrupt = percent(val, spec);
+                } else if (strcmp(tok, "enobufs") == 0) {
+                        enobufs = percent(val, spec);
+                } else if (strcmp(tok, "seed") == 0) {
+                        seed = strtoull(val, NULL, 0);
+                } else {
+                        qerror("radar: unknown impairment \"%s\" in \"%s\"\n", tok, spec);
+                }
+        }
+
+        /* loss= with burst= is a Gilbert model with the same overall loss */
+        if (burst > 1 && loss > 0 && !ge) {
+                if (loss >= 1)
+                        qerror("radar: impairment loss= must be under 100%% with burst=\n");
+
+                ge = 1;
+                ge_p = loss / (burst * (1 - loss));
+                ge_r = 1 / burst;
+                ge_h = 1;
+                ge_k = 0;
+        }
+
+        for (i = 0; i < IMPAIR_KINDS; i++)
+                rng[i] = splitmix(seed * IMPAIR_KINDS + i);
+
+        enabled = 1;
+}
+
+
+/*
+ * impair_enabled() - is the impairment simulator on?
+ */
+int impair_enabled(void)
+{
+        return enabled;
+}
+
+
+/*
+ * impair_sendto() - sendto() through the impairments, returns as sendto() does
+ */
+int impair_sendto(int fd, const void *buf, int len, const struct sockaddr_in *dest)
+{
+        uint8_t copy[IMPAIR_MSG_SIZE];
+        int copies = 1, rc = len;
+        uint64_t us;
+
+        if (enobufs && uniform(IMPAIR_ENOBUFS) < enobufs) {
+                ++counts[IMPAIR_ENOBUFS];
+                errno = ENOBUFS;
+                return -1;
+        }
+
+        /* as far as we can tell it was sent */
+        if (lost()) {
+                ++counts[IMPAIR_LOSS];
+                return len;
+        }
+
+        if (corrupt && len <= IMPAIR_MSG_SIZE && uniform(IMPAIR_CORRUPT) < corrupt) {
+                int bit = (int)(uniform(IMPAIR_CORRUPT) * len * 8);
+
+                memcpy(copy, buf, len);
+                copy[bit / 8] ^= 1 << (bit % 8);
+                buf = copy;
+                ++counts[IMPAIR_CORRUPT];
+        }
+
+        if (dup && uniform(IMPAIR_DUPLICATE) < dup) {
+                ++counts[IMPAIR_DUPLICATE];
+                copies = 2;
+        }
+
+        while (copies--) {
+                us = hold_time();
+
+                if (us && hold(fd, buf, len, dest, ustime() + us))
+                        continue;
+
+                if (sendto(fd, buf, len, 0, (const struct sockaddr *)dest, sizeof(*dest)) < 0 && copies == 0)
+                        rc = -1;
+        }
+
+        return rc;
+}
+
+
+/*
+ * impair_run() - send the held messages that are now due
+ */
+void impair_run(void)
+{
+        uint64_t now;
+
+        if (!nheld)
+                return;
+
+        now = ustime();
+
+        while (nheld && heap[0]->due <= now) {
+                held_t *h = unhold();
+
+                /* errors here are the network's problem, the sender has moved on */
+                if (h->fd >= 0 && sendto(h->fd, h->buf, h->len, 0, (const struct sockaddr *)&h->dest, sizeof(h->dest)) < 0)
+                        ;
+
+                spare[nspare++] = h;
+        }
+}
+
+
+/*
+ * impair_forget() - a socket is being closed, don't send what is held for it
+ */
+void impair_forget(int fd)
+{
+        int i;
+
+        for (i = 0; i < nheld; i++) {
+                if (heap[i]->fd == fd)
+                        heap[i]->fd = -1;
+        }
+}
+
+
+/*
+ * impair_timeout() - poll() timeout (mS) no later than the next held message is due
+ */
+int impair_timeout(int ms)
+{
+        uint64_t now;
+
+        if (!nheld)
+                return ms;
+
+        now = ustime();
+
+        if (heap[0]->due <= now)
+                return 0;
+
+        return (int)min((uint64_t)ms, (heap[0]->due - now + 999) / 1000);
+}
+
+
+/*
+ * impair_count() - number of messages an impairment has applied to
+ */
+uint64_t impair_count(int kind)
+{
+        return (kind >= 0 && kind < IMPAIR_KINDS) ? counts[kind] : 0;
+}
+
+
+/*
+ * impair_name() - short name of an impairment
+ */
+const char *impair_name(int kind)
+{
+        return (kind >= 0 && kind < IMPAIR_KINDS) ? names[kind] : "?";
+}
+
+
+/*
+ * impair_report() - print what was done
+ */
+void impair_report(void)
+{
+        int i;
+
+        printf("Impaired:");
+
+        for (i = 0; i < IMPAIR_KINDS; i++)
+                printf(" %s %llu", names[i], (unsigned long long)counts[i]);
+
+        if (overflow)
+                printf(" (queue full %llu)", (unsigned long long)overflow);
+
+        printf("\n");
+}
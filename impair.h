@@ -0,0 +1,44 @@
+/*
+ * impair.h -- Network impairment simulator at the udp_send() boundary
+ * Author: Michael J. Tubby B.Sc. MIET  mike@tubby.org
+ */
+
+#ifndef _IMPAIR_H
+#define _IMPAIR_H
+
+#include <stdint.h>
+#include <netinet/in.h>
+
+#define IMPAIR_QUEUE		4096			/* messages held for delay, jitter and reordering */
+#define IMPAIR_MSG_SIZE		1500			/* largest message we can hold */
+#define IMPAIR_REORDER_HOLD	10			/* without delay= a reordered message is held this long (mS) */
+
+
+/*
+ * impairments, each has its own random number stream
+ */
+enum impair_kind {
+        IMPAIR_LOSS,					/* dropped (Bernoulli or Gilbert-Elliott) */
+        IMPAIR_DELAY,					/* held for delay +/- jitter */
+        IMPAIR_REORDER,					/* sent out of order */
+        IMPAIR_DUPLICATE,				/* sent twice */
+        IMPAIR_CORRUPT,					/* a bit flipped */
+        IMPAIR_ENOBUFS,					/* sendto() failed with ENOBUFS */
+        IMPAIR_KINDS
+};
+
+
+/*
+ * exported functions
+ */
+void impair_init(const char *);
+int impair_enabled(void);
+int impair_sendto(int, const void *, int, const struct sockaddr_in *);
+void impair_run(void);
+void impair_forget(int);
+int impair_timeout(int);
+uint64_t impair_count(int);
+const char *impair_name(int);
+void impair_report(void);
+
+#endif
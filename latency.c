@@ -0,0 +1,257 @@
+/*
+ * latency.c -- Per-stage latency histograms and event loop lag
+ * Author: Michael J. Tubby B.Sc. MIET  mike@tubby.org
+ *
+ * ABSTRACT
+ *
+ * Measure where the time goes between a read() from the receiver and the
+ * sendto() to the aggregator, and how late the poll() loop services its
+ * timers, without adding noticeable cost to the forwarding path.
+ *
+ * Each stage has a log-linear (HDR style) histogram: values below 16nS have
+ * a bucket each and above that each power of two is split into 16 linear
+ * sub-buckets, so any value is held to within about 6% using 464 counters.
+ * Recording is a clock read, a count-leading-zeros and an increment.
+ *
+ * Frames are timed with the monotonic clock at the end of read(), when the
+ * frame has been decoded, after the duplicate check, after signing and after
+ * sendto().  Frames held for multiframe sending also record their holding
+ * time.  Timer lag is the time since the timerfd deadline when we read it,
+ * worked out from the time remaining to the next expiry.
+ *
+ * The histograms are printed once per second with -f and summarised as
+ * percentiles in a RADAR_OPCODE_LATENCY message at the telemetry interval.
+ * A running total since start-up is kept for the metrics endpoint.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/timerfd.h>
+
+#include "radar.h"
+#include "latency.h"
+#include "nstime.h"
+
+
+/*
+ * global variables
+ */
+latency_hist_t latency_now[LATENCY_STAGES];		/* this second */
+uint64_t latency_read;					/* time of the last read() (nS) */
+uint64_t latency_mark;					/* time the last stage finished (nS) */
+
+
+/*
+ * local variables
+ */
+static latency_hist_t period[LATENCY_STAGES];		/* this telemetry period */
+static latency_hist_t total[LATENCY_STAGES];		/* since start-up, for the metrics endpoint */
+
+static const char *names[LATENCY_STAGES] = {
+        "read-parse",
+        "parse-dedup",
+        "dedup-sign",
+        "sign-sendto",
+        "multiframe-hold",
+        "loop-housekeeping",
+        "loop-forward"
+};
+
+
+/*
+ * bucket_value() - the highest value that falls in a bucket
+ */
+static uint32_t bucket_value(int idx)
+{
+        int e, m;
+
+        if (idx < LATENCY_SUB)
+                return idx;
+
+        e = idx / LATENCY_SUB + LATENCY_SUB_BITS - 1;
+        m = idx % LATENCY_SUB;
+
+        return (uint32_t)((((uint64_t)LATENCY_SUB + m + 1) << (e - LATENCY_SUB_BITS)) - 1);
+}
+
+
+/*
+ * latency_percentile() - value at a percentile given in parts per thousand, e.g. 999 for p99.9
+ */
+uint32_t latency_percentile(const latency_hist_t *h, int pm)
+{
+        uint64_t target, sum = 0;
+        int i;
+
+        if (!h->n)
+                return 0;
+
+        target = (h->n * pm + 999) / 1000;
+
+        for (i = 0; i < LATENCY_BUCKETS; i++) {
+                sum += h->count[i];
+
+                if (sum >= target)
+                        return min(bucket_value(i), h->max);
+        }
+
+        return h->max;
+}
+
+
+/*
+ * latency_merge() - add the values in one histogram to another
+ */
+void latency_merge(latency_hist_t *to, const latency_hist_t *from)
+{
+        int i;
+
+        for (i = 0; i < LATENCY_BUCKETS; i++)
+                to->count[i] += from->count[i];
+
+        to->n += from->n;
+        to->max = max(to->max, from->max);
+        to->sum += from->sum;
+}
+
+
+/*
+ * latency_name() - printable name of a stage
+ */
+const char *latency_name(int stage)
+{
+        return (stage >= 0 && stage < LATENCY_STAGES) ? names[stage] : "unknown";
+}
+
+
+/*
+ * latency_total() - histogram of a stage since start-up (updated once per second)
+ */
+const latency_hist_t *latency_total(int stage)
+{
+        return &total[stage];
+}
+
+
+/*
+ * latency_start() - note the time a read() from the receiver completed
+ */
+void latency_start(void)
+{
+        latency_read = latency_mark = nstime();
+}
+
+
+/*
+ * latency_frame() - a frame has been decoded from the last read()
+ */
+void latency_frame(void)
+{
+        uint64_t now = nstime();
+
+        latency_record(LATENCY_READ_PARSE, now - latency_read);
+        latency_mark = now;
+}
+
+
+/*
+ * latency_stage() - a frame has finished a stage, returns the time now
+ */
+uint64_t latency_stage(int stage)
+{
+        uint64_t now = nstime();
+
+        latency_record(stage, now - latency_mark);
+        latency_mark = now;
+
+        return now;
+}
+
+
+/*
+ * latency_lag() - record how late we are servicing a periodic timerfd that has
+ * just been read, given the expiry count that read() returned, returns the lag (nS)
+ */
+uint64_t latency_lag(int stage, int fd, uint64_t expirations)
+{
+        struct itimerspec cur;
+        uint64_t interval, remain, lag;
+
+        if (timerfd_gettime(fd, &cur) < 0)
+                return 0;
+
+        interval = (uint64_t)cur.it_interval.tv_sec * 1000000000 + cur.it_interval.tv_nsec;
+        remain = (uint64_t)cur.it_value.tv_sec * 1000000000 + cur.it_value.tv_nsec;
+
+        if (!interval || remain > interval)
+                return 0;
+
+        /* time since the last deadline plus any whole periods we missed */
+        lag = interval - remain;
+
+        if (expirations > 1)
+                lag += (expirations - 1) * interval;
+
+        latency_record(stage, lag);
+
+        return lag;
+}
+
+
+/*
+ * summary() - fill in a summary of a histogram
+ */
+static void summary(latency_summary_t *s, const latency_hist_t *h)
+{
+        s->count = (uint32_t)h->n;
+        s->p50 = latency_percentile(h, 500);
+        s->p99 = latency_percentile(h, 990);
+        s->p999 = latency_percentile(h, 999);
+        s->max = h->max;
+}
+
+
+/*
+ * latency_second() - once per second from house keeping, optionally print this second's
+ * percentiles then add them to the telemetry period
+ */
+void latency_second(int print)
+{
+        int i;
+
+        for (i = 0; i < LATENCY_STAGES; i++) {
+                latency_hist_t *h = &latency_now[i];
+
+                if (!h->n)
+                        continue;
+
+                if (print) {
+                        latency_summary_t s;
+
+                        summary(&s, h);
+                        printf("  %-18s n=%6u  p50=%9.1f  p99=%9.1f  p99.9=%9.1f  max=%9.1f uS\n",
+                                names[i], s.count, s.p50 / 1000.0, s.p99 / 1000.0, s.p999 / 1000.0, s.max / 1000.0);
+                }
+
+                latency_merge(&period[i], h);
+                latency_merge(&total[i], h);
+                memset(h, 0, sizeof(latency_hist_t));
+        }
+}
+
+
+/*
+ * latency_report() - summarise the telemetry period for each stage and start a new period
+ */
+void latency_report(latency_summary_t *out)
+{
+        int i;
+
+        for (i = 0; i < LATENCY_STAGES; i++)
+                summary(&out[i], &period[i]);
+
+        memset(period, 0, sizeof(period));
+}
@@ -0,0 +1,107 @@
+/*
+ * latency.h -- Per-stage latency histograms and event loop lag
+ * Author: Michael J. Tubby B.Sc. MIET  mike@tubby.org
+ */
+
+#ifndef _LATENCY_H
+#define _LATENCY_H
+
+#include <stdint.h>
+
+#define LATENCY_SUB_BITS		4					/* 16 sub-buckets per power of two (~6% resolution) */
+#define LATENCY_SUB			(1 << LATENCY_SUB_BITS)
+#define LATENCY_BUCKETS			((32 - LATENCY_SUB_BITS + 1) * LATENCY_SUB)	/* covers 0 to 4.29 seconds in nS */
+
+
+/*
+ * pipeline stages and event loop timers that we measure
+ */
+enum latency_stage {
+        LATENCY_READ_PARSE,				/* read() returned to frame decoded */
+        LATENCY_PARSE_DEDUP,				/* frame decoded to duplicate check done */
+        LATENCY_DEDUP_SIGN,				/* duplicate check done to auth tag signed */
+        LATENCY_SIGN_SEND,				/* auth tag signed to sendto() returned */
+        LATENCY_MULTIFRAME_HOLD,			/* time a frame waits in the multiframe buffer */
+        LATENCY_LOOP_HOUSEKEEPING,			/* housekeeping timer lag behind its deadline */
+        LATENCY_LOOP_FORWARD,				/* multiframe forwarding timer lag behind its deadline */
+        LATENCY_STAGES
+};
+
+
+/*
+ * log-linear (HDR style) histogram of nano-second values
+ */
+typedef struct {
+        uint64_t count[LATENCY_BUCKETS];		/* counts per bucket */
+        uint64_t n;					/* total number of values */
+        uint32_t max;					/* largest value seen (nS) */
+        uint64_t sum;					/* sum of values (nS) */
+} latency_hist_t;
+
+
+/*
+ * summary of one histogram as sent to the aggregator (all values nS)
+ */
+typedef struct {
+        uint32_t count;
+        uint32_t p50;
+        uint32_t p99;
+        uint32_t p999;
+        uint32_t max;
+} __attribute__((packed)) latency_summary_t;
+
+
+extern latency_hist_t latency_now[LATENCY_STAGES];
+extern uint64_t latency_read;
+extern uint64_t latency_mark;
+
+
+/*
+ * latency_add() - add a value to a histogram, inline as it is called several times per frame
+ */
+static inline void latency_add(latency_hist_t *h, uint64_t ns)
+{
+        uint32_t v = (ns > UINT32_MAX) ? UINT32_MAX : (uint32_t)ns;
+        int idx;
+
+        if (v < LATENCY_SUB) {
+                idx = v;
+        } else {
+                int e = 31 - __builtin_clz(v);
+
+                idx = (e - LATENCY_SUB_BITS + 1) * LATENCY_SUB + ((v >> (e - LATENCY_SUB_BITS)) & (LATENCY_SUB - 1));
+        }
+
+        ++h->count[idx];
+        ++h->n;
+        h->sum += v;
+
+        if (v > h->max)
+                h->max = v;
+}
+
+
+/*
+ * latency_record() - add a value to a stage histogram
+ */
+static inline void latency_record(int stage, uint64_t ns)
+{
+        latency_add(&latency_now[stage], ns);
+}
+
+
+/*
+ * exported functions
+ */
+void latency_start(void);
+void latency_frame(void);
+uint64_t latency_stage(int);
+uint64_t latency_lag(int, int, uint64_t);
+void latency_second(int);
+void latency_report(latency_summary_t *);
+uint32_t latency_percentile(const latency_hist_t *, int);
+void latency_merge(latency_hist_t *, const latency_hist_t *);
+const char *latency_name(int);
+const latency_hist_t *latency_total(int);
+
+#endif
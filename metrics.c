@@ -0,0 +1,583 @@
+/*
+ * metrics.c -- Local metrics endpoint (OpenMetrics over HTTP)
+ * Author: Michael J. Tubby B.Sc. MIET  mike@tubby.org
+ *
+ * ABSTRACT
+ *
+ * The stats and telemetry structures only go upstream every 15 minutes so
+ * a local monitoring stack (Prometheus, VictoriaMetrics, Telegraf...) cannot
+ * see throughput, drops or reconnects as they happen.  With "-M" we listen
+ * for HTTP on a TCP port (loopback unless an address is given) or a unix
+ * domain socket and answer "GET /metrics" in OpenMetrics text format with:
+ *
+ *	the radio channel counters from stats_t (DF counts, dupes, tx)
+ *	the ingest counters from telemetry_t (connects, frames, reads)
+ *	the state of each BEAST source and the UDP state-machine
+ *	the per-stage latency histograms as summaries
+ *
+ * and "GET /trace" writes out the trace ring (see trace.c) and returns the
+ * name of the file.
+ *
+ * The listener and its clients are non-blocking and run in the main poll()
+ * loop.  A response is built in one go when the request arrives so it is a
+ * consistent snapshot - there are no other threads so no locking is needed -
+ * and it is written out as the socket allows, so a slow or stuck scraper can
+ * never hold up forwarding.
+ *
+ */
+
+#define _GNU_SOURCE
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/types.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+
+#include "radar.h"
+#include "beast.h"
+#include "udp.h"
+#include "latency.h"
+#include "metrics.h"
+#include "trace.h"
+#include "impair.h"
+#include "probe.h"
+#include "qerror.h"
+
+
+/*
+ * external variables
+ */
+extern int debug;
+
+
+/*
+ * local variables
+ */
+static int listen_fd = 0;
+static char sockpath[HOSTNAME_LEN+1];
+static metrics_client_t clients[METRICS_MAX_CLIENTS];
+static char body[METRICS_BUF_SIZE];
+static int bodylen;
+
+
+/*
+ * emit() - append formatted text to the response body
+ */
+static void emit(const char *fmt, ...)
+{
+        va_list ap;
+        int n;
+
+        if (bodylen >= sizeof(body))
+                return;
+
+        va_start(ap, fmt);
+        n = vsnprintf(&body[bodylen], sizeof(body) - bodylen, fmt, ap);
+        va_end(ap);
+
+        if (n > 0)
+                bodylen = min(bodylen + n, (int)sizeof(body));
+}
+
+
+/*
+ * counter() - a counter metric with no labels
+ */
+static void counter(const char *name, const char *help, uint64_t v)
+{
+        emit("# TYPE %s counter\n# HELP %s %s\n%s_total %llu\n", name, name, help, name, (unsigned long long)v);
+}
+
+
+/*
+ * gauge() - a gauge metric with no labels
+ */
+static void gauge(const char *name, const char *help, double v)
+{
+        emit("# TYPE %s gauge\n# HELP %s %s\n%s %.12g\n", name, name, help, name, v);
+}
+
+
+/*
+ * family() - start a metric family whose samples have labels
+ */
+static void family(const char *name, const char *type, const char *help)
+{
+        emit("# TYPE %s %s\n# HELP %s %s\n", name, type, name, help);
+}
+
+
+/*
+ * build_metrics() - snapshot everything into the response body
+ */
+static void build_metrics(void)
+{
+        stats_t s = stats;
+        telemetry_t t = telemetry;
+        int i;
+
+        bodylen = 0;
+
+        /* radio channel */
+        family("radar_rx_frames", "counter", "Frames received by type");
+        emit("radar_rx_frames_total{type=\"mode_ac\"} %llu\n", (unsigned long long)s.rx_mode_ac);
+        emit("radar_rx_frames_total{type=\"mode_ss\"} %llu\n", (unsigned long long)s.rx_mode_ss);
+        emit("radar_rx_frames_total{type=\"mode_es\"} %llu\n", (unsigned long long)s.rx_mode_es);
+
+        family("radar_rx_df", "counter", "Mode-S frames received by downlink format");
+        for (i = 0; i < MAX_DF; i++)
+                emit("radar_rx_df_total{df=\"%d\"} %llu\n", i, (unsigned long long)s.rx_df[i]);
+
+        family("radar_dupes", "counter", "Duplicate frames not forwarded by type");
+        emit("radar_dupes_total{type=\"mode_ac\"} %llu\n", (unsigned long long)s.dupe_ac);
+        emit("radar_dupes_total{type=\"mode_ss\"} %llu\n", (unsigned long long)s.dupe_ss);
+        emit("radar_dupes_total{type=\"mode_es\"} %llu\n", (unsigned long long)s.dupe_es);
+
+        family("radar_tx_messages", "counter", "Messages sent to the aggregator by type");
+        emit("radar_tx_messages_total{type=\"keepalive\"} %llu\n", (unsigned long long)s.tx_keepalive);
+        emit("radar_tx_messages_total{type=\"mode_ac\"} %llu\n", (unsigned long long)s.tx_mode_ac);
+        emit("radar_tx_messages_total{type=\"mode_ss\"} %llu\n", (unsigned long long)s.tx_mode_ss);
+        emit("radar_tx_messages_total{type=\"mode_es\"} %llu\n", (unsigned long long)s.tx_mode_es);
+        emit("radar_tx_messages_total{type=\"multiframe\"} %llu\n", (unsigned long long)s.tx_mode_multi);
+        emit("radar_tx_messages_total{type=\"fec\"} %llu\n", (unsigned long long)s.tx_fec);
+        emit("radar_tx_messages_total{type=\"stats\"} %llu\n", (unsigned long long)s.tx_stats);
+        emit("radar_tx_messages_total{type=\"telemetry\"} %llu\n", (unsigned long long)s.tx_telemetry);
+
+        counter("radar_tx_bytes", "Bytes sent to the aggregator", s.tx_bytes);
+        counter("radar_tx_errors", "sendto() failures", udp_errors());
+        gauge("radar_beast_hw_filter", "Mode-S Beast hardware filter flags in force", s.hw_filter);
+
+        gauge("radar_uplink_budget_kbps", "Uplink budget in force (-U), zero if none", s.uplink_kbps);
+        family("radar_shed", "counter", "Frames shed to stay within the uplink budget by class");
+        emit("radar_shed_total{class=\"mode_ac\"} %llu\n", (unsigned long long)s.shed_ac);
+        emit("radar_shed_total{class=\"mode_ss\"} %llu\n", (unsigned long long)s.shed_ss);
+        emit("radar_shed_total{class=\"comm_b\"} %llu\n", (unsigned long long)s.shed_commb);
+        emit("radar_shed_total{class=\"es_other\"} %llu\n", (unsigned long long)s.shed_es_other);
+        emit("radar_shed_total{class=\"es\"} %llu\n", (unsigned long long)s.shed_es);
+
+        /* BEAST ingest */
+        family("radar_beast_connects", "counter", "Connection attempts to BEAST sources by result");
+        emit("radar_beast_connects_total{result=\"success\"} %u\n", t.connect_success);
+        emit("radar_beast_connects_total{result=\"fail\"} %u\n", t.connect_fail);
+
+        counter("radar_beast_disconnects", "BEAST source disconnects", t.disconnect);
+        counter("radar_beast_socket_errors", "BEAST source read errors", t.socket_error);
+        counter("radar_beast_reads", "Reads from BEAST sources", t.socket_reads);
+        counter("radar_beast_read_bytes", "Bytes read from BEAST sources", t.bytes_read);
+
+        family("radar_beast_frames", "counter", "Frames parsed from BEAST sources by result");
+        emit("radar_beast_frames_total{result=\"good\"} %u\n", t.frames_good);
+        emit("radar_beast_frames_total{result=\"bad\"} %u\n", t.frames_bad);
+
+        counter("radar_beast_source_switches", "Fail-overs and fail-backs between BEAST sources", t.source_switch);
+        counter("radar_beast_source_stalls", "Stalls detected on the active BEAST source", t.source_stall);
+        gauge("radar_beast_active_source", "Index of the active BEAST source", beast_active());
+        gauge("radar_beast_packets_per_second", "Frames from the active source in the last second", t.packets_per_second);
+
+        family("radar_beast_source_state", "gauge", "BEAST source connection state (0 disconnected, 1 connected, 2 retry wait, 3 connecting, 4 closed)");
+        for (i = 0; i < beast_sources(); i++) {
+                const beast_source_t *src = beast_source(i);
+
+                emit("radar_beast_source_state{source=\"%d\",addr=\"%s\"} %d\n", i, src->addr, src->constate);
+        }
+
+        /* UDP */
+        gauge("radar_udp_state", "UDP state (0 idle, 1 startup, 2 run, 3 retry wait)", udp_state());
+        counter("radar_udp_network_changes", "UDP restarts on local address or default route changes", t.network_changes);
+        counter("radar_config_changes", "Settings changed by the aggregator", t.config_changes);
+        gauge("radar_uplink_active_path", "Index of the uplink path in use (-O)", udp_active());
+        counter("radar_uplink_switches", "Fail-overs and fail-backs between uplink paths", t.uplink_switch);
+        counter("radar_uplink_dup", "Critical messages also sent on a standby path (-J)", t.uplink_dup);
+
+        family("radar_uplink_path_up", "gauge", "Uplink path healthy");
+        for (i = 0; i < udp_paths(); i++)
+                emit("radar_uplink_path_up{path=\"%d\",name=\"%s\"} %d\n", i, udp_path(i)->name, udp_path(i)->up);
+
+        family("radar_uplink_path_sent", "counter", "Messages sent by uplink path");
+        for (i = 0; i < udp_paths(); i++)
+                emit("radar_uplink_path_sent_total{path=\"%d\"} %llu\n", i, (unsigned long long)udp_path(i)->sent);
+
+        family("radar_uplink_path_errors", "counter", "Send and health check failures by uplink path");
+        for (i = 0; i < udp_paths(); i++)
+                emit("radar_uplink_path_errors_total{path=\"%d\"} %u\n", i, udp_path(i)->errors);
+
+        if (udp_dests()) {
+                family("radar_fanout_sent", "counter", "Messages sent by extra destination (-D)");
+                for (i = 0; i < udp_dests(); i++)
+                        emit("radar_fanout_sent_total{dest=\"%d\",host=\"%s\"} %llu\n", i, udp_dest(i)->host, (unsigned long long)udp_dest(i)->sent);
+
+                family("radar_fanout_filtered", "counter", "Messages and multiframe frames not wanted by extra destination (-D)");
+                for (i = 0; i < udp_dests(); i++)
+                        emit("radar_fanout_filtered_total{dest=\"%d\",host=\"%s\"} %llu\n", i, udp_dest(i)->host, (unsigned long long)udp_dest(i)->filtered);
+
+                family("radar_fanout_shed", "counter", "Copies shed to stay within the uplink budget (-U) by extra destination (-D)");
+                for (i = 0; i < udp_dests(); i++)
+                        emit("radar_fanout_shed_total{dest=\"%d\",host=\"%s\"} %llu\n", i, udp_dest(i)->host, (unsigned long long)udp_dest(i)->shed);
+
+                family("radar_fanout_errors", "counter", "Look-up and send failures by extra destination (-D)");
+                for (i = 0; i < udp_dests(); i++)
+                        emit("radar_fanout_errors_total{dest=\"%d\",host=\"%s\"} %u\n", i, udp_dest(i)->host, udp_dest(i)->errors);
+        }
+
+        if (probe_enabled()) {
+                family("radar_uplink_rtt_seconds", "gauge", "Smoothed uplink round trip time by path (-A), zero if not known");
+                for (i = 0; i < udp_paths(); i++)
+                        emit("radar_uplink_rtt_seconds{path=\"%d\"} %.6f\n", i, probe_rtt(i) / 1e6);
+
+                family("radar_uplink_jitter_seconds", "gauge", "Uplink round trip time jitter by path (-A)");
+                for (i = 0; i < udp_paths(); i++)
+                        emit("radar_uplink_jitter_seconds{path=\"%d\"} %.6f\n", i, probe_jitter(i) / 1e6);
+
+                family("radar_uplink_loss_ratio", "gauge", "Uplink probes lost by path over the last 32 (-A)");
+                for (i = 0; i < udp_paths(); i++)
+                        emit("radar_uplink_loss_ratio{path=\"%d\"} %.3f\n", i, probe_loss(i) / 1e3);
+        }
+
+        if (impair_enabled()) {
+                family("radar_impaired", "counter", "Messages impaired by the network impairment simulator (-X)");
+                for (i = 0; i < IMPAIR_KINDS; i++)
+                        emit("radar_impaired_total{kind=\"%s\"} %llu\n", impair_name(i), (unsigned long long)impair_count(i));
+        }
+
+        /* overload protection */
+        gauge("radar_input_backlog_bytes", "Input queued in the kernel for the active BEAST source", beast_backlog());
+        gauge("radar_overload_level", "Overload degradation level in force (-o), zero if none", t.overload_level);
+        counter("radar_overload_changes", "Overload level changes", t.overload_changes);
+        counter("radar_overload_discarded_bytes", "Input discarded to bound latency under overload", t.overload_discarded);
+
+        /* serial ingest */
+        gauge("radar_serial_low_latency", "ASYNC_LOW_LATENCY set on the serial port", t.serial_low_latency);
+        gauge("radar_serial_latency_timer_seconds", "FTDI latency timer", t.serial_latency_timer / 1e3);
+
+        /* in-process latency */
+        gauge("radar_kernel_timestamps", "Arrival times are kernel receive timestamps", t.kernel_timestamps);
+
+        family("radar_latency_seconds", "summary", "Forwarding pipeline stage latency and event loop lag since start-up");
+        for (i = 0; i < LATENCY_STAGES; i++) {
+                const latency_hist_t *h = latency_total(i);
+                const char *name = latency_name(i);
+
+                emit("radar_latency_seconds{stage=\"%s\",quantile=\"0.5\"} %.9f\n", name, latency_percentile(h, 500) / 1e9);
+                emit("radar_latency_seconds{stage=\"%s\",quantile=\"0.99\"} %.9f\n", name, latency_percentile(h, 990) / 1e9);
+                emit("radar_latency_seconds{stage=\"%s\",quantile=\"0.999\"} %.9f\n", name, latency_percentile(h, 999) / 1e9);
+                emit("radar_latency_seconds_sum{stage=\"%s\"} %.9f\n", name, h->sum / 1e9);
+                emit("radar_latency_seconds_count{stage=\"%s\"} %llu\n", name, (unsigned long long)h->n);
+        }
+
+        gauge("radar_start_time_seconds", "Start-up time of radar", s.start);
+
+        emit("# EOF\n");
+}
+
+
+/*
+ * respond() - build the HTTP response for a complete request
+ */
+static void respond(metrics_client_t *c)
+{
+        char method[8], path[64];
+        const char *status = "200 OK";
+        const char *type = "application/openmetrics-text; version=1.0.0; charset=utf-8";
+
+        if (sscanf(c->req, "%7s %63s", method, path) != 2 || strcmp(method, "GET") != 0) {
+                status = "405 Method Not Allowed";
+                type = "text/plain";
+                bodylen = snprintf(body, sizeof(body), "GET only\n");
+
+        } else if (strcmp(path, "/metrics") == 0 || strcmp(path, "/") == 0) {
+                build_metrics();
+
+        } else if (strcmp(path, "/trace") == 0) {
+                char name[HOSTNAME_LEN+64];
+
+                type = "text/plain";
+
+                if (trace_dump(name, sizeof(name)) == 0) {
+                        bodylen = snprintf(body, sizeof(body), "%s\n", name);
+                } else {
+                        status = "500 Internal Server Error";
+                        bodylen = snprintf(body, sizeof(body), "cannot write %s\n", name);
+                }
+
+        } else {
+                status = "404 Not Found";
+                type = "text/plain";
+                bodylen = snprintf(body, sizeof(body), "not found\n");
+        }
+
+        c->resplen = snprintf(c->resp, sizeof(c->resp),
+                "HTTP/1.0 %s\r\nContent-Type: %s\r\nContent-Length: %d\r\nConnection: close\r\n\r\n", status, type, bodylen);
+
+        bodylen = min(bodylen, (int)sizeof(c->resp) - c->resplen);
+        memcpy(&c->resp[c->resplen], body, bodylen);
+        c->resplen += bodylen;
+        c->sent = 0;
+}
+
+
+/*
+ * drop() - close a client connection
+ */
+static void drop(metrics_client_t *c)
+{
+        close(c->fd);
+        c->fd = 0;
+}
+
+
+/*
+ * do_accept() - accept new clients, refusing them if all slots are busy
+ */
+static void do_accept(void)
+{
+        int fd, i;
+
+        while ((fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) > 0) {
+                for (i = 0; i < METRICS_MAX_CLIENTS; i++) {
+                        if (!clients[i].fd)
+                                break;
+                }
+
+                if (i == METRICS_MAX_CLIENTS) {
+                        close(fd);
+                        continue;
+                }
+
+                memset(&clients[i], 0, offsetof(metrics_client_t, req));
+                clients[i].fd = fd;
+        }
+}
+
+
+/*
+ * do_read() - read request data, respond once we have the end of the headers
+ */
+static void do_read(metrics_client_t *c)
+{
+        int n = read(c->fd, &c->req[c->reqlen], METRICS_REQ_SIZE - c->reqlen);
+
+        if (n <= 0) {
+                if (n == 0 || (errno != EAGAIN && errno != EINTR))
+                        drop(c);
+                return;
+        }
+
+        c->reqlen += n;
+        c->req[c->reqlen] = '\0';
+        c->idle = 0;
+
+        if (strstr(c->req, "\r\n\r\n") || strstr(c->req, "\n\n"))
+                respond(c);
+        else if (c->reqlen >= METRICS_REQ_SIZE)
+                drop(c);
+}
+
+
+/*
+ * do_write() - send as much of the response as the socket will take
+ */
+static void do_write(metrics_client_t *c)
+{
+        int n = write(c->fd, &c->resp[c->sent], c->resplen - c->sent);
+
+        if (n < 0) {
+                if (errno != EAGAIN && errno != EINTR)
+                        drop(c);
+                return;
+        }
+
+        c->sent += n;
+        c->idle = 0;
+
+        if (c->sent >= c->resplen)
+                drop(c);
+}
+
+
+/*
+ * listen_unix() - listen on a unix domain socket
+ */
+static int listen_unix(char *path)
+{
+        struct sockaddr_un uaddr;
+        int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+        if (fd < 0)
+                qerror("metrics_init(): Could not create socket\n");
+
+        memset(&uaddr, 0, sizeof(uaddr));
+        uaddr.sun_family = AF_UNIX;
+        strncpy(uaddr.sun_path, path, sizeof(uaddr.sun_path) - 1);
+        strncpy(sockpath, path, HOSTNAME_LEN);
+
+        unlink(path);
+
+        if (bind(fd, (struct sockaddr *)&uaddr, sizeof(uaddr)) < 0)
+                qerror("metrics_init(): cannot bind to %s: %s (%d)\n", path, strerror(errno), errno);
+
+        return fd;
+}
+
+
+/*
+ * listen_tcp() - listen on a TCP port, "[address:]port"
+ */
+static int listen_tcp(char *spec)
+{
+        struct sockaddr_in saddr;
+        char addr[HOSTNAME_LEN+1] = METRICS_ADDR;
+        char *p;
+        int fd, on = 1;
+
+        memset(&saddr, 0, sizeof(saddr));
+        saddr.sin_family = AF_INET;
+
+        if ((p = strrchr(spec, ':')) != NULL) {
+                snprintf(addr, sizeof(addr), "%.*s", (int)(p - spec), spec);
+                ++p;
+        } else {
+                p = spec;
+        }
+
+        saddr.sin_port = htons((uint16_t)atoi(p));
+
+        if (!atoi(p) || inet_pton(AF_INET, addr, &saddr.sin_addr) != 1)
+                qerror("radar: bad metrics address '%s' (use [address:]port or a path)\n", spec);
+
+        fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+        if (fd < 0)
+                qerror("metrics_init(): Could not create socket\n");
+
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+        if (bind(fd, (struct sockaddr *)&saddr, sizeof(saddr)) < 0)
+                qerror("metrics_init(): cannot bind to %s:%d: %s (%d)\n", addr, ntohs(saddr.sin_port), strerror(errno), errno);
+
+        return fd;
+}
+
+
+/*
+ * metrics_init() - start listening, spec is "[address:]port" or the path of a unix domain socket
+ */
+void metrics_init(char *spec)
+{
+        if (strchr(spec, '/'))
+                listen_fd = listen_unix(spec);
+        else
+                listen_fd = listen_tcp(spec);
+
+        if (listen(listen_fd, METRICS_MAX_CLIENTS) < 0)
+                qerror("metrics_init(): listen failed: %s (%d)\n", strerror(errno), errno);
+
+        if (debug)
+                printf("metrics_init(): listening on %s\n", spec);
+}
+
+
+/*
+ * metrics_poll_setup() - fill in pollfd entries for the listener and clients, returns the count
+ */
+int metrics_poll_setup(struct pollfd *fds)
+{
+        int i, n = 0;
+
+        if (!listen_fd)
+                return 0;
+
+        fds[n].fd = listen_fd;
+        fds[n].events = POLLIN;
+        fds[n].revents = 0;
+        ++n;
+
+        for (i = 0; i < METRICS_MAX_CLIENTS; i++) {
+                if (clients[i].fd) {
+                        fds[n].fd = clients[i].fd;
+                        fds[n].events = clients[i].resplen ? POLLOUT : POLLIN;
+                        fds[n].revents = 0;
+                        ++n;
+                }
+        }
+
+        return n;
+}
+
+
+/*
+ * metrics_poll_events() - handle poll() results for the entries made by metrics_poll_setup()
+ */
+void metrics_poll_events(struct pollfd *fds, int n)
+{
+        int i, j;
+
+        for (i = 0; i < n; i++) {
+                if (!fds[i].revents)
+                        continue;
+
+                if (fds[i].fd == listen_fd) {
+                        do_accept();
+                        continue;
+                }
+
+                for (j = 0; j < METRICS_MAX_CLIENTS; j++) {
+                        metrics_client_t *c = &clients[j];
+
+                        if (c->fd && c->fd == fds[i].fd) {
+                                if (fds[i].revents & (POLLHUP|POLLERR))
+                                        drop(c);
+                                else if (fds[i].revents & POLLOUT)
+                                        do_write(c);
+                                else if (fds[i].revents & POLLIN)
+                                        do_read(c);
+                                break;
+                        }
+                }
+        }
+}
+
+
+/*
+ * metrics_second() - house keeping, drop clients that have gone quiet
+ */
+void metrics_second(void)
+{
+        int i;
+
+        for (i = 0; i < METRICS_MAX_CLIENTS; i++) {
+                if (clients[i].fd && ++clients[i].idle > METRICS_TIMEOUT)
+                        drop(&clients[i]);
+        }
+}
+
+
+/*
+ * metrics_close() - shut down the listener and any clients
+ */
+void metrics_close(void)
+{
+        int i;
+
+        for (i = 0; i < METRICS_MAX_CLIENTS; i++) {
+                if (clients[i].fd)
+                        drop(&clients[i]);
+        }
+
+        if (listen_fd) {
+                close(listen_fd);
+                listen_fd = 0;
+
+                if (sockpath[0])
+                        unlink(sockpath);
+        }
+}
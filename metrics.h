@@ -0,0 +1,42 @@
+/*
+ * metrics.h -- Local metrics endpoint (OpenMetrics over HTTP)
+ * Author: Michael J. Tubby B.Sc. MIET  mike@tubby.org
+ */
+
+#ifndef _METRICS_H
+#define _METRICS_H
+
+#include <stdint.h>
+#include <poll.h>
+
+#define METRICS_MAX_CLIENTS		4		/* concurrent scrapes */
+#define METRICS_REQ_SIZE		1024		/* largest request we accept */
+#define METRICS_BUF_SIZE		65536		/* response buffer per client */
+#define METRICS_TIMEOUT			5		/* close clients idle for this long (seconds) */
+#define METRICS_ADDR			"127.0.0.1"	/* default listen address for a port number */
+
+
+/*
+ * a connected client - request in, response out
+ */
+typedef struct {
+        int fd;						/* socket or zero if slot free */
+        int idle;					/* seconds since last activity */
+        int reqlen;					/* bytes of request read */
+        int resplen;					/* bytes of response to send */
+        int sent;					/* bytes of response sent */
+        char req[METRICS_REQ_SIZE+1];			/* request */
+        char resp[METRICS_BUF_SIZE];			/* response */
+} metrics_client_t;
+
+
+/*
+ * exported functions
+ */
+void metrics_init(char *);
+int metrics_poll_setup(struct pollfd *);
+void metrics_poll_events(struct pollfd *, int);
+void metrics_second(void);
+void metrics_close(void);
+
+#endif
@@ -13,20 +13,15 @@
 #include <stdio.h>
 #include <sys/time.h>
 
+#include "ustime.h"
 #include "mstime.h"
 
 
 /*
- * mstime() - return unix epoc time in milli-seconds
+ * mstime() - return unix epoc time in milli-seconds, from ustime() so
+ * that it follows the virtual clock when replaying a capture
  */
 uint64_t mstime(void)
 {
-        struct timeval tv;
-        uint64_t ms;
-
-        gettimeofday(&tv, NULL);
-
-        ms = (uint64_t)tv.tv_sec * 1000 + (uint64_t)tv.tv_usec / 1000;
-        
-        return ms;
+        return ustime() / 1000;
 }
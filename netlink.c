@@ -0,0 +1,318 @@
+/*
+ * netlink.c -- Immediate UDP recovery on address, route and link changes (rtnetlink)
+ * Author: Michael J. Tubby B.Sc. MIET  mike@tubby.org
+ *
+ * ABSTRACT
+ *
+ * When a router reboots, a 4G modem reconnects or CGNAT hands out a new
+ * address our UDP socket is left sending from an address, or through a NAT
+ * mapping, that no longer exists.  There is often no sendto() error to tell
+ * us, so until now we recovered on SIGHUP, on the -n rebind timer or not at
+ * all, and lost minutes of data.
+ *
+ * The kernel announces these changes on rtnetlink, so we listen in the main
+ * event loop for:
+ *
+ *	RTMGRP_IPV4_IFADDR	an IPv4 address added or removed (not loopback)
+ *				on an interface an uplink path (-O) uses, or
+ *				on any interface without -O
+ *	RTMGRP_IPV4_ROUTE	the default route in the main table added,
+ *				changed or removed
+ *	RTMGRP_LINK		an interface used by an uplink path (-O) going
+ *				up or down
+ *
+ * An address or default route change restarts UDP (udp_restart()): the
+ * sockets are rebuilt at once on the address we have for the aggregator, so
+ * that we send from the new address with a new NAT mapping within
+ * NETLINK_SETTLE of the change, and it is looked up again in the background
+ * in case it has moved too.  Changes come in bursts (an address, then its routes) so we wait
+ * for the burst to finish and restart at most once every NETLINK_HOLDOFF.
+ * A link change only brings the next uplink path health check forward
+ * (udp_recheck()) as the standby paths are unaffected.  If the kernel runs
+ * out of buffer for us (ENOBUFS) we have missed something and restart anyway.
+ *
+ * Nothing here needs privilege.  If the socket can't be opened (some
+ * containers) we carry on without it.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <net/if.h>
+
+#include "radar.h"
+#include "netlink.h"
+#include "udp.h"
+#include "nstime.h"
+#include "qerror.h"
+
+
+/*
+ * external variables
+ */
+extern int debug;
+
+
+/*
+ * local variables
+ */
+static int nl_fd = -1;
+static uint64_t due = 0;				/* time to restart UDP (nS), zero if not needed */
+static uint64_t last = 0;				/* time of the last restart (nS) */
+static const char *why = NULL;				/* first change seen since the last restart */
+
+
+/*
+ * attribute() - find a route attribute in a message, NULL if absent
+ */
+static struct rtattr *attribute(struct rtattr *rta, int len, int type)
+{
+        for (; RTA_OK(rta, len); rta = RTA_NEXT(rta, len))
+                if (rta->rta_type == type)
+                        return rta;
+
+        return NULL;
+}
+
+
+/*
+ * changed() - schedule a UDP restart once the burst of changes has settled
+ */
+static void changed(const char *what)
+{
+        uint64_t now = nstime();
+        uint64_t when = now + NETLINK_SETTLE * 1000000ULL;
+
+        if (last && when < last + NETLINK_HOLDOFF * 1000000ULL)
+                when = last + NETLINK_HOLDOFF * 1000000ULL;
+
+        if (!why)
+                why = what;
+
+        due = when;
+
+        if (debug)
+                printf("netlink: %s, restart UDP in %llu mS\n", what, (unsigned long long)((due - now) / 1000000));
+}
+
+
+/*
+ * on_path() - is an address change on an interface an uplink path (-O) uses, or of a source
+ * address one is bound to - without -O any interface will do
+ */
+static int on_path(struct nlmsghdr *nlh)
+{
+        struct ifaddrmsg *ifa = NLMSG_DATA(nlh);
+        struct rtattr *rta = attribute(IFA_RTA(ifa), IFA_PAYLOAD(nlh), IFA_LOCAL);
+        char ifname[IF_NAMESIZE];
+        int i;
+
+        if (!udp_path(0)->bound)
+                return 1;
+
+        /* an interface that has gone has no name, but its address is still in the message */
+        if (!if_indextoname(ifa->ifa_index, ifname))
+                ifname[0] = '\0';
+
+        for (i = 0; i < udp_paths(); i++) {
+                const udp_path_t *p = udp_path(i);
+
+                if ((ifname[0] && strcmp(p->ifname, ifname) == 0) ||
+                    (rta && p->addr.s_addr != INADDR_ANY && p->addr.s_addr == *(uint32_t *)RTA_DATA(rta)))
+                        return 1;
+        }
+
+        return 0;
+}
+
+
+/*
+ * link_changed() - an interface went up or down, recheck the uplink path on it
+ */
+static void link_changed(struct nlmsghdr *nlh)
+{
+        struct ifinfomsg *ifi = NLMSG_DATA(nlh);
+        struct rtattr *rta = attribute(IFLA_RTA(ifi), IFLA_PAYLOAD(nlh), IFLA_IFNAME);
+        int i;
+
+        if (!rta)
+                return;
+
+        for (i = 0; i < udp_paths(); i++) {
+                if (strcmp(udp_path(i)->ifname, (char *)RTA_DATA(rta)) == 0) {
+                        if (debug)
+                                printf("netlink: link %s %s\n", (char *)RTA_DATA(rta), (ifi->ifi_flags & IFF_RUNNING) ? "running" : "down");
+
+                        udp_recheck();
+                        return;
+                }
+        }
+}
+
+
+/*
+ * message() - act on one rtnetlink message
+ */
+static void message(struct nlmsghdr *nlh)
+{
+        switch (nlh->nlmsg_type) {
+                case RTM_NEWADDR:
+                case RTM_DELADDR: {
+                        struct ifaddrmsg *ifa = NLMSG_DATA(nlh);
+
+                        if (ifa->ifa_family == AF_INET && ifa->ifa_scope != RT_SCOPE_HOST && on_path(nlh))
+                                changed(nlh->nlmsg_type == RTM_NEWADDR ? "address added" : "address removed");
+                        break;
+                }
+
+                case RTM_NEWROUTE:
+                case RTM_DELROUTE: {
+                        struct rtmsg *rtm = NLMSG_DATA(nlh);
+                        struct rtattr *rta = attribute(RTM_RTA(rtm), RTM_PAYLOAD(nlh), RTA_TABLE);
+                        uint32_t table = rta ? *(uint32_t *)RTA_DATA(rta) : rtm->rtm_table;
+
+                        if (rtm->rtm_family == AF_INET && rtm->rtm_dst_len == 0 && table == RT_TABLE_MAIN)
+                                changed(nlh->nlmsg_type == RTM_NEWROUTE ? "default route added" : "default route removed");
+                        break;
+                }
+
+                case RTM_NEWLINK:
+                case RTM_DELLINK:
+                        link_changed(nlh);
+                        break;
+        }
+}
+
+
+/*
+ * netlink_init() - subscribe to address, route and link changes
+ */
+void netlink_init(void)
+{
+        struct sockaddr_nl sa;
+
+        if ((nl_fd = socket(AF_NETLINK, SOCK_RAW | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_ROUTE)) < 0) {
+                qlog("radar: can't open rtnetlink, network changes will not be noticed: %s (%d)\n", strerror(errno), errno);
+                return;
+        }
+
+        memset(&sa, 0, sizeof(sa));
+        sa.nl_family = AF_NETLINK;
+        sa.nl_groups = RTMGRP_IPV4_IFADDR | RTMGRP_IPV4_ROUTE | RTMGRP_LINK;
+
+        if (bind(nl_fd, (struct sockaddr *)&sa, sizeof(sa)) < 0) {
+                qlog("radar: can't bind rtnetlink, network changes will not be noticed: %s (%d)\n", strerror(errno), errno);
+                close(nl_fd);
+                nl_fd = -1;
+        }
+}
+
+
+/*
+ * netlink_poll_setup() - add the netlink socket to the poll() list, returns the number added
+ */
+int netlink_poll_setup(struct pollfd *fds)
+{
+        if (nl_fd < 0)
+                return 0;
+
+        fds->fd = nl_fd;
+        fds->events = POLLIN;
+        fds->revents = 0;
+
+        return 1;
+}
+
+
+/*
+ * netlink_poll_events() - read and act on the changes announced
+ */
+void netlink_poll_events(struct pollfd *fds, int n)
+{
+        static uint8_t buf[NETLINK_BUF_SIZE] __attribute__((aligned(NLMSG_ALIGNTO)));
+        int len;
+
+        if (!n || !fds->revents)
+                return;
+
+        while ((len = recv(nl_fd, buf, sizeof(buf), 0)) != 0) {
+                struct nlmsghdr *nlh;
+
+                if (len < 0) {
+                        /* the kernel dropped messages for us - assume the worst */
+                        if (errno == ENOBUFS)
+                                changed("netlink overrun");
+                        else if (errno == EINTR)
+                                continue;
+
+                        break;
+                }
+
+                for (nlh = (struct nlmsghdr *)buf; NLMSG_OK(nlh, (unsigned)len); nlh = NLMSG_NEXT(nlh, len))
+                        message(nlh);
+        }
+}
+
+
+/*
+ * netlink_timeout() - poll() timeout (mS) no later than a pending UDP restart
+ */
+int netlink_timeout(int ms)
+{
+        uint64_t now;
+
+        if (!due)
+                return ms;
+
+        now = nstime();
+
+        if (due <= now)
+                return 0;
+
+        return (int)min((uint64_t)ms, (due - now + 999999) / 1000000);
+}
+
+
+/*
+ * netlink_check() - restart UDP once the changes have settled, called after every poll()
+ */
+void netlink_check(void)
+{
+        uint64_t now;
+
+        if (!due)
+                return;
+
+        now = nstime();
+
+        if (now < due)
+                return;
+
+        qlog("radar: network change (%s), restarting UDP\n", why);
+
+        due = 0;
+        last = now;
+        why = NULL;
+
+        udp_restart();
+}
+
+
+/*
+ * netlink_close() - stop listening
+ */
+void netlink_close(void)
+{
+        if (nl_fd >= 0) {
+                close(nl_fd);
+                nl_fd = -1;
+        }
+}
@@ -0,0 +1,27 @@
+/*
+ * netlink.h -- Immediate UDP recovery on address, route and link changes (rtnetlink)
+ * Author: Michael J. Tubby B.Sc. MIET  mike@tubby.org
+ */
+
+#ifndef _NETLINK_H
+#define _NETLINK_H
+
+#include <stdint.h>
+#include <poll.h>
+
+#define NETLINK_SETTLE		50			/* wait this long for a burst of changes to finish (milliseconds) */
+#define NETLINK_HOLDOFF		1000			/* least time between restarts (milliseconds) */
+#define NETLINK_BUF_SIZE	16384			/* receive buffer */
+
+
+/*
+ * exported functions
+ */
+void netlink_init(void);
+int netlink_poll_setup(struct pollfd *);
+void netlink_poll_events(struct pollfd *, int);
+int netlink_timeout(int);
+void netlink_check(void);
+void netlink_close(void);
+
+#endif
@@ -0,0 +1,28 @@
+/*
+ * nstime() - return monotonic time in nano-seconds
+ * Author: Michael J. Tubby mike{@tubby.org
+ *
+ * Used for measuring short intervals inside radar so it uses the monotonic
+ * clock rather than wall clock time which may be stepped by NTP.  The value
+ * has no fixed origin and must only be used for differences.
+ *
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "nstime.h"
+
+
+/*
+ * nstime() - return monotonic time in nano-seconds
+ */
+uint64_t nstime(void)
+{
+        struct timespec ts;
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+
+        return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
@@ -0,0 +1,13 @@
+/*
+ * nstime.h -- header file for monotonic nano-seconds time
+ * Author: Michael J Tubby
+ */
+
+#ifndef _NSTIME_H
+#define _NSTIME_H
+
+#include <stdint.h>
+
+uint64_t nstime(void);
+
+#endif
@@ -0,0 +1,180 @@
+/*
+ * overload.c -- CPU overload protection: input backlog, loop lag and graceful degradation
+ * Author: Michael J. Tubby B.Sc. MIET  mike@tubby.org
+ *
+ * ABSTRACT
+ *
+ * On a slow SBC, or one that is thermally throttling, radar can fall behind
+ * its receiver.  Nothing fails: the kernel socket buffer in front of the
+ * BEAST connection fills and every frame is forwarded a little later than
+ * the one before.  With -o <bytes>[:<ms>] we watch for this once a second:
+ *
+ *	backlog		input queued in the kernel for the active source
+ *			(beast_backlog(), FIONREAD/SIOCINQ on the socket)
+ *	loop lag	how late the event loop timers fired (latency_lag())
+ *
+ * If either is over its threshold we step down one level, each one doing
+ * less work per frame than the last:
+ *
+ *	1  Mode-S short and Mode-A/C are not forwarded
+ *	2  only ES identification, position and velocity are forwarded
+ *	3  multiframe sending is forced on (one signature and sendto() per batch)
+ *	4  the multiframe interval is widened to OVERLOAD_INTERVAL and any backlog
+ *	   over the threshold is discarded so that latency stays bounded
+ *
+ * radar has no error correction of its own to give up (CRCs are checked by
+ * readsb/dump1090 or the Beast hardware) so level 2 is where it stops doing
+ * per-frame work on frames that the aggregator can do without.
+ *
+ * We step back up one level after OVERLOAD_HOLD seconds in a row with the
+ * backlog under a quarter and the lag under half of their thresholds.  Every
+ * change is logged, recorded in the trace ring and telemetry, and brings the
+ * next telemetry report forward so that it is seen at the aggregator.
+ *
+ * The caller (house_keeping() in radar.c) applies the level returned by
+ * overload_second() to its forwarding settings.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "overload.h"
+#include "beast.h"
+#include "telemetry.h"
+#include "trace.h"
+#include "probes.h"
+#include "qerror.h"
+
+
+/*
+ * external variables
+ */
+extern int debug;
+
+
+/*
+ * local variables
+ */
+static int enabled = 0;
+static int backlog_limit = OVERLOAD_BACKLOG;		/* bytes */
+static uint64_t lag_limit = OVERLOAD_LAG * 1000000ULL;	/* nS */
+static uint64_t lag_max = 0;				/* worst loop lag this second (nS) */
+static int level = OVERLOAD_NONE;
+static int calm = 0;					/* seconds in a row under the thresholds */
+
+static const char *names[OVERLOAD_LEVELS] = {
+        "normal", "no-ss-ac", "essential", "multiframe", "batch"
+};
+
+
+/*
+ * change() - move to a new level and tell everyone
+ */
+static void change(int new, int backlog, uint64_t lag)
+{
+        qlog("radar: overload level %d (%s), was %d (%s): input backlog %d bytes, loop lag %llu mS\n",
+                new, names[new], level, names[level], backlog, (unsigned long long)(lag / 1000000));
+
+        PROBE3(overload_level, level, new, backlog);
+        trace_event(TRACE_EV_OVERLOAD, 0, new);
+
+        level = new;
+        calm = 0;
+
+        telemetry.overload_level = new;
+        ++telemetry.overload_changes;
+        telemetry_soon();
+}
+
+
+/*
+ * overload_init() - enable overload protection with backlog (bytes) and loop lag (mS)
+ * thresholds, zero for the defaults
+ */
+void overload_init(int backlog, int lag)
+{
+        enabled = 1;
+
+        if (backlog)
+                backlog_limit = backlog;
+
+        if (lag)
+                lag_limit = lag * 1000000ULL;
+}
+
+
+/*
+ * overload_lag() - note how late an event loop timer fired (nS)
+ */
+void overload_lag(uint64_t ns)
+{
+        if (ns > lag_max)
+                lag_max = ns;
+}
+
+
+/*
+ * overload_second() - measure and step the level up or down, called once a second,
+ * returns the level to apply
+ */
+int overload_second(void)
+{
+        int backlog;
+        uint64_t lag = lag_max;
+
+        lag_max = 0;
+
+        if (!enabled)
+                return OVERLOAD_NONE;
+
+        backlog = beast_backlog();
+
+        if ((uint32_t)backlog > telemetry.backlog_max)
+                telemetry.backlog_max = backlog;
+
+        if (lag / 1000 > telemetry.loop_lag_max)
+                telemetry.loop_lag_max = (uint32_t)(lag / 1000);
+
+        if (debug > 1)
+                printf("overload_second(): level %d backlog %d lag %llu uS\n", level, backlog, (unsigned long long)(lag / 1000));
+
+        if (backlog > backlog_limit || lag > lag_limit) {
+                if (level < OVERLOAD_BATCH) {
+                        change(level + 1, backlog, lag);
+                } else if (backlog > backlog_limit) {
+                        /* nothing left to give up - drop what is over the threshold rather than fall further behind */
+                        telemetry.overload_discarded += beast_discard(backlog - backlog_limit);
+                }
+
+                calm = 0;
+
+        } else if (level && backlog < backlog_limit / 4 && lag < lag_limit / 2) {
+                if (++calm >= OVERLOAD_HOLD)
+                        change(level - 1, backlog, lag);
+
+        } else {
+                calm = 0;
+        }
+
+        return level;
+}
+
+
+/*
+ * overload_level() - level in force
+ */
+int overload_level(void)
+{
+        return level;
+}
+
+
+/*
+ * overload_name() - short name of a level
+ */
+const char *overload_name(int n)
+{
+        return (n >= 0 && n < OVERLOAD_LEVELS) ? names[n] : "?";
+}
@@ -0,0 +1,39 @@
+/*
+ * overload.h -- CPU overload protection: input backlog, loop lag and graceful degradation
+ * Author: Michael J. Tubby B.Sc. MIET  mike@tubby.org
+ */
+
+#ifndef _OVERLOAD_H
+#define _OVERLOAD_H
+
+#include <stdint.h>
+
+#define OVERLOAD_BACKLOG	32768			/* default input backlog threshold (bytes) */
+#define OVERLOAD_LAG		100			/* default event loop lag threshold (mS) */
+#define OVERLOAD_HOLD		10			/* seconds under the thresholds before stepping back down */
+#define OVERLOAD_INTERVAL	250			/* multiframe interval at the widest batching (mS) */
+
+
+/*
+ * degradation levels, each includes those below it
+ */
+enum overload_level {
+        OVERLOAD_NONE,					/* normal operation */
+        OVERLOAD_NO_SS_AC,				/* Mode-S short and Mode-A/C not forwarded */
+        OVERLOAD_ESSENTIAL,				/* only ES identification, position and velocity forwarded */
+        OVERLOAD_MULTIFRAME,				/* multiframe sending forced on */
+        OVERLOAD_BATCH,					/* multiframe interval widened, backlog beyond the threshold discarded */
+        OVERLOAD_LEVELS
+};
+
+
+/*
+ * exported functions
+ */
+void overload_init(int, int);
+void overload_lag(uint64_t);
+int overload_second(void);
+int overload_level(void);
+const char *overload_name(int);
+
+#endif
@@ -0,0 +1,310 @@
+/*
+ * probe.c -- Uplink RTT, jitter and loss probing over CONFIG_REQ/ACK
+ * Author: Michael J. Tubby B.Sc. MIET  mike@tubby.org
+ *
+ * ABSTRACT
+ *
+ * Everything we send is fire and forget, so until now we had no idea what
+ * the uplink was like: how long messages take, how much that varies and how
+ * many are lost.  With -A [<ms>] we send a small probe on every uplink path
+ * (opcode CONFIG_REQ, type RADAR_CONFIG_PROBE) once a second, or every <ms>,
+ * and the aggregator sends it straight back with the CONFIG_ACK opcode and an
+ * auth tag made with our pass-phrase.  radar-sink answers in the same way so
+ * a local stand-in can be used for testing.  For each path we keep:
+ *
+ *	RTT	smoothed round trip time, an EWMA with gain 1/8 as TCP does
+ *	jitter	the mean difference between successive round trips, with
+ *		gain 1/16 as RTP does (RFC 3550)
+ *	loss	probes not answered within PROBE_TIMEOUT out of the last
+ *		PROBE_WINDOW
+ *
+ * which go in the telemetry and metrics.  The echo is matched to a probe we
+ * are waiting for and checked against our own send time, so an old or forged
+ * echo can't fake a measurement.
+ *
+ * The results drive two decisions.  A path whose last PROBE_SILENT probes
+ * have gone unanswered, while another path's probes are being answered, is
+ * marked silent (udp_path_silent()) so that its health check fails and we
+ * fail over to, or stay off, it - a broken path behind CGNAT is otherwise
+ * invisible.  If every path goes quiet we can't tell a dead uplink from a
+ * dead aggregator so nothing is marked.  With -I the multiframe interval
+ * follows the round trip time of the path in use (see radar.c).
+ *
+ * An aggregator that doesn't answer probes costs us only the probes.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "radar.h"
+#include "probe.h"
+#include "udp.h"
+#include "telemetry.h"
+#include "nstime.h"
+
+
+/*
+ * external variables
+ */
+extern int debug;
+
+
+/*
+ * state of a probe
+ */
+enum probe_state {
+        PROBE_EMPTY,
+        PROBE_PENDING,
+        PROBE_ANSWERED,
+        PROBE_LOST
+};
+
+
+/*
+ * a probe sent
+ */
+typedef struct {
+        uint32_t id;
+        uint64_t sent;					/* nS */
+        uint8_t state;					/* enum probe_state */
+} slot_t;
+
+
+/*
+ * what we know about a path
+ */
+typedef struct {
+        slot_t ring[PROBE_WINDOW];			/* the last PROBE_WINDOW probes */
+        uint32_t n;					/* probes sent */
+        uint64_t srtt;					/* smoothed round trip time (nS) */
+        uint64_t jitter;				/* nS */
+        uint64_t last_rtt;
+        int answered;					/* an echo has ever come back */
+        int lost_run;					/* probes lost in a row */
+} path_t;
+
+
+/*
+ * local variables
+ */
+static int interval = 0;				/* mS between probes, zero if off */
+static uint64_t next = 0;				/* time of the next round of probes (nS) */
+static uint32_t next_id = 1;
+static path_t paths[UDP_MAX_PATHS];
+
+
+/*
+ * expire() - probes not answered in time are lost, and paths that have lost too many in a
+ * row while another is being answered are silent
+ */
+static void expire(uint64_t now)
+{
+        int i, j, npaths = min(udp_paths(), UDP_MAX_PATHS);
+
+        for (i = 0; i < npaths; i++) {
+                for (j = 0; j < PROBE_WINDOW; j++) {
+                        slot_t *s = &paths[i].ring[j];
+
+                        if (s->state == PROBE_PENDING && now - s->sent > PROBE_TIMEOUT * 1000000ULL) {
+                                s->state = PROBE_LOST;
+                                ++paths[i].lost_run;
+                        }
+                }
+        }
+
+        for (i = 0; i < npaths; i++) {
+                int others = 0;
+
+                for (j = 0; j < npaths; j++)
+                        if (j != i && paths[j].answered && paths[j].lost_run == 0)
+                                ++others;
+
+                udp_path_silent(i, paths[i].lost_run >= PROBE_SILENT && others);
+        }
+}
+
+
+/*
+ * probe_init() - probe every uplink path every ms milliseconds
+ */
+void probe_init(int ms)
+{
+        interval = ms;
+        next = nstime();
+}
+
+
+/*
+ * probe_enabled() - are we probing?
+ */
+int probe_enabled(void)
+{
+        return interval > 0;
+}
+
+
+/*
+ * probe_check() - send the probes that are due and expire those not answered, called
+ * after every poll()
+ */
+void probe_check(void)
+{
+        int i, npaths = min(udp_paths(), UDP_MAX_PATHS);
+        uint64_t now;
+
+        if (!interval)
+                return;
+
+        now = nstime();
+
+        if (now < next)
+                return;
+
+        next = now + interval * 1000000ULL;
+        expire(now);
+
+        for (i = 0; i < npaths; i++) {
+                path_t *p = &paths[i];
+                slot_t *s = &p->ring[p->n++ % PROBE_WINDOW];
+
+                /* still waiting for the one we are about to forget */
+                if (s->state == PROBE_PENDING)
+                        ++p->lost_run;
+
+                s->id = next_id++;
+                s->sent = now;
+                s->state = radar_send_probe(i, s->id, now) ? PROBE_PENDING : PROBE_EMPTY;
+        }
+}
+
+
+/*
+ * probe_timeout() - poll() timeout (mS) no later than the next round of probes
+ */
+int probe_timeout(int ms)
+{
+        uint64_t now;
+
+        if (!interval)
+                return ms;
+
+        now = nstime();
+
+        if (next <= now)
+                return 0;
+
+        return (int)min((uint64_t)ms, (next - now + 999999) / 1000000);
+}
+
+
+/*
+ * probe_reply() - an echo of one of our probes has come back on a path
+ */
+void probe_reply(int path, const radar_probe_t *msg)
+{
+        uint64_t rtt, d;
+        path_t *p;
+        int j;
+
+        if (!interval || path < 0 || path >= UDP_MAX_PATHS || msg->path != path)
+                return;
+
+        p = &paths[path];
+
+        for (j = 0; j < PROBE_WINDOW && !(p->ring[j].id == msg->id && p->ring[j].state == PROBE_PENDING); j++)
+                ;
+
+        /* not one we are waiting for - late, answered already or not ours */
+        if (j == PROBE_WINDOW || p->ring[j].sent != msg->sent)
+                return;
+
+        rtt = nstime() - p->ring[j].sent;
+        p->ring[j].state = PROBE_ANSWERED;
+
+        if (!p->answered) {
+                p->srtt = rtt;
+                p->jitter = 0;
+        } else {
+                p->srtt = (p->srtt * 7 + rtt) / 8;
+                d = (rtt > p->last_rtt) ? rtt - p->last_rtt : p->last_rtt - rtt;
+                p->jitter = (p->jitter * 15 + d) / 16;
+        }
+
+        p->last_rtt = rtt;
+        p->answered = 1;
+        p->lost_run = 0;
+
+        if (debug > 1)
+                printf("probe_reply(): path %d probe %u RTT %llu uS\n", path, msg->id, (unsigned long long)(rtt / 1000));
+
+        /* a silent path that answers again can be used again */
+        udp_path_silent(path, 0);
+}
+
+
+/*
+ * probe_rtt() - smoothed round trip time on a path (uS), zero if not known
+ */
+uint32_t probe_rtt(int path)
+{
+        if (path < 0 || path >= UDP_MAX_PATHS || !paths[path].answered)
+                return 0;
+
+        return (uint32_t)min(paths[path].srtt / 1000, UINT32_MAX);
+}
+
+
+/*
+ * probe_jitter() - round trip time jitter on a path (uS)
+ */
+uint32_t probe_jitter(int path)
+{
+        if (path < 0 || path >= UDP_MAX_PATHS)
+                return 0;
+
+        return (uint32_t)min(paths[path].jitter / 1000, UINT32_MAX);
+}
+
+
+/*
+ * probe_loss() - probes lost out of the last PROBE_WINDOW that have been answered or timed
+ * out on a path (per mille)
+ */
+uint32_t probe_loss(int path)
+{
+        int j, lost = 0, done = 0;
+
+        if (path < 0 || path >= UDP_MAX_PATHS)
+                return 0;
+
+        for (j = 0; j < PROBE_WINDOW; j++) {
+                if (paths[path].ring[j].state == PROBE_LOST)
+                        ++lost;
+
+                if (paths[path].ring[j].state == PROBE_ANSWERED || paths[path].ring[j].state == PROBE_LOST)
+                        ++done;
+        }
+
+        return done ? lost * 1000 / done : 0;
+}
+
+
+/*
+ * probe_second() - copy the measurements into the telemetry
+ */
+void probe_second(void)
+{
+        int i, npaths = min(udp_paths(), UDP_MAX_PATHS);
+
+        if (!interval)
+                return;
+
+        for (i = 0; i < npaths && i < UDP_MAX_PATHS; i++) {
+                telemetry.probe_rtt[i] = probe_rtt(i);
+                telemetry.probe_jitter[i] = probe_jitter(i);
+                telemetry.probe_loss[i] = probe_loss(i);
+        }
+}
@@ -0,0 +1,33 @@
+/*
+ * probe.h -- Uplink RTT, jitter and loss probing over CONFIG_REQ/ACK
+ * Author: Michael J. Tubby B.Sc. MIET  mike@tubby.org
+ */
+
+#ifndef _PROBE_H
+#define _PROBE_H
+
+#include <stdint.h>
+
+#include "radar.h"
+
+#define PROBE_INTERVAL		1000			/* default time between probes on each path (milliseconds) */
+#define PROBE_INTERVAL_MIN	100			/* shortest we allow */
+#define PROBE_WINDOW		32			/* probes loss is measured over */
+#define PROBE_TIMEOUT		2000			/* a probe not answered in this long is lost (milliseconds) */
+#define PROBE_SILENT		3			/* probes lost in a row before a path is treated as silent */
+
+
+/*
+ * exported functions
+ */
+void probe_init(int);
+int probe_enabled(void);
+void probe_check(void);
+int probe_timeout(int);
+void probe_reply(int, const radar_probe_t *);
+uint32_t probe_rtt(int);
+uint32_t probe_jitter(int);
+uint32_t probe_loss(int);
+void probe_second(void);
+
+#endif
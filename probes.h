@@ -0,0 +1,59 @@
+/*
+ * probes.h -- USDT (SystemTap/DTrace compatible) static probes
+ * Author: Michael J. Tubby B.Sc. MIET  mike@tubby.org
+ *
+ * Probes at the decision points in the forwarding path give bpftrace, perf
+ * and SystemTap stable attach points that survive -O2 builds and inlining,
+ * unlike uprobes on static functions.  An unused probe is a single nop in
+ * the code plus a note in the ELF file so they are left in production builds.
+ *
+ * The probes are compiled in when <sys/sdt.h> is available (Debian/Ubuntu:
+ * systemtap-sdt-dev) and are no-ops otherwise or with -DRADAR_NO_PROBES.
+ * Provider is "radar" - list them with:
+ *
+ *	bpftrace -l 'usdt:/usr/sbin/radar:*'
+ *
+ * Probe			Arguments
+ *
+ * frame_received		frame length, DF, RSSI, arrival time (uS)
+ * dupe_hit			frame length
+ * dupe_miss			frame length
+ * packet_signed		sequence number, opcode, message size
+ * packet_sent			message size
+ * packet_failed		message size, errno (0 if UDP not running)
+ * multiframe_flush		frame count, sequence number, holding time of oldest frame (nS)
+ * beast_state			source index, old state, new state (enum beast_state)
+ * source_switch		old source index, new source index
+ * udp_state			old state, new state (enum udpstate)
+ * dedup_clean			SS entries removed, ES entries removed, time taken (uS)
+ * frame_shed			class (enum udp_class), bytes it would have cost
+ * overload_level		old level, new level (enum overload_level), input backlog (bytes)
+ * uplink_switch		old uplink path index, new uplink path index
+ *
+ * Example scripts are in the bpftrace directory.
+ *
+ */
+
+#ifndef _PROBES_H
+#define _PROBES_H
+
+#if !defined(RADAR_NO_PROBES) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define RADAR_PROBES
+#endif
+#endif
+
+#ifdef RADAR_PROBES
+#define PROBE1(name, a)			DTRACE_PROBE1(radar, name, a)
+#define PROBE2(name, a, b)		DTRACE_PROBE2(radar, name, a, b)
+#define PROBE3(name, a, b, c)		DTRACE_PROBE3(radar, name, a, b, c)
+#define PROBE4(name, a, b, c, d)	DTRACE_PROBE4(radar, name, a, b, c, d)
+#else
+#define PROBE1(name, a)			do { (void)(a); } while (0)
+#define PROBE2(name, a, b)		do { (void)(a); (void)(b); } while (0)
+#define PROBE3(name, a, b, c)		do { (void)(a); (void)(b); (void)(c); } while (0)
+#define PROBE4(name, a, b, c, d)	do { (void)(a); (void)(b); (void)(c); (void)(d); } while (0)
+#endif
+
+#endif
@@ -0,0 +1,831 @@
+/*
+ * radar-harness.c -- End-to-end loopback throughput harness for radar
+ * Author: Michael J. Tubby B.Sc. MIET  mike@tubby.org
+ *
+ *
+ * ABSTRACT
+ *
+ * Finds the highest frame rate a feeder can forward before it falls behind.
+ * The harness plays the part of readsb, serving generated BEAST traffic on a
+ * TCP port (or a unix socket, a named pipe or radar's standard input) for
+ * radar to read, and of the aggregator, receiving radar's
+ * UDP messages on port 5997, checking their authentication tags and matching
+ * the frames in them with the frames that were sent.
+ *
+ * The rate starts low and is stepped up; each step generates traffic for a
+ * few seconds and then pauses to let radar drain before it is scored:
+ *
+ *	loss	unique DF17 frames sent that were not forwarded (these are sent
+ *		whatever the -m/-y/-e settings so they are what is checked)
+ *	latency	BEAST write to UDP receive, the send time is carried in the
+ *		MLAT timestamp field which radar passes through untouched
+ *	CPU	radar's user+system time per frame sent from /proc/<pid>/stat
+ *
+ * It stops at the first step with more loss than the limit, a p99 latency
+ * over the limit or where radar did not read the BEAST stream fast enough
+ * for the harness to write it, and reports the last rate that passed.
+ *
+ * The traffic mix is DF17 extended squitters from a set of aircraft, DF11/4/5
+ * short squitters and Mode-A/C, with a proportion of the DF17 frames repeated
+ * (as a second antenna path or a retransmission would) for radar to remove
+ * as duplicates.  The "escape density" is the chance of each parity and RSSI
+ * byte being 0x1A so it has to be escaped and burstiness sends the frames in
+ * groups rather than spread evenly.
+ *
+ *
+ * USAGE
+ *
+ *	radar-harness [options] [-- radar -r 127.0.0.1 -h 127.0.0.1 ...]
+ *
+ * where:
+ *
+ *	-l <port>	  TCP port to serve BEAST on (default 30005)
+ *	-l unix:<path>	  serve BEAST on a unix domain socket instead
+ *	-l fifo:<path>	  write BEAST to a named pipe instead
+ *	-l -		  write BEAST to radar's standard input (needs "--")
+ *	-k <key>	  check messages carry this sharing key
+ *	-p <pass-phrase>  pass-phrase radar is using (default "secret")
+ *	-c <pid>	  radar process to measure CPU of if not started by the harness
+ *	-r <fps>	  starting rate in frames per second (default 1000)
+ *	-R <fps>	  highest rate to try (default 1000000)
+ *	-s <factor>	  multiply the rate by this each step (default 1.5)
+ *	-t <seconds>	  length of each step (default 5)
+ *	-n <aircraft>	  number of aircraft (default 200)
+ *	-D <percent>	  DF17 frames that are duplicates (default 30)
+ *	-S <percent>	  short squitters in the mix (default 35)
+ *	-A <percent>	  Mode-A/C in the mix (default 5)
+ *	-E <percent>	  escape density (default 2)
+ *	-b <frames>	  burst size (default 1 - evenly spread)
+ *	-L <percent>	  loss limit (default 0.1)
+ *	-P <ms>		  p99 latency limit (default 500)
+ *
+ * Anything after "--" is run as radar, stopped at the end and measured; add "-m"
+ * "-y" or "-e" there to compare.  Otherwise start radar pointing at this host
+ * ("-r 127.0.0.1 -h 127.0.0.1", plus ":<port>" with "-l") and give its pid
+ * with "-c" for the CPU figures.
+ *
+ * Running the same steps with "-l unix:/tmp/beast.sock" and radar's
+ * "-l unix:/tmp/beast.sock", with "-l fifo:..." or with "-l -" and radar's
+ * "-l -" compares the local source types with the loopback TCP connection.
+ *
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/timerfd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include "defs.h"
+#include "radar.h"
+#include "beast.h"
+#include "udp.h"
+#include "authtag.h"
+#include "latency.h"
+#include "nstime.h"
+
+
+#define HARNESS_TICK		1000000		/* generator tick (nS) */
+#define HARNESS_OUT_SIZE	(4 << 20)	/* BEAST output buffer, full means radar is not keeping up */
+#define HARNESS_RCVBUF		(8 << 20)	/* UDP receive buffer */
+#define HARNESS_DRAIN		1000		/* pause after each step (mS) plus the latency limit */
+#define HARNESS_CONNECT_WAIT	15		/* seconds to wait for radar to connect */
+#define HARNESS_RECENT		64		/* DF17 frames that duplicates are taken from */
+
+#define HARNESS_TCP		0		/* -l <port> */
+#define HARNESS_UNIX		1		/* -l unix:<path> */
+#define HARNESS_FIFO		2		/* -l fifo:<path> */
+#define HARNESS_STDIN		3		/* -l - */
+
+#define MLAT_DUPE		0x800000000000ULL	/* MLAT field: frame is a duplicate */
+#define MLAT_STEP_SHIFT		40			/* MLAT field: step number (7 bits) */
+#define MLAT_TIME_MASK		0xFFFFFFFFFFULL		/* MLAT field: send time (uS) */
+
+
+int debug = 0;					/* for authtag.c */
+
+
+/*
+ * per step counters
+ */
+typedef struct {
+        double rate;				/* target frames per second */
+        uint64_t sent;				/* frames written */
+        uint64_t sent_es;			/* unique DF17 written */
+        uint64_t sent_dupe;			/* duplicate DF17 written */
+        uint64_t stalled;			/* frames not written as the buffer was full */
+        uint64_t recv;				/* frames received */
+        uint64_t recv_es;			/* unique DF17 received */
+        uint64_t recv_dupe;			/* duplicates that were forwarded */
+        uint64_t late;				/* frames received after their step was scored */
+        uint64_t msgs;				/* UDP messages */
+        uint64_t bad;				/* bad authentication tag, key or length */
+        uint64_t cpu;				/* radar CPU time (uS) */
+        uint64_t ns;				/* time spent generating (nS) */
+        latency_hist_t lat;			/* DF17 end-to-end latency */
+} step_t;
+
+
+static int beast_type = HARNESS_TCP;
+static int beast_port = BEAST_TCP_PORT;
+static char *beast_path = NULL;
+static uint64_t check_key = 0;
+static pid_t radar_pid = 0;
+static int child = 0;
+static double rate_start = 1000;
+static double rate_max = 1000000;
+static double rate_step = 1.5;
+static int step_secs = 5;
+static int aircraft = 200;
+static int pct_dupe = 30;
+static int pct_ss = 35;
+static int pct_ac = 5;
+static int pct_esc = 2;
+static int burst = 1;
+static double loss_limit = 0.1;
+static int p99_limit = 500;
+
+static int listen_fd = -1;
+static int beast_fd = -1;
+static int stdin_fd = -1;			/* read end of the pipe for radar's stdin */
+static int udp_fd = -1;
+static int timer_fd = -1;
+static uint8_t out[HARNESS_OUT_SIZE];
+static int out_head = 0, out_tail = 0;
+static uint8_t recent[HARNESS_RECENT][MODE_ES_LEN];
+static int nrecent = 0;
+static uint32_t counter = 0;
+static uint32_t rnd = 0x1090;
+static uint64_t epoch;
+static int step = 0;
+static step_t cur;
+static volatile int ending = 0;
+
+
+/*
+ * next() - cheap repeatable pseudo-random numbers
+ */
+static uint32_t next(void)
+{
+        rnd = rnd * 1664525 + 1013904223;
+        return rnd >> 8;
+}
+
+
+/*
+ * chance() - true percent% of the time
+ */
+static int chance(int percent)
+{
+        return (int)(next() % 100) < percent;
+}
+
+
+/*
+ * put() - add a byte to the BEAST output doubling an Escape
+ */
+static void put(uint8_t b)
+{
+        out[out_tail++] = b;
+
+        if (b == BEAST_ESC)
+                out[out_tail++] = b;
+}
+
+
+/*
+ * parity() - a parity/CRC byte, sometimes an Escape
+ */
+static uint8_t parity(void)
+{
+        return chance(pct_esc) ? BEAST_ESC : (uint8_t)next();
+}
+
+
+/*
+ * generate() - write one frame to the output buffer, returns zero if there is no room
+ */
+static int generate(void)
+{
+        uint8_t data[MODE_ES_LEN];
+        uint64_t mlat;
+        int i, type, len, r;
+
+        if (out_tail + 2 * (2 + MLAT_LEN + 1 + MODE_ES_LEN) > HARNESS_OUT_SIZE) {
+                if (out_head == 0)
+                        return 0;
+
+                memmove(out, &out[out_head], out_tail - out_head);
+                out_tail -= out_head;
+                out_head = 0;
+
+                if (out_tail + 2 * (2 + MLAT_LEN + 1 + MODE_ES_LEN) > HARNESS_OUT_SIZE)
+                        return 0;
+        }
+
+        mlat = ((uint64_t)step << MLAT_STEP_SHIFT) | (((nstime() - epoch) / 1000) & MLAT_TIME_MASK);
+        r = next() % 100;
+
+        if (r < pct_ac) {
+                type = 0x31;
+                len = MODE_AC_LEN;
+                data[0] = next();
+                data[1] = next();
+
+        } else if (r < pct_ac + pct_ss) {
+                static const uint8_t df[] = { 11, 4, 5 };
+                uint32_t icao = 0x400000 + next() % aircraft;
+
+                type = 0x32;
+                len = MODE_SS_LEN;
+                data[0] = (df[next() % 3] << 3) | 5;
+                data[1] = icao >> 16;
+                data[2] = icao >> 8;
+                data[3] = icao;
+                data[4] = counter >> 16;		/* unique within the duplicate window */
+                data[5] = counter >> 8;
+                data[6] = counter;
+                ++counter;
+
+        } else if (nrecent && chance(pct_dupe)) {
+                type = 0x33;
+                len = MODE_ES_LEN;
+                memcpy(data, recent[next() % nrecent], MODE_ES_LEN);
+                mlat |= MLAT_DUPE;
+                ++cur.sent_dupe;
+
+        } else {
+                uint32_t icao = 0x400000 + next() % aircraft;
+
+                type = 0x33;
+                len = MODE_ES_LEN;
+                data[0] = (17 << 3) | 5;		/* DF17 CA5 */
+                data[1] = icao >> 16;
+                data[2] = icao >> 8;
+                data[3] = icao;
+                data[4] = (11 << 3);			/* airborne position */
+                data[5] = counter >> 24;		/* unique within the duplicate window */
+                data[6] = counter >> 16;
+                data[7] = counter >> 8;
+                data[8] = counter;
+                data[9] = next();
+                data[10] = next();
+                data[11] = parity();
+                data[12] = parity();
+                data[13] = parity();
+                ++counter;
+
+                memcpy(recent[nrecent < HARNESS_RECENT ? nrecent++ : next() % HARNESS_RECENT], data, MODE_ES_LEN);
+                ++cur.sent_es;
+        }
+
+        out[out_tail++] = BEAST_ESC;
+        out[out_tail++] = type;
+
+        for (i=MLAT_LEN-1; i>=0; --i)
+                put(mlat >> (8 * i));
+
+        put(chance(pct_esc) ? BEAST_ESC : 0x80 + next() % 0x60);	/* RSSI */
+
+        for (i=0; i<len; ++i)
+                put(data[i]);
+
+        ++cur.sent;
+
+        return 1;
+}
+
+
+/*
+ * flush() - write as much of the output buffer as radar will take
+ */
+static void flush(void)
+{
+        while (beast_fd >= 0 && out_head < out_tail) {
+                int rc = write(beast_fd, &out[out_head], out_tail - out_head);
+
+                if (rc > 0) {
+                        out_head += rc;
+                } else {
+                        if (rc < 0 && errno != EAGAIN && errno != EINTR) {
+                                fprintf(stderr, "radar-harness: BEAST connection lost: %s\n", strerror(errno));
+                                ending = 1;
+                        }
+                        break;
+                }
+        }
+
+        if (out_head == out_tail)
+                out_head = out_tail = 0;
+}
+
+
+/*
+ * frame() - account for one frame received from radar
+ */
+static void frame(const uint8_t *mlat, const uint8_t *data, int len)
+{
+        uint64_t m = 0, now = (nstime() - epoch) / 1000;
+        int i;
+
+        for (i=0; i<MLAT_LEN; ++i)
+                m = (m << 8) | mlat[i];
+
+        if ((int)((m >> MLAT_STEP_SHIFT) & 0x7F) != (step & 0x7F)) {
+                ++cur.late;
+                return;
+        }
+
+        ++cur.recv;
+
+        if (m & MLAT_DUPE) {
+                ++cur.recv_dupe;
+
+        } else if (len == MODE_ES_LEN && (data[0] >> 3) == 17) {
+                ++cur.recv_es;
+                latency_add(&cur.lat, ((now - (m & MLAT_TIME_MASK)) & MLAT_TIME_MASK) * 1000);
+        }
+}
+
+
+/*
+ * receive() - read and check radar's UDP messages
+ */
+static void receive(void)
+{
+        uint8_t buf[2048];
+        int len;
+
+        while ((len = recv(udp_fd, buf, sizeof(buf), MSG_DONTWAIT)) > 0) {
+                radar_msg_t *mp = (radar_msg_t *)buf;
+                uint64_t key;
+
+                ++cur.msgs;
+
+                if (len < (int)sizeof(radar_msg_t) + AUTHTAG_LEN || !authtag_check(&buf[len - AUTHTAG_LEN], AUTHTAG_LEN, buf, len - AUTHTAG_LEN)) {
+                        ++cur.bad;
+                        continue;
+                }
+
+                memcpy(&key, &mp->key, sizeof(key));
+
+                if (check_key && key != check_key) {
+                        ++cur.bad;
+                        continue;
+                }
+
+                switch (mp->opcode) {
+                        case RADAR_OPCODE_MODE_AC:
+                        case RADAR_OPCODE_MODE_S:
+                        case RADAR_OPCODE_MODE_ES: {
+                                int dlen = len - (int)sizeof(radar_msg_t) - MLAT_LEN - 1 - AUTHTAG_LEN;
+
+                                if (dlen == MODE_AC_LEN || dlen == MODE_SS_LEN || dlen == MODE_ES_LEN)
+                                        frame(mp->data, &mp->data[MLAT_LEN + 1], dlen);
+                                else
+                                        ++cur.bad;
+                                break;
+                        }
+
+                        case RADAR_OPCODE_MULTIFRAME: {
+                                int i, n = mp->data[0];
+                                es_t *es = (es_t *)&mp->data[1];
+
+                                if ((int)sizeof(radar_msg_t) + 1 + n * (int)sizeof(es_t) + AUTHTAG_LEN != len) {
+                                        ++cur.bad;
+                                        break;
+                                }
+
+                                for (i=0; i<n; ++i)
+                                        frame(es[i].mlat, es[i].data, MODE_ES_LEN);
+                                break;
+                        }
+
+                        default:				/* keepalive, stats and telemetry */
+                                break;
+                }
+        }
+}
+
+
+/*
+ * cpu_time() - user+system CPU time of radar (uS), zero if unknown
+ */
+static uint64_t cpu_time(void)
+{
+        char path[64], buf[1024], *p;
+        unsigned long utime, stime;
+        FILE *fp;
+        int n;
+
+        if (!radar_pid)
+                return 0;
+
+        snprintf(path, sizeof(path), "/proc/%d/stat", (int)radar_pid);
+
+        if ((fp = fopen(path, "r")) == NULL)
+                return 0;
+
+        n = fread(buf, 1, sizeof(buf) - 1, fp);
+        fclose(fp);
+        buf[n > 0 ? n : 0] = '\0';
+
+        /* skip "pid (comm) " as comm may contain spaces, then fields 3..13 to utime and stime */
+        if ((p = strrchr(buf, ')')) == NULL)
+                return 0;
+
+        if (sscanf(p + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu", &utime, &stime) != 2)
+                return 0;
+
+        return (uint64_t)(utime + stime) * 1000000 / sysconf(_SC_CLK_TCK);
+}
+
+
+/*
+ * wait_for() - run the loop for ms milliseconds, generating traffic if gen is set
+ */
+static void wait_for(int ms, int gen)
+{
+        struct itimerspec its;
+        struct pollfd fds[4];
+        uint64_t start = nstime(), due = 0;
+        double rate = cur.rate;
+
+        memset(&its, 0, sizeof(its));
+        its.it_value.tv_nsec = HARNESS_TICK;
+        its.it_interval.tv_nsec = HARNESS_TICK;
+        timerfd_settime(timer_fd, 0, &its, NULL);
+
+        while (!ending && nstime() - start < (uint64_t)ms * 1000000) {
+                int n = 0;
+
+                fds[n].fd = timer_fd;
+                fds[n++].events = POLLIN;
+                fds[n].fd = udp_fd;
+                fds[n++].events = POLLIN;
+
+                /* a named pipe can only be opened for writing once radar has it open */
+                if (beast_fd < 0 && beast_type == HARNESS_FIFO)
+                        beast_fd = open(beast_path, O_WRONLY | O_NONBLOCK);
+
+                if (beast_fd >= 0) {
+                        fds[n].fd = beast_fd;
+                        fds[n++].events = (out_head < out_tail) ? POLLOUT : 0;
+                } else if (listen_fd >= 0) {
+                        fds[n].fd = listen_fd;
+                        fds[n++].events = POLLIN;
+                }
+
+                fds[2].revents = 0;
+
+                if (poll(fds, n, 100) < 0 && errno != EINTR) {
+                        perror("radar-harness: poll()");
+                        exit(EXIT_FAILURE);
+                }
+
+                if (fds[0].revents & POLLIN) {
+                        uint64_t expirations;
+
+                        if (read(timer_fd, &expirations, sizeof(expirations)) < 0)
+                                ;
+
+                        /* frames due by now, released in bursts of "burst" */
+                        if (gen && beast_fd >= 0) {
+                                uint64_t target = (uint64_t)(rate * (nstime() - start) / 1e9);
+
+                                while (due + burst <= target) {
+                                        int i;
+
+                                        for (i=0; i<burst; ++i) {
+                                                if (!generate())
+                                                        ++cur.stalled;
+                                        }
+
+                                        due += burst;
+                                }
+
+                                flush();
+                        }
+                }
+
+                if (fds[1].revents & POLLIN)
+                        receive();
+
+                if (beast_fd >= 0 && (fds[2].revents & POLLOUT))
+                        flush();
+
+                if (beast_fd < 0 && (fds[2].revents & POLLIN)) {
+                        int one = 1;
+
+                        beast_fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK);
+
+                        if (beast_fd >= 0 && beast_type == HARNESS_TCP)
+                                setsockopt(beast_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+                }
+
+                if (beast_fd >= 0 && (fds[2].revents & (POLLERR | POLLHUP))) {
+                        fprintf(stderr, "radar-harness: BEAST connection closed by radar\n");
+                        ending = 1;
+                }
+
+                if (child && waitpid(radar_pid, NULL, WNOHANG) == radar_pid) {
+                        fprintf(stderr, "radar-harness: radar exited\n");
+                        radar_pid = 0;
+                        ending = 1;
+                }
+        }
+
+        if (gen)
+                cur.ns = nstime() - start;
+}
+
+
+/*
+ * step_loss() - unique DF17 frames not forwarded as a percentage of those sent
+ */
+static double step_loss(const step_t *s)
+{
+        return s->sent_es ? 100.0 * (double)(s->sent_es - min(s->recv_es, s->sent_es)) / s->sent_es : 0;
+}
+
+
+/*
+ * report() - print one step, returns non-zero if it passed
+ */
+static int report(const step_t *s)
+{
+        double secs = s->ns / 1e9;
+        double loss = step_loss(s);
+        uint32_t p50 = latency_percentile(&s->lat, 500);
+        uint32_t p99 = latency_percentile(&s->lat, 990);
+        int pass = (loss <= loss_limit) && (p99 <= (uint32_t)p99_limit * 1000000) && !s->stalled && !s->bad;
+
+        printf("%9.0f %9.0f %9.0f %7.3f %8.2f %8.2f %8.2f %6llu %6llu %6llu",
+                s->rate, s->sent / secs, s->recv / secs, loss,
+                p50 / 1e6, p99 / 1e6, s->lat.max / 1e6,
+                (unsigned long long)s->recv_dupe, (unsigned long long)s->stalled, (unsigned long long)s->bad);
+
+        if (radar_pid)
+                printf(" %8.2f %5.1f", s->sent ? (double)s->cpu / s->sent : 0, s->cpu / secs / 1e4);
+
+        printf("  %s\n", pass ? "ok" : "FAIL");
+        fflush(stdout);
+
+        return pass;
+}
+
+
+/*
+ * open_sockets() - BEAST listener, UDP sink and generator timer
+ */
+static void open_sockets(void)
+{
+        struct sockaddr_in sa;
+        struct sockaddr_un ua;
+        int one = 1, size = HARNESS_RCVBUF, fds[2];
+
+        memset(&sa, 0, sizeof(sa));
+        sa.sin_family = AF_INET;
+        sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+        switch (beast_type) {
+                case HARNESS_TCP:
+                        listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+                        setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+                        sa.sin_port = htons(beast_port);
+
+                        if (bind(listen_fd, (struct sockaddr *)&sa, sizeof(sa)) < 0 || listen(listen_fd, 1) < 0) {
+                                fprintf(stderr, "radar-harness: can't listen on port %d: %s\n", beast_port, strerror(errno));
+                                exit(EXIT_FAILURE);
+                        }
+                        break;
+
+                case HARNESS_UNIX:
+                        memset(&ua, 0, sizeof(ua));
+                        ua.sun_family = AF_UNIX;
+                        strncpy(ua.sun_path, beast_path, sizeof(ua.sun_path) - 1);
+                        unlink(beast_path);
+
+                        listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0);
+
+                        if (bind(listen_fd, (struct sockaddr *)&ua, sizeof(ua)) < 0 || listen(listen_fd, 1) < 0) {
+                                fprintf(stderr, "radar-harness: can't listen on %s: %s\n", beast_path, strerror(errno));
+                                exit(EXIT_FAILURE);
+                        }
+
+                        /* radar drops root privileges before it opens local sources */
+                        chmod(beast_path, 0666);
+                        break;
+
+                case HARNESS_FIFO:
+                        if (mkfifo(beast_path, 0666) < 0 && errno != EEXIST) {
+                                fprintf(stderr, "radar-harness: can't create %s: %s\n", beast_path, strerror(errno));
+                                exit(EXIT_FAILURE);
+                        }
+
+                        chmod(beast_path, 0666);
+                        break;
+
+                case HARNESS_STDIN:
+                        if (pipe(fds) < 0) {
+                                perror("radar-harness: pipe()");
+                                exit(EXIT_FAILURE);
+                        }
+
+                        stdin_fd = fds[0];
+                        beast_fd = fds[1];
+                        fcntl(beast_fd, F_SETFL, fcntl(beast_fd, F_GETFL) | O_NONBLOCK);
+                        break;
+        }
+
+        udp_fd = socket(AF_INET, SOCK_DGRAM, 0);
+        setsockopt(udp_fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+        sa.sin_port = htons(UDP_PORT);
+
+        if (bind(udp_fd, (struct sockaddr *)&sa, sizeof(sa)) < 0) {
+                fprintf(stderr, "radar-harness: can't bind UDP port %d: %s\n", UDP_PORT, strerror(errno));
+                exit(EXIT_FAILURE);
+        }
+
+        timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+}
+
+
+/*
+ * signal_handler() - stop cleanly on ^C
+ */
+static void signal_handler(int sig)
+{
+        (void)sig;
+        ending = 1;
+}
+
+
+/*
+ * usage() - print help and exit
+ */
+static void usage(void)
+{
+        fprintf(stderr, "usage: radar-harness [-l port|unix:path|fifo:path|-] [-k key] [-p pass-phrase] [-c pid] [-r fps] [-R fps] [-s factor]\n"
+                        "                     [-t secs] [-n aircraft] [-D dupe%%] [-S ss%%] [-A ac%%] [-E esc%%] [-b burst]\n"
+                        "                     [-L loss%%] [-P p99-ms] [-- radar ...]\n");
+        exit(EXIT_FAILURE);
+}
+
+
+/*
+ * main program
+ */
+int main(int argc, char *argv[])
+{
+        char *pass = "secret";
+        double best = 0, best_loss = 0;
+        int c, i;
+
+        while ((c = getopt(argc, argv, "l:k:p:c:r:R:s:t:n:D:S:A:E:b:L:P:?")) != -1) {
+                switch (c) {
+                        case 'l':
+                                if (!strcmp(optarg, "-")) {
+                                        beast_type = HARNESS_STDIN;
+                                } else if (!strncmp(optarg, "unix:", 5)) {
+                                        beast_type = HARNESS_UNIX;
+                                        beast_path = optarg + 5;
+                                } else if (!strncmp(optarg, "fifo:", 5)) {
+                                        beast_type = HARNESS_FIFO;
+                                        beast_path = optarg + 5;
+                                } else {
+                                        beast_type = HARNESS_TCP;
+                                        beast_port = atoi(optarg);
+                                }
+                                break;
+                        case 'k': check_key = (uint64_t)strtoull(optarg, NULL, 16); break;
+                        case 'p': pass = optarg; break;
+                        case 'c': radar_pid = atoi(optarg); break;
+                        case 'r': rate_start = atof(optarg); break;
+                        case 'R': rate_max = atof(optarg); break;
+                        case 's': rate_step = atof(optarg); break;
+                        case 't': step_secs = atoi(optarg); break;
+                        case 'n': aircraft = atoi(optarg); break;
+                        case 'D': pct_dupe = atoi(optarg); break;
+                        case 'S': pct_ss = atoi(optarg); break;
+                        case 'A': pct_ac = atoi(optarg); break;
+                        case 'E': pct_esc = atoi(optarg); break;
+                        case 'b': burst = atoi(optarg); break;
+                        case 'L': loss_limit = atof(optarg); break;
+                        case 'P': p99_limit = atoi(optarg); break;
+                        default: usage();
+                }
+        }
+
+        if (rate_start <= 0 || rate_step <= 1 || step_secs < 1 || aircraft < 1 || burst < 1 || pct_ss + pct_ac > 100)
+                usage();
+
+        if ((beast_path && !*beast_path) || (beast_type == HARNESS_STDIN && optind >= argc))
+                usage();
+
+        authtag_init(pass);
+        signal(SIGINT, signal_handler);
+        signal(SIGTERM, signal_handler);
+        signal(SIGPIPE, SIG_IGN);
+        open_sockets();
+        epoch = nstime();
+
+        /* start radar if we were given a command line */
+        if (optind < argc) {
+                if ((radar_pid = fork()) == 0) {
+                        if (stdin_fd >= 0) {
+                                dup2(stdin_fd, STDIN_FILENO);
+                                close(stdin_fd);
+                                close(beast_fd);
+                        }
+
+                        execvp(argv[optind], &argv[optind]);
+                        fprintf(stderr, "radar-harness: can't run %s: %s\n", argv[optind], strerror(errno));
+                        _exit(EXIT_FAILURE);
+                }
+
+                child = 1;
+
+                if (stdin_fd >= 0)
+                        close(stdin_fd);
+        }
+
+        if (beast_type == HARNESS_TCP)
+                printf("radar-harness: waiting for radar to connect to port %d\n", beast_port);
+        else if (beast_type == HARNESS_STDIN)
+                printf("radar-harness: waiting for radar to read its standard input\n");
+        else
+                printf("radar-harness: waiting for radar to open %s\n", beast_path);
+
+        /* radar sends a keepalive once its UDP sender is running and it has no traffic */
+        for (i=0; i<HARNESS_CONNECT_WAIT && (beast_fd < 0 || !cur.msgs) && !ending; ++i)
+                wait_for(1000, 0);
+
+        if (beast_fd < 0 || !cur.msgs) {
+                fprintf(stderr, "radar-harness: radar did not connect or send\n");
+                ending = 1;
+        } else {
+                printf("%9s %9s %9s %7s %8s %8s %8s %6s %6s %6s", "rate/s", "sent/s", "fwd/s", "loss%",
+                        "p50 ms", "p99 ms", "max ms", "dupes", "stall", "bad");
+
+                if (radar_pid)
+                        printf(" %8s %5s", "cpu us/f", "cpu%");
+
+                printf("\n");
+        }
+
+        for (cur.rate = rate_start; !ending && cur.rate <= rate_max; cur.rate *= rate_step) {
+                uint64_t cpu = cpu_time();
+                double rate = cur.rate;
+
+                memset(&cur, 0, sizeof(cur));
+                cur.rate = rate;
+                nrecent = 0;
+
+                wait_for(step_secs * 1000, 1);
+                wait_for(HARNESS_DRAIN + p99_limit, 0);
+                cur.cpu = cpu_time() - cpu;
+
+                if (ending)
+                        break;
+
+                if (!report(&cur))
+                        break;
+
+                best = cur.rate;
+                best_loss = step_loss(&cur);
+                step = (step + 1) & 0x7F;
+        }
+
+        if (best > 0 && best_loss == 0)
+                printf("radar-harness: highest rate forwarded without loss or lag: %.0f frames/s\n", best);
+        else if (best > 0)
+                printf("radar-harness: highest rate forwarded within the limits: %.0f frames/s with %.3f%% loss\n", best, best_loss);
+        else if (beast_fd >= 0 && !ending)
+                printf("radar-harness: the starting rate of %.0f frames/s failed\n", rate_start);
+
+        if (child && radar_pid) {
+                kill(radar_pid, SIGTERM);
+                waitpid(radar_pid, NULL, 0);
+        }
+
+        if (beast_path)
+                unlink(beast_path);
+
+        return best > 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
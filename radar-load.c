@@ -0,0 +1,874 @@
+/*
+ * radar-load.c -- Multi-station UDP load generator
+ * Author: Michael J. Tubby B.Sc. MIET  mike@tubby.org
+ *
+ *
+ * ABSTRACT
+ *
+ * Sends the traffic of thousands of feeders at once for capacity testing the
+ * aggregator, relays and firewalls in front of it.  The messages are made by
+ * radar's own code: radar.c is linked in compiled with -DRADAR_NO_MAIN and
+ * each synthetic station's frames go through radar_process() (and so the
+ * duplicate check, send_mode_es() or the multiframe buffer and signing)
+ * with the station's key, pass-phrase, sequence number and multiframe
+ * buffer swapped in, exactly as sim.c does for configurations.  Idle
+ * stations send keepalives and every station sends telemetry and radio
+ * stats on a staggered period, with radar_send_keepalive(),
+ * radar_send_telemetry() and radar_send_stats().
+ *
+ * udp_simulate() hands each message to the generator rather than radar's
+ * sender and they are sent in batches with sendmmsg().  radar's code keeps
+ * its state in globals so rather than threads there are several worker
+ * processes (one per CPU by default), each with its own socket and its own
+ * share of the stations.
+ *
+ * Stations are not all alike: their rates follow a Pareto distribution, as
+ * a few busy sites and a long tail of quiet ones do, and drift up and down
+ * by up to 20% from second to second.  A proportion of them can use
+ * multiframe.
+ *
+ * The rate achieved (messages, frames, payload and on the wire including
+ * the IP and UDP headers) is printed every second and at the end; give a
+ * rate of 0 to find out how fast the generator can go.
+ *
+ * Making and signing each message costs several times what sending it does,
+ * so for links, relays and firewalls -P has each worker make a ring of that
+ * many messages before the clock starts (on a simulated clock, so the mix is
+ * the same as it would be live at the rate asked for) and then only send
+ * them, round and round.  Once the ring wraps the sequence numbers repeat so
+ * an aggregator or radar-sink counts the repeats as duplicates.
+ *
+ * Either way each message is a system call's worth of work in the kernel, a
+ * few hundred thousand to a million or so per CPU, so a link of 10Gbit/s
+ * is only filled by large multiframe messages and several workers; the
+ * rate reached is the ceiling of this box and is what is reported.
+ *
+ *
+ * USAGE
+ *
+ *	radar-load [options]
+ *
+ * where:
+ *
+ *	-h <host>	  destination (default 127.0.0.1)
+ *	-l <port>	  destination UDP port (default 5997)
+ *	-n <stations>	  number of stations (default 100)
+ *	-r <fps>	  aggregate frame rate, 0 for as fast as possible (default 10000)
+ *	-d <seconds>	  how long to run (default 10)
+ *	-w <workers>	  worker processes (default one per CPU)
+ *	-k <key>	  key of the first station, the others follow on (default 0x1090000000000000)
+ *	-p <pass-phrase>  pass-phrase of every station (default "secret")
+ *	-K <file>	  give each station its own pass-phrase and write the keys and
+ *			  pass-phrases to a file for radar-sink -K
+ *	-m <percent>	  stations using multiframe (default 0)
+ *	-i <ms>		  multiframe forwarding interval (default 50)
+ *	-T <seconds>	  telemetry and stats period (default 900)
+ *	-b <messages>	  sendmmsg() batch (default 64)
+ *	-P <messages>	  make and sign a ring of this many messages per worker first
+ *			  and send those, repeating when it wraps (default 0 - off)
+ *
+ * e.g. to drive radar-sink with a thousand stations as fast as possible:
+ *
+ *	radar-sink -K keys.txt -i 1 &
+ *	radar-load -n 1000 -r 0 -m 50 -K keys.txt
+ *
+ * (radar-load writes keys.txt before it starts sending, start the sink once it has).
+ * To load a link or firewall as hard as possible:
+ *
+ *	radar-load -h aggregator -n 1000 -r 0 -m 100 -P 200000
+ *
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <math.h>
+#include <signal.h>
+#include <time.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/mman.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "radar.h"
+#include "udp.h"
+#include "dupe.h"
+#include "authtag.h"
+#include "ustime.h"
+#include "nstime.h"
+
+
+#define LOAD_WORKERS_MAX	256
+#define LOAD_BATCH_MAX		1024
+#define LOAD_MSG_SIZE		1024			/* larger than any message radar sends */
+#define LOAD_SNDBUF		(4 << 20)
+#define LOAD_TICK		1000000			/* generator tick (nS) */
+#define LOAD_FLAT_OUT		1000			/* frames per worker per tick at -r 0 */
+#define LOAD_DUPE_WINDOW	100000			/* duplicate window (uS), frames are unique anyway */
+#define LOAD_PARETO		1.2			/* station rate distribution */
+#define LOAD_SKEW_MAX		50.0			/* busiest station relative to the quietest */
+#define LOAD_AIRCRAFT		64			/* aircraft per station */
+#define LOAD_IP_UDP		28			/* IPv4 and UDP header bytes */
+
+
+/*
+ * radar.c - the state a station changes
+ */
+extern uint64_t key;
+extern uint32_t seq;
+extern uint32_t send_count;
+extern int multiframe;
+extern int num;
+extern esdata_t esdata[RADAR_MAX_MULTIFRAME];
+extern int ending;
+
+
+/*
+ * a synthetic station
+ */
+typedef struct {
+        uint64_t key;
+        uint8_t hkey[AUTHTAG_KEY_LEN];		/* expanded pass-phrase */
+        int index;
+        int multiframe;
+        double weight;				/* share of the aggregate rate */
+        double drift;				/* this second's variation */
+        double due;				/* frames owed */
+        uint32_t seq;
+        uint32_t send_count;
+        uint32_t counter;			/* makes every frame unique */
+        int num;
+        esdata_t esdata[RADAR_MAX_MULTIFRAME];
+        uint64_t next_forward;			/* uS */
+        uint64_t next_telemetry;		/* uS */
+} station_t;
+
+
+/*
+ * counters a worker shares with the parent
+ */
+typedef struct {
+        volatile uint64_t msgs;
+        volatile uint64_t frames;
+        volatile uint64_t bytes;
+        volatile uint64_t errors;		/* messages sendmmsg() would not take */
+        volatile int ready;			/* -P: ring made, sending */
+} counters_t;
+
+
+static char host[HOSTNAME_LEN+1] = "127.0.0.1";
+static int dport = UDP_PORT;
+static int nstations = 100;
+static double rate = 10000;
+static int duration = 10;
+static int nworkers = 0;
+static uint64_t first_key = 0x1090000000000000ULL;
+static char *pass = "secret";
+static char *keyfile = NULL;
+static int pct_multiframe = 0;
+static int interval = RADAR_FORWARD_INTERVAL;
+static int telemetry_secs = TELEMETRY_INTERVAL;
+static int batch_size = 64;
+static int presign = 0;
+
+static station_t *stations;
+static double total_weight = 0;
+static counters_t *counters;			/* one per worker, shared */
+static counters_t *mine;			/* this worker's */
+static int fd = -1;
+static uint8_t bufs[LOAD_BATCH_MAX][LOAD_MSG_SIZE];
+static struct mmsghdr msgs[LOAD_BATCH_MAX];
+static struct iovec iovs[LOAD_BATCH_MAX];
+static int queued = 0;
+static uint32_t rnd = 0x1090;
+static uint8_t *arena = NULL;			/* -P: the messages made in advance */
+static size_t arena_size = 0, arena_used = 0;
+static struct iovec *ring = NULL;		/* -P: each message, iov_base is an offset into arena until filled */
+static uint32_t *ring_frames = NULL;		/* -P: frames in each message */
+static int nring = 0;
+static counters_t making;			/* -P: counters while the ring is being made */
+static uint64_t frames_made = 0;
+
+
+/*
+ * next() - cheap repeatable pseudo-random numbers
+ */
+static uint32_t next(void)
+{
+        rnd = rnd * 1664525 + 1013904223;
+        return rnd >> 8;
+}
+
+
+/*
+ * uniform() - pseudo-random number in (0, 1]
+ */
+static double uniform(void)
+{
+        return (next() % 1000000 + 1) / 1e6;
+}
+
+
+/*
+ * send_batch() - send the queued messages
+ */
+static void send_batch(void)
+{
+        int sent = 0, rc;
+
+        while (sent < queued) {
+                if ((rc = sendmmsg(fd, &msgs[sent], queued - sent, 0)) > 0) {
+                        sent += rc;
+                        continue;
+                }
+
+                if (rc < 0 && errno == EINTR)
+                        continue;
+
+                /* ENOBUFS, or ECONNREFUSED when nothing is listening: drop the rest */
+                mine->errors += queued - sent;
+                break;
+        }
+
+        queued = 0;
+}
+
+
+/*
+ * keep() - add a message to the ring being made for -P
+ */
+static void keep(void *buf, int size)
+{
+        if (nring >= presign)
+                return;
+
+        if (arena_used + size > arena_size) {
+                arena_size = max(arena_size * 2, (size_t)presign * 64);
+
+                if ((arena = realloc(arena, arena_size)) == NULL) {
+                        perror("radar-load: realloc()");
+                        exit(EXIT_FAILURE);
+                }
+        }
+
+        memcpy(arena + arena_used, buf, size);
+        ring[nring].iov_base = (void *)arena_used;
+        ring[nring].iov_len = size;
+        ring_frames[nring] = making.frames - frames_made;
+        frames_made = making.frames;
+        arena_used += size;
+        ++nring;
+}
+
+
+/*
+ * queue() - take a message from radar's code instead of it being sent (see udp_simulate())
+ */
+static void queue(void *buf, int size)
+{
+        if (size > LOAD_MSG_SIZE)
+                return;
+
+        if (ring) {
+                keep(buf, size);
+                return;
+        }
+
+        memcpy(bufs[queued], buf, size);
+        iovs[queued].iov_len = size;
+        ++queued;
+
+        mine->msgs++;
+        mine->bytes += size;
+
+        if (queued >= batch_size)
+                send_batch();
+}
+
+
+/*
+ * load() - swap a station's state into radar.c
+ */
+static void load(station_t *s)
+{
+        key = s->key;
+        seq = s->seq;
+        send_count = s->send_count;
+        multiframe = s->multiframe;
+        num = s->num;
+
+        if (num)
+                memcpy(esdata, s->esdata, num * sizeof(esdata_t));
+
+        authtag_key(s->hkey);
+}
+
+
+/*
+ * save() - swap a station's state back out
+ */
+static void save(station_t *s)
+{
+        s->seq = seq;
+        s->send_count = send_count;
+        s->num = num;
+
+        if (num)
+                memcpy(s->esdata, esdata, num * sizeof(esdata_t));
+}
+
+
+/*
+ * generate() - give radar_process() one DF17 airborne position from one of the station's aircraft
+ */
+static void generate(station_t *s, uint64_t rx)
+{
+        uint8_t data[MODE_ES_LEN], mlat[MLAT_LEN];
+        uint64_t ticks = nstime() * 12 / 1000;		/* 12MHz MLAT clock */
+        uint32_t icao = 0x400000 + ((s->index * LOAD_AIRCRAFT + next() % LOAD_AIRCRAFT) & 0x3FFFFF);
+        uint32_t c = s->counter++;
+        int i;
+
+        for (i=0; i<MLAT_LEN; ++i)
+                mlat[i] = ticks >> (8 * (MLAT_LEN - 1 - i));
+
+        data[0] = (17 << 3) | 5;			/* DF17 CA5 */
+        data[1] = icao >> 16;
+        data[2] = icao >> 8;
+        data[3] = icao;
+        data[4] = (11 << 3);				/* airborne position */
+        data[5] = c >> 24;				/* unique within the duplicate window */
+        data[6] = c >> 16;
+        data[7] = c >> 8;
+        data[8] = c;
+
+        for (i=9; i<MODE_ES_LEN; ++i)
+                data[i] = next();
+
+        radar_process(mlat, 0x80 + next() % 0x60, data, MODE_ES_LEN, rx);
+        mine->frames++;
+}
+
+
+/*
+ * second() - keepalives for stations that sent nothing and a new drift for each
+ */
+static void second(int w)
+{
+        int i;
+
+        for (i = w; i < nstations; i += nworkers) {
+                station_t *s = &stations[i];
+
+                load(s);
+
+                if (send_count == 0)
+                        radar_send_keepalive();
+
+                send_count = 0;
+                save(s);
+                s->drift = 0.8 + 0.4 * uniform();
+        }
+
+        dupe_clean();
+}
+
+
+/*
+ * step() - give every station the frames it is owed for dt seconds and send what is due
+ */
+static void step(int w, uint64_t us, double dt, double my_rate, double my_weight)
+{
+        int i;
+
+        for (i = w; i < nstations; i += nworkers) {
+                station_t *s = &stations[i];
+                int n;
+
+                if (rate > 0)
+                        s->due += my_rate * s->weight / my_weight * s->drift * dt;
+                else
+                        s->due += LOAD_FLAT_OUT * s->weight / my_weight * s->drift;
+
+                n = (int)s->due;
+
+                if (!n && (!s->multiframe || us < s->next_forward) && us < s->next_telemetry)
+                        continue;
+
+                s->due -= n;
+                load(s);
+
+                while (n--)
+                        generate(s, us);
+
+                if (s->multiframe && us >= s->next_forward) {
+                        radar_send_multiframe();
+                        s->next_forward += interval * 1000;
+                }
+
+                if (us >= s->next_telemetry) {
+                        radar_send_telemetry();
+                        radar_send_stats();
+                        s->next_telemetry += (uint64_t)telemetry_secs * 1000000;
+                }
+
+                save(s);
+        }
+}
+
+
+/*
+ * pace() - wait for the next tick unless we are flat out or behind
+ */
+static void pace(uint64_t *tick)
+{
+        struct timespec ts;
+
+        if (rate <= 0)
+                return;
+
+        *tick += LOAD_TICK;
+
+        if (*tick > nstime()) {
+                ts.tv_sec = *tick / 1000000000;
+                ts.tv_nsec = *tick % 1000000000;
+                clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+        } else {
+                *tick = nstime();
+        }
+}
+
+
+/*
+ * make_ring() - -P: run the stations on a simulated clock until the ring is full
+ */
+static void make_ring(int w, double my_rate, double my_weight)
+{
+        uint64_t us = ustime(), next_second = us + 1000000;
+        int i;
+
+        if ((ring = calloc(presign, sizeof(struct iovec))) == NULL || (ring_frames = calloc(presign, sizeof(uint32_t))) == NULL) {
+                perror("radar-load: calloc()");
+                exit(EXIT_FAILURE);
+        }
+
+        mine = &making;
+
+        while (!ending && nring < presign) {
+                us += LOAD_TICK / 1000;
+                ustime_set(us);
+                step(w, us, LOAD_TICK / 1e9, my_rate, my_weight);
+
+                if (us >= next_second) {
+                        second(w);
+                        next_second += 1000000;
+                }
+        }
+
+        /* the arena has stopped moving */
+        for (i = 0; i < nring; i++)
+                ring[i].iov_base = arena + (size_t)ring[i].iov_base;
+
+        mine = &counters[w];
+}
+
+
+/*
+ * send_ring() - -P: send the ring round and round until the time is up
+ */
+static void send_ring(uint64_t end, double my_rate)
+{
+        uint64_t tick = nstime(), last = tick;
+        double due = 0;
+        int pos = 0;
+
+        while (!ending && nstime() < end) {
+                uint64_t now = nstime();
+                int n = 0, sent, i;
+
+                if (rate > 0)
+                        due += my_rate * (now - last) / 1e9;
+
+                last = now;
+
+                /* a batch of the messages whose frames are due, or a full one flat out */
+                while (n < batch_size && (rate <= 0 || due > 0)) {
+                        int k = (pos + n) % nring;
+
+                        msgs[n].msg_hdr.msg_iov = &ring[k];
+                        due -= ring_frames[k];
+                        ++n;
+                }
+
+                for (sent = 0; sent < n; ) {
+                        int rc = sendmmsg(fd, &msgs[sent], n - sent, 0);
+
+                        if (rc > 0) {
+                                sent += rc;
+                                continue;
+                        }
+
+                        if (rc < 0 && errno == EINTR)
+                                continue;
+
+                        mine->errors += n - sent;
+                        break;
+                }
+
+                for (i = 0; i < n; i++) {
+                        int k = (pos + i) % nring;
+
+                        mine->msgs++;
+                        mine->frames += ring_frames[k];
+                        mine->bytes += ring[k].iov_len;
+                }
+
+                pos = (pos + n) % nring;
+
+                if (due <= 0)
+                        pace(&tick);
+        }
+}
+
+
+/*
+ * worker() - send the traffic of every nworkers'th station until the time is up
+ */
+static void worker(int w, uint64_t end)
+{
+        uint64_t last, tick, next_second;
+        double my_rate, my_weight = 0;
+        int i;
+
+        mine = &counters[w];
+        udp_simulate(queue);
+        dupe_window(LOAD_DUPE_WINDOW);
+        rnd += w;
+
+        for (i = w; i < nstations; i += nworkers)
+                my_weight += stations[i].weight;
+
+        my_rate = rate * my_weight / total_weight;
+        next_second = ustime() + 1000000;
+
+        for (i = w; i < nstations; i += nworkers) {
+                stations[i].next_forward = ustime() + interval * 1000;
+                stations[i].next_telemetry = ustime() + (uint64_t)telemetry_secs * 1000000 * (next() % 1000) / 1000;
+                stations[i].drift = 1.0;
+        }
+
+        if (presign) {
+                make_ring(w, my_rate, my_weight);
+
+                /* the run starts once the ring is made */
+                end = nstime() + (uint64_t)duration * 1000000000;
+                mine->ready = 1;
+
+                if (nring)
+                        send_ring(end, my_rate);
+                return;
+        }
+
+        last = tick = nstime();
+
+        while (!ending && nstime() < end) {
+                uint64_t now = nstime(), us = ustime();
+
+                step(w, us, (now - last) / 1e9, my_rate, my_weight);
+                last = now;
+
+                if (us >= next_second) {
+                        second(w);
+                        next_second += 1000000;
+                }
+
+                send_batch();
+                pace(&tick);
+        }
+
+        /* what is left in the multiframe buffers */
+        for (i = w; i < nstations; i += nworkers) {
+                load(&stations[i]);
+                radar_send_multiframe();
+                save(&stations[i]);
+        }
+
+        send_batch();
+}
+
+
+/*
+ * make_stations() - keys, pass-phrases, rates and multiframe for every station
+ */
+static void make_stations(void)
+{
+        uint8_t hkey[AUTHTAG_KEY_LEN];
+        FILE *fp = NULL;
+        int i;
+
+        if ((stations = calloc(nstations, sizeof(station_t))) == NULL) {
+                perror("radar-load: calloc()");
+                exit(EXIT_FAILURE);
+        }
+
+        if (keyfile && (fp = fopen(keyfile, "w")) == NULL) {
+                fprintf(stderr, "radar-load: can't create %s: %s\n", keyfile, strerror(errno));
+                exit(EXIT_FAILURE);
+        }
+
+        authtag_expand(hkey, pass);
+
+        for (i = 0; i < nstations; i++) {
+                station_t *s = &stations[i];
+
+                s->key = first_key + i;
+                s->index = i;
+                s->seq = 1;
+                s->multiframe = (int)(next() % 100) < pct_multiframe;
+                s->weight = min(pow(uniform(), -1.0 / LOAD_PARETO), LOAD_SKEW_MAX);
+                total_weight += s->weight;
+
+                if (fp) {
+                        char secret[PSK_LEN+1];
+
+                        snprintf(secret, sizeof(secret), "%s-%d", pass, i);
+                        authtag_expand(s->hkey, secret);
+                        fprintf(fp, "0x%016llX %s\n", (unsigned long long)s->key, secret);
+                } else {
+                        memcpy(s->hkey, hkey, AUTHTAG_KEY_LEN);
+                }
+        }
+
+        if (fp)
+                fclose(fp);
+}
+
+
+/*
+ * open_socket() - a worker's socket connected to the destination
+ */
+static void open_socket(void)
+{
+        struct sockaddr_in sa;
+        struct hostent *he;
+        int i, size = LOAD_SNDBUF;
+
+        if ((he = gethostbyname(host)) == NULL) {
+                fprintf(stderr, "radar-load: can't resolve %s: %s\n", host, hstrerror(h_errno));
+                exit(EXIT_FAILURE);
+        }
+
+        memset(&sa, 0, sizeof(sa));
+        sa.sin_family = AF_INET;
+        sa.sin_addr = *(struct in_addr *)he->h_addr;
+        sa.sin_port = htons(dport);
+
+        if ((fd = socket(AF_INET, SOCK_DGRAM, 0)) < 0 || connect(fd, (struct sockaddr *)&sa, sizeof(sa)) < 0) {
+                fprintf(stderr, "radar-load: can't open socket to %s:%d: %s\n", host, dport, strerror(errno));
+                exit(EXIT_FAILURE);
+        }
+
+        setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+
+        for (i = 0; i < LOAD_BATCH_MAX; i++) {
+                iovs[i].iov_base = bufs[i];
+                msgs[i].msg_hdr.msg_iov = &iovs[i];
+                msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+}
+
+
+/*
+ * totals() - add up the workers' counters
+ */
+static void totals(counters_t *t)
+{
+        int i;
+
+        memset(t, 0, sizeof(counters_t));
+
+        for (i = 0; i < nworkers; i++) {
+                t->msgs += counters[i].msgs;
+                t->frames += counters[i].frames;
+                t->bytes += counters[i].bytes;
+                t->errors += counters[i].errors;
+        }
+}
+
+
+/*
+ * report() - the rates between two sets of totals
+ */
+static void report(const counters_t *t, const counters_t *p, double secs)
+{
+        uint64_t msgs = t->msgs - p->msgs;
+        uint64_t bytes = t->bytes - p->bytes;
+
+        printf("%10.0f %10.0f %9.1f %9.1f %10llu\n", (t->frames - p->frames) / secs, msgs / secs,
+                bytes * 8 / secs / 1e6, (bytes + msgs * LOAD_IP_UDP) * 8 / secs / 1e6,
+                (unsigned long long)(t->errors - p->errors));
+        fflush(stdout);
+}
+
+
+/*
+ * stop() - stop cleanly on ^C
+ */
+static void stop(int sig)
+{
+        (void)sig;
+        ending = 1;
+}
+
+
+/*
+ * usage() - print help and exit
+ */
+static void usage(void)
+{
+        fprintf(stderr, "usage: radar-load [-h host] [-l port] [-n stations] [-r fps] [-d seconds] [-w workers] [-k key]\n"
+                        "                  [-p pass-phrase] [-K key-file] [-m multiframe%%] [-i ms] [-T seconds] [-b batch]\n"
+                        "                  [-P messages]\n");
+        exit(EXIT_FAILURE);
+}
+
+
+/*
+ * main program
+ */
+int main(int argc, char *argv[])
+{
+        counters_t t, prev;
+        uint64_t start, end;
+        double secs;
+        pid_t pids[LOAD_WORKERS_MAX];
+        int c, i, running;
+
+        while ((c = getopt(argc, argv, "h:l:n:r:d:w:k:p:K:m:i:T:b:P:?")) != -1) {
+                switch (c) {
+                        case 'h': strncpy(host, optarg, HOSTNAME_LEN); break;
+                        case 'l': dport = atoi(optarg); break;
+                        case 'n': nstations = atoi(optarg); break;
+                        case 'r': rate = atof(optarg); break;
+                        case 'd': duration = atoi(optarg); break;
+                        case 'w': nworkers = atoi(optarg); break;
+                        case 'k': first_key = strtoull(optarg, NULL, 16); break;
+                        case 'p': pass = optarg; break;
+                        case 'K': keyfile = optarg; break;
+                        case 'm': pct_multiframe = atoi(optarg); break;
+                        case 'i': interval = atoi(optarg); break;
+                        case 'T': telemetry_secs = atoi(optarg); break;
+                        case 'b': batch_size = atoi(optarg); break;
+                        case 'P': presign = atoi(optarg); break;
+                        default: usage();
+                }
+        }
+
+        if (!nworkers)
+                nworkers = sysconf(_SC_NPROCESSORS_ONLN);
+
+        nworkers = min(nworkers, nstations);
+
+        if (optind < argc || nstations < 1 || rate < 0 || duration < 1 || nworkers < 1 || nworkers > LOAD_WORKERS_MAX ||
+            interval < 10 || interval > 250 || telemetry_secs < 1 || batch_size < 1 || batch_size > LOAD_BATCH_MAX || presign < 0)
+                usage();
+
+        make_stations();
+
+        counters = mmap(NULL, nworkers * sizeof(counters_t), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+
+        if (counters == MAP_FAILED) {
+                perror("radar-load: mmap()");
+                exit(EXIT_FAILURE);
+        }
+
+        memset(counters, 0, nworkers * sizeof(counters_t));
+        signal(SIGINT, stop);
+        signal(SIGTERM, stop);
+
+        printf("radar-load: %d stations (%d%% multiframe) to %s:%d with %d workers for %d seconds at ",
+                nstations, pct_multiframe, host, dport, nworkers, duration);
+
+        if (rate > 0)
+                printf("%.0f frames/s\n", rate);
+        else
+                printf("as many frames/s as possible\n");
+
+        start = nstime();
+        end = start + (uint64_t)duration * 1000000000;
+
+        for (i = 0; i < nworkers; i++) {
+                if ((pids[i] = fork()) == 0) {
+                        open_socket();
+                        worker(i, end);
+                        _exit(EXIT_SUCCESS);
+                }
+
+                if (pids[i] < 0) {
+                        perror("radar-load: fork()");
+                        exit(EXIT_FAILURE);
+                }
+        }
+
+        running = nworkers;
+
+        /* -P: the clock starts when every worker has made its ring */
+        if (presign) {
+                printf("radar-load: making %d messages per worker\n", presign);
+                fflush(stdout);
+
+                for (i = 0; i < nworkers && !ending; ) {
+                        if (counters[i].ready)
+                                ++i;
+                        else if (waitpid(pids[i], NULL, WNOHANG) == pids[i]) {
+                                ++i;
+                                --running;
+                        } else {
+                                usleep(10000);
+                        }
+                }
+
+                start = nstime();
+                end = start + (uint64_t)duration * 1000000000;
+        }
+
+        printf("%10s %10s %9s %9s %10s\n", "frames/s", "msgs/s", "Mbit/s", "wire Mb/s", "dropped");
+
+        memset(&prev, 0, sizeof(prev));
+
+        while (running) {
+                uint64_t before = nstime();
+
+                sleep(1);
+
+                while (waitpid(-1, NULL, WNOHANG) > 0)
+                        --running;
+
+                if (ending) {
+                        for (i = 0; i < nworkers; i++)
+                                kill(pids[i], SIGTERM);
+                }
+
+                totals(&t);
+                report(&t, &prev, (nstime() - before) / 1e9);
+                prev = t;
+        }
+
+        totals(&t);
+        secs = (min(nstime(), end) - start) / 1e9;
+
+        printf("\nradar-load: achieved %.0f frames/s in %.0f msgs/s, %.1f Mbit/s (%.1f Mbit/s on the wire) over %.1f seconds\n",
+                t.frames / secs, t.msgs / secs, t.bytes * 8 / secs / 1e6, (t.bytes + t.msgs * LOAD_IP_UDP) * 8 / secs / 1e6, secs);
+        printf("radar-load: %llu messages, %llu frames, %llu dropped by the socket\n",
+                (unsigned long long)t.msgs, (unsigned long long)t.frames, (unsigned long long)t.errors);
+
+        return EXIT_SUCCESS;
+}
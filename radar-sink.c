@@ -0,0 +1,1199 @@
+/*
+ * radar-sink.c -- Verifying UDP sink standing in for the aggregator
+ * Author: Michael J. Tubby B.Sc. MIET  mike@tubby.org
+ *
+ *
+ * ABSTRACT
+ *
+ * Receives Radar V2 messages on UDP port 5997 as the aggregator would and
+ * checks everything about them that can be checked without the aggregator:
+ *
+ *	format	every opcode is parsed and its length checked, multiframe
+ *		messages by their frame count
+ *	auth	the authentication tag is verified with the pass-phrase of the
+ *		station's key
+ *	order	sequence numbers are tracked per key, counting gaps (lost),
+ *		numbers that arrive after a later one (reordered), numbers
+ *		seen twice (duplicate, which radar never does so it is a
+ *		replay or a fault) and restarts of radar
+ *	latency	one-way latency from the ts header to the kernel receive time,
+ *		which is only meaningful when both clocks are disciplined (or
+ *		over loopback)
+ *	fec	a data message that was lost is rebuilt from a parity message
+ *		(radar -K, see fec.c) and the other messages it covers, then
+ *		checked and counted as if it had arrived
+ *
+ * so it can be run in place of the aggregator to check a change to radar
+ * end to end, and is fast enough to be the far end of a load test.  Several
+ * worker threads each have their own socket bound to the port with
+ * SO_REUSEPORT (the kernel spreads the stations over them) and read with
+ * recvmmsg(); the HMAC checks, which are most of the work, run in parallel.
+ * Optionally everything received is written to a pcap file for wireshark.
+ *
+ * A line of totals is printed every interval and a table per station at the
+ * end.  The exit status is non-zero if any message was rejected or any
+ * sequence number was duplicated, so it can be used in a script as an oracle.
+ *
+ * To see what FEC buys on a lossy link, -L drops a share of the messages on
+ * arrival, at random or in bursts of a given mean length (a two state
+ * Gilbert model, closer to what a 4G link does), before they are looked at.
+ *
+ * RTT probes (radar -A, see probe.c) are answered as the aggregator answers
+ * them: sent straight back with the CONFIG_ACK opcode, our own header and a
+ * tag made with the station's pass-phrase, from the address they were sent
+ * to.  Probes dropped by -L are not answered, so radar sees the loss.
+ *
+ * With -c the settings given are pushed to each station as the aggregator
+ * would (CONFIG_REQ, see PROTOCOL.md) once a second until it answers, and its
+ * answer - the settings now in force, or why it refused - is printed.
+ *
+ *
+ * USAGE
+ *
+ *	radar-sink [options]
+ *
+ * where:
+ *
+ *	-l <port>	  UDP port to listen on (default 5997)
+ *	-b <address>	  address to bind (default all)
+ *	-t <threads>	  worker threads (default 4)
+ *	-p <pass-phrase>  pass-phrase for keys not given one with -k (default "secret")
+ *	-k <key>[:<pass>] accept only the listed keys (repeat for each station)
+ *	-K <file>	  accept only the keys in a file, one "<key> [<pass-phrase>]" per line
+ *	-w <file>	  write the messages received to a pcap file
+ *	-i <seconds>	  interval between lines of totals (default 10, 0 for none)
+ *	-d <seconds>	  stop after this long (default run until ^C)
+ *	-L <%>[:<burst>]  drop this percentage of messages on arrival, in bursts of this mean length
+ *	-c <settings>	  push settings to every station e.g. m=1,i=100,f=16,es=0x20000,ss=0,ac=0,
+ *			  kbps=64,burst=2000,s=300,t=600 (multiframe, interval, frames, DF masks,
+ *			  Mode-A/C, uplink budget, stats and telemetry intervals)
+ *
+ * Without -k or -K every key is accepted and checked with the -p pass-phrase.
+ *
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "defs.h"
+#include "radar.h"
+#include "udp.h"
+#include "authtag.h"
+#include "latency.h"
+#include "ustime.h"
+#include "nstime.h"
+#include "uthash.h"
+
+
+#define SINK_THREADS_MAX	64
+#define SINK_BATCH		64			/* messages per recvmmsg() */
+#define SINK_MSG_SIZE		2048
+#define SINK_RCVBUF		(8 << 20)		/* UDP receive buffer per thread */
+#define SINK_STATIONS_MAX	10000			/* stations tracked before new keys are rejected */
+#define SINK_WINDOW		64			/* sequence numbers remembered for reordering */
+#define SINK_PCAP_SNAPLEN	65535
+#define SINK_PCAP_LINKTYPE	101			/* LINKTYPE_RAW - starts with the IPv4 header */
+#define SINK_FEC_RING		64			/* data messages kept per station for FEC, a power of two */
+#define SINK_PUSH_INTERVAL	1000000			/* settings pushed again until answered (uS) */
+
+
+int debug = 0;					/* for authtag.c */
+
+
+/*
+ * a pass-phrase given for a key with -k or -K
+ */
+typedef struct {
+        uint64_t key;
+        uint8_t hkey[AUTHTAG_KEY_LEN];		/* expanded pass-phrase */
+        UT_hash_handle hh;
+} psk_t;
+
+
+/*
+ * a recent data message kept for rebuilding another from FEC parity
+ */
+typedef struct {
+        uint32_t seq;
+        uint16_t len;				/* zero if empty */
+        uint8_t rebuilt;			/* rebuilt from parity rather than received */
+        uint8_t buf[sizeof(radar_multiframe_t)];
+} slot_t;
+
+
+/*
+ * what we know about a station, one per key
+ */
+typedef struct {
+        uint64_t key;
+        const uint8_t *hkey;			/* expanded pass-phrase */
+        pthread_mutex_t lock;
+        uint64_t msgs;
+        uint64_t frames;
+        uint64_t keepalives;
+        uint64_t probes;			/* RTT probes answered */
+        uint32_t tx_seq;			/* sequence number of what we send it */
+        uint64_t pushed;			/* when settings (-c) were last pushed (uS) */
+        int answer;				/* its answer, RADAR_CONFIG_OK etc., -1 for none yet */
+        uint64_t bad;				/* bad authentication tag or length */
+        uint32_t first;				/* first sequence number since a restart */
+        uint32_t last;				/* highest sequence number */
+        uint64_t window;			/* bit n set if last-n has been received */
+        int64_t lost;				/* gaps not (yet) filled by reordered messages */
+        uint64_t reordered;
+        uint64_t duplicate;
+        uint64_t old;				/* too late to tell reordered from duplicate */
+        uint64_t restarts;
+        uint64_t fec_msgs;			/* parity messages */
+        uint64_t fec_bytes;
+        uint64_t recovered;			/* data messages rebuilt from parity */
+        uint64_t fec_late;			/* received after they had been rebuilt */
+        slot_t *ring;				/* recent data messages, kept once parity has been seen */
+        latency_hist_t now;			/* one-way latency this interval */
+        latency_hist_t lat;			/* one-way latency since start */
+        UT_hash_handle hh;
+} station_t;
+
+
+/*
+ * a worker thread and its socket
+ */
+typedef struct {
+        pthread_t tid;
+        int fd;
+        pthread_mutex_t lock;
+        uint64_t msgs;				/* counters for messages that have no station */
+        uint64_t bytes;
+        uint64_t runt;
+        uint64_t unknown;
+        uint64_t dropped;			/* by the loss simulator */
+        unsigned int seed;			/* loss simulator state */
+        int burst;
+} worker_t;
+
+
+static int port = UDP_PORT;
+static struct in_addr bind_addr = { INADDR_ANY };
+static int nthreads = 4;
+static char *pass = "secret";
+static uint8_t default_hkey[AUTHTAG_KEY_LEN];
+static psk_t *psks = NULL;			/* -k/-K keys, read only once the workers start */
+static station_t *stations = NULL;
+static int nstations = 0;
+static pthread_rwlock_t stations_lock = PTHREAD_RWLOCK_INITIALIZER;
+static worker_t workers[SINK_THREADS_MAX];
+static FILE *pcap = NULL;
+static pthread_mutex_t pcap_lock = PTHREAD_MUTEX_INITIALIZER;
+static int interval = 10;
+static int duration = 0;
+static volatile int ending = 0;
+static double loss = 0;				/* -L: share of messages dropped on arrival */
+static double loss_burst = 1;			/* -L: mean length of a run of drops */
+static radar_config_t push;			/* -c: settings to push, if push.set */
+
+
+/*
+ * add_psk() - add a key and its pass-phrase to the list of accepted keys
+ */
+static void add_psk(const char *hex, char *secret)
+{
+        psk_t *p;
+        uint64_t key;
+        char *end;
+
+        key = strtoull(hex, &end, 16);
+
+        if (end == hex || (*end && *end != ':' && *end != ' ' && *end != '\t' && *end != '\n')) {
+                fprintf(stderr, "radar-sink: bad key \"%s\"\n", hex);
+                exit(EXIT_FAILURE);
+        }
+
+        HASH_FIND(hh, psks, &key, sizeof(key), p);
+
+        if (!p) {
+                if ((p = calloc(1, sizeof(psk_t))) == NULL) {
+                        perror("radar-sink: calloc()");
+                        exit(EXIT_FAILURE);
+                }
+
+                p->key = key;
+                HASH_ADD(hh, psks, key, sizeof(key), p);
+        }
+
+        authtag_expand(p->hkey, secret ? secret : pass);
+}
+
+
+/*
+ * read_keys() - read a -K file of "<key> [<pass-phrase>]" lines, # starts a comment
+ */
+static void read_keys(const char *path)
+{
+        char line[256], *hex, *secret;
+        FILE *fp;
+
+        if ((fp = fopen(path, "r")) == NULL) {
+                fprintf(stderr, "radar-sink: can't open %s: %s\n", path, strerror(errno));
+                exit(EXIT_FAILURE);
+        }
+
+        while (fgets(line, sizeof(line), fp)) {
+                line[strcspn(line, "#\r\n")] = '\0';
+
+                if ((hex = strtok(line, " \t")) == NULL)
+                        continue;
+
+                secret = strtok(NULL, "\r\n");
+
+                while (secret && (*secret == ' ' || *secret == '\t'))
+                        ++secret;
+
+                add_psk(hex, (secret && *secret) ? secret : NULL);
+        }
+
+        fclose(fp);
+}
+
+
+/*
+ * find_station() - the station for a key, NULL if the key is not accepted
+ */
+static station_t *find_station(uint64_t key)
+{
+        station_t *s;
+        psk_t *p = NULL;
+
+        pthread_rwlock_rdlock(&stations_lock);
+        HASH_FIND(hh, stations, &key, sizeof(key), s);
+        pthread_rwlock_unlock(&stations_lock);
+
+        if (s)
+                return s;
+
+        if (psks) {
+                HASH_FIND(hh, psks, &key, sizeof(key), p);
+
+                if (!p)
+                        return NULL;
+        }
+
+        pthread_rwlock_wrlock(&stations_lock);
+        HASH_FIND(hh, stations, &key, sizeof(key), s);
+
+        if (!s && nstations < SINK_STATIONS_MAX && (s = calloc(1, sizeof(station_t))) != NULL) {
+                s->key = key;
+                s->hkey = p ? p->hkey : default_hkey;
+                s->answer = -1;
+                pthread_mutex_init(&s->lock, NULL);
+                HASH_ADD(hh, stations, key, sizeof(key), s);
+                ++nstations;
+        }
+
+        pthread_rwlock_unlock(&stations_lock);
+
+        return s;
+}
+
+
+/*
+ * check_length() - frames carried by a message, -1 if its length is wrong for its opcode
+ */
+static int check_length(const radar_msg_t *mp, int len)
+{
+        int n;
+
+        switch (mp->opcode) {
+                case RADAR_OPCODE_MODE_AC:
+                case RADAR_OPCODE_MODE_S:
+                case RADAR_OPCODE_MODE_ES:
+                        /* radar sends Mode-A/C and short squitters with the ES opcode, the length tells them apart */
+                        return (len == sizeof(radar_mode_ac_t) || len == sizeof(radar_mode_ss_t) ||
+                                len == sizeof(radar_mode_es_t)) ? 1 : -1;
+
+                case RADAR_OPCODE_MULTIFRAME:
+                        n = mp->data[0];
+                        return (n >= 1 && n <= RADAR_MAX_MULTIFRAME &&
+                                len == (int)sizeof(radar_msg_t) + 1 + n * (int)sizeof(es_t) + AUTHTAG_LEN) ? n : -1;
+
+                case RADAR_OPCODE_FEC:
+                        n = len - (int)RADAR_FEC_HEADER - AUTHTAG_LEN;
+                        return (n >= (int)sizeof(radar_mode_ac_t) && n <= (int)sizeof(radar_multiframe_t)) ? 0 : -1;
+
+                case RADAR_OPCODE_KEEPALIVE:
+                        return (len == sizeof(radar_keepalive_t)) ? 0 : -1;
+
+                case RADAR_OPCODE_SYSTEM_TELEMETRY:
+                        return (len == sizeof(radar_telemetry_t)) ? 0 : -1;
+
+                case RADAR_OPCODE_RADIO_STATS:
+                        return (len == sizeof(radar_stats_t)) ? 0 : -1;
+
+                case RADAR_OPCODE_LATENCY:
+                        return (len == sizeof(radar_latency_t)) ? 0 : -1;
+
+                case RADAR_OPCODE_CONFIG_REQ:
+                        return (len == sizeof(radar_probe_t)) ? 0 : -1;
+
+                case RADAR_OPCODE_CONFIG_ACK:
+                        return (len == sizeof(radar_config_t)) ? 0 : -1;
+
+                default:				/* opcodes we don't know only need a valid tag */
+                        return 0;
+        }
+}
+
+
+/*
+ * sequence() - account for a sequence number, returns non-zero if it filled a gap (reordered)
+ */
+static int sequence(station_t *s, uint32_t seq)
+{
+        int32_t d;
+
+        if (!s->msgs) {
+                s->first = s->last = seq;
+                s->window = 1;
+                return 0;
+        }
+
+        d = (int32_t)(seq - s->last);
+
+        if (d > 0) {
+                s->lost += d - 1;
+                s->window = (d < SINK_WINDOW) ? (s->window << d) | 1 : 1;
+                s->last = seq;
+
+        } else if (seq == 1 && s->last != 1) {
+                /* radar has been restarted, the gap before it can't be known */
+                ++s->restarts;
+                s->first = s->last = seq;
+                s->window = 1;
+
+        } else if ((int32_t)(seq - s->first) < 0 || -d >= SINK_WINDOW) {
+                ++s->old;
+
+        } else if (s->window & (1ULL << -d)) {
+                ++s->duplicate;
+
+        } else {
+                s->window |= 1ULL << -d;
+                ++s->reordered;
+                --s->lost;
+                return 1;
+        }
+
+        return 0;
+}
+
+
+/*
+ * is_data() - a message that FEC parity covers
+ */
+static int is_data(uint8_t opcode)
+{
+        return opcode >= RADAR_OPCODE_MODE_AC && opcode <= RADAR_OPCODE_MULTIFRAME;
+}
+
+
+/*
+ * keep() - remember a data message for FEC
+ */
+static void keep(station_t *s, const uint8_t *buf, int len, uint32_t seq, int rebuilt)
+{
+        slot_t *slot = &s->ring[seq & (SINK_FEC_RING - 1)];
+
+        if (len > (int)sizeof(slot->buf))
+                return;
+
+        slot->seq = seq;
+        slot->len = len;
+        slot->rebuilt = rebuilt;
+        memcpy(slot->buf, buf, len);
+}
+
+
+/*
+ * rebuild() - use a parity message to rebuild the one data message it covers that is
+ * missing, if only one is (called with the station locked)
+ */
+static void rebuild(station_t *s, const uint8_t *buf, int len)
+{
+        uint8_t out[sizeof(radar_multiframe_t)];
+        uint32_t first, covers, want = 0;
+        uint16_t lens;
+        int plen = len - (int)RADAR_FEC_HEADER - AUTHTAG_LEN;
+        int i, j, d, frames, missing = 0;
+        uint64_t key;
+        uint32_t seq;
+
+        ++s->fec_msgs;
+        s->fec_bytes += len;
+
+        if (!s->ring && (s->ring = calloc(SINK_FEC_RING, sizeof(slot_t))) == NULL)
+                return;
+
+        memcpy(&first, buf + offsetof(radar_fec_t, first), sizeof(first));
+        memcpy(&covers, buf + offsetof(radar_fec_t, covers), sizeof(covers));
+        memcpy(&lens, buf + offsetof(radar_fec_t, len), sizeof(lens));
+        memcpy(out, buf + RADAR_FEC_HEADER, plen);
+
+        for (i = 0; i < RADAR_FEC_SPAN; i++) {
+                slot_t *slot = &s->ring[(first + i) & (SINK_FEC_RING - 1)];
+
+                if (!(covers & (1U << i)))
+                        continue;
+
+                if (slot->len && slot->seq == first + i && slot->len <= plen) {
+                        for (j = 0; j < slot->len; j++)
+                                out[j] ^= slot->buf[j];
+
+                        lens ^= slot->len;
+                } else {
+                        want = first + i;
+                        ++missing;
+                }
+        }
+
+        if (missing != 1 || lens > plen || lens < sizeof(radar_msg_t) + AUTHTAG_LEN)
+                return;
+
+        /* only a gap behind the highest number seen, not one the parity has overtaken */
+        d = (int32_t)(s->last - want);
+
+        if (d <= 0 || d >= SINK_WINDOW || (s->window & (1ULL << d)) || (int32_t)(want - s->first) < 0)
+                return;
+
+        memcpy(&key, &((radar_msg_t *)out)->key, sizeof(key));
+        memcpy(&seq, &((radar_msg_t *)out)->seq, sizeof(seq));
+        frames = check_length((radar_msg_t *)out, lens);
+
+        if (key != s->key || seq != want || frames < 0 || !is_data(((radar_msg_t *)out)->opcode) ||
+            !authtag_verify(s->hkey, &out[lens - AUTHTAG_LEN], AUTHTAG_LEN, out, lens - AUTHTAG_LEN))
+                return;
+
+        /* it fills the gap as a late arrival would, but it was rebuilt */
+        if (sequence(s, seq)) {
+                --s->reordered;
+                ++s->recovered;
+        }
+
+        s->frames += frames;
+        keep(s, out, lens, seq, 1);
+}
+
+
+/*
+ * pcap_write() - add a message to the pcap file with made up IPv4 and UDP headers
+ */
+static void pcap_write(const struct sockaddr_in *from, struct in_addr to, uint64_t rx, const uint8_t *buf, int len)
+{
+        struct {
+                uint32_t sec, usec, caplen, len;
+                uint8_t ip[20];
+                uint8_t udp[8];
+        } __attribute__((packed)) hdr;
+        uint32_t sum = 0;
+        int i;
+
+        hdr.sec = rx / 1000000;
+        hdr.usec = rx % 1000000;
+        hdr.caplen = hdr.len = sizeof(hdr.ip) + sizeof(hdr.udp) + len;
+
+        memset(hdr.ip, 0, sizeof(hdr.ip));
+        hdr.ip[0] = 0x45;
+        hdr.ip[2] = hdr.len >> 8;
+        hdr.ip[3] = hdr.len;
+        hdr.ip[8] = 64;
+        hdr.ip[9] = IPPROTO_UDP;
+        memcpy(&hdr.ip[12], &from->sin_addr, 4);
+        memcpy(&hdr.ip[16], &to, 4);
+
+        for (i = 0; i < (int)sizeof(hdr.ip); i += 2)
+                sum += (hdr.ip[i] << 8) | hdr.ip[i + 1];
+
+        sum = (sum & 0xFFFF) + (sum >> 16);
+        sum = ~((sum & 0xFFFF) + (sum >> 16));
+        hdr.ip[10] = sum >> 8;
+        hdr.ip[11] = sum;
+
+        memcpy(&hdr.udp[0], &from->sin_port, 2);
+        hdr.udp[2] = port >> 8;
+        hdr.udp[3] = port;
+        hdr.udp[4] = (sizeof(hdr.udp) + len) >> 8;
+        hdr.udp[5] = sizeof(hdr.udp) + len;
+        hdr.udp[6] = hdr.udp[7] = 0;			/* no checksum */
+
+        pthread_mutex_lock(&pcap_lock);
+
+        /* another thread may have stopped writing since the caller looked */
+        if (pcap && (fwrite(&hdr, sizeof(hdr), 1, pcap) != 1 || fwrite(buf, len, 1, pcap) != 1)) {
+                fprintf(stderr, "radar-sink: pcap write failed, stopped writing: %s\n", strerror(errno));
+                fclose(pcap);
+                pcap = NULL;
+        }
+
+        pthread_mutex_unlock(&pcap_lock);
+}
+
+
+/*
+ * pcap_open() - start a pcap file
+ */
+static void pcap_open(const char *path)
+{
+        struct {
+                uint32_t magic;
+                uint16_t major, minor;
+                int32_t zone;
+                uint32_t sigfigs, snaplen, linktype;
+        } hdr = { 0xA1B2C3D4, 2, 4, 0, 0, SINK_PCAP_SNAPLEN, SINK_PCAP_LINKTYPE };
+
+        if ((pcap = fopen(path, "w")) == NULL || fwrite(&hdr, sizeof(hdr), 1, pcap) != 1) {
+                fprintf(stderr, "radar-sink: can't create %s: %s\n", path, strerror(errno));
+                exit(EXIT_FAILURE);
+        }
+}
+
+
+/*
+ * reply() - send a message to a station from the address it sent to
+ */
+static void reply(worker_t *w, void *buf, int len, const struct sockaddr_in *from, struct in_addr to)
+{
+        char control[CMSG_SPACE(sizeof(struct in_pktinfo))];
+        struct in_pktinfo pi;
+        struct cmsghdr *cmsg;
+        struct msghdr mh;
+        struct iovec iov;
+
+        memset(&pi, 0, sizeof(pi));
+        pi.ipi_spec_dst = to;
+
+        iov.iov_base = buf;
+        iov.iov_len = len;
+        memset(&mh, 0, sizeof(mh));
+        mh.msg_name = (void *)from;
+        mh.msg_namelen = sizeof(struct sockaddr_in);
+        mh.msg_iov = &iov;
+        mh.msg_iovlen = 1;
+        mh.msg_control = control;
+        mh.msg_controllen = sizeof(control);
+
+        cmsg = CMSG_FIRSTHDR(&mh);
+        cmsg->cmsg_level = IPPROTO_IP;
+        cmsg->cmsg_type = IP_PKTINFO;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(pi));
+        memcpy(CMSG_DATA(cmsg), &pi, sizeof(pi));
+
+        if (sendmsg(w->fd, &mh, MSG_DONTWAIT) < 0 && debug)
+                perror("radar-sink: sendmsg()");
+}
+
+
+/*
+ * echo() - answer an RTT probe, as the aggregator does
+ */
+static void echo(worker_t *w, station_t *s, const uint8_t *buf, uint32_t seq, const struct sockaddr_in *from, struct in_addr to)
+{
+        radar_probe_t msg;
+        uint64_t ts = ustime();
+
+        memcpy(&msg, buf, sizeof(msg));
+        memcpy(&msg.ts, &ts, sizeof(ts));
+        memcpy(&msg.seq, &seq, sizeof(seq));
+        msg.opcode = RADAR_OPCODE_CONFIG_ACK;
+        authtag_sign_with(s->hkey, msg.atag, AUTHTAG_LEN, &msg, sizeof(msg) - AUTHTAG_LEN);
+
+        reply(w, &msg, sizeof(msg), from, to);
+}
+
+
+/*
+ * push_config() - push the -c settings to a station, as the aggregator would
+ */
+static void push_config(worker_t *w, station_t *s, uint32_t seq, const struct sockaddr_in *from, struct in_addr to)
+{
+        radar_config_t msg = push;
+
+        msg.key = s->key;
+        msg.ts = ustime();
+        msg.seq = seq;
+        msg.opcode = RADAR_OPCODE_CONFIG_REQ;
+        msg.type = RADAR_CONFIG_SET;
+        msg.id = seq;
+        authtag_sign_with(s->hkey, msg.atag, AUTHTAG_LEN, &msg, sizeof(msg) - AUTHTAG_LEN);
+
+        reply(w, &msg, sizeof(msg), from, to);
+}
+
+
+/*
+ * answered() - a station has answered the settings pushed
+ */
+static void answered(station_t *s, const radar_config_t *msg)
+{
+        static const char *status[] = { "changed", "invalid", "stale", "locked" };
+
+        printf("radar-sink: 0x%016llX settings %s (0x%04X): multiframe %u, %u frames, %u mS, ES DFs 0x%08X, SS DFs 0x%08X, "
+                "Mode-A/C %u, budget %u kbps/%u bytes, stats %u S, telemetry %u S\n", (unsigned long long)s->key,
+                msg->status <= RADAR_CONFIG_LOCKED ? status[msg->status] : "?", msg->set, msg->multiframe, msg->frames,
+                msg->interval, msg->es_dfs, msg->ss_dfs, msg->mode_ac, msg->budget_kbps, msg->budget_burst,
+                msg->stats_interval, msg->telemetry_interval);
+        fflush(stdout);
+}
+
+
+/*
+ * receive() - check one message, answering RTT probes
+ */
+static void receive(worker_t *w, uint8_t *buf, int len, uint64_t rx, const struct sockaddr_in *from, struct in_addr to)
+{
+        radar_msg_t *mp = (radar_msg_t *)buf;
+        station_t *s;
+        uint64_t key, ts;
+        uint32_t seq, echo_seq = 0, push_seq = 0;
+        int frames, ok, answer = 0;
+
+        if (len < (int)sizeof(radar_msg_t) + AUTHTAG_LEN) {
+                ++w->runt;
+                return;
+        }
+
+        memcpy(&key, &mp->key, sizeof(key));
+        memcpy(&ts, &mp->ts, sizeof(ts));
+        memcpy(&seq, &mp->seq, sizeof(seq));
+
+        if ((s = find_station(key)) == NULL) {
+                ++w->unknown;
+                return;
+        }
+
+        /* the expensive part, outside the lock */
+        frames = check_length(mp, len);
+        ok = frames >= 0 && authtag_verify(s->hkey, &buf[len - AUTHTAG_LEN], AUTHTAG_LEN, buf, len - AUTHTAG_LEN);
+
+        pthread_mutex_lock(&s->lock);
+
+        if (!ok) {
+                ++s->bad;
+
+        } else if (s->ring && is_data(mp->opcode) && s->ring[seq & (SINK_FEC_RING - 1)].seq == seq &&
+                   s->ring[seq & (SINK_FEC_RING - 1)].rebuilt) {
+                /* we have already rebuilt it from parity so don't count it twice */
+                ++s->fec_late;
+                s->ring[seq & (SINK_FEC_RING - 1)].rebuilt = 0;
+
+        } else {
+                uint64_t ns = (rx > ts) ? (rx - ts) * 1000 : 0;
+
+                sequence(s, seq);
+                ++s->msgs;
+                s->frames += frames;
+
+                if (mp->opcode == RADAR_OPCODE_KEEPALIVE)
+                        ++s->keepalives;
+
+                if (mp->opcode == RADAR_OPCODE_CONFIG_REQ && ((radar_probe_t *)buf)->type == RADAR_CONFIG_PROBE) {
+                        ++s->probes;
+                        echo_seq = ++s->tx_seq;
+                }
+
+                if (mp->opcode == RADAR_OPCODE_CONFIG_ACK && ((radar_config_t *)buf)->type == RADAR_CONFIG_SET &&
+                    s->answer < 0) {
+                        s->answer = ((radar_config_t *)buf)->status;
+                        answer = 1;
+                }
+
+                if (push.set && s->answer < 0 && rx >= s->pushed + SINK_PUSH_INTERVAL) {
+                        s->pushed = rx;
+                        push_seq = ++s->tx_seq;
+                }
+
+                latency_add(&s->now, ns);
+
+                if (s->ring && is_data(mp->opcode))
+                        keep(s, buf, len, seq, 0);
+
+                if (mp->opcode == RADAR_OPCODE_FEC)
+                        rebuild(s, buf, len);
+        }
+
+        pthread_mutex_unlock(&s->lock);
+
+        if (echo_seq)
+                echo(w, s, buf, echo_seq, from, to);
+
+        if (answer)
+                answered(s, (radar_config_t *)buf);
+
+        if (push_seq)
+                push_config(w, s, push_seq, from, to);
+}
+
+
+/*
+ * dropped() - the loss simulator: should this message be dropped?  Losses come in runs
+ * with a mean length of loss_burst, entered often enough to drop 'loss' of the messages
+ */
+static int dropped(worker_t *w)
+{
+        double r = rand_r(&w->seed) / (RAND_MAX + 1.0);
+
+        if (w->burst)
+                w->burst = r >= 1 / loss_burst;
+        else
+                w->burst = r < loss / (loss_burst * (1 - loss));
+
+        return w->burst;
+}
+
+
+/*
+ * worker() - receive and check messages on one socket until told to stop
+ */
+static void *worker(void *arg)
+{
+        worker_t *w = arg;
+        static __thread uint8_t bufs[SINK_BATCH][SINK_MSG_SIZE];
+        static __thread char controls[SINK_BATCH][CMSG_SPACE(sizeof(struct timespec)) + CMSG_SPACE(sizeof(struct in_pktinfo))];
+        struct mmsghdr msgs[SINK_BATCH];
+        struct iovec iovs[SINK_BATCH];
+        struct sockaddr_in froms[SINK_BATCH];
+        int i, n;
+
+        while (!ending) {
+                uint64_t bytes = 0;
+
+                for (i = 0; i < SINK_BATCH; i++) {
+                        iovs[i].iov_base = bufs[i];
+                        iovs[i].iov_len = SINK_MSG_SIZE;
+                        memset(&msgs[i].msg_hdr, 0, sizeof(struct msghdr));
+                        msgs[i].msg_hdr.msg_name = &froms[i];
+                        msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+                        msgs[i].msg_hdr.msg_iov = &iovs[i];
+                        msgs[i].msg_hdr.msg_iovlen = 1;
+                        msgs[i].msg_hdr.msg_control = controls[i];
+                        msgs[i].msg_hdr.msg_controllen = sizeof(controls[i]);
+                }
+
+                /* SO_RCVTIMEO brings us back to check for the end now and again */
+                if ((n = recvmmsg(w->fd, msgs, SINK_BATCH, MSG_WAITFORONE, NULL)) <= 0)
+                        continue;
+
+                for (i = 0; i < n; i++) {
+                        struct cmsghdr *cmsg;
+                        struct in_addr to = bind_addr;
+                        uint64_t rx = 0;
+
+                        for (cmsg = CMSG_FIRSTHDR(&msgs[i].msg_hdr); cmsg; cmsg = CMSG_NXTHDR(&msgs[i].msg_hdr, cmsg)) {
+                                if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPNS) {
+                                        struct timespec ts;
+
+                                        memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+                                        rx = (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+
+                                } else if (cmsg->cmsg_level == IPPROTO_IP && cmsg->cmsg_type == IP_PKTINFO) {
+                                        struct in_pktinfo pi;
+
+                                        memcpy(&pi, CMSG_DATA(cmsg), sizeof(pi));
+                                        to = pi.ipi_addr;
+                                }
+                        }
+
+                        if (!rx)
+                                rx = ustime();
+
+                        if (loss && dropped(w)) {
+                                ++w->dropped;
+                                continue;
+                        }
+
+                        receive(w, bufs[i], msgs[i].msg_len, rx, &froms[i], to);
+                        bytes += msgs[i].msg_len;
+
+                        if (pcap)
+                                pcap_write(&froms[i], to, rx, bufs[i], msgs[i].msg_len);
+                }
+
+                pthread_mutex_lock(&w->lock);
+                w->msgs += n;
+                w->bytes += bytes;
+                pthread_mutex_unlock(&w->lock);
+        }
+
+        return NULL;
+}
+
+
+/*
+ * open_socket() - a worker's socket, all bound to the same port
+ */
+static int open_socket(void)
+{
+        struct sockaddr_in sa;
+        struct timeval tv = { 0, 200000 };
+        int fd, one = 1, size = SINK_RCVBUF;
+
+        if ((fd = socket(AF_INET, SOCK_DGRAM, 0)) < 0) {
+                perror("radar-sink: socket()");
+                exit(EXIT_FAILURE);
+        }
+
+        setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one));
+        setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPNS, &one, sizeof(one));
+        setsockopt(fd, IPPROTO_IP, IP_PKTINFO, &one, sizeof(one));
+
+        memset(&sa, 0, sizeof(sa));
+        sa.sin_family = AF_INET;
+        sa.sin_addr = bind_addr;
+        sa.sin_port = htons(port);
+
+        if (bind(fd, (struct sockaddr *)&sa, sizeof(sa)) < 0) {
+                fprintf(stderr, "radar-sink: can't bind UDP port %d: %s\n", port, strerror(errno));
+                exit(EXIT_FAILURE);
+        }
+
+        return fd;
+}
+
+
+/*
+ * totals - everything added up for a report
+ */
+typedef struct {
+        uint64_t msgs, bytes, frames, rejected, duplicate, reordered, old;
+        uint64_t dropped, fec_msgs, fec_bytes, recovered, probes;
+        int64_t lost;
+        latency_hist_t lat;
+} totals_t;
+
+
+/*
+ * collect() - add up the workers and stations, moving this interval's latency into the totals
+ */
+static void collect(totals_t *t, latency_hist_t *now)
+{
+        station_t *s, *tmp;
+        int i;
+
+        memset(t, 0, sizeof(totals_t));
+
+        for (i = 0; i < nthreads; i++) {
+                pthread_mutex_lock(&workers[i].lock);
+                t->msgs += workers[i].msgs;
+                t->bytes += workers[i].bytes;
+                t->rejected += workers[i].runt + workers[i].unknown;
+                t->dropped += workers[i].dropped;
+                pthread_mutex_unlock(&workers[i].lock);
+        }
+
+        pthread_rwlock_rdlock(&stations_lock);
+
+        HASH_ITER(hh, stations, s, tmp) {
+                pthread_mutex_lock(&s->lock);
+                t->frames += s->frames;
+                t->rejected += s->bad;
+                t->lost += s->lost;
+                t->reordered += s->reordered;
+                t->duplicate += s->duplicate;
+                t->old += s->old;
+                t->fec_msgs += s->fec_msgs;
+                t->fec_bytes += s->fec_bytes;
+                t->recovered += s->recovered;
+                t->probes += s->probes;
+                latency_merge(now, &s->now);
+                latency_merge(&s->lat, &s->now);
+                memset(&s->now, 0, sizeof(latency_hist_t));
+                latency_merge(&t->lat, &s->lat);
+                pthread_mutex_unlock(&s->lock);
+        }
+
+        pthread_rwlock_unlock(&stations_lock);
+}
+
+
+/*
+ * report_interval() - one line of totals for the last interval
+ */
+static void report_interval(const totals_t *t, const totals_t *prev, const latency_hist_t *now, double secs)
+{
+        printf("%9.0f %9.0f %9.1f %8llu %8lld %8llu %8llu %8llu %8.2f %8.2f %8.2f %6d\n",
+                (t->msgs - prev->msgs) / secs, (t->frames - prev->frames) / secs, (t->bytes - prev->bytes) / secs / 1000,
+                (unsigned long long)t->rejected, (long long)t->lost, (unsigned long long)t->recovered, (unsigned long long)t->reordered,
+                (unsigned long long)t->duplicate,
+                latency_percentile(now, 500) / 1e6, latency_percentile(now, 990) / 1e6, now->max / 1e6, nstations);
+        fflush(stdout);
+}
+
+
+/*
+ * report_stations() - the table of stations at the end
+ */
+static void report_stations(const totals_t *t, double secs)
+{
+        station_t *s, *tmp;
+        int i;
+
+        printf("\n%-18s %10s %10s %8s %6s %8s %8s %8s %8s %8s %6s %8s %8s %8s\n", "key", "msgs", "frames", "keepalv",
+                "bad", "lost", "recov", "reorder", "dupe", "old", "restrt", "p50 ms", "p99 ms", "max ms");
+
+        HASH_ITER(hh, stations, s, tmp) {
+                printf("0x%016llX %10llu %10llu %8llu %6llu %8lld %8llu %8llu %8llu %8llu %6llu %8.2f %8.2f %8.2f\n",
+                        (unsigned long long)s->key, (unsigned long long)s->msgs, (unsigned long long)s->frames,
+                        (unsigned long long)s->keepalives, (unsigned long long)s->bad, (long long)s->lost,
+                        (unsigned long long)s->recovered, (unsigned long long)s->reordered, (unsigned long long)s->duplicate,
+                        (unsigned long long)s->old, (unsigned long long)s->restarts,
+                        latency_percentile(&s->lat, 500) / 1e6, latency_percentile(&s->lat, 990) / 1e6,
+                        s->lat.max / 1e6);
+        }
+
+        printf("\nradar-sink: %llu messages (%.0f/s), %llu frames (%.0f/s) from %d stations in %.1f seconds\n",
+                (unsigned long long)t->msgs, t->msgs / secs, (unsigned long long)t->frames, t->frames / secs,
+                nstations, secs);
+
+        if (t->dropped)
+                printf("radar-sink: loss simulator dropped %llu messages (%.2f%%)\n", (unsigned long long)t->dropped,
+                        100.0 * t->dropped / (t->msgs ? t->msgs : 1));
+
+        if (t->fec_msgs)
+                printf("radar-sink: FEC parity %llu messages, %.1f%% of bytes received: %llu messages rebuilt, %lld still lost\n",
+                        (unsigned long long)t->fec_msgs, 100.0 * t->fec_bytes / (t->bytes ? t->bytes : 1),
+                        (unsigned long long)t->recovered, (long long)t->lost);
+
+        if (t->probes)
+                printf("radar-sink: answered %llu RTT probes\n", (unsigned long long)t->probes);
+
+        if (push.set) {
+                int changed = 0;
+
+                HASH_ITER(hh, stations, s, tmp)
+                        if (s->answer == RADAR_CONFIG_OK)
+                                ++changed;
+
+                printf("radar-sink: settings changed on %d of %d stations\n", changed, nstations);
+        }
+
+        for (i = 0; i < nthreads; i++) {
+                if (workers[i].runt || workers[i].unknown)
+                        printf("radar-sink: thread %d rejected %llu too short and %llu with unknown keys\n", i,
+                                (unsigned long long)workers[i].runt, (unsigned long long)workers[i].unknown);
+        }
+}
+
+
+/*
+ * signal_handler() - stop cleanly on ^C
+ */
+static void signal_handler(int sig)
+{
+        (void)sig;
+        ending = 1;
+}
+
+
+/*
+ * parse_settings() - the -c settings to push, a comma separated list of <name>=<value>
+ */
+static int parse_settings(char *spec)
+{
+        char *tok, *save = NULL;
+
+        for (tok = strtok_r(spec, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+                char name[8];
+                unsigned long v;
+                char *end;
+
+                if (sscanf(tok, "%7[^=]=", name) != 1 || !strchr(tok, '='))
+                        return 0;
+
+                v = strtoul(strchr(tok, '=') + 1, &end, 0);
+
+                if (*end)
+                        return 0;
+
+                if (strcmp(name, "m") == 0) {
+                        push.multiframe = v;
+                        push.set |= RADAR_SET_MULTIFRAME;
+                } else if (strcmp(name, "i") == 0) {
+                        push.interval = v;
+                        push.set |= RADAR_SET_INTERVAL;
+                } else if (strcmp(name, "f") == 0) {
+                        push.frames = v;
+                        push.set |= RADAR_SET_FRAMES;
+                } else if (strcmp(name, "es") == 0) {
+                        push.es_dfs = v;
+                        push.set |= RADAR_SET_ES_DFS;
+                } else if (strcmp(name, "ss") == 0) {
+                        push.ss_dfs = v;
+                        push.set |= RADAR_SET_SS_DFS;
+                } else if (strcmp(name, "ac") == 0) {
+                        push.mode_ac = v;
+                        push.set |= RADAR_SET_MODE_AC;
+                } else if (strcmp(name, "kbps") == 0) {
+                        push.budget_kbps = v;
+                        push.set |= RADAR_SET_BUDGET;
+                } else if (strcmp(name, "burst") == 0) {
+                        push.budget_burst = v;
+                        push.set |= RADAR_SET_BUDGET;
+                } else if (strcmp(name, "s") == 0) {
+                        push.stats_interval = v;
+                        push.set |= RADAR_SET_STATS;
+                } else if (strcmp(name, "t") == 0) {
+                        push.telemetry_interval = v;
+                        push.set |= RADAR_SET_TELEMETRY;
+                } else {
+                        return 0;
+                }
+        }
+
+        return push.set != 0;
+}
+
+
+/*
+ * usage() - print help and exit
+ */
+static void usage(void)
+{
+        fprintf(stderr, "usage: radar-sink [-l port] [-b address] [-t threads] [-p pass-phrase] [-k key[:pass]]...\n"
+                        "                  [-K key-file] [-w pcap-file] [-i seconds] [-d seconds] [-L percent[:burst]]\n"
+                        "                  [-c settings]\n");
+        exit(EXIT_FAILURE);
+}
+
+
+/*
+ * main program
+ */
+int main(int argc, char *argv[])
+{
+        totals_t t, prev;
+        latency_hist_t now;
+        uint64_t start, last;
+        char *pcap_path = NULL;
+        int c, i;
+
+        /* -k and -K may come before -p so keep them until the options are read */
+        char *keys[argc];
+        int nkeys = 0;
+        char *keyfile = NULL;
+
+        while ((c = getopt(argc, argv, "l:b:t:p:k:K:w:i:d:L:c:?")) != -1) {
+                switch (c) {
+                        case 'l': port = atoi(optarg); break;
+                        case 'b':
+                                if (inet_pton(AF_INET, optarg, &bind_addr) != 1) {
+                                        fprintf(stderr, "radar-sink: bad address \"%s\"\n", optarg);
+                                        exit(EXIT_FAILURE);
+                                }
+                                break;
+                        case 't': nthreads = atoi(optarg); break;
+                        case 'p': pass = optarg; break;
+                        case 'k': keys[nkeys++] = optarg; break;
+                        case 'K': keyfile = optarg; break;
+                        case 'w': pcap_path = optarg; break;
+                        case 'i': interval = atoi(optarg); break;
+                        case 'd': duration = atoi(optarg); break;
+                        case 'L':
+                                if (sscanf(optarg, "%lf:%lf", &loss, &loss_burst) < 1 || loss < 0 || loss >= 100 || loss_burst < 1)
+                                        usage();
+                                loss /= 100;
+                                break;
+                        case 'c':
+                                if (!parse_settings(optarg))
+                                        usage();
+                                break;
+                        default: usage();
+                }
+        }
+
+        if (optind < argc || nthreads < 1 || nthreads > SINK_THREADS_MAX || port < 1 || port > 65535 || interval < 0 || duration < 0)
+                usage();
+
+        authtag_expand(default_hkey, pass);
+
+        for (i = 0; i < nkeys; i++) {
+                char *colon = strchr(keys[i], ':');
+
+                add_psk(keys[i], colon ? colon + 1 : NULL);
+        }
+
+        if (keyfile)
+                read_keys(keyfile);
+
+        if (pcap_path)
+                pcap_open(pcap_path);
+
+        signal(SIGINT, signal_handler);
+        signal(SIGTERM, signal_handler);
+
+        for (i = 0; i < nthreads; i++) {
+                workers[i].fd = open_socket();
+                pthread_mutex_init(&workers[i].lock, NULL);
+                workers[i].seed = 1 + i;
+        }
+
+        for (i = 0; i < nthreads; i++) {
+                if (pthread_create(&workers[i].tid, NULL, worker, &workers[i]) != 0) {
+                        perror("radar-sink: pthread_create()");
+                        exit(EXIT_FAILURE);
+                }
+        }
+
+        printf("radar-sink: listening on %s:%d with %d threads, %s\n", inet_ntoa(bind_addr), port, nthreads,
+                psks ? "accepting listed keys only" : "accepting any key");
+
+        if (interval)
+                printf("%9s %9s %9s %8s %8s %8s %8s %8s %8s %8s %8s %6s\n", "msgs/s", "frames/s", "kB/s", "rejected",
+                        "lost", "recov", "reorder", "dupe", "p50 ms", "p99 ms", "max ms", "keys");
+
+        memset(&prev, 0, sizeof(prev));
+        start = last = nstime();
+
+        while (!ending) {
+                uint64_t tick = nstime();
+
+                usleep(100000);
+
+                if (duration && tick - start >= (uint64_t)duration * 1000000000)
+                        break;
+
+                if (interval && tick - last >= (uint64_t)interval * 1000000000) {
+                        memset(&now, 0, sizeof(now));
+                        collect(&t, &now);
+                        report_interval(&t, &prev, &now, (tick - last) / 1e9);
+                        prev = t;
+                        last = tick;
+                }
+        }
+
+        ending = 1;
+
+        for (i = 0; i < nthreads; i++)
+                pthread_join(workers[i].tid, NULL);
+
+        memset(&now, 0, sizeof(now));
+        collect(&t, &now);
+        report_stations(&t, (nstime() - start) / 1e9);
+
+        if (pcap)
+                fclose(pcap);
+
+        return (t.rejected || t.duplicate) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
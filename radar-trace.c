@@ -0,0 +1,173 @@
+/*
+ * radar-trace.c -- Decode a trace ring dump written by radar (see trace.c)
+ * Author: Michael J. Tubby B.Sc. MIET  mike@tubby.org
+ *
+ * USAGE
+ *
+ *	radar-trace [-c] <file> ...
+ *
+ * where:
+ *
+ *	-c		  output comma separated values with a heading line
+ *
+ * One line is printed per record, oldest first.  Frames show what radar did
+ * with them and the sequence number of the message they went in (zero if not
+ * sent), events show what happened and their argument (e.g. source index).
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "trace.h"
+
+
+/*
+ * code_name() - printable name of a record code
+ */
+static const char *code_name(int code)
+{
+        switch (code) {
+                case TRACE_NONE:		return "NONE";
+                case TRACE_SENT:		return "SENT";
+                case TRACE_SEND_FAIL:		return "SEND_FAIL";
+                case TRACE_BUFFERED:		return "BUFFERED";
+                case TRACE_DUPE:		return "DUPE";
+                case TRACE_FILTERED:		return "FILTERED";
+                case TRACE_SHED:		return "SHED";
+                case TRACE_OVERLOAD:		return "OVERLOAD";
+                case TRACE_EV_BAD_FRAME:	return "BAD_FRAME";
+                case TRACE_EV_BEAST_RESET:	return "BEAST_RESET";
+                case TRACE_EV_SOURCE_SWITCH:	return "SOURCE_SWITCH";
+                case TRACE_EV_UDP_RESET:	return "UDP_RESET";
+                case TRACE_EV_MULTIFRAME:	return "MULTIFRAME";
+                case TRACE_EV_OVERLOAD:		return "OVERLOAD_LEVEL";
+                case TRACE_EV_UPLINK_SWITCH:	return "UPLINK_SWITCH";
+                default:			return "UNKNOWN";
+        }
+}
+
+
+/*
+ * udp_name() - printable name of a UDP state (enum udpstate in udp.h)
+ */
+static const char *udp_name(int state)
+{
+        static const char *names[] = { "IDLE", "STARTUP", "RUN", "RETRY_WAIT" };
+
+        return (state >= 0 && state < 4) ? names[state] : "?";
+}
+
+
+/*
+ * format_ts() - format a micro-second timestamp as UTC date and time
+ */
+static char *format_ts(uint64_t us)
+{
+        static char buf[40];
+        time_t secs = (time_t)(us / 1000000);
+        int n;
+
+        n = strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", gmtime(&secs));
+        snprintf(&buf[n], sizeof(buf) - n, ".%06u", (unsigned)(us % 1000000));
+
+        return buf;
+}
+
+
+/*
+ * decode() - decode one dump file, returns zero on success
+ */
+static int decode(const char *name, int csv)
+{
+        trace_header_t hdr;
+        trace_t t;
+        FILE *f;
+        uint32_t i;
+
+        if ((f = fopen(name, "rb")) == NULL) {
+                perror(name);
+                return 1;
+        }
+
+        if (fread(&hdr, sizeof(hdr), 1, f) != 1 || hdr.magic != TRACE_MAGIC) {
+                fprintf(stderr, "%s: not a radar trace file\n", name);
+                fclose(f);
+                return 1;
+        }
+
+        if (hdr.version != TRACE_VERSION || hdr.size != sizeof(trace_t)) {
+                fprintf(stderr, "%s: unsupported version %u record size %u\n", name, hdr.version, hdr.size);
+                fclose(f);
+                return 1;
+        }
+
+        if (csv) {
+                printf("time,code,df,icao,rssi,len,batch,udp,source,arg\n");
+        } else {
+                printf("# %s: key 0x%016llX dumped %s UTC, %u records (%u older records overwritten)\n",
+                        name, (unsigned long long)hdr.key, format_ts(hdr.ts), hdr.count, hdr.lost);
+        }
+
+        for (i = 0; i < hdr.count; i++) {
+                if (fread(&t, sizeof(t), 1, f) != 1) {
+                        fprintf(stderr, "%s: truncated at record %u\n", name, i);
+                        break;
+                }
+
+                if (csv) {
+                        printf("%s,%s,%d,%06X,%u,%u,%u,%s,%u,%u\n", format_ts(t.ts), code_name(t.code),
+                                t.code < 0x80 ? t.df : -1, t.icao, t.rssi, t.len, t.batch, udp_name(t.udp), t.source, t.arg);
+
+                } else if (t.code >= 0x80) {
+                        printf("%s  %-13s batch %-10u arg %-5u udp %-10s src %u\n", format_ts(t.ts), code_name(t.code),
+                                t.batch, t.arg, udp_name(t.udp), t.source);
+
+                } else {
+                        if (t.df == 0xFF)
+                                printf("%s  %-13s Mode-A/C        ", format_ts(t.ts), code_name(t.code));
+                        else
+                                printf("%s  %-13s DF%-2u %06X     ", format_ts(t.ts), code_name(t.code), t.df, t.icao);
+
+                        printf("rssi %-3u len %-2u batch %-10u udp %-10s src %u\n", t.rssi, t.len, t.batch, udp_name(t.udp), t.source);
+                }
+        }
+
+        fclose(f);
+        return 0;
+}
+
+
+/*
+ * main program
+ */
+int main(int argc, char *argv[])
+{
+        int rc, csv = 0, errors = 0;
+
+        while ((rc = getopt(argc, argv, "c?")) >= 0) {
+                switch (rc) {
+                        case 'c':
+                                ++csv;
+                                break;
+
+                        default:
+                                fprintf(stderr, "usage: radar-trace [-c] <file> ...\n");
+                                exit(1);
+                }
+        }
+
+        if (optind >= argc) {
+                fprintf(stderr, "usage: radar-trace [-c] <file> ...\n");
+                exit(1);
+        }
+
+        for (; optind < argc; optind++)
+                errors += decode(argv[optind], csv);
+
+        exit(errors ? EXIT_FAILURE : EXIT_SUCCESS);
+}
@@ -112,6 +112,11 @@
  *	-h <hostname>	  destination hostname for aggregator, defaults to adsb-in.1090mhz.uk
  *      -p <pass-phrase>  pre-shared key for message authentication, defaults to "secret"
  *	-r <ipaddr>	  address of device that provides ADS-B source if not localhost
+ *			  or "-" for stdin, "fifo:<path>" or "unix:<path>" for a local source
+ *			  (repeat to add hot-standby sources in order of preference)
+ *	-j <ms>		  stall timeout before failing over to a standby source (default 500)
+ *	-a		  use AVR protocol on TCP port 30002 instead of BEAST
+ *	-H		  filter to DF11/17 only in Mode-S Beast hardware (drops DF18-21)
  *	-e                forward everything (Mode-A/C, Mode-S, and all Extended Squitter)
  *	-u <user>	  user name to run under, e.g. 'nobody'
  *	-g <group>	  group name to run under, e.g. 'nogroup'
@@ -123,6 +128,23 @@
  *	-t <seconds>	  send system telemetry every period (default 900 = 15 min)
  *	-m		  enable multiframe sending (more efficient but adds latency)
  *	-i <ms>           multiframe forwaring interval/timeout (milliseconds)
+ *	-T		  stamp messages with the frame arrival time rather than the send time
+ *	-M <[addr:]port|path> serve OpenMetrics over HTTP on a local port or unix domain socket
+ *	-w <dir>	  directory for trace dumps on SIGUSR1 or /trace (default /tmp)
+ *	-W <file>	  capture the BEAST/AVR input with arrival times to a file
+ *	-R <file>	  replay a capture file instead of reading a receiver (needs -h)
+ *	-F		  replay as fast as possible rather than in real time
+ *	-C <config>	  with -R simulate a forwarding configuration offline, repeat to compare (see sim.c)
+ *	-U <kbps>[:<bytes>[:pace]] hold the uplink to a budget, shedding the least useful frames (see udp.c)
+ *	-o <bytes>[:<ms>] overload protection: degrade when the input backlog or loop lag pass these (see overload.c)
+ *	-K <k>		  send an XOR parity message after every k data messages (see fec.c)
+ *	-X <spec>	  impair the uplink for testing: loss, delay, reorder, dup, corrupt... (see impair.c)
+ *	-O <if|addr>	  send over an uplink bound to an interface or source address, repeat for standby paths (see udp.c)
+ *	-J		  with -O also send position, velocity and identification on the best standby path
+ *	-A <ms>		  probe the uplink RTT, jitter and loss every <ms>, 0 for once a second (see probe.c)
+ *	-I		  with -m and -A widen the multiframe interval to suit the uplink RTT
+ *	-L		  lock the settings, refusing changes pushed by the aggregator (see PROTOCOL.md)
+ *	-D <host>[:<port>],key=<key>[,...] also send to another destination, signed for it, repeatable (see udp.c)
  *	-v		  print version number and exit
  *
  * but normally runs as a service.
@@ -176,12 +198,25 @@
 #include "banner.h"
 #include "version.h"
 #include "beast.h"
+#include "avr.h"
 #include "udp.h"
 #include "dupe.h"
 #include "authtag.h"
 #include "ustime.h"
 #include "mstime.h"
 #include "hex.h"
+#include "nstime.h"
+#include "latency.h"
+#include "metrics.h"
+#include "trace.h"
+#include "capture.h"
+#include "sim.h"
+#include "overload.h"
+#include "fec.h"
+#include "impair.h"
+#include "netlink.h"
+#include "probe.h"
+#include "probes.h"
 #include "qerror.h"
 
 
@@ -203,33 +238,59 @@ int multiframe = 0;
 int forward_interval = RADAR_FORWARD_INTERVAL;			/* milliseconds */
 int rebind = 0;
 int everything = 0;
+int df1117 = 0;
 int stats_interval = STATS_INTERVAL;
 int telemetry_interval = TELEMETRY_INTERVAL;
 int reset_udp = 0;
+int stamp_arrival = 0;
+char metrics[HOSTNAME_LEN+1] = "";
+int dump_trace = 0;
+char capture[HOSTNAME_LEN+1] = "";
+char replay[HOSTNAME_LEN+1] = "";
+int replay_fast = 0;
+uint64_t replay_base;							/* capture time at the start of the replay (uS) */
+uint64_t replay_real;							/* nstime() at the start of the replay */
+uint64_t next_second;							/* replay: next housekeeping (capture uS) */
+uint64_t next_forward;							/* replay: next multiframe flush (capture uS) */
+uint32_t cur_trace;							/* trace record of the frame being processed */
 uint64_t key;
 char hostname[HOSTNAME_LEN+1] = UDP_HOST;
+int hostgiven = 0;							/* -h given, replay needs it */
 char psk[PSK_LEN+1] = "secret";
-char localaddress[HOSTNAME_LEN+1] = "127.0.0.1";
-uint16_t port = BEAST_TCP_PORT;
+char localaddress[BEAST_MAX_SOURCES][HOSTNAME_LEN+1] = { "127.0.0.1" };
+int nlocal = 0;
+int stall_timeout = BEAST_STALL_TIMEOUT;
+uint16_t port = 0;							/* default depends on protocol */
 uint32_t seq = 1;
 char username[USERNAME_LEN+1] = "nobody";
 char groupname[GROUPNAME_LEN+1] = "nogroup";
 int qos = 0;
 uint32_t dupe_ss_count = 0;
 uint32_t dupe_es_count = 0;
+uint32_t shed_count = 0;
+int uplink_kbps = 0;							/* -U uplink budget, zero for none */
+int uplink_burst = 0;							/* -U burst (bytes), zero for the default */
+int uplink_pace = 0;							/* -U also sets SO_MAX_PACING_RATE */
+int protect = 0;							/* -o overload protection enabled */
+int overload = OVERLOAD_NONE;						/* overload level in force */
+int base_multiframe;							/* -m and -i as configured, restored as overload eases */
+int base_interval;
+int adaptive = 0;							/* -I multiframe interval follows the uplink RTT */
+int max_frames = RADAR_MAX_MULTIFRAME;					/* most frames in a multiframe message */
+uint32_t es_dfs = RADAR_ES_DFS;						/* extended (112 bit) DFs forwarded, bit n for DFn */
+uint32_t ss_dfs = 0;							/* short (56 bit) DFs forwarded */
+int locked = 0;								/* -L refuse settings pushed by the aggregator */
+uint64_t config_ts = 0;							/* time stamp of the last change pushed */
+int forward_fd = -1;							/* multiframe forwarding timer */
+int fec_k = 0;								/* -K data messages per parity message */
 uint32_t send_count = 0;
 uint32_t byte_count = 0;
+uint64_t latency_sum = 0;
+uint32_t latency_count = 0;
+uint32_t latency_max = 0;
 char serport[BEAST_SERIAL_PORT_NAME+1] = "/dev/ttyUSB0";
 int num;
 
-
-typedef struct {
-        uint8_t mlat[MLAT_LEN];					/* Multi-lateration timestamp */
-        uint8_t rssi;        					/* Received signal strength indication */
-        uint8_t data[MODE_ES_LEN];				/* data */
-} esdata_t;
-
-
 esdata_t esdata[RADAR_MAX_MULTIFRAME];
 
 
@@ -243,6 +304,15 @@ void cleanup(void)
 
         /* close down UDP */
         udp_close();
+
+        /* close metrics listener */
+        metrics_close();
+
+        /* stop watching for network changes */
+        netlink_close();
+
+        /* finish any capture */
+        capture_close();
 }
 
 
@@ -266,6 +336,10 @@ void signal_handler(int signal)
                 case SIGINT:
                         ++ending;
                         break;
+
+                case SIGUSR1:
+                        ++dump_trace;
+                        break;
         }
 }
 
@@ -318,22 +392,84 @@ static void clear_buffer(void)
 }
 
 
+/*
+ * header_ts() - timestamp for a message header: the send time or with -T the arrival time
+ */
+static uint64_t header_ts(uint64_t rx)
+{
+        return (stamp_arrival && rx) ? rx : ustime();
+}
+
+
+/*
+ * traced() - record what happened to the frame being processed and the message it went in
+ */
+static void traced(int ok, uint32_t batch)
+{
+        trace_t *t = trace_at(cur_trace);
+
+        t->code = ok ? TRACE_SENT : TRACE_SEND_FAIL;
+        t->batch = batch;
+}
+
+
+/*
+ * sent() - record the in-process latency (arrival to sendto) of a frame we've just sent
+ */
+static void sent(uint64_t rx)
+{
+        uint32_t us;
+
+        if (rx) {
+                us = telemetry_latency(rx);
+
+                latency_sum += us;
+                ++latency_count;
+
+                if (us > latency_max)
+                        latency_max = us;
+        }
+}
+
+
+/*
+ * parity() - add a data message that has just been sent to the parity group and send
+ * the parity when the group is complete (see fec.c)
+ */
+static void parity(const void *bp, int size, uint32_t sq)
+{
+        if (fec_add(bp, size, sq))
+                radar_send_fec();
+}
+
+
 /*
  * send_mode_ac() - Send a Mode-A/C message to the aggregator
  */
-static void send_mode_ac(radar_mode_ac_t *bp)
+static void send_mode_ac(radar_mode_ac_t *bp, uint64_t rx)
 {
         if (bp) {
+                int ok;
+
                 bp->key = key;							/* API key */
-                bp->ts = ustime();						/* timestamp uS */
+                bp->ts = header_ts(rx);						/* timestamp uS */
                 bp->seq = seq++;						/* sequence number */
                 bp->opcode = RADAR_OPCODE_MODE_ES;				/* opcode */
                 
                 /* add auth tag */
                 authtag_sign(bp->atag, AUTHTAG_LEN, bp, sizeof(radar_mode_ac_t)-AUTHTAG_LEN);
+                latency_stage(LATENCY_DEDUP_SIGN);
+                PROBE3(packet_signed, bp->seq, bp->opcode, sizeof(radar_mode_ac_t));
                 
                 /* send to aggregator */
-                udp_send(bp, sizeof(radar_mode_ac_t));				/* send message */
+                ok = udp_send(bp, sizeof(radar_mode_ac_t));			/* send message */
+
+                if (ok) {
+                        latency_stage(LATENCY_SIGN_SEND);
+                        sent(rx);
+                }
+
+                traced(ok, bp->seq);
 
                 /* stats for aggregator */
                 ++stats.tx_mode_ac;
@@ -343,6 +479,9 @@ static void send_mode_ac(radar_mode_ac_t *bp)
                 /* local stats */
                 ++send_count;
                 byte_count += sizeof(radar_mode_ac_t);
+
+                /* -K: parity */
+                parity(bp, sizeof(radar_mode_ac_t), bp->seq);
         }
 }
 
@@ -350,21 +489,31 @@ static void send_mode_ac(radar_mode_ac_t *bp)
 /*
  * send_mode_ss() - Send a Mode-S Short Squitter to the aggregator
  */
-static void send_mode_ss(radar_mode_ss_t *bp)
+static void send_mode_ss(radar_mode_ss_t *bp, uint64_t rx)
 {
         if (bp) {
                 uint8_t df = bp->data[0] >> 3;
+                int ok;
         
                 bp->key = key;							/* API key */
-                bp->ts = ustime();						/* timestamp uS */
+                bp->ts = header_ts(rx);						/* timestamp uS */
                 bp->seq = seq++;						/* sequence number */
                 bp->opcode = RADAR_OPCODE_MODE_ES;				/* opcode */
                 
                 /* add auth tag */
                 authtag_sign(bp->atag, AUTHTAG_LEN, bp, sizeof(radar_mode_ss_t)-AUTHTAG_LEN);
+                latency_stage(LATENCY_DEDUP_SIGN);
+                PROBE3(packet_signed, bp->seq, bp->opcode, sizeof(radar_mode_ss_t));
 
                 /* send to aggregator */                	
-                udp_send(bp, sizeof(radar_mode_ss_t));
+                ok = udp_send(bp, sizeof(radar_mode_ss_t));
+
+                if (ok) {
+                        latency_stage(LATENCY_SIGN_SEND);
+                        sent(rx);
+                }
+
+                traced(ok, bp->seq);
 
                 /* stats for aggregator */
                 ++stats.tx_mode_ss;
@@ -374,6 +523,9 @@ static void send_mode_ss(radar_mode_ss_t *bp)
                 /* local stats */
                 ++send_count;
                 byte_count += sizeof(radar_mode_ss_t);
+
+                /* -K: parity */
+                parity(bp, sizeof(radar_mode_ss_t), bp->seq);
                 
                 if (debug)
                         printf("send_mode_ss(): df=%d\n", df);
@@ -381,37 +533,51 @@ static void send_mode_ss(radar_mode_ss_t *bp)
 }
 
 
+/*
+ * radar_filters() - the DFs to forward from -e and -y, until the aggregator says otherwise
+ */
+void radar_filters(void)
+{
+        es_dfs = everything ? 0xFFFFFFFF : RADAR_ES_DFS;
+        ss_dfs = send_ss ? 0xFFFFFFFF : 0;
+
+        /* -B -H: the Beast only delivers DF11 and DF17, so don't claim to forward more */
+        if (protocol == RADAR_PROTOCOL_BEAST_SERIAL && df1117 && !everything) {
+                es_dfs &= 1U << 17;
+                ss_dfs &= 1U << 11;
+        }
+}
+
+
 /*
  * send_mode_es() - Send a Mode-S Extended Squitter to the aggregator
  */
-static void send_mode_es(radar_mode_es_t *bp)
+static void send_mode_es(radar_mode_es_t *bp, uint64_t rx)
 {
         if (bp) {
+                int ok;
+
                 bp->key = key;							/* API key */
-                bp->ts = ustime();						/* timestamp uS */
+                bp->ts = header_ts(rx);						/* timestamp uS */
                 bp->seq = seq++;						/* sequence number */
                 bp->opcode = RADAR_OPCODE_MODE_ES;				/* opcode */
 
                 /* add auth tag */
                 authtag_sign(bp->atag, AUTHTAG_LEN, bp, sizeof(radar_mode_es_t) - AUTHTAG_LEN);
-#if 0
-                /*
-                 * interference monkey - brake random bits on random occasions to check auth tag works ...
-                 */
-                int r = rand() % 10;
-                
-                if (r == 0) {
-                        uint8_t *p = (uint8_t *)bp;
-                        int bit = rand() % 8;					/* bit to flip */
-                        int byte = rand() % sizeof(radar_mode_es_t);		/* byte to flip at */
-                        
-                        uint8_t mask = 1 << bit;
-                        p[byte] ^= mask;
-                        printf("send_mode_es(): corrupted byte=%d bit=%d\n", byte, bit);
+                latency_stage(LATENCY_DEDUP_SIGN);
+                PROBE3(packet_signed, bp->seq, bp->opcode, sizeof(radar_mode_es_t));
+                /* send to aggregator, identification, position and velocity are critical */
+                if (udp_es_class(bp->data) == UDP_CLASS_ES)
+                        ok = udp_send_critical(bp, sizeof(radar_mode_es_t));
+                else
+                        ok = udp_send(bp, sizeof(radar_mode_es_t));
+
+                if (ok) {
+                        latency_stage(LATENCY_SIGN_SEND);
+                        sent(rx);
                 }
-#endif
-                /* send to aggregator */
-                udp_send(bp, sizeof(radar_mode_es_t));
+
+                traced(ok, bp->seq);
 
                 /* stats for aggregator */
                 ++stats.tx_mode_es;
@@ -421,6 +587,9 @@ static void send_mode_es(radar_mode_es_t *bp)
                 /* local stats */
                 ++send_count;
                 byte_count += sizeof(radar_mode_es_t);
+
+                /* -K: parity */
+                parity(bp, sizeof(radar_mode_es_t), bp->seq);
         }
 }
 
@@ -446,7 +615,8 @@ void radar_send_keepalive(void)
         /* add auth tag */
         authtag_sign(&msg.atag[0], AUTHTAG_LEN, &msg, sizeof(radar_keepalive_t) - AUTHTAG_LEN);
                 
-        /* send to aggregator */
+        /* send to aggregator, paid for out of any uplink budget but never shed */
+        udp_admit(UDP_CLASS_CONTROL, sizeof(radar_keepalive_t) + UDP_IP_OVERHEAD);
         udp_send(&msg, sizeof(radar_keepalive_t));
 
         /* stats for aggregator */
@@ -472,7 +642,8 @@ void radar_send_stats(void)
         /* add auth tag */
         authtag_sign(&msg.atag[0], AUTHTAG_LEN, &msg, sizeof(radar_stats_t) - AUTHTAG_LEN);
                 
-        /* send to aggregator */
+        /* send to aggregator, paid for out of any uplink budget but never shed */
+        udp_admit(UDP_CLASS_CONTROL, sizeof(radar_stats_t) + UDP_IP_OVERHEAD);
         udp_send(&msg, sizeof(radar_stats_t));
 
         /* stats for aggregator */
@@ -502,7 +673,8 @@ void radar_send_telemetry(void)
         /* add auth tag */
         authtag_sign(&msg.atag[0], AUTHTAG_LEN, &msg, sizeof(radar_telemetry_t) - AUTHTAG_LEN);
                 
-        /* send to aggregator */
+        /* send to aggregator, paid for out of any uplink budget but never shed */
+        udp_admit(UDP_CLASS_CONTROL, sizeof(radar_telemetry_t) + UDP_IP_OVERHEAD);
         udp_send(&msg, sizeof(radar_telemetry_t));
 
         /* stats for aggregator */
@@ -516,6 +688,71 @@ void radar_send_telemetry(void)
 }
 
 
+/*
+ * radar_send_latency() - send a summary of the pipeline latency and loop lag histograms
+ */
+void radar_send_latency(void)
+{
+        radar_latency_t msg;
+
+        msg.key = key;
+        msg.ts = ustime();
+        msg.seq = seq++;
+        msg.opcode = RADAR_OPCODE_LATENCY;
+        msg.stages = LATENCY_STAGES;
+        latency_report(msg.stage);
+
+        /* add auth tag */
+        authtag_sign(&msg.atag[0], AUTHTAG_LEN, &msg, sizeof(radar_latency_t) - AUTHTAG_LEN);
+
+        /* send to aggregator, paid for out of any uplink budget but never shed */
+        udp_admit(UDP_CLASS_CONTROL, sizeof(radar_latency_t) + UDP_IP_OVERHEAD);
+        udp_send(&msg, sizeof(radar_latency_t));
+
+        /* stats for aggregator */
+        ++stats.tx_telemetry;
+        ++stats.tx_count;
+        stats.tx_bytes += sizeof(radar_latency_t);
+
+        /* local stats */
+        ++send_count;
+        byte_count += sizeof(radar_latency_t);
+}
+
+
+/*
+ * radar_send_probe() - send an RTT probe on an uplink path for the aggregator to echo (see probe.c),
+ * returns 0 if the path can't send
+ */
+int radar_send_probe(int path, uint32_t id, uint64_t sent)
+{
+        radar_probe_t msg;
+
+        msg.key = key;
+        msg.ts = ustime();
+        msg.seq = seq++;
+        msg.opcode = RADAR_OPCODE_CONFIG_REQ;
+        msg.type = RADAR_CONFIG_PROBE;
+        msg.path = path;
+        msg.id = id;
+        msg.sent = sent;
+
+        /* add auth tag */
+        authtag_sign(&msg.atag[0], AUTHTAG_LEN, &msg, sizeof(radar_probe_t) - AUTHTAG_LEN);
+
+        /* send on this path whether or not it is the one in use, paid for out of any uplink budget */
+        udp_admit(UDP_CLASS_CONTROL, sizeof(radar_probe_t) + UDP_IP_OVERHEAD);
+        if (!udp_send_path(path, &msg, sizeof(radar_probe_t)))
+                return 0;
+
+        /* stats for aggregator */
+        ++stats.tx_count;
+        stats.tx_bytes += sizeof(radar_probe_t);
+
+        return 1;
+}
+
+
 /*
  * radar_send_multiframe() - send several Extended Squitter frames in a single UDP/IP message for improved efficiency
  */
@@ -524,8 +761,10 @@ void radar_send_multiframe(void)
         if (num) {
                 uint8_t buf[1024];
                 uint8_t *bp = buf;
-                uint64_t ts = ustime();
-                int i, sz;
+                uint64_t ts = header_ts(esdata[0].rx);			/* -T: arrival of the oldest frame */
+                uint64_t now = nstime();
+                uint32_t batch = seq;
+                int i, sz, critical;
 
                 if (debug)
                         printf("radar_send_multiframe(): num=%d\n", num);
@@ -554,6 +793,8 @@ void radar_send_multiframe(void)
                         
                         memcpy(bp, &esdata[i].data, MODE_ES_LEN);
                         bp += MODE_ES_LEN;
+
+                        latency_record(LATENCY_MULTIFRAME_HOLD, now - esdata[i].held);
                 }
 
                 /* size to be signed/auth tagged */
@@ -561,12 +802,29 @@ void radar_send_multiframe(void)
 
                 /* add auth tag */
                 authtag_sign(bp, AUTHTAG_LEN, &buf, sz);
+                latency_mark = nstime();
+                PROBE3(packet_signed, batch, RADAR_OPCODE_MULTIFRAME, sz + AUTHTAG_LEN);
+                PROBE3(multiframe_flush, num, batch, now - esdata[0].held);
                 
                 /* bump size to include the auth tag */
                 sz += AUTHTAG_LEN;
 
-                /* send to aggregator */
-                udp_send(&buf, sz);
+                /* send to aggregator, critical if any frame is identification, position or velocity */
+                for (i=0, critical=0; i<num; ++i)
+                        critical |= udp_es_class(esdata[i].data) == UDP_CLASS_ES;
+
+                if (critical ? udp_send_critical(&buf, sz) : udp_send(&buf, sz)) {
+                        latency_stage(LATENCY_SIGN_SEND);
+
+                        for (i=0; i<num; ++i)
+                                sent(esdata[i].rx);
+                }
+
+                /* fill in the batch for the buffered frames' trace records */
+                for (i=0; i<num; ++i)
+                        trace_batch(esdata[i].trace, esdata[i].rx, batch);
+
+                trace_event(TRACE_EV_MULTIFRAME, batch, num);
 
                 /* stats for aggregator */
                 ++stats.tx_mode_multi;
@@ -577,6 +835,9 @@ void radar_send_multiframe(void)
                 ++send_count;
                 byte_count += sz;
 
+                /* -K: parity */
+                parity(buf, sz, batch);
+
                 /* reset buffer */
                 clear_buffer();
         }
@@ -584,23 +845,76 @@ void radar_send_multiframe(void)
 
 
 /*
- * radar_process() - process a radar message from BEAST input
+ * radar_send_fec() - send the parity message for the open parity group (see fec.c)
+ */
+void radar_send_fec(void)
+{
+        radar_fec_t msg;
+        int len, sz;
+
+        if ((len = fec_parity(&msg)) == 0)
+                return;
+
+        msg.key = key;
+        msg.ts = ustime();
+        msg.seq = seq++;
+        msg.opcode = RADAR_OPCODE_FEC;
+
+        /* add auth tag straight after the parity */
+        sz = RADAR_FEC_HEADER + len;
+        authtag_sign(&msg.parity[len], AUTHTAG_LEN, &msg, sz);
+        sz += AUTHTAG_LEN;
+        PROBE3(packet_signed, msg.seq, msg.opcode, sz);
+
+        /* send to aggregator, paid for out of any uplink budget but never shed */
+        udp_admit(UDP_CLASS_CONTROL, sz + UDP_IP_OVERHEAD);
+        udp_send(&msg, sz);
+
+        /* stats for aggregator */
+        ++stats.tx_fec;
+        ++stats.tx_count;
+        stats.tx_bytes += sz;
+
+        /* local stats */
+        ++send_count;
+        byte_count += sz;
+}
+
+
+/*
+ * radar_process() - process a radar message from BEAST input, rx is the arrival time (uS)
  */
-void radar_process(uint8_t mlat[MLAT_LEN], uint8_t rssi, uint8_t *data, int len)
+void radar_process(uint8_t mlat[MLAT_LEN], uint8_t rssi, uint8_t *data, int len, uint64_t rx)
 {
+        /* trace record, code is filled in below (filtered unless we decide otherwise) */
+        cur_trace = trace_frame(rx, data, len, rssi);
+        trace_at(cur_trace)->code = TRACE_FILTERED;
+        PROBE4(frame_received, len, data[0] >> 3, rssi, rx);
+
         if (len == MODE_ES_LEN) {						/* Mode-S Extended message (14 bytes) */
                 uint8_t df = data[0] >> 3;					/* downlink format */
 
-                if ( (df >= 17 && df <= 22) || everything ){
+                if (overload >= OVERLOAD_ESSENTIAL && (es_dfs & (1U << df)) && udp_es_class(data) != UDP_CLASS_ES) {
+                        trace_at(cur_trace)->code = TRACE_OVERLOAD;		/* not worth the CPU when overloaded */
+
+                } else if (es_dfs & (1U << df)) {
                         int dupe;
                         
                         dupe = dupe_check_es(data);				/* duplicate check */
+                        latency_stage(LATENCY_PARSE_DEDUP);
                         
                         if (dupe) {
+                                trace_at(cur_trace)->code = TRACE_DUPE;
                                 ++dupe_es_count;
                                 ++stats.dupe_es;
                                 ++stats.dupes;
 
+                        } else if (!udp_admit(udp_es_class(data), multiframe ?
+                                        (int)sizeof(es_t) + (num ? 0 : RADAR_MULTIFRAME_OVERHEAD) :
+                                        (int)sizeof(radar_mode_es_t) + UDP_IP_OVERHEAD)) {
+                                trace_at(cur_trace)->code = TRACE_SHED;		/* over the uplink budget */
+                                ++shed_count;
+
                         } else {
                         
                                 if (multiframe) {
@@ -611,10 +925,14 @@ void radar_process(uint8_t mlat[MLAT_LEN], uint8_t rssi, uint8_t *data, int len)
                                         memcpy(&esdata[num].mlat, mlat, MLAT_LEN);
                                         esdata[num].rssi = rssi;
                                         memcpy(&esdata[num].data, data, MODE_ES_LEN);
+                                        esdata[num].rx = rx;
+                                        esdata[num].held = latency_mark;
+                                        esdata[num].trace = cur_trace;
+                                        trace_at(cur_trace)->code = TRACE_BUFFERED;
                                         
                                         ++num;
 
-                                        if (num >= RADAR_MAX_MULTIFRAME)	/* buffer full? send now */
+                                        if (num >= max_frames)			/* buffer full? send now */
                                                 radar_send_multiframe();
                                                 
                                 } else {
@@ -624,7 +942,7 @@ void radar_process(uint8_t mlat[MLAT_LEN], uint8_t rssi, uint8_t *data, int len)
                                         buf.rssi = rssi;
                                         memcpy(buf.data, data, MODE_ES_LEN);
 
-                                        send_mode_es(&buf);
+                                        send_mode_es(&buf, rx);
                                 }
                         }
                 }
@@ -635,12 +953,18 @@ void radar_process(uint8_t mlat[MLAT_LEN], uint8_t rssi, uint8_t *data, int len)
         } else if (len == MODE_SS_LEN) {					/* Mode-S Short message (7 bytes) */
                 uint8_t df = data[0] >> 3;					/* downlink format */
 
-                if (send_ss) {
+                if ((ss_dfs & (1U << df)) && overload >= OVERLOAD_NO_SS_AC) {
+                        trace_at(cur_trace)->code = TRACE_OVERLOAD;
+
+                } else if (ss_dfs & (1U << df)) {
                         int dupe;
                 
                         dupe = dupe_check_ss(data);
+                        latency_stage(LATENCY_PARSE_DEDUP);
 
                         if (dupe) {
+                                trace_at(cur_trace)->code = TRACE_DUPE;
+
                                 if (debug > 2)
                                         printf("radar_process(): not sending duplicate SS\n");
                                 
@@ -648,6 +972,10 @@ void radar_process(uint8_t mlat[MLAT_LEN], uint8_t rssi, uint8_t *data, int len)
                                 ++stats.dupe_ss;
                                 ++stats.dupes;
 
+                        } else if (!udp_admit(UDP_CLASS_SS, sizeof(radar_mode_ss_t) + UDP_IP_OVERHEAD)) {
+                                trace_at(cur_trace)->code = TRACE_SHED;
+                                ++shed_count;
+
                         } else {
                                 radar_mode_ss_t buf;
 
@@ -655,7 +983,7 @@ void radar_process(uint8_t mlat[MLAT_LEN], uint8_t rssi, uint8_t *data, int len)
                                 buf.rssi = rssi;                                /* copy RSSI */
                                 memcpy(buf.data, data, MODE_SS_LEN);	/* Short squitter */
                          
-                                send_mode_ss(&buf);
+                                send_mode_ss(&buf, rx);
                         }
                 }
 
@@ -664,14 +992,21 @@ void radar_process(uint8_t mlat[MLAT_LEN], uint8_t rssi, uint8_t *data, int len)
         
         } else if (len == MODE_AC_LEN) {
 
-                if (send_ac) {
+                if (send_ac && overload >= OVERLOAD_NO_SS_AC) {
+                        trace_at(cur_trace)->code = TRACE_OVERLOAD;
+
+                } else if (send_ac && !udp_admit(UDP_CLASS_AC, sizeof(radar_mode_ac_t) + UDP_IP_OVERHEAD)) {
+                        trace_at(cur_trace)->code = TRACE_SHED;
+                        ++shed_count;
+
+                } else if (send_ac) {
                         radar_mode_ac_t buf;
 
                         memcpy(buf.mlat, mlat, MLAT_LEN);			/* copy over MLAT */
                         buf.rssi = rssi;					/* copy RSSI */
                         memcpy(buf.data, data, MODE_AC_LEN);			/* Mode-A/C short */
                          
-                        send_mode_ac(&buf);
+                        send_mode_ac(&buf, rx);
                 }
 
                 ++stats.rx_mode_ac;
@@ -679,6 +1014,299 @@ void radar_process(uint8_t mlat[MLAT_LEN], uint8_t rssi, uint8_t *data, int len)
 }
 
 
+#ifndef RADAR_NO_MAIN
+
+/*
+ * forward_timer() - (re)arm the multiframe forwarding timer at forward_interval, or
+ * stop it if we are not sending multiframe
+ */
+static void forward_timer(void)
+{
+        struct itimerspec spec_forward;
+        long nsec = multiframe ? forward_interval * 1000000L : 0;
+
+        if (forward_fd < 0) {
+                forward_fd = timerfd_create(CLOCK_REALTIME,  0);
+
+                if (forward_fd < 0)
+                        qerror("unable to create timer!");
+        }
+
+        spec_forward.it_interval.tv_sec = 0;
+        spec_forward.it_interval.tv_nsec = nsec;
+        spec_forward.it_value.tv_sec = 0;
+        spec_forward.it_value.tv_nsec = nsec;
+
+        timerfd_settime(forward_fd, 0, &spec_forward, NULL);
+}
+
+
+/*
+ * rtt_interval() - multiframe interval when not overloaded: as configured or, with -I, a quarter of
+ * the round trip time on the uplink path in use as holding frames that long adds little to the
+ * delay the aggregator sees anyway - but not on a lossy path, where smaller messages lose less
+ */
+static int rtt_interval(void)
+{
+        uint32_t rtt;
+
+        if (!adaptive || (rtt = probe_rtt(udp_active())) == 0 || probe_loss(udp_active()) >= RADAR_ADAPT_LOSS)
+                return base_interval;
+
+        return min(max(base_interval, (int)(rtt / 4000)), RADAR_FORWARD_INTERVAL_MAX);
+}
+
+
+/*
+ * forward_apply() - forward as configured (-m, -i, -I or the aggregator) adjusted for the
+ * overload level
+ */
+static void forward_apply(void)
+{
+        int interval = (overload >= OVERLOAD_BATCH) ? max(rtt_interval(), OVERLOAD_INTERVAL) : rtt_interval();
+        int mf = base_multiframe || overload >= OVERLOAD_MULTIFRAME;
+
+        /* send what is buffered before leaving multiframe mode */
+        if (multiframe && !mf && num)
+                radar_send_multiframe();
+
+        if (mf && !multiframe)
+                clear_buffer();
+
+        if (mf != multiframe || interval != forward_interval) {
+                if (debug)
+                        printf("forward_apply(): multiframe %s, interval %d mS (RTT %u uS)\n", mf ? "on" : "off",
+                                interval, probe_rtt(udp_active()));
+
+                multiframe = mf;
+                forward_interval = interval;
+
+                /* when replaying the flushes run on the capture's clock, see replay_next() */
+                if (replay[0])
+                        next_forward = ustime() + forward_interval * 1000;
+                else
+                        forward_timer();
+        }
+}
+
+
+/*
+ * overload_apply() - change how we forward to suit the overload level (see overload.c)
+ */
+static void overload_apply(int level)
+{
+        if (level == overload)
+                return;
+
+        overload = level;
+        forward_apply();
+}
+
+
+/*
+ * send_config() - answer settings pushed by the aggregator with those now in force
+ */
+static void send_config(int path, uint32_t id, int status, uint16_t set)
+{
+        radar_config_t msg;
+
+        memset(&msg, 0, sizeof(msg));
+        msg.key = key;
+        msg.ts = ustime();
+        msg.seq = seq++;
+        msg.opcode = RADAR_OPCODE_CONFIG_ACK;
+        msg.type = RADAR_CONFIG_SET;
+        msg.status = status;
+        msg.set = set;
+        msg.id = id;
+        msg.multiframe = base_multiframe ? 1 : 0;
+        msg.frames = max_frames;
+        msg.interval = base_interval;
+        msg.es_dfs = es_dfs;
+        msg.ss_dfs = ss_dfs;
+        msg.mode_ac = send_ac ? 1 : 0;
+        msg.budget_kbps = uplink_kbps;
+        msg.budget_burst = uplink_burst;
+        msg.stats_interval = stats_interval;
+        msg.telemetry_interval = telemetry_interval;
+
+        /* add auth tag */
+        authtag_sign(&msg.atag[0], AUTHTAG_LEN, &msg, sizeof(radar_config_t) - AUTHTAG_LEN);
+
+        /* answer on the path it came in on, paid for out of any uplink budget */
+        udp_admit(UDP_CLASS_CONTROL, sizeof(radar_config_t) + UDP_IP_OVERHEAD);
+        if (!udp_send_path(path, &msg, sizeof(radar_config_t)))
+                return;
+
+        /* stats for aggregator */
+        ++stats.tx_count;
+        stats.tx_bytes += sizeof(radar_config_t);
+}
+
+
+/*
+ * hw_flags() - BEAST_HW_xxx flags for a Mode-S Beast (-B) to deliver what the settings in force
+ * forward: the -H filter stays on only while nothing but DF11 and DF17 is wanted
+ */
+static int hw_flags(void)
+{
+        int wide = (es_dfs & ~(1U << 17)) || (ss_dfs & ~(1U << 11));
+
+        return BEAST_HW_CRC |
+               ((send_ac || everything) ? BEAST_HW_MODE_AC : 0) |
+               ((everything || (ss_dfs & ((1U << 0) | (1U << 4) | (1U << 5)))) ? BEAST_HW_DF045 : 0) |
+               ((df1117 && !wide) ? BEAST_HW_DF1117 : 0);
+}
+
+
+/*
+ * config_valid() - are the settings to be changed all in range?
+ */
+static int config_valid(const radar_config_t *req, uint16_t set)
+{
+        if ((set & RADAR_SET_MULTIFRAME) && req->multiframe > 1)
+                return 0;
+
+        if ((set & RADAR_SET_INTERVAL) && (req->interval < 10 || req->interval > RADAR_FORWARD_INTERVAL_MAX))
+                return 0;
+
+        if ((set & RADAR_SET_FRAMES) && (req->frames < 1 || req->frames > RADAR_MAX_MULTIFRAME))
+                return 0;
+
+        if ((set & RADAR_SET_MODE_AC) && req->mode_ac > 1)
+                return 0;
+
+        if ((set & RADAR_SET_BUDGET) && (req->budget_kbps > INT32_MAX / 1000 || req->budget_burst > INT32_MAX))
+                return 0;
+
+        /* only changed, not turned on or off - telemetry set up at start-up has its constants */
+        if ((set & RADAR_SET_STATS) && (!stats_interval || req->stats_interval < RADAR_CONFIG_PERIOD_MIN ||
+            req->stats_interval > RADAR_CONFIG_PERIOD_MAX))
+                return 0;
+
+        if ((set & RADAR_SET_TELEMETRY) && (!telemetry_interval || req->telemetry_interval < RADAR_CONFIG_PERIOD_MIN ||
+            req->telemetry_interval > RADAR_CONFIG_PERIOD_MAX))
+                return 0;
+
+        return 1;
+}
+
+
+/*
+ * config_apply() - change the settings asked for, keeping the duplicate tables, the sources
+ * and the sockets as they are
+ */
+static void config_apply(const radar_config_t *req, uint16_t set)
+{
+        if (set & RADAR_SET_MULTIFRAME)
+                base_multiframe = req->multiframe;
+
+        if (set & RADAR_SET_INTERVAL)
+                base_interval = req->interval;
+
+        if (set & RADAR_SET_FRAMES) {
+                max_frames = req->frames;
+
+                if (num >= max_frames)
+                        radar_send_multiframe();
+        }
+
+        if (set & RADAR_SET_ES_DFS)
+                es_dfs = req->es_dfs;
+
+        if (set & RADAR_SET_SS_DFS)
+                ss_dfs = req->ss_dfs;
+
+        if (set & RADAR_SET_MODE_AC)
+                send_ac = req->mode_ac;
+
+        /* with -B the Beast filters in hardware, so it has to be told too */
+        if (set & (RADAR_SET_ES_DFS | RADAR_SET_SS_DFS | RADAR_SET_MODE_AC))
+                beast_hw_update(hw_flags());
+
+        if (set & RADAR_SET_BUDGET) {
+                uplink_kbps = req->budget_kbps;
+                uplink_burst = req->budget_burst;
+                udp_budget(uplink_kbps, uplink_burst, uplink_pace);
+        }
+
+        if (set & RADAR_SET_STATS) {
+                stats_interval = req->stats_interval;
+                stats_period(stats_interval);
+        }
+
+        if (set & RADAR_SET_TELEMETRY) {
+                telemetry_interval = req->telemetry_interval;
+                telemetry_period(telemetry_interval);
+        }
+
+        forward_apply();
+
+        ++telemetry.config_changes;
+
+        qlog("radar: settings changed by the aggregator (0x%04X): multiframe %s, %d frames, %d mS, ES DFs 0x%08X, SS DFs 0x%08X, "
+                "Mode-A/C %s, budget %d kbps, stats %d S, telemetry %d S\n", set, base_multiframe ? "on" : "off", max_frames,
+                base_interval, es_dfs, ss_dfs, send_ac ? "on" : "off", uplink_kbps, stats_interval, telemetry_interval);
+}
+
+
+/*
+ * config_set() - settings pushed by the aggregator: a change is applied whole or not at all, and
+ * only if it is newer than the last and close to our time so that it can't be replayed
+ */
+static void config_set(int path, const radar_config_t *req)
+{
+        uint64_t now = ustime();
+        uint64_t skew = RADAR_CONFIG_SKEW * 1000000ULL;
+        uint16_t set = req->set & RADAR_SET_ALL;
+        int status = RADAR_CONFIG_OK;
+
+        if (locked)
+                status = RADAR_CONFIG_LOCKED;
+        else if (req->ts <= config_ts || req->ts + skew < now || req->ts > now + skew)
+                status = RADAR_CONFIG_STALE;
+        else if (!config_valid(req, set))
+                status = RADAR_CONFIG_INVALID;
+
+        if (status == RADAR_CONFIG_OK) {
+                config_ts = req->ts;
+                config_apply(req, set);
+        } else {
+                qlog("radar: settings from the aggregator refused (%s)\n", status == RADAR_CONFIG_LOCKED ? "locked" :
+                        status == RADAR_CONFIG_STALE ? "stale" : "invalid");
+                set = 0;
+        }
+
+        send_config(path, req->id, status, set);
+}
+
+
+/*
+ * radar_receive() - a message from the aggregator arrived on an uplink path: the echo of a
+ * probe or settings to change
+ */
+static void radar_receive(int path, void *buf, int len)
+{
+        radar_msg_t *mp = buf;
+        radar_probe_t *probe = buf;
+        radar_config_t *config = buf;
+
+        if (len < (int)sizeof(radar_msg_t) + AUTHTAG_LEN || mp->key != key)
+                return;
+
+        if (!authtag_check((uint8_t *)buf + len - AUTHTAG_LEN, AUTHTAG_LEN, buf, len - AUTHTAG_LEN)) {
+                if (debug)
+                        printf("radar_receive(): bad auth tag on path %d\n", path);
+                return;
+        }
+
+        if (mp->opcode == RADAR_OPCODE_CONFIG_ACK && len == sizeof(radar_probe_t) && probe->type == RADAR_CONFIG_PROBE)
+                probe_reply(path, probe);
+        else if (mp->opcode == RADAR_OPCODE_CONFIG_REQ && len == sizeof(radar_config_t) && config->type == RADAR_CONFIG_SET)
+                config_set(path, config);
+}
+
+
 /*
  * house_keeping() - called once per second from a timer
  */
@@ -700,16 +1328,54 @@ static void house_keeping(void)
         /* Beast housekeeping */
         beast_second();
 
+        /* measure the input backlog and loop lag and degrade or recover */
+        if (protect)
+                overload_apply(overload_second());
+
+        /* with -I match the multiframe interval to the uplink round trip time */
+        if (adaptive)
+                forward_apply();
+
         /* UDP housekeeping */
         udp_second();
 
+        /* uplink RTT, jitter and loss into the telemetry */
+        probe_second();
+
+        /* close a parity group that has been open for a second */
+        if (fec_pending())
+                radar_send_fec();
+
         /* foreground stats */
         if (dostats) {
-                printf("Packets forwarded: %3u   Not forwarded (dupes): %3u  Bytes per second: %5u\n", send_count, dupe_ss_count+dupe_es_count, byte_count);
+                printf("Packets forwarded: %3u   Not forwarded (dupes): %3u  Bytes per second: %5u  Latency avg/max: %5u/%6u uS",
+                        send_count, dupe_ss_count+dupe_es_count, byte_count,
+                        latency_count ? (uint32_t)(latency_sum / latency_count) : 0, latency_max);
+
+                if (uplink_kbps)
+                        printf("  Shed: %u", shed_count);
+
+                if (overload)
+                        printf("  Overload: %s", overload_name(overload));
+
+                if (probe_enabled())
+                        printf("  RTT: %u.%u mS", probe_rtt(udp_active()) / 1000, probe_rtt(udp_active()) % 1000 / 100);
+
+                printf("\n");
         }
 
         /* clear the per-second stats */                                
-        send_count = dupe_ss_count = dupe_es_count = byte_count = 0;
+        send_count = dupe_ss_count = dupe_es_count = shed_count = byte_count = 0;
+        latency_sum = latency_count = latency_max = 0;
+
+        /* per-stage latency histograms, printed with the foreground stats */
+        latency_second(dostats);
+
+        /* metrics endpoint housekeeping */
+        metrics_second();
+
+        /* flush the capture file */
+        capture_second();
                                 
         /* do radio stats and device telemetry */
         stats_second();
@@ -717,15 +1383,105 @@ static void house_keeping(void)
 }
 
 
+/*
+ * replay_next() - capture time of the next replay event: a record or one of the timers
+ */
+static uint64_t replay_next(void)
+{
+        uint64_t t = next_second;
+        uint64_t rec = replay_peek();
+
+        if (multiframe && next_forward < t)
+                t = next_forward;
+
+        if (rec && rec < t)
+                t = rec;
+
+        return rec ? t : 0;
+}
+
+
+/*
+ * replay_clock() - capture time that real time has reached since the replay started
+ */
+static uint64_t replay_clock(void)
+{
+        return replay_base + (nstime() - replay_real) / 1000;
+}
+
+
+/*
+ * replay_timeout() - poll() timeout until the next replay event is due (mS)
+ */
+static int replay_timeout(void)
+{
+        uint64_t t = replay_next(), now;
+
+        if (replay_fast || !t)
+                return 0;
+
+        now = replay_clock();
+
+        return (t > now) ? (int)min((t - now + 999) / 1000, 250) : 0;
+}
+
+
+/*
+ * replay_run() - run the replay events that are due, in time order on the capture's
+ * clock: the housekeeping and multiframe timers fire and records are parsed at the
+ * times they did live; in real time mode we stop at the first event not yet due
+ */
+static void replay_run(void)
+{
+        uint8_t buf[CAPTURE_MAX_READ];
+        int n, len;
+
+        for (n = 0; n < RADAR_REPLAY_BATCH && !ending; n++) {
+                uint64_t t = replay_next();
+
+                if (!t) {
+                        /* end of the capture - send what is buffered and stop */
+                        if (num)
+                                radar_send_multiframe();
+
+                        if (dostats)
+                                printf("Replay of %s finished\n", replay);
+
+                        ++ending;
+                        break;
+                }
+
+                if (!replay_fast && t > replay_clock())
+                        break;
+
+                ustime_set(t);
+
+                if (t == next_second) {
+                        house_keeping();
+                        next_second += 1000000;
+
+                } else if (multiframe && t == next_forward) {
+                        if (num)
+                                radar_send_multiframe();
+
+                        next_forward += forward_interval * 1000;
+
+                } else if ((len = replay_read(buf)) > 0) {
+                        beast_input(buf, len);
+                }
+        }
+}
+
+
 /*
  * main program
  */
 int main(int argc, char *argv[])
 {
-        int rc;
+        int rc, i;
         int timer_fd = 0;
-        int forward_fd = 0;
-        uint8_t dummybuf[8];
+        int replay_fmt = 0;
+        uint64_t expirations;
 
         struct itimerspec spec_second = {		/* 1 second timer for housekeeping */
                 { 1, 0 },
@@ -739,12 +1495,13 @@ int main(int argc, char *argv[])
         signal(SIGINT, signal_handler);
         signal(SIGTERM, signal_handler);
         signal(SIGHUP, signal_handler);
+        signal(SIGUSR1, signal_handler);
 
         
         /*
          * parse command line args
          */
-        while ((rc = getopt(argc, argv, "k:l:r:h:p:u:g:s:t:q:S:P:i:n:mebBGfvdcyxh?")) >= 0) {
+        while ((rc = getopt(argc, argv, "k:l:r:h:p:u:g:s:t:q:S:P:i:n:j:M:w:W:R:C:U:o:K:X:O:JA:ILD:maebBGHTFfvdcyxzh?")) >= 0) {
                 switch (rc) {
 
                 case 'b':
@@ -755,6 +1512,14 @@ int main(int argc, char *argv[])
                         protocol = RADAR_PROTOCOL_BEAST_SERIAL;
                         break;
 
+                case 'a':
+                        protocol = RADAR_PROTOCOL_AVR_TCP;
+                        break;
+
+                case 'H':
+                        ++df1117;
+                        break;
+
                 case 'G':
                         protocol = RADAR_PROTOCOL_GNS_SERIAL;
                         break;
@@ -783,7 +1548,16 @@ int main(int argc, char *argv[])
                         if (strlen(optarg) > HOSTNAME_LEN) {
                                 qerror("radar: IP address of server too long\n");
                         }
-                        strncpy(localaddress, optarg, HOSTNAME_LEN);
+                        if (nlocal >= BEAST_MAX_SOURCES) {
+                                qerror("radar: too many BEAST sources (max %d)\n", BEAST_MAX_SOURCES);
+                        }
+                        strncpy(localaddress[nlocal++], optarg, HOSTNAME_LEN);
+                        break;
+
+                case 'j':
+                        stall_timeout = atoi(optarg);
+                        if (stall_timeout < 50 || stall_timeout > 60000)
+                                qerror("radar: stall timeout must be in range 50-60000mS\n");
                         break;
 
                 case 'h':
@@ -791,6 +1565,7 @@ int main(int argc, char *argv[])
                                 qerror("radar: remote hostname too long\n");
                         }
                         strncpy(hostname, optarg, HOSTNAME_LEN);
+                        ++hostgiven;
                         break;
 
                 case 'c':
@@ -809,9 +1584,113 @@ int main(int argc, char *argv[])
                         ++multiframe;
                         break;
 
+                case 'T':
+                        ++stamp_arrival;
+                        break;
+
+                case 'M':
+                        if (strlen(optarg) > HOSTNAME_LEN) {
+                                qerror("radar: metrics address too long\n");
+                        }
+                        strncpy(metrics, optarg, HOSTNAME_LEN);
+                        break;
+
+                case 'w':
+                        if (strlen(optarg) > HOSTNAME_LEN) {
+                                qerror("radar: trace directory name too long\n");
+                        }
+                        trace_init(optarg);
+                        break;
+
+                case 'W':
+                        if (strlen(optarg) > HOSTNAME_LEN) {
+                                qerror("radar: capture file name too long\n");
+                        }
+                        strncpy(capture, optarg, HOSTNAME_LEN);
+                        break;
+
+                case 'R':
+                        if (strlen(optarg) > HOSTNAME_LEN) {
+                                qerror("radar: replay file name too long\n");
+                        }
+                        strncpy(replay, optarg, HOSTNAME_LEN);
+                        break;
+
+                case 'F':
+                        ++replay_fast;
+                        break;
+
+                case 'C':
+                        sim_add(optarg);
+                        break;
+
+                case 'U': {
+                        char pace[8] = "";
+
+                        if (sscanf(optarg, "%d:%d:%7s", &uplink_kbps, &uplink_burst, pace) < 1 || uplink_kbps < 1 || uplink_burst < 0 ||
+                            (pace[0] && strcmp(pace, "pace") != 0))
+                                qerror("radar: uplink budget must be <kbps>[:<burst bytes>[:pace]]\n");
+
+                        uplink_pace = pace[0] != '\0';
+                        break;
+                }
+
+                case 'K':
+                        fec_k = atoi(optarg);
+                        if (fec_k < 2 || fec_k > RADAR_FEC_MAX_K)
+                                qerror("radar: FEC group size must be in range 2-%d\n", RADAR_FEC_MAX_K);
+                        break;
+
+                case 'X':
+                        udp_impair(optarg);
+                        break;
+
+                case 'O':
+                        udp_add_path(optarg);
+                        break;
+
+                case 'J':
+                        udp_dup_send(1);
+                        break;
+
+                case 'A': {
+                        int ms = atoi(optarg);
+
+                        if (ms == 0)
+                                ms = PROBE_INTERVAL;
+                        else if (ms < PROBE_INTERVAL_MIN)
+                                qerror("radar: probe interval must be at least %dmS\n", PROBE_INTERVAL_MIN);
+
+                        probe_init(ms);
+                        break;
+                }
+
+                case 'I':
+                        adaptive = 1;
+                        break;
+
+                case 'L':
+                        locked = 1;
+                        break;
+
+                case 'D':
+                        udp_add_dest(optarg);
+                        break;
+
+                case 'o': {
+                        int backlog = 0, lag = 0;
+
+                        if (sscanf(optarg, "%d:%d", &backlog, &lag) < 1 || backlog < 0 || lag < 0)
+                                qerror("radar: overload thresholds must be <backlog bytes>[:<loop lag mS>], 0 for the defaults\n");
+
+                        overload_init(backlog, lag);
+                        ++protect;
+                        break;
+                }
+
                 case 'i':
                         forward_interval = atoi(optarg);
-                        if (forward_interval < 10 || forward_interval > 250)
+                        if (forward_interval < 10 || forward_interval > RADAR_FORWARD_INTERVAL_MAX)
                                 qerror("radar: multiframe forwarding interval must be in range 10-250mS\n");
                         break;
 
@@ -878,14 +1757,37 @@ int main(int argc, char *argv[])
                         printf("  -p <psk>           : pre-shared key for HMAC authentication (signing of messages)\n");
                         printf("  -B                 : use Mode-S BEAST via USB connection\n");
                         printf("  -G                 : use GNS 5892/5894T HULC via serial connection\n");
+                        printf("  -a                 : use AVR protocol over TCP (fallback, default port 30002)\n");
                         printf("  -S <serial port>   : specify serial port for Mode-S Beast connection (default: /dev/ttyUSB0)\n");
+                        printf("  -H                 : Mode-S Beast hardware filter to DF11/17 only (drops DF18-21)\n");
                         printf("  -c                 : enable sending Mode-A/C message (not recommended)\n");
                         printf("  -y                 : enable sending Mode-S Short messages (not recommended)\n");
                         printf("  -e                 : forward everything\n");
-                        printf("  -l <ip addr>       : IP address of local dump1090/readsb server (default: 127.0.0.1)\n");
-                        printf("  -P <port>          : TCP port number to connect to Beast on (default: 30005)\n");
+                        printf("  -l <ip addr[:port]>: IP address of local dump1090/readsb server (default: 127.0.0.1)\n");
+                        printf("                       or - (stdin), fifo:<path> or unix:<path> for a local source\n");
+                        printf("                       repeat to add hot-standby sources in order of preference\n");
+                        printf("  -j <ms>            : stall timeout before failing over to a standby source (default 500)\n");
+                        printf("  -P <port>          : TCP port number to connect to Beast on (default: 30005, AVR: 30002)\n");
                         printf("  -m                 : Enable multiframe sending (more efficient but more latency)\n");
                         printf("  -i <ms>            : Forwarding interval in milliseconds for multiframe (range 10-250, default 50)\n");
+                        printf("  -T                 : timestamp messages with frame arrival time instead of send time\n");
+                        printf("  -M <[addr:]port|path>: serve OpenMetrics on a local HTTP port or unix socket (/metrics)\n");
+                        printf("  -w <dir>           : directory for trace dumps on SIGUSR1 or /trace (default /tmp)\n");
+                        printf("  -W <file>          : capture the BEAST/AVR input with arrival times to a file\n");
+                        printf("  -R <file>          : replay a capture file instead of reading a receiver (needs -h)\n");
+                        printf("  -F                 : replay as fast as possible (default: real time)\n");
+                        printf("  -C <config>        : with -R, simulate a forwarding configuration e.g. m,i=100 (repeatable)\n");
+                        printf("  -U <kbps>[:<bytes>[:pace]]: uplink budget and burst, shedding Mode-A/C, SS, DF20/21 then ES over it\n");
+                        printf("  -K <k>             : send an XOR parity message after every k data messages (2-%d)\n", RADAR_FEC_MAX_K);
+                        printf("  -O <if|addr>       : uplink path bound to an interface or source address (repeat for standby)\n");
+                        printf("  -J                 : with -O send position/velocity/identification on a standby path too\n");
+                        printf("  -A <ms>            : probe uplink RTT, jitter and loss every <ms> (0 = %d), needs aggregator support\n", PROBE_INTERVAL);
+                        printf("  -I                 : with -m and -A widen the multiframe interval to a quarter of the uplink RTT\n");
+                        printf("  -L                 : lock the settings, refusing changes pushed by the aggregator\n");
+                        printf("  -D <host>[:<port>],key=<key>[,pass=<psk>][,qos=<n>][,es=<mask>][,ss=<mask>][,ac=0|1][,tel=0|1]\n");
+                        printf("                     : also send to another destination with its own key and pass-phrase (max %d)\n", UDP_MAX_DESTS);
+                        printf("  -X <spec>          : impair the uplink for testing e.g. loss=2,burst=3,delay=40,jitter=15\n");
+                        printf("  -o <bytes>[:<ms>]  : degrade gracefully if input backlog/loop lag exceed these (0 = 32768:100)\n");
                         printf("  -s <seconds>       : Set the radio stats interval (default 900)\n");
                         printf("  -t <seconds>       : Set the telemetry interval (default 900)\n");
                         printf("  -d                 : run as daemon (detach from controlling tty)\n");
@@ -915,12 +1817,45 @@ int main(int argc, char *argv[])
         if (!gotkey || key == 0)
                 qerror("radar: must specify your API key with -k <key>\n");
 
+        /* the DFs forwarded can be changed by the aggregator, as can everything else with no -L */
+        radar_filters();
+
+        /* listen for probe echoes and settings from the aggregator */
+        udp_receive(radar_receive);
+
         if (isdaemon && debug)
                 qerror("radar: cannot perform debug in background\n");
         
         if (isdaemon && dostats)
                 qerror("radar: cannot output stats in background\n");
 
+        for (i = 0; i < nlocal; i++) {
+                if (isdaemon && strcmp(localaddress[i], "-") == 0)
+                        qerror("radar: cannot read from stdin in background\n");
+        }
+
+        if (replay[0] && capture[0])
+                qerror("radar: cannot capture (-W) and replay (-R) at the same time\n");
+
+        if (replay_fast && !replay[0])
+                qerror("radar: -F only applies to replay (-R)\n");
+
+        if (sim_configs() && !replay[0])
+                qerror("radar: the simulator (-C) needs a capture to replay (-R)\n");
+
+        /* a replay is not live traffic, don't let it go to the aggregator by default */
+        if (replay[0] && !hostgiven && !sim_configs())
+                qerror("radar: replay (-R) needs the destination given with -h\n");
+
+        /*
+         * open capture or replay files before dropping privileges
+         */
+        if (capture[0])
+                capture_open(capture, (protocol == RADAR_PROTOCOL_AVR_TCP) ? BEAST_FORMAT_AVR : BEAST_FORMAT_BINARY);
+
+        if (replay[0])
+                replay_fmt = replay_open(replay, &replay_base);
+
         
         /*
          * if process is root drop privs
@@ -993,11 +1928,34 @@ int main(int argc, char *argv[])
          */
         authtag_init(psk);
 
+        /*
+         * offline simulation of forwarding configurations - runs the capture and exits
+         */
+        if (sim_configs()) {
+                sim_run(replay_fmt, replay_base);
+                exit(EXIT_SUCCESS);
+        }
+
         /*
          * initialise the UDP sub-system
          */
         udp_init(hostname, qos, rebind);
 
+        if (uplink_kbps)
+                udp_budget(uplink_kbps, uplink_burst, uplink_pace);
+
+        if (fec_k)
+                fec_init(fec_k);
+
+        /* restart UDP as soon as the local address or default route changes */
+        netlink_init();
+
+        /*
+         * start the local metrics endpoint
+         */
+        if (metrics[0])
+                metrics_init(metrics);
+
         /*
          * run in background
          */
@@ -1010,16 +1968,54 @@ int main(int argc, char *argv[])
         /*
          * initialise the appropriate ADS-B protocol source
          */
+        if (replay[0]) {
+                beast_replay_init(replay_fmt);
+                protocol = RADAR_PROTOCOL_NONE;
+
+                if (dostats)
+                        printf("Replaying %s %s\n", replay, replay_fast ? "as fast as possible" : "in real time");
+        }
+
         switch (protocol) {
 
+                case RADAR_PROTOCOL_NONE:
+                        break;
+
                 case RADAR_PROTOCOL_BEAST_TCP:
-                        beast_tcp_init(localaddress, port);
-                        if (dostats)
-                                printf("Using BEAST over TCP on %s:%d (preferred)\n", localaddress, BEAST_TCP_PORT);
+                        if (!nlocal)
+                                nlocal = 1;
+
+                        if (!port)
+                                port = BEAST_TCP_PORT;
+
+                        for (i = 0; i < nlocal; i++) {
+                                beast_tcp_init(localaddress[i], port);
+                                if (dostats)
+                                        printf("Using BEAST from %s default TCP port %d (%s)\n", localaddress[i], port, i ? "standby" : "preferred");
+                        }
+
+                        beast_stall_init(stall_timeout);
+                        break;
+
+                case RADAR_PROTOCOL_AVR_TCP:
+                        if (!nlocal)
+                                nlocal = 1;
+
+                        if (!port)
+                                port = AVR_TCP_PORT;
+
+                        for (i = 0; i < nlocal; i++) {
+                                beast_avr_init(localaddress[i], port);
+                                if (dostats)
+                                        printf("Using AVR from %s default TCP port %d (fallback, no RSSI)\n", localaddress[i], port);
+                        }
+
+                        beast_stall_init(stall_timeout);
                         break;
                 
                 case RADAR_PROTOCOL_BEAST_SERIAL:
                         beast_serial_init(serport, B3000000);
+                        beast_hw_init(hw_flags());
                         if (dostats)
                                 printf("Using Mode-S BEAST over serial/USB on device: %s speed: 3Mbps\n", serport);
                         break;
@@ -1036,50 +2032,52 @@ int main(int argc, char *argv[])
         }
 
         /*
-         * start the housekeeping timer
+         * start the housekeeping timer, when replaying it runs on the capture's clock instead
          */
-        timer_fd = timerfd_create(CLOCK_REALTIME,  0);
+        if (replay[0]) {
+                replay_real = nstime();
+                next_second = replay_base + 1000000;
+                next_forward = replay_base + forward_interval * 1000;
+                ustime_set(replay_base);
+                timer_fd = forward_fd = -1;
+        } else {
+                timer_fd = timerfd_create(CLOCK_REALTIME,  0);
 
-        if (!timer_fd)
-                qerror("unable to create timer!");
+                if (!timer_fd)
+                        qerror("unable to create timer!");
 
-        timerfd_settime(timer_fd, 0, &spec_second, NULL);
+                timerfd_settime(timer_fd, 0, &spec_second, NULL);
+        }
 
 
         /*
          * if using multiframe clear the buffer and start the forwarding timer
          */
-        if (multiframe) {
-#if 0
-                struct itimerspec spec_forward = {		/* radar multi-frame forwarding intervl */
-                        { 0, RADAR_FORWARD_INTERVAL },
-                        { 0, RADAR_FORWARD_INTERVAL }
-                };
-#endif
-                struct itimerspec spec_forward;
-                long nsec = forward_interval * 1000000;
-
-                spec_forward.it_interval.tv_sec = 0;
-                spec_forward.it_interval.tv_nsec = nsec;
-                spec_forward.it_value.tv_sec = 0;
-                spec_forward.it_value.tv_nsec = nsec;
-
-                forward_fd = timerfd_create(CLOCK_REALTIME,  0);
-
-                if (!forward_fd)
-                        qerror("unable to create timer!");
+        if (multiframe && !replay[0]) {
+                forward_timer();
+                clear_buffer();
+        }
 
-                timerfd_settime(forward_fd, 0, &spec_forward, NULL);
+        /*
+         * overload protection restores -m and -i as they were set as the load eases,
+         * there is no input backlog to measure when replaying
+         */
+        base_multiframe = multiframe;
+        base_interval = forward_interval;
 
-                clear_buffer();
+        if (protect && replay[0]) {
+                if (dostats)
+                        printf("Overload protection (-o) is not used when replaying\n");
+                protect = 0;
         }
 
         /*
          * forward traffic ...
          */
         do {
-                struct pollfd fds[3];
+                struct pollfd fds[2+BEAST_MAX_SOURCES+1+METRICS_MAX_CLIENTS+1+UDP_MAX_PATHS];
                 int nfds = 2;
+                int nbeast, nmetrics, nnetlink, nudp;
                 int rc;
         
                 /* watch house-keeping timer */
@@ -1090,12 +2088,21 @@ int main(int argc, char *argv[])
                 fds[1].fd = forward_fd;
                 fds[1].events = (multiframe) ? POLLIN : 0;
 
-                /* watch for input, hangups and errors from Beast connection, if active */
-                if (beast_fd) {
-                        fds[2].fd = beast_fd;
-                        fds[2].events = POLLIN|POLLHUP|POLLERR;
-                        ++nfds;
-                }
+                /* watch for input, hangups and errors from Beast connections, if active */
+                nbeast = beast_poll_setup(&fds[2]);
+                nfds += nbeast;
+
+                /* watch the metrics listener and clients, if enabled */
+                nmetrics = metrics_poll_setup(&fds[nfds]);
+                nfds += nmetrics;
+
+                /* watch for address, route and link changes */
+                nnetlink = netlink_poll_setup(&fds[nfds]);
+                nfds += nnetlink;
+
+                /* watch for messages from the aggregator, if probing */
+                nudp = udp_poll_setup(&fds[nfds]);
+                nfds += nudp;
 
                 /*
                  * perform poll() for IO status and decode result:
@@ -1106,7 +2113,7 @@ int main(int argc, char *argv[])
                  *
                  */
 again:
-                rc = poll(fds, nfds, 250);
+                rc = poll(fds, nfds, trace_timeout(probe_timeout(netlink_timeout(udp_timeout(replay[0] ? replay_timeout() : beast_poll_timeout())))));
 
                 if (rc > 0) {
                         /*
@@ -1115,9 +2122,10 @@ again:
                          
                         /* check house-keeping timer */
                         if (fds[0].revents & POLLIN) {
-                                rc = read(timer_fd, dummybuf, 8);
+                                rc = read(timer_fd, &expirations, sizeof(expirations));
                                 
                                 if (rc > 0) {
+                                        overload_lag(latency_lag(LATENCY_LOOP_HOUSEKEEPING, timer_fd, expirations));
                                         house_keeping();
                                 } else {
                                         /* should not get here */
@@ -1127,9 +2135,10 @@ again:
 
                         /* check fast forwarding timer (for multframe) */
                         if (multiframe && (fds[1].revents & POLLIN)) {
-                                rc = read(forward_fd, dummybuf, 8);
+                                rc = read(forward_fd, &expirations, sizeof(expirations));
 
                                 if (rc > 0) {
+                                        overload_lag(latency_lag(LATENCY_LOOP_FORWARD, forward_fd, expirations));
                                 
                                         /* if we have outstanding frames then send them */
                                         if (num)
@@ -1141,13 +2150,16 @@ again:
                         }
 
                         /* check for beast data available and errors */
-                        if (beast_fd) {
-                                if (fds[2].revents & POLLIN) {
-                                        beast_read();
-                                } else if (fds[2].revents & POLLHUP || fds[2].revents & POLLERR) {
-                                        beast_reset_connection();
-                                }
-                        }
+                        beast_poll_events(&fds[2], nbeast);
+
+                        /* check for metrics requests */
+                        metrics_poll_events(&fds[2+nbeast], nmetrics);
+
+                        /* check for network changes */
+                        netlink_poll_events(&fds[2+nbeast+nmetrics], nnetlink);
+
+                        /* check for probe echoes */
+                        udp_poll_events(&fds[2+nbeast+nmetrics+nnetlink], nudp);
 
                 } else if (rc == 0) {
                         /*
@@ -1173,8 +2185,45 @@ again:
                         }
                 }
 
+                /* replay the capture events that are due */
+                if (replay[0])
+                        replay_run();
+
+                /* send the messages the impairment simulator held back that are now due */
+                udp_run();
+
+                /* uplink path health checks, fail-over and fail-back */
+                udp_check();
+
+                /* restart UDP once a burst of network changes has settled */
+                netlink_check();
+
+                /* send uplink probes that are due and expire those not answered */
+                probe_check();
+
+                /* BEAST stall detection and fail-over */
+                beast_check();
+
+                /* dump the trace ring on SIGUSR1 */
+                if (dump_trace) {
+                        char name[HOSTNAME_LEN+64];
+
+                        trace_dump(name, sizeof(name));
+                        dump_trace = 0;
+                }
+
+                /* write the next part of a trace dump in progress */
+                trace_run();
+
         } while (!ending);
 
+        /* finish a trace dump in progress */
+        while (trace_run())
+                ;
+
+        if (dostats && impair_enabled())
+                impair_report();
+
         /*
          * clean up and finish
          */
@@ -1182,3 +2231,4 @@ again:
         exit(EXIT_SUCCESS);
 }
 
+#endif /* RADAR_NO_MAIN */
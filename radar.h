@@ -13,6 +13,7 @@
 #include "stats.h"
 #include "telemetry.h"
 #include "authtag.h"
+#include "latency.h"
 
 
 #define RADAR_PORT				5997
@@ -21,20 +22,53 @@
 #define RADAR_PROTOCOL_BEAST_TCP		1
 #define RADAR_PROTOCOL_BEAST_SERIAL		2
 #define RADAR_PROTOCOL_GNS_SERIAL		3
+#define RADAR_PROTOCOL_AVR_TCP			4
 
 #define RADAR_OPCODE_RESERVED			0x00
 #define RADAR_OPCODE_MODE_AC			0x01
 #define RADAR_OPCODE_MODE_S			0x02
 #define RADAR_OPCODE_MODE_ES			0x03
 #define RADAR_OPCODE_MULTIFRAME			0x04
+#define RADAR_OPCODE_FEC			0x05
 #define RADAR_OPCODE_KEEPALIVE			0x80
 #define RADAR_OPCODE_SYSTEM_TELEMETRY		0x81
 #define RADAR_OPCODE_RADIO_STATS		0x82
+#define RADAR_OPCODE_LATENCY			0x83
 #define RADAR_OPCODE_CONFIG_REQ			0xC1
-#define RADAR_OPCODE_CONGIG_ACK			0xC2
+#define RADAR_OPCODE_CONFIG_ACK			0xC2
+
+#define RADAR_CONFIG_PROBE			0x01		/* CONFIG_REQ/ACK type: RTT probe and its echo */
+#define RADAR_CONFIG_SET			0x02		/* CONFIG_REQ/ACK type: aggregator changes our settings */
+
+#define RADAR_SET_MULTIFRAME			0x0001		/* radar_config_t fields to change */
+#define RADAR_SET_INTERVAL			0x0002
+#define RADAR_SET_FRAMES			0x0004
+#define RADAR_SET_ES_DFS			0x0008
+#define RADAR_SET_SS_DFS			0x0010
+#define RADAR_SET_MODE_AC			0x0020
+#define RADAR_SET_BUDGET			0x0040
+#define RADAR_SET_STATS				0x0080
+#define RADAR_SET_TELEMETRY			0x0100
+#define RADAR_SET_ALL				0x01FF
+
+#define RADAR_CONFIG_OK				0		/* CONFIG_ACK status: changed as asked */
+#define RADAR_CONFIG_INVALID			1		/* a value is out of range, nothing changed */
+#define RADAR_CONFIG_STALE			2		/* time stamp too old or not after the last change */
+#define RADAR_CONFIG_LOCKED			3		/* not allowed here (-L) */
+
+#define RADAR_CONFIG_SKEW			30			/* seconds a change may be from our clock */
+#define RADAR_CONFIG_PERIOD_MIN			60			/* pushed stats/telemetry intervals (seconds) */
+#define RADAR_CONFIG_PERIOD_MAX			86400
+#define RADAR_ES_DFS				0x007E0000		/* DF17-22, the extended frames we forward without -e */
 
 #define RADAR_MAX_MULTIFRAME			32
 #define RADAR_FORWARD_INTERVAL			50			/* milliseconds */
+#define RADAR_FORWARD_INTERVAL_MAX		250			/* milliseconds, -i and -I limit */
+#define RADAR_ADAPT_LOSS			50			/* -I keeps -i on paths losing this many probes per mille */
+#define RADAR_REPLAY_BATCH			1000			/* replay events per pass of the main loop */
+#define RADAR_MULTIFRAME_OVERHEAD		(sizeof(radar_msg_t) + 1 + AUTHTAG_LEN + 28)	/* header, count, tag, IP and UDP */
+#define RADAR_FEC_MAX_K				16			/* data messages per parity message */
+#define RADAR_FEC_SPAN				32			/* sequence numbers a parity group may span */
 
 
 /*
@@ -163,6 +197,33 @@ typedef struct {
 } __attribute__((packed)) radar_telemetry_t;
 
 
+/*
+ * radar message type: latency - per-stage latency and event loop lag percentiles (see latency.c,h)
+ */
+typedef struct {
+        uint64_t key;                           /* API key for this radar station */
+        uint64_t ts;                            /* Timestamp (uS) */
+        uint32_t seq;                           /* Message sequence number */
+        uint8_t opcode;				/* Opcode: message type */
+        uint8_t stages;				/* number of stage summaries that follow */
+        latency_summary_t stage[LATENCY_STAGES];	/* summaries in enum latency_stage order */
+        uint8_t atag[AUTHTAG_LEN];		/* Authentication tag */
+} __attribute__((packed)) radar_latency_t;
+
+
+/*
+ * an Extended Squitter frame held in the multiframe buffer
+ */
+typedef struct {
+        uint8_t mlat[MLAT_LEN];			/* Multi-lateration timestamp */
+        uint8_t rssi;        			/* Received signal strength indication */
+        uint8_t data[MODE_ES_LEN];		/* data */
+        uint64_t rx;				/* arrival time (uS) */
+        uint64_t held;				/* time buffered (monotonic nS) */
+        uint32_t trace;				/* trace record */
+} esdata_t;
+
+
 /*
  * es_msg_t type - one extended squitter sub-message - 21 bytes
  */
@@ -187,12 +248,80 @@ typedef struct {
 } __attribute__((packed)) radar_multiframe_t;
 
 
+/*
+ * radar message type: FEC parity - the XOR of up to RADAR_FEC_MAX_K data messages (opcodes
+ * 0x01-0x04) exactly as sent, each zero padded to the longest, so that any one of them that
+ * is lost can be rebuilt from the others (see fec.c)
+ */
+typedef struct {
+        uint64_t key;                           /* API key for this radar station */
+        uint64_t ts;                            /* Timestamp (uS) */
+        uint32_t seq;                           /* Message sequence number */
+        uint8_t opcode;				/* Opcode: message type */
+        uint32_t first;				/* sequence number of the first data message covered */
+        uint32_t covers;			/* bit n set if sequence number first+n is covered */
+        uint16_t len;				/* XOR of the lengths of the messages covered */
+        uint8_t parity[sizeof(radar_multiframe_t) + AUTHTAG_LEN];	/* parity, then the auth tag */
+} __attribute__((packed)) radar_fec_t;
+
+#define RADAR_FEC_HEADER			(sizeof(radar_fec_t) - sizeof(((radar_fec_t *)0)->parity))
+
+
+/*
+ * radar message type: RTT probe (CONFIG_REQ) and its echo (CONFIG_ACK) - the aggregator sends
+ * the probe back with the ACK opcode, its own header and an auth tag made with our key (see probe.c)
+ */
+typedef struct {
+        uint64_t key;                           /* API key for this radar station */
+        uint64_t ts;                            /* Timestamp (uS) */
+        uint32_t seq;                           /* Message sequence number */
+        uint8_t opcode;				/* Opcode: CONFIG_REQ or CONFIG_ACK */
+        uint8_t type;				/* RADAR_CONFIG_PROBE */
+        uint8_t path;				/* uplink path the probe was sent on */
+        uint32_t id;				/* probe number */
+        uint64_t sent;				/* send time (sender's monotonic nS), echoed */
+        uint8_t atag[AUTHTAG_LEN];		/* Authentication tag */
+} __attribute__((packed)) radar_probe_t;
+
+
+/*
+ * radar message type: settings pushed by the aggregator (CONFIG_REQ) and our answer (CONFIG_ACK),
+ * which carries the settings in force afterwards whatever was asked
+ */
+typedef struct {
+        uint64_t key;                           /* API key for this radar station */
+        uint64_t ts;                            /* Timestamp (uS) */
+        uint32_t seq;                           /* Message sequence number */
+        uint8_t opcode;				/* Opcode: CONFIG_REQ or CONFIG_ACK */
+        uint8_t type;				/* RADAR_CONFIG_SET */
+        uint8_t status;				/* ACK: RADAR_CONFIG_OK etc. */
+        uint16_t set;				/* RADAR_SET_ bits of the fields to change (ACK: changed) */
+        uint32_t id;				/* request number, echoed */
+        uint8_t multiframe;			/* multiframe sending on (1) or off (0) */
+        uint8_t frames;				/* most frames in a multiframe message (1-32) */
+        uint16_t interval;			/* multiframe interval (10-250 mS) */
+        uint32_t es_dfs;			/* bit n set: forward extended (112 bit) DFn frames */
+        uint32_t ss_dfs;			/* bit n set: forward short (56 bit) DFn frames */
+        uint8_t mode_ac;			/* forward Mode-A/C (1) or not (0) */
+        uint32_t budget_kbps;			/* uplink budget, zero for none */
+        uint32_t budget_burst;			/* uplink burst (bytes), zero for the default */
+        uint32_t stats_interval;		/* radio stats interval (seconds) */
+        uint32_t telemetry_interval;		/* telemetry interval (seconds) */
+        uint8_t atag[AUTHTAG_LEN];		/* Authentication tag */
+} __attribute__((packed)) radar_config_t;
+
+
 /*
  * external functions
  */
-void radar_process(uint8_t mlat[MLAT_LEN], uint8_t rssi, uint8_t *buf, int size);
+void radar_process(uint8_t mlat[MLAT_LEN], uint8_t rssi, uint8_t *buf, int size, uint64_t rx);
 void radar_send_keepalive(void);
 void radar_send_stats(void);
 void radar_send_telemetry(void);
+void radar_send_latency(void);
+void radar_send_multiframe(void);
+void radar_send_fec(void);
+int radar_send_probe(int, uint32_t, uint64_t);
+void radar_filters(void);
 
 #endif
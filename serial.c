@@ -0,0 +1,202 @@
+/*
+ * serial.c -- Low latency tuning for serial/USB connected receivers
+ * Author: Michael J. Tubby B.Sc. MIET  mike@tubby.org
+ *
+ * ABSTRACT
+ *
+ * Mode-S Beast and GNS HULC receivers are usually FTDI USB serial devices.
+ * The FTDI chip holds received data until its buffer fills or its latency
+ * timer expires (16mS by default) and the tty layer may add more buffering,
+ * which is far more delay than the rest of radar put together.
+ *
+ * After each (re)connect serial_tune():
+ *
+ *   * sets ASYNC_LOW_LATENCY on the tty with TIOCSSERIAL so the tty layer
+ *     pushes data straight through (on some kernels ftdi_sio also sets its
+ *     latency timer to 1mS when it sees this flag)
+ *
+ *   * writes SERIAL_LATENCY_TIMER to the FTDI latency_timer in sysfs - this
+ *     normally needs root or a udev rule as we drop privileges at start-up
+ *     so failure is not an error
+ *
+ *   * works out a read size that covers the device FIFO and the data the
+ *     line can deliver in one latency timer period
+ *
+ * To show the improvement in telemetry we compare the spacing of arrival
+ * times with the spacing of the frames' MLAT timestamps: the MLAT counter is
+ * the time the frame was received off-air so any difference between the two
+ * is buffering and scheduling delay on the way to us.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <limits.h>
+#include <libgen.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/serial.h>
+
+#include "radar.h"
+#include "beast.h"
+#include "serial.h"
+#include "telemetry.h"
+
+
+extern int debug;
+
+
+/*
+ * local variables
+ */
+static uint64_t last_rx;				/* arrival time of previous frame (uS) */
+static uint64_t last_mlat;				/* MLAT timestamp of previous frame (12MHz ticks) */
+static uint64_t jitter_sum;
+static uint32_t jitter_count;
+static uint32_t jitter_max;
+
+
+/*
+ * baud_rate() - convert a termios speed into bits per second
+ */
+static int baud_rate(speed_t speed)
+{
+        switch (speed) {
+                case B115200:	return 115200;
+                case B230400:	return 230400;
+                case B460800:	return 460800;
+                case B921600:	return 921600;
+                case B1000000:	return 1000000;
+                case B2000000:	return 2000000;
+                case B3000000:	return 3000000;
+                default:	return 0;
+        }
+}
+
+
+/*
+ * latency_timer() - set the FTDI latency timer through sysfs, returns the timer value or zero if unknown
+ */
+static int latency_timer(const char *dev)
+{
+        char real[PATH_MAX];
+        char path[PATH_MAX+64];
+        FILE *f;
+        int timer = 0;
+
+        /* resolve /dev/serial/by-id/... style links down to ttyUSBn */
+        if (!realpath(dev, real))
+                return 0;
+
+        snprintf(path, sizeof(path), "/sys/bus/usb-serial/devices/%s/latency_timer", basename(real));
+
+        if ((f = fopen(path, "r")) != NULL) {
+                if (fscanf(f, "%d", &timer) != 1)
+                        timer = 0;
+                fclose(f);
+        }
+
+        if (timer > SERIAL_LATENCY_TIMER) {
+                if ((f = fopen(path, "w")) != NULL) {
+                        fprintf(f, "%d\n", SERIAL_LATENCY_TIMER);
+
+                        if (fclose(f) == 0)
+                                timer = SERIAL_LATENCY_TIMER;
+                }
+
+                if (debug)
+                        printf("latency_timer(): %s latency timer is %dmS\n", path, timer);
+        }
+
+        return timer;
+}
+
+
+/*
+ * serial_tune() - tune a newly opened serial port for low latency, returns the read size to use
+ */
+int serial_tune(int fd, const char *dev, speed_t speed)
+{
+        struct serial_struct ss;
+        int fifo = 0;
+        int size, timer, bytes;
+
+        /* ask the tty layer not to hold data back */
+        telemetry.serial_low_latency = 0;
+
+        if (ioctl(fd, TIOCGSERIAL, &ss) == 0) {
+                fifo = ss.xmit_fifo_size;
+
+                ss.flags |= ASYNC_LOW_LATENCY;
+
+                if (ioctl(fd, TIOCSSERIAL, &ss) == 0)
+                        telemetry.serial_low_latency = 1;
+        }
+
+        timer = latency_timer(dev);
+        telemetry.serial_latency_timer = (uint8_t)timer;
+
+        /* read at least the FIFO and everything the line can deliver in one latency timer period */
+        bytes = baud_rate(speed) / 10 / 1000 * (timer ? timer : 16);
+        size = SERIAL_MIN_READ;
+
+        while (size < BEAST_BUF_SIZE && (size < fifo || size < bytes))
+                size <<= 1;
+
+        telemetry.serial_read_size = (uint16_t)size;
+
+        /* arrival spacing is measured from the first frame on the new connection */
+        last_rx = last_mlat = 0;
+
+        if (debug)
+                printf("serial_tune(): %s low_latency=%d latency_timer=%dmS fifo=%d read size=%d\n", dev, telemetry.serial_low_latency, timer, fifo, size);
+
+        return size;
+}
+
+
+/*
+ * serial_arrival() - compare arrival spacing with MLAT timestamp spacing for a frame
+ */
+void serial_arrival(uint64_t rx, const uint8_t *mlat)
+{
+        uint64_t ts = ((uint64_t)mlat[0] << 40) | ((uint64_t)mlat[1] << 32) | ((uint64_t)mlat[2] << 24) |
+                      ((uint64_t)mlat[3] << 16) | ((uint64_t)mlat[4] << 8) | (uint64_t)mlat[5];
+
+        if (!ts)
+                return;
+
+        if (last_mlat) {
+                int64_t dm = (int64_t)(((ts - last_mlat) & 0xFFFFFFFFFFFFULL) / SERIAL_MLAT_CLOCK);
+                int64_t da = (int64_t)(rx - last_rx);
+
+                if (dm < SERIAL_MAX_GAP && da < SERIAL_MAX_GAP) {
+                        uint32_t jitter = (uint32_t)llabs(da - dm);
+
+                        jitter_sum += jitter;
+                        ++jitter_count;
+
+                        if (jitter > jitter_max)
+                                jitter_max = jitter;
+                }
+        }
+
+        last_rx = rx;
+        last_mlat = ts;
+}
+
+
+/*
+ * serial_telemetry() - fill in the arrival jitter for a telemetry message and start a new period
+ */
+void serial_telemetry(void)
+{
+        telemetry.serial_jitter_avg = jitter_count ? (uint32_t)(jitter_sum / jitter_count) : 0;
+        telemetry.serial_jitter_max = jitter_max;
+
+        jitter_sum = 0;
+        jitter_count = 0;
+        jitter_max = 0;
+}
@@ -0,0 +1,25 @@
+/*
+ * serial.h -- Low latency tuning for serial/USB connected receivers
+ * Author: Michael J. Tubby B.Sc. MIET  mike@tubby.org
+ */
+
+#ifndef _SERIAL_H
+#define _SERIAL_H
+
+#include <stdint.h>
+#include <termios.h>
+
+#define SERIAL_LATENCY_TIMER		1		/* FTDI latency timer we ask for (mS) - kernel default is 16mS */
+#define SERIAL_MIN_READ			64		/* smallest read size - one full speed USB packet */
+#define SERIAL_MLAT_CLOCK		12		/* Mode-S Beast MLAT counter runs at 12MHz */
+#define SERIAL_MAX_GAP			1000000		/* ignore arrival spacing over gaps longer than this (uS) */
+
+
+/*
+ * exported functions
+ */
+int serial_tune(int, const char *, speed_t);
+void serial_arrival(uint64_t, const uint8_t *);
+void serial_telemetry(void);
+
+#endif
@@ -0,0 +1,350 @@
+/*
+ * sim.c -- Offline forwarding policy simulator
+ * Author: Michael J. Tubby B.Sc. MIET  mike@tubby.org
+ *
+ * ABSTRACT
+ *
+ * Answers "what would -m, -i, -y, -e or a shorter duplicate window cost on
+ * this site?" before the setting is changed on a metered link.  A capture
+ * (see capture.c) is run through several forwarding configurations at once:
+ *
+ *	radar -k <key> -R site.cap -C default -C m -C m,i=200 -C y -C e -C w=1000
+ *
+ * The capture is parsed once and each frame is given to the real
+ * radar_process() once per configuration, with that configuration's flags,
+ * duplicate tables, multiframe buffer and sequence number swapped in around
+ * the call.  Messages are signed as usual but handed to sim_send() instead
+ * of being sent.  Time is the capture's clock: the multiframe timer of each
+ * configuration and the once a second duplicate clean-up and keepalive run
+ * at the capture times they would have live.
+ *
+ * A configuration is a comma separated list of:
+ *
+ *	m	multiframe (-m)
+ *	i=<ms>	multiframe forwarding interval (-i, default 50)
+ *	y	send Mode-S short squitters (-y)
+ *	c	send Mode-A/C (-c)
+ *	e	forward everything (-e)
+ *	w=<ms>	duplicate window (default 3000)
+ *
+ * or "default" for the defaults.  At the end a table of frames, messages
+ * and bytes per second, duplicates suppressed per second and percentiles of
+ * the time frames were held before sending is printed for each.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "radar.h"
+#include "beast.h"
+#include "udp.h"
+#include "ustime.h"
+#include "capture.h"
+#include "sim.h"
+#include "qerror.h"
+
+
+/*
+ * external variables - the radar.c and dupe.c state a configuration changes
+ */
+extern int multiframe;
+extern int send_ss;
+extern int send_ac;
+extern int everything;
+extern int num;
+extern uint32_t seq;
+extern uint32_t send_count;
+extern uint32_t dupe_ss_count;
+extern uint32_t dupe_es_count;
+extern esdata_t esdata[RADAR_MAX_MULTIFRAME];
+extern dupe_ss_t *dupe_ss;
+extern dupe_es_t *dupe_es;
+
+
+/*
+ * local variables
+ */
+static sim_config_t configs[SIM_MAX_CONFIGS];
+static int nconfigs = 0;
+static sim_config_t *cur = NULL;		/* configuration swapped in */
+
+
+/*
+ * load() - swap a configuration's state into radar.c and dupe.c
+ */
+static void load(sim_config_t *c)
+{
+        multiframe = c->multiframe;
+        send_ss = c->send_ss;
+        send_ac = c->send_ac;
+        everything = c->everything;
+        radar_filters();
+        dupe_ss = c->dupe_ss;
+        dupe_es = c->dupe_es;
+        dupe_window(c->window);
+        memcpy(esdata, c->esdata, c->num * sizeof(esdata_t));
+        num = c->num;
+        seq = c->seq;
+        send_count = c->send_count;
+        dupe_ss_count = dupe_es_count = 0;
+        cur = c;
+}
+
+
+/*
+ * save() - swap a configuration's state back out
+ */
+static void save(sim_config_t *c)
+{
+        c->dupe_ss = dupe_ss;
+        c->dupe_es = dupe_es;
+        memcpy(c->esdata, esdata, num * sizeof(esdata_t));
+        c->num = num;
+        c->seq = seq;
+        c->send_count = send_count;
+        c->dupes += dupe_ss_count + dupe_es_count;
+        cur = NULL;
+}
+
+
+/*
+ * sim_send() - account for a message instead of sending it (see udp_simulate())
+ */
+static void sim_send(void *buf, int size)
+{
+        radar_msg_t *mp = buf;
+        uint64_t now = ustime();
+        int i;
+
+        if (!cur)
+                return;
+
+        ++cur->packets;
+        cur->bytes += size;
+
+        switch (mp->opcode) {
+                case RADAR_OPCODE_MODE_AC:
+                case RADAR_OPCODE_MODE_S:
+                case RADAR_OPCODE_MODE_ES:
+                        /* sent as it arrived */
+                        ++cur->frames;
+                        latency_add(&cur->hold, 0);
+                        break;
+
+                case RADAR_OPCODE_MULTIFRAME:
+                        /* the frames are still in the buffer while it is sent */
+                        cur->frames += num;
+
+                        for (i = 0; i < num; i++)
+                                latency_add(&cur->hold, (now - esdata[i].rx) * 1000);
+                        break;
+
+                case RADAR_OPCODE_KEEPALIVE:
+                        ++cur->keepalives;
+                        break;
+        }
+}
+
+
+/*
+ * sim_frame() - give a decoded frame to radar_process() once for each configuration
+ */
+static void sim_frame(uint8_t *mlat, uint8_t rssi, uint8_t *data, int len, uint64_t rx)
+{
+        int i;
+
+        for (i = 0; i < nconfigs; i++) {
+                load(&configs[i]);
+                radar_process(mlat, rssi, data, len, rx);
+                save(&configs[i]);
+        }
+}
+
+
+/*
+ * second() - the parts of house_keeping() that change what is sent
+ */
+static void second(void)
+{
+        int i;
+
+        for (i = 0; i < nconfigs; i++) {
+                load(&configs[i]);
+                dupe_clean();
+
+                if (send_count == 0)
+                        radar_send_keepalive();
+
+                send_count = 0;
+                save(&configs[i]);
+        }
+}
+
+
+/*
+ * flush() - send a configuration's multiframe buffer
+ */
+static void flush(sim_config_t *c)
+{
+        load(c);
+
+        if (num)
+                radar_send_multiframe();
+
+        save(c);
+}
+
+
+/*
+ * run_timers() - run the timers due up to and including 'until' in time order
+ */
+static void run_timers(uint64_t *next_second, uint64_t until)
+{
+        for (;;) {
+                uint64_t t = *next_second;
+                sim_config_t *c = NULL;
+                int i;
+
+                for (i = 0; i < nconfigs; i++) {
+                        if (configs[i].multiframe && configs[i].next_forward < t) {
+                                t = configs[i].next_forward;
+                                c = &configs[i];
+                        }
+                }
+
+                if (t > until)
+                        break;
+
+                ustime_set(t);
+
+                if (c) {
+                        flush(c);
+                        c->next_forward += c->interval * 1000;
+                } else {
+                        second();
+                        *next_second += 1000000;
+                }
+        }
+}
+
+
+/*
+ * report() - print the results
+ */
+static void report(double secs)
+{
+        int i;
+
+        printf("\n%-20s %9s %9s %10s %9s %9s %9s %9s %9s\n", "configuration", "frames/s", "msgs/s", "bytes/s",
+                "dupes/s", "bytes/fr", "hold p50", "hold p99", "hold max");
+
+        for (i = 0; i < nconfigs; i++) {
+                sim_config_t *c = &configs[i];
+
+                printf("%-20s %9.1f %9.1f %10.0f %9.1f %9.1f %7.1fms %7.1fms %7.1fms\n", c->name,
+                        c->frames / secs, c->packets / secs, c->bytes / secs, c->dupes / secs,
+                        c->frames ? (double)c->bytes / c->frames : 0,
+                        latency_percentile(&c->hold, 500) / 1e6,
+                        latency_percentile(&c->hold, 990) / 1e6,
+                        c->hold.max / 1e6);
+        }
+}
+
+
+/*
+ * sim_add() - add a configuration from its -C description
+ */
+void sim_add(const char *spec)
+{
+        sim_config_t *c;
+        char buf[SIM_NAME_LEN+1], *tok, *save;
+
+        if (nconfigs >= SIM_MAX_CONFIGS)
+                qerror("radar: too many simulator configurations (max %d)\n", SIM_MAX_CONFIGS);
+
+        if (strlen(spec) > SIM_NAME_LEN)
+                qerror("radar: simulator configuration \"%s\" too long\n", spec);
+
+        c = &configs[nconfigs++];
+        memset(c, 0, sizeof(sim_config_t));
+        strcpy(c->name, spec);
+        c->interval = RADAR_FORWARD_INTERVAL;
+        c->window = DUPE_MAX_ES;
+        c->seq = 1;
+
+        strcpy(buf, spec);
+
+        for (tok = strtok_r(buf, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+                if (strcmp(tok, "default") == 0) {
+                        ;
+                } else if (strcmp(tok, "m") == 0) {
+                        c->multiframe = 1;
+                } else if (strcmp(tok, "y") == 0) {
+                        c->send_ss = 1;
+                } else if (strcmp(tok, "c") == 0) {
+                        c->send_ac = 1;
+                } else if (strcmp(tok, "e") == 0) {
+                        c->everything = 1;
+                } else if (strncmp(tok, "i=", 2) == 0) {
+                        c->interval = atoi(tok + 2);
+                        if (c->interval < 10 || c->interval > 250)
+                                qerror("radar: simulator multiframe interval must be in range 10-250mS\n");
+                } else if (strncmp(tok, "w=", 2) == 0) {
+                        c->window = (uint64_t)atoi(tok + 2) * 1000;
+                        if (c->window < 100000 || c->window > 60000000)
+                                qerror("radar: simulator duplicate window must be in range 100-60000mS\n");
+                } else {
+                        qerror("radar: unknown simulator option \"%s\" in \"%s\"\n", tok, spec);
+                }
+        }
+}
+
+
+/*
+ * sim_configs() - number of configurations, zero if not simulating
+ */
+int sim_configs(void)
+{
+        return nconfigs;
+}
+
+
+/*
+ * sim_run() - run the capture opened with replay_open() through every configuration
+ * and print the results; fmt and start are what replay_open() returned
+ */
+void sim_run(int fmt, uint64_t start)
+{
+        uint8_t buf[CAPTURE_MAX_READ];
+        uint64_t next_second = start + 1000000;
+        uint64_t t, last = start;
+        int i, len;
+
+        beast_replay_init(fmt);
+        beast_output(sim_frame);
+        udp_simulate(sim_send);
+        ustime_set(start);
+
+        for (i = 0; i < nconfigs; i++)
+                configs[i].next_forward = start + configs[i].interval * 1000;
+
+        while ((t = replay_peek()) != 0) {
+                run_timers(&next_second, t);
+                ustime_set(t);
+
+                if ((len = replay_read(buf)) > 0)
+                        beast_input(buf, len);
+
+                last = t;
+        }
+
+        /* send whatever is left in the multiframe buffers */
+        for (i = 0; i < nconfigs; i++)
+                flush(&configs[i]);
+
+        printf("Simulated %.1f seconds of capture", (last - start) / 1e6);
+        report(last > start ? (last - start) / 1e6 : 1);
+}
@@ -0,0 +1,56 @@
+/*
+ * sim.h -- Offline forwarding policy simulator
+ * Author: Michael J. Tubby B.Sc. MIET  mike@tubby.org
+ */
+
+#ifndef _SIM_H
+#define _SIM_H
+
+#include <stdint.h>
+
+#include "radar.h"
+#include "dupe.h"
+#include "latency.h"
+
+#define SIM_MAX_CONFIGS		16		/* configurations in one run */
+#define SIM_NAME_LEN		32
+
+
+/*
+ * a forwarding configuration, the radar.c and dupe.c state that it changes
+ * while it runs and the results
+ */
+typedef struct {
+        char name[SIM_NAME_LEN+1];		/* as given to -C */
+        int multiframe;				/* -m */
+        int send_ss;				/* -y */
+        int send_ac;				/* -c */
+        int everything;				/* -e */
+        int interval;				/* -i multiframe forwarding interval (mS) */
+        uint64_t window;			/* duplicate window (uS) */
+
+        dupe_ss_t *dupe_ss;			/* duplicate tables */
+        dupe_es_t *dupe_es;
+        esdata_t esdata[RADAR_MAX_MULTIFRAME];	/* multiframe buffer */
+        int num;
+        uint32_t seq;				/* message sequence number */
+        uint32_t send_count;			/* messages this second */
+        uint64_t next_forward;			/* next multiframe flush (uS) */
+
+        uint64_t packets;			/* messages sent */
+        uint64_t bytes;				/* bytes sent */
+        uint64_t frames;			/* frames forwarded */
+        uint64_t dupes;				/* duplicates suppressed */
+        uint64_t keepalives;			/* keepalives sent */
+        latency_hist_t hold;			/* arrival to send (nS) */
+} sim_config_t;
+
+
+/*
+ * exported functions
+ */
+void sim_add(const char *);
+int sim_configs(void);
+void sim_run(int, uint64_t);
+
+#endif
@@ -41,6 +41,19 @@ void stats_init(int ival)
 }
 
 
+/*
+ * stats_period() - send the statistics every ival seconds from now on, without losing the
+ * counts so far
+ */
+void stats_period(int ival)
+{
+        interval = ival;
+
+        if (count > ival)
+                count = ival;
+}
+
+
 /*
  * stats_second() - house keeping
  */
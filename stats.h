@@ -44,6 +44,17 @@ typedef struct {
         uint64_t tx_count;			/* Total number of transmissions */
         uint64_t tx_bytes;			/* Total number of bytes transmitted */
 
+        uint32_t hw_filter;			/* BEAST_HW_xxx settings in force on a Mode-S Beast, zero if not configured */
+
+        uint32_t uplink_kbps;			/* uplink budget (-U), zero if none */
+        uint64_t shed_ac;			/* frames shed to stay within the uplink budget by class */
+        uint64_t shed_ss;
+        uint64_t shed_commb;			/* DF20/21 */
+        uint64_t shed_es_other;			/* ES other than identification, position and velocity */
+        uint64_t shed_es;			/* ES identification, position and velocity */
+        uint8_t fec_k;				/* data messages per FEC parity message (-K), zero if none */
+        uint64_t tx_fec;			/* FEC parity messages sent */
+
 } __attribute__((packed)) stats_t;
 
 
@@ -54,6 +65,7 @@ extern stats_t stats;
  * exported functions
  */
 void stats_init(int);
+void stats_period(int);
 void stats_second(void);
 void stats_send(void);
 
@@ -55,6 +55,8 @@
 #include "radar.h"
 #include "beast.h"
 #include "arch.h"
+#include "serial.h"
+#include "ustime.h"
 #include "telemetry.h"
 
 #define MB			(1024*1024)
@@ -76,6 +78,9 @@ static int interval;
 static int countdown;
 static char path[64];
 static FILE * tempf = NULL;
+static uint64_t latency_sum;
+static uint32_t latency_count;
+static uint32_t latency_max;
 
 
 /*
@@ -186,9 +191,23 @@ void telemetry_update(void)
 
                 /* has to be here for reasons of ordering */
                 telemetry.protocol = protocol;
+
+                /* serial arrival jitter for this period */
+                serial_telemetry();
+
+                /* in-process latency for this period */
+                telemetry.latency_avg = latency_count ? (uint32_t)(latency_sum / latency_count) : 0;
+                telemetry.latency_max = latency_max;
+                latency_sum = latency_count = latency_max = 0;
         
                 /* send telemetry */
                 radar_send_telemetry();
+
+                /* overload maxima are for the period */
+                telemetry.backlog_max = telemetry.loop_lag_max = 0;
+
+                /* and the latency histogram summary for the same period */
+                radar_send_latency();
         }
 }
 
@@ -270,6 +289,48 @@ void telemetry_second(void)
 }
 
 
+/*
+ * telemetry_period() - send the telemetry every ival seconds from now on
+ */
+void telemetry_period(int ival)
+{
+        interval = ival;
+
+        if (countdown > ival)
+                countdown = ival;
+}
+
+
+/*
+ * telemetry_soon() - bring the next telemetry report forward to the next second,
+ * e.g. when the overload level changes (see overload.c)
+ */
+void telemetry_soon(void)
+{
+        if (countdown > 1)
+                countdown = 1;
+}
+
+
+/*
+ * telemetry_latency() - record the in-process latency of a frame that has just been
+ * sent, given its arrival time (uS), and return the latency
+ */
+uint32_t telemetry_latency(uint64_t rx)
+{
+        uint64_t now = ustime();
+        uint32_t us = (now > rx) ? (uint32_t)(now - rx) : 0;
+
+        latency_sum += us;
+        ++latency_count;
+
+        if (us > latency_max)
+                latency_max = us;
+
+        return us;
+}
+
+
 /*
  * telemetry_close() - shutdown telemetry
  */ 
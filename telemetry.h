@@ -9,6 +9,7 @@
 #include <sys/utsname.h>
 
 #include "defs.h"
+#include "udp.h"
 
 #define TELEMETRY_INTERVAL	900			/* fifteen minutes */
 
@@ -82,7 +83,7 @@ typedef struct {
         /*
          * radar software performance items
          */
-        uint8_t protocol;				/* Protocol: 0:none 1:BEAST 2:AVR */
+        uint8_t protocol;				/* Protocol: see RADAR_PROTOCOL_xxx in radar.h */
         uint32_t connect_success;
         uint32_t connect_fail;
         uint32_t disconnect;
@@ -93,6 +94,64 @@ typedef struct {
         uint32_t frames_bad;
         uint16_t packets_per_second;			/* packets per second */
 
+        /*
+         * hot-standby BEAST sources
+         */
+        uint8_t active_source;				/* index of the active source (0 = primary) */
+        uint32_t source_switch;				/* number of fail-overs and fail-backs */
+        uint32_t source_stall;				/* number of stalls detected on the active source */
+
+        /*
+         * serial (Mode-S Beast / GNS HULC) ingest
+         */
+        uint8_t serial_low_latency;			/* ASYNC_LOW_LATENCY set on the tty */
+        uint8_t serial_latency_timer;			/* FTDI latency timer (mS), 0 if unknown */
+        uint16_t serial_read_size;			/* read size used for the serial port */
+        uint32_t serial_jitter_avg;			/* mean difference between arrival and MLAT spacing (uS) */
+        uint32_t serial_jitter_max;			/* maximum difference between arrival and MLAT spacing (uS) */
+
+        /*
+         * in-process latency
+         */
+        uint8_t kernel_timestamps;			/* arrival times are kernel receive timestamps */
+        uint32_t latency_avg;				/* mean arrival to sendto() time per frame (uS) */
+        uint32_t latency_max;				/* maximum arrival to sendto() time per frame (uS) */
+
+        /*
+         * overload protection (-o)
+         */
+        uint8_t overload_level;				/* degradation level in force, see enum overload_level */
+        uint32_t overload_changes;			/* number of level changes */
+        uint32_t backlog_max;				/* largest input backlog this period (bytes) */
+        uint32_t loop_lag_max;				/* largest event loop timer lag this period (uS) */
+        uint32_t overload_discarded;			/* input discarded to bound latency (bytes) */
+
+        /*
+         * multipath uplink (-O)
+         */
+        uint8_t uplink_paths;				/* number of uplink paths, 1 without -O */
+        uint8_t uplink_active;				/* index of the path in use (0 = preferred) */
+        uint8_t uplink_up;				/* bitmap of healthy paths */
+        uint32_t uplink_switch;				/* number of fail-overs and fail-backs */
+        uint32_t uplink_dup;				/* critical frames also sent on a second path (-J) */
+        uint32_t uplink_errors[UDP_MAX_PATHS];		/* send and health check failures by path */
+        uint32_t network_changes;			/* UDP restarts on address or default route changes */
+
+        /*
+         * uplink probing (-A), by path
+         */
+        uint32_t probe_rtt[UDP_MAX_PATHS];		/* smoothed round trip time (uS), zero if not known */
+        uint32_t probe_jitter[UDP_MAX_PATHS];		/* round trip time jitter (uS) */
+        uint16_t probe_loss[UDP_MAX_PATHS];		/* probes lost out of the last PROBE_WINDOW (per mille) */
+        uint32_t config_changes;			/* settings changed by the aggregator */
+
+        /*
+         * extra destinations (-D)
+         */
+        uint8_t fanout_dests;				/* number of extra destinations */
+        uint32_t fanout_sent;				/* messages sent to them */
+        uint32_t fanout_errors;				/* send failures to them */
+
 } __attribute__((packed)) telemetry_t;
 
 
@@ -105,6 +164,9 @@ extern telemetry_t telemetry;
 void telemetry_init(int);
 void telemetry_second(void);
 void telemetry_send(void);
+void telemetry_period(int);
+void telemetry_soon(void);
+uint32_t telemetry_latency(uint64_t);
 
 #endif
 
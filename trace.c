@@ -0,0 +1,246 @@
+/*
+ * trace.c -- Always-on ring buffer of recent frames and pipeline decisions
+ * Author: Michael J. Tubby B.Sc. MIET  mike@tubby.org
+ *
+ * ABSTRACT
+ *
+ * When a feeder misbehaves (a burst of dupes, frames_bad climbing, UDP resets)
+ * the -x debug output is no help: it is off under -d and far too slow for full
+ * traffic.  Instead we keep the last TRACE_SIZE frames and events in a fixed
+ * ring of compact binary records: arrival time, DF, ICAO address, what we did
+ * with it (sent, buffered, duplicate, filtered), the sequence number of the
+ * message it went out in, the UDP state and the active source.
+ *
+ * Recording is a few stores into the next slot with no formatting or system
+ * calls.  Frames held for multiframe get their batch sequence number filled in
+ * when the multiframe is sent, if the slot hasn't been overwritten by then.
+ *
+ * SIGUSR1, or a request for /trace on the metrics endpoint, writes the ring to
+ * <dir>/radar-trace-<time>-<pid>.bin (oldest record first) where <dir> is set
+ * with -w and defaults to /tmp.  Use the radar-trace tool to decode it.
+ *
+ * The dump is a copy of the ring taken at the time of the request and written
+ * TRACE_CHUNK bytes per pass of the main loop by trace_run(), so a dump of
+ * most of a megabyte doesn't hold up forwarding.  As the directory is usually
+ * shared the file is created with O_EXCL and O_NOFOLLOW, mode 0600, and a
+ * suffix is added rather than open an existing file or follow a link.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+
+#include "radar.h"
+#include "beast.h"
+#include "udp.h"
+#include "ustime.h"
+#include "qerror.h"
+#include "trace.h"
+
+
+/*
+ * external variables
+ */
+extern int debug;
+extern uint64_t key;
+
+
+/*
+ * global variables
+ */
+trace_t trace_ring[TRACE_SIZE];
+uint32_t trace_head = 0;
+
+
+/*
+ * local variables
+ */
+static char dir[HOSTNAME_LEN+1] = TRACE_DIR;
+static struct {
+        trace_header_t hdr;
+        trace_t ring[TRACE_SIZE];
+} __attribute__((packed)) snap;					/* copy being written */
+static int dump_fd = -1;
+static size_t dump_off = 0;
+static size_t dump_len = 0;
+
+
+/*
+ * trace_frame() - record a frame as it enters radar_process(), returns the record index
+ */
+uint32_t trace_frame(uint64_t rx, const uint8_t *data, int len, uint8_t rssi)
+{
+        trace_t *t = trace_next();
+        uint8_t df = (len == MODE_AC_LEN) ? 0xFF : data[0] >> 3;
+
+        t->ts = rx;
+        t->df = df;
+        t->len = (uint8_t)len;
+        t->rssi = rssi;
+        t->code = TRACE_NONE;
+        t->batch = 0;
+        t->arg = 0;
+        t->udp = (uint8_t)udp_state();
+        t->source = (uint8_t)beast_active();
+
+        /* DF11 and DF17-19 carry the ICAO address in clear, the others overlay it on the parity */
+        if (df == 11 || (df >= 17 && df <= 19))
+                t->icao = (data[1] << 16) | (data[2] << 8) | data[3];
+        else
+                t->icao = 0;
+
+        return trace_head - 1;
+}
+
+
+/*
+ * trace_event() - record a pipeline event
+ */
+void trace_event(int code, uint32_t batch, uint16_t arg)
+{
+        trace_t *t = trace_next();
+
+        memset(t, 0, sizeof(trace_t));
+        t->ts = ustime();
+        t->code = (uint8_t)code;
+        t->batch = batch;
+        t->arg = arg;
+        t->udp = (uint8_t)udp_state();
+        t->source = (uint8_t)beast_active();
+}
+
+
+/*
+ * trace_batch() - fill in the batch sequence number of a buffered frame when its multiframe is sent
+ */
+void trace_batch(uint32_t idx, uint64_t rx, uint32_t batch)
+{
+        trace_t *t = trace_at(idx);
+
+        /* only if the record hasn't been overwritten since */
+        if (trace_head - idx <= TRACE_SIZE && t->ts == rx && t->code == TRACE_BUFFERED)
+                t->batch = batch;
+}
+
+
+/*
+ * trace_init() - set the directory that dumps are written to
+ */
+void trace_init(const char *d)
+{
+        strncpy(dir, d, HOSTNAME_LEN);
+}
+
+
+/*
+ * trace_create() - create a new dump file, never opening an existing one or following a link
+ */
+static int trace_create(char *name, int len)
+{
+        time_t now = time(NULL);
+        char stamp[32];
+        int fd, n;
+
+        strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", gmtime(&now));
+
+        for (n = 0; n < TRACE_TRIES; n++) {
+                if (n)
+                        snprintf(name, len, "%s/radar-trace-%s-%d-%d.bin", dir, stamp, (int)getpid(), n);
+                else
+                        snprintf(name, len, "%s/radar-trace-%s-%d.bin", dir, stamp, (int)getpid());
+
+                fd = open(name, O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, 0600);
+
+                if (fd >= 0 || errno != EEXIST)
+                        return fd;
+        }
+
+        return -1;
+}
+
+
+/*
+ * trace_dump() - copy the ring and start writing it to a file, returns zero on success and
+ * the file name in 'name', the file is complete once trace_run() has finished with it
+ */
+int trace_dump(char *name, int len)
+{
+        uint32_t head = trace_head;
+        uint32_t count = min(head, (uint32_t)TRACE_SIZE);
+        uint32_t start = (head - count) & (TRACE_SIZE - 1);
+        uint32_t first = min(count, TRACE_SIZE - start);
+
+        if (dump_fd >= 0) {
+                snprintf(name, len, "%s (a dump is still being written)", dir);
+                return -1;
+        }
+
+        if ((dump_fd = trace_create(name, len)) < 0) {
+                if (debug)
+                        printf("trace_dump(): cannot create %s: %s (%d)\n", name, strerror(errno), errno);
+                return -1;
+        }
+
+        snap.hdr.magic = TRACE_MAGIC;
+        snap.hdr.version = TRACE_VERSION;
+        snap.hdr.size = sizeof(trace_t);
+        snap.hdr.count = count;
+        snap.hdr.lost = head - count;
+        snap.hdr.key = key;
+        snap.hdr.ts = ustime();
+
+        /* oldest records run from 'start' to the end of the ring then wrap to the beginning */
+        memcpy(&snap.ring[0], &trace_ring[start], first * sizeof(trace_t));
+        memcpy(&snap.ring[first], &trace_ring[0], (count - first) * sizeof(trace_t));
+
+        dump_off = 0;
+        dump_len = sizeof(trace_header_t) + count * sizeof(trace_t);
+
+        if (debug)
+                printf("trace_dump(): writing %u records to %s\n", count, name);
+
+        return 0;
+}
+
+
+/*
+ * trace_run() - write the next chunk of a dump, returns non-zero while there is more to write
+ */
+int trace_run(void)
+{
+        ssize_t rc;
+
+        if (dump_fd < 0)
+                return 0;
+
+        rc = write(dump_fd, (uint8_t *)&snap + dump_off, min(dump_len - dump_off, (size_t)TRACE_CHUNK));
+
+        if (rc > 0)
+                dump_off += rc;
+
+        if (rc <= 0 || dump_off >= dump_len) {
+                if (rc <= 0)
+                        qlog("radar: trace dump write failed: %s\n", rc < 0 ? strerror(errno) : "no space");
+
+                close(dump_fd);
+                dump_fd = -1;
+                return 0;
+        }
+
+        return 1;
+}
+
+
+/*
+ * trace_timeout() - don't wait in poll() while a dump is being written
+ */
+int trace_timeout(int ms)
+{
+        return dump_fd >= 0 ? 0 : ms;
+}
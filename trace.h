@@ -0,0 +1,106 @@
+/*
+ * trace.h -- Always-on ring buffer of recent frames and pipeline decisions
+ * Author: Michael J. Tubby B.Sc. MIET  mike@tubby.org
+ */
+
+#ifndef _TRACE_H
+#define _TRACE_H
+
+#include <stdint.h>
+
+#define TRACE_SIZE			32768		/* records in the ring - must be a power of two */
+#define TRACE_MAGIC			0x43525452	/* "RTRC" little endian */
+#define TRACE_VERSION			1
+#define TRACE_DIR			"/tmp"		/* default directory for dumps */
+#define TRACE_CHUNK			65536		/* bytes of a dump written per pass of the main loop */
+#define TRACE_TRIES			100		/* unique file names tried per dump */
+
+
+/*
+ * record codes - what happened to a frame, or a pipeline event
+ */
+enum trace_code {
+        TRACE_NONE,
+        TRACE_SENT,					/* sent in its own message */
+        TRACE_SEND_FAIL,				/* send attempted but UDP not running or sendto() failed */
+        TRACE_BUFFERED,					/* held for multiframe, batch filled in when sent */
+        TRACE_DUPE,					/* duplicate - not sent */
+        TRACE_FILTERED,					/* DF or type not forwarded */
+        TRACE_SHED,					/* dropped to stay within the uplink budget (-U) */
+        TRACE_OVERLOAD,					/* not forwarded at the overload level in force (-o) */
+
+        TRACE_EV_BAD_FRAME = 0x80,			/* BEAST/AVR framing error, arg = source */
+        TRACE_EV_BEAST_RESET,				/* BEAST connection reset, arg = source */
+        TRACE_EV_SOURCE_SWITCH,				/* active source changed, arg = new source */
+        TRACE_EV_UDP_RESET,				/* UDP reset, arg = 0 after an error, 1 on a network change */
+        TRACE_EV_MULTIFRAME,				/* multiframe sent, batch = seq, arg = frame count */
+        TRACE_EV_OVERLOAD,				/* overload level changed, arg = new level */
+        TRACE_EV_UPLINK_SWITCH				/* uplink path changed, arg = new path */
+};
+
+
+/*
+ * one trace record - 24 bytes
+ */
+typedef struct {
+        uint64_t ts;					/* arrival time of frame or time of event (uS) */
+        uint32_t icao;					/* ICAO address where the DF carries it in clear */
+        uint32_t batch;					/* sequence number of the message it was sent in */
+        uint8_t code;					/* TRACE_xxx */
+        uint8_t df;					/* downlink format, 0xFF for Mode-A/C */
+        uint8_t rssi;					/* signal level */
+        uint8_t len;					/* frame length */
+        uint8_t udp;					/* UDP state when recorded */
+        uint8_t source;					/* active BEAST source */
+        uint16_t arg;					/* event argument */
+} __attribute__((packed)) trace_t;
+
+
+/*
+ * dump file header, followed by 'count' records oldest first
+ */
+typedef struct {
+        uint32_t magic;					/* TRACE_MAGIC */
+        uint16_t version;				/* TRACE_VERSION */
+        uint16_t size;					/* sizeof(trace_t) */
+        uint32_t count;					/* number of records */
+        uint32_t lost;					/* records overwritten before this dump */
+        uint64_t key;					/* station sharing key */
+        uint64_t ts;					/* time of dump (uS) */
+} __attribute__((packed)) trace_header_t;
+
+
+extern trace_t trace_ring[TRACE_SIZE];
+extern uint32_t trace_head;
+
+
+/*
+ * trace_next() - claim the next record, overwriting the oldest
+ */
+static inline trace_t *trace_next(void)
+{
+        return &trace_ring[trace_head++ & (TRACE_SIZE - 1)];
+}
+
+
+/*
+ * trace_at() - the record at an index returned by trace_frame()
+ */
+static inline trace_t *trace_at(uint32_t idx)
+{
+        return &trace_ring[idx & (TRACE_SIZE - 1)];
+}
+
+
+/*
+ * exported functions
+ */
+uint32_t trace_frame(uint64_t, const uint8_t *, int, uint8_t);
+void trace_event(int, uint32_t, uint16_t);
+void trace_batch(uint32_t, uint64_t, uint32_t);
+void trace_init(const char *);
+int trace_dump(char *, int);
+int trace_run(void);
+int trace_timeout(int);
+
+#endif
@@ -8,6 +8,81 @@
  * a management layer because the previous code was brittle and had no error recovery.
  *
  * We now run a state-machine that manages DNS look-ups and error recovery.
+ * After a network change (udp_restart(), see netlink.c) the sockets are
+ * rebuilt at once on the addresses we have and the names looked up again in
+ * the background with getaddrinfo_a(), so the event loop never waits for DNS.
+ *
+ * UPLINK BUDGET
+ *
+ * On 4G and satellite backhaul a burst of sendto()s overflows the modem's
+ * buffers and delays everything behind it.  With -U <kbps>[:<burst>] the
+ * traffic is held to a budget with a token bucket that fills at the budget
+ * rate up to the burst size in bytes (default 100mS worth).  Every message
+ * takes its size plus the IP and UDP headers out of the bucket as it is
+ * admitted (a frame held for multiframe takes its share).  With ":pace" on
+ * the end SO_MAX_PACING_RATE is set on the socket as well so the kernel
+ * spaces packets out too; this needs the fq qdisc on the interface and
+ * without it some kernels hold UDP back far more than the budget.
+ *
+ * When the budget is exceeded frames are shed, by priority, before they are
+ * signed; radar never queues them to send later, so the budget only sheds
+ * and any smoothing of bursts within it is left to ":pace": each class may only send while the bucket holds more than its
+ * reserve, so Mode-A/C goes first, then short squitters, then DF20/21, then
+ * Extended Squitters other than identification, position and velocity,
+ * which are only shed when the bucket is empty.  Keepalives, stats and
+ * telemetry (UDP_CLASS_CONTROL) always go but are paid for.  The number shed
+ * in each class is sent in the stats.
+ *
+ * IMPAIRMENT
+ *
+ * With -X <spec> every sendto() goes through the impairment simulator in
+ * impair.c, which can lose, delay, reorder, duplicate or corrupt messages or
+ * fail the send with ENOBUFS, so that multiframe, FEC and the uplink budget
+ * can be tried against a bad link on the bench.  A failure it injects is
+ * handled exactly as a real one.  Messages it holds back are sent by
+ * udp_run(), called after every poll() with a timeout from udp_timeout().
+ *
+ * MULTIPATH
+ *
+ * With -O <interface|address>, repeated, we keep one socket per uplink path,
+ * bound to the interface (SO_BINDTODEVICE, or IP_UNICAST_IF without the
+ * privilege for it) or the source address and connected to the aggregator,
+ * in order of preference, e.g. wired broadband then a 4G dongle.  Behind
+ * CGNAT a dead path rarely gives a sendto() error so every UDP_CHECK_INTERVAL
+ * udp_check() also looks at each path: the interface must be up and running,
+ * there must be no ICMP error queued on the socket (SO_ERROR) and connect()
+ * must still find a route to the aggregator from it.  A path failing either
+ * way is marked down and we move to the most preferred healthy path at once,
+ * sending the message that failed again on it; we go back to a preferred path
+ * only when it has been healthy for UDP_FAILBACK_HOLD, as beast.c does for its
+ * sources.  If every path is down the whole set is rebuilt after UDP_RETRY.
+ *
+ * With -A the aggregator is also probed on every path (see probe.c) and a
+ * path whose probes go unanswered while another's are answered is marked
+ * silent, which fails its health check.  Replies, and settings pushed by the
+ * aggregator, come back to the path's socket and are handed to the function
+ * given to udp_receive() by udp_poll_events().  With -U the budget may be
+ * changed while running (udp_budget()).
+ *
+ * With -J the messages the aggregator can least do without (see
+ * udp_send_critical()) are also sent on the best standby path; the duplicate
+ * has the same sequence number and is dropped at the far end.
+ *
+ * FAN-OUT
+ *
+ * With -D <host>[:<port>],key=<key>[,...], repeated, every message sent to the
+ * aggregator is also sent to up to UDP_MAX_DESTS other destinations, e.g. an
+ * in-house collector, without a second radar decoding the same receiver.
+ * Each has its own key, pass-phrase, QoS and filter (DF masks, Mode-A/C and
+ * telemetry).  fan_out() takes the message as built for the aggregator,
+ * leaves out the multiframe frames the destination doesn't want, puts in its
+ * key and its own sequence number and signs it with its pass-phrase, which
+ * was processed once at start-up (authtag_prepare()), so each copy costs an
+ * HMAC and a sendto().  Destinations use the default route on sockets of
+ * their own, are looked up again every UDP_RETRY until they can be and are
+ * not sent FEC parity, probes or settings answers.  Under an uplink budget a
+ * copy is charged at the class of the frames in it after the aggregator's
+ * message has been, so copies are shed before the aggregator's traffic.
  *
  */
 
@@ -24,13 +99,34 @@
 #include <netdb.h>
 #include <arpa/inet.h>
 #include <sys/time.h>
+#include <sys/ioctl.h>
+#include <net/if.h>
+#include <ifaddrs.h>
 #include <linux/socket.h>
 #include <linux/ip.h>
 
 #include "defs.h"
+#include "radar.h"
 #include "udp.h"
 #include "hex.h"
 #include "stats.h"
+#include "trace.h"
+#include "probes.h"
+#include "ustime.h"
+#include "mstime.h"
+#include "telemetry.h"
+#include "impair.h"
+#include "qerror.h"
+
+
+/*
+ * a host name looked up again in the background after a network change
+ */
+typedef struct {
+        struct gaicb gai;
+        struct addrinfo hints;
+        int pending;					/* outstanding, the glibc resolver owns gai */
+} lookup_t;
 
 
 /*
@@ -44,14 +140,30 @@ extern int reset_udp;
  * local variables
  */
 static enum udpstate state;
-static int udp_fd;
 static char hostname[HOSTNAME_LEN+1];
 static int qos;
 static int retry = 0;
 static int rebind_interval = 0;
 static int rebind = 0;
-static struct hostent *hostinfo;
 static struct sockaddr_in dest;
+static uint32_t send_errors = 0;
+static void (*simulate)(void *, int) = NULL;		/* offline simulation instead of sending */
+static uint64_t budget = 0;				/* uplink budget bytes/second, zero for none */
+static int64_t burst;					/* bucket size (bytes) */
+static int64_t tokens;					/* bytes we may send now, negative when in debt */
+static uint64_t refilled;				/* time of the last refill (uS) */
+static int pace = 0;					/* also set SO_MAX_PACING_RATE */
+static int impaired = 0;				/* send through the impairment simulator */
+static udp_path_t paths[UDP_MAX_PATHS];			/* uplink paths, preferred first */
+static int npaths = 0;
+static int active = 0;					/* path in use */
+static int dup_send = 0;				/* also send critical messages on a standby path */
+static uint64_t checked = 0;				/* time of the last health check (mS) */
+static void (*receiver)(int, void *, int) = NULL;	/* messages from the aggregator, by path */
+static const int reserve[UDP_CLASSES] = { 75, 50, 25, 10, 0, 0 };	/* % of the bucket each class must leave */
+static udp_dest_t dests[UDP_MAX_DESTS];			/* extra destinations (-D) */
+static int ndests = 0;
+static lookup_t lookups[1 + UDP_MAX_DESTS];		/* re-lookups after a restart: the aggregator, then -D */
 
 
 /*
@@ -61,24 +173,45 @@ static void chgstate(enum udpstate newstate)
 {
         if (debug)
                 printf("udp chgstate(): %d -> %d\n", state, newstate);
-                
+
+        PROBE2(udp_state, state, newstate);
         state = newstate;
 }
 
 
+/*
+ * close_paths() - close the sockets for every uplink path
+ */
+static void close_paths(void)
+{
+        int i;
+
+        for (i = 0; i < npaths; i++) {
+                if (paths[i].fd >= 0) {
+                        impair_forget(paths[i].fd);
+                        close(paths[i].fd);
+                }
+
+                paths[i].fd = -1;
+                paths[i].up = 0;
+        }
+
+        telemetry.uplink_up = 0;
+}
+
+
 /*
  * reset_connection() - reset the UDP connection after an error
  */
 static void reset_connection(void)
 {
-        if (udp_fd) {
-                close(udp_fd);
-                udp_fd = 0;
-        }
+        close_paths();
 
         if (debug)
                 printf("reset_connection(): start retry timer...\n");
 
+        trace_event(TRACE_EV_UDP_RESET, 0, 0);
+
         retry = UDP_RETRY;
         chgstate(UDP_STATE_RETRY_WAIT);
 }
@@ -89,11 +222,16 @@ static void reset_connection(void)
  */
 static int host_lookup(void)
 {
-        hostinfo = gethostbyname(hostname);
+        struct hostent *hostinfo = gethostbyname(hostname);
     
         if (hostinfo) {
                 if (debug)
                         printf("host_lookup(): Destination is %s (%s) port %u\n", hostinfo->h_name, inet_ntoa(*(struct in_addr*)hostinfo->h_addr), UDP_PORT);
+
+                memset(&dest, 0, sizeof(dest));
+                dest.sin_family = AF_INET;
+                dest.sin_addr = *(struct in_addr*) hostinfo->h_addr;
+                dest.sin_port = htons(UDP_PORT);
                 return 1;
         
         } else {
@@ -106,17 +244,127 @@ static int host_lookup(void)
 
 
 /*
- * make_socket() - make a UDP socket
+ * link_ok() - is the interface a path watches up and running
  */
-static int make_socket(void)
+static int link_ok(udp_path_t *p)
 {
-        int rc;
+        struct ifreq ifr;
+
+        if (!p->ifname[0])
+                return 1;
+
+        memset(&ifr, 0, sizeof(ifr));
+        memcpy(ifr.ifr_name, p->ifname, IFNAMSIZ);
+
+        if (ioctl(p->fd, SIOCGIFFLAGS, &ifr) < 0)
+                return 0;
+
+        return (ifr.ifr_flags & (IFF_UP | IFF_RUNNING)) == (IFF_UP | IFF_RUNNING);
+}
+
+
+/*
+ * path_ok() - health check a path that has a socket: link up, no ICMP error
+ * queued and still a route to the aggregator
+ */
+static int path_ok(udp_path_t *p)
+{
+        int err = 0;
+        socklen_t len = sizeof(err);
+
+        if (!link_ok(p) || p->silent)
+                return 0;
+
+        if (getsockopt(p->fd, SOL_SOCKET, SO_ERROR, &err, &len) == 0 && err) {
+                if (debug)
+                        printf("path_ok(): %s: %s (%d)\n", p->name, strerror(err), err);
+                return 0;
+        }
+
+        /* connect() again repeats the route lookup from the bound interface or address */
+        return connect(p->fd, (struct sockaddr *)&dest, sizeof(dest)) == 0;
+}
+
+
+/*
+ * bind_path() - bind a path's socket to its interface or source address
+ */
+static int bind_path(udp_path_t *p)
+{
+        struct ifaddrs *ifa, *i;
+        int fd = p->fd;
+
+        if (p->addr.s_addr != INADDR_ANY) {
+                /* bound to a source address */
+                struct sockaddr_in src;
+
+                memset(&src, 0, sizeof(src));
+                src.sin_family = AF_INET;
+                src.sin_addr = p->addr;
+
+                if (bind(fd, (struct sockaddr *)&src, sizeof(src)) < 0) {
+                        if (debug)
+                                printf("bind_path(): %s: bind(): %s (%d)\n", p->name, strerror(errno), errno);
+                        return 0;
+                }
+
+                /* watch the link state of the interface the address is on */
+                p->ifname[0] = '\0';
+
+                if (getifaddrs(&ifa) == 0) {
+                        for (i = ifa; i; i = i->ifa_next) {
+                                if (i->ifa_addr && i->ifa_addr->sa_family == AF_INET &&
+                                    ((struct sockaddr_in *)i->ifa_addr)->sin_addr.s_addr == p->addr.s_addr) {
+                                        strncpy(p->ifname, i->ifa_name, IFNAMSIZ - 1);
+                                        break;
+                                }
+                        }
+
+                        freeifaddrs(ifa);
+                }
+
+        } else if (setsockopt(fd, SOL_SOCKET, SO_BINDTODEVICE, p->ifname, strlen(p->ifname)) < 0) {
+                /* without CAP_NET_RAW (older kernels) steer by interface index instead */
+                uint32_t ifindex = htonl(if_nametoindex(p->ifname));
+
+                if (!ifindex || setsockopt(fd, IPPROTO_IP, IP_UNICAST_IF, &ifindex, sizeof(ifindex)) < 0) {
+                        if (debug)
+                                printf("bind_path(): %s: can't bind to interface: %s (%d)\n", p->name, strerror(errno), errno);
+                        return 0;
+                }
+        }
+
+        return 1;
+}
+
+
+/*
+ * set_pacing() - let the kernel pace a socket to the uplink budget too (-U ...:pace)
+ */
+static void set_pacing(int fd)
+{
+        /* needs the fq qdisc, no budget is no limit */
+        if (pace) {
+                uint32_t pacing = budget ? (uint32_t)min(budget, UINT32_MAX) : UINT32_MAX;
+
+                if (setsockopt(fd, SOL_SOCKET, SO_MAX_PACING_RATE, &pacing, sizeof(pacing)) < 0 && debug)
+                        printf("set_pacing(): SO_MAX_PACING_RATE: %s (%d)\n", strerror(errno), errno);
+        }
+}
+
+
+/*
+ * open_path() - make the UDP socket for a path
+ */
+static int open_path(udp_path_t *p)
+{
+        int fd;
 
         /* make a UDP socket */
-        if ((udp_fd = socket(AF_INET, SOCK_DGRAM, 0)) < 0) {
+        if ((fd = socket(AF_INET, SOCK_DGRAM, 0)) < 0) {
         
                 if (debug)
-                        printf("make_socket(): socket(): %s (%d)\n", strerror(errno), errno);
+                        printf("open_path(): socket(): %s (%d)\n", strerror(errno), errno);
                         
                 return 0;
         } 
@@ -125,133 +373,1167 @@ static int make_socket(void)
         if (qos) {
                 const int iptos = qos << 2;		/* QoS in top 6-bits of the IP header */
 
-                if ((rc = setsockopt(udp_fd, IPPROTO_IP, IP_TOS, &iptos, sizeof(iptos)) < 0)) {
+                if (setsockopt(fd, IPPROTO_IP, IP_TOS, &iptos, sizeof(iptos)) < 0) {
         
                         if (debug)
-                                printf("make_socket(): setsockopt(): %s (%d)\n", strerror(errno), errno);
+                                printf("open_path(): setsockopt(): %s (%d)\n", strerror(errno), errno);
                                 
+                        close(fd);
                         return 0;
                 }
         }
 
-        /* setup destination */
-        memset(&dest, 0, sizeof(dest));
-        dest.sin_family = AF_INET;
-        dest.sin_addr = *(struct in_addr*) hostinfo->h_addr;
-        dest.sin_port = htons(UDP_PORT);
+        set_pacing(fd);
 
-        return 1;
+        p->fd = fd;
+
+        if (!p->bound)
+                return 1;
+
+        /* not bound as asked, try again at the next health check */
+        if (!bind_path(p)) {
+                close(fd);
+                p->fd = -1;
+                return 0;
+        }
+
+        return path_ok(p);
 }
 
 
+
 /*
- * udp_send() - send a UDP/IP message to the aggregator
+ * path_up() - mark a path healthy or not
  */
-void udp_send(void *buf, int size)
+static void path_up(int i, int up)
 {
-        if (state == UDP_STATE_RUN) {
-                int rc;
+        udp_path_t *p = &paths[i];
 
-                rc = sendto(udp_fd, buf, size, 0, &dest, sizeof(dest));
+        if (up && !p->up) {
+                p->healthy_since = mstime();
+                telemetry.uplink_up |= 1 << i;
 
-                if (rc >= 0) {
-                        /* send succeeded */
-                        ++stats.tx_count;
-                        stats.tx_bytes += size;
+        } else if (!up && p->up) {
+                qlog("radar: uplink path %d (%s) is down\n", i, p->name);
+                ++p->errors;
+                ++telemetry.uplink_errors[i];
+                telemetry.uplink_up &= ~(1 << i);
+        }
 
-                        /* debug dump */
-                        if (debug > 2)
-                                hex_dump("UDP", buf, size);
-                } else {
-                        /* send failed */
-                        if (debug)
-                                printf("udp_send(): failed: %s (%d)", strerror(errno), errno);
-                                
-                        if (reset_udp)
-                                reset_connection();
+        p->up = up;
+}
+
+
+/*
+ * switch_path() - change the path in use
+ */
+static void switch_path(int new, const char *why)
+{
+        if (new != active) {
+                qlog("radar: uplink %s: path %d (%s) -> %d (%s)\n", why, active, paths[active].name, new, paths[new].name);
+
+                PROBE2(uplink_switch, active, new);
+                trace_event(TRACE_EV_UPLINK_SWITCH, 0, new);
+                active = new;
+                telemetry.uplink_active = new;
+                ++telemetry.uplink_switch;
+        }
+}
+
+
+/*
+ * fail_over() - the path in use has failed, move to the most preferred healthy one,
+ * returns 0 if there isn't one
+ */
+static int fail_over(void)
+{
+        int i;
+
+        path_up(active, 0);
+
+        for (i = 0; i < npaths; i++) {
+                if (paths[i].up) {
+                        switch_path(i, "fail over");
+                        return 1;
                 }
         }
+
+        return 0;
 }
 
 
 /*
- * udp_init() - initialise the UDP sub-system
+ * standby() - the best healthy path other than the one in use, -1 if none
  */
-void udp_init(char * host, int qs, int rb)
+static int standby(void)
 {
-        strcpy(hostname, host);
-        qos = qs;
-        rebind_interval = rb;
-        chgstate(UDP_STATE_IDLE);
+        int i;
+
+        for (i = 0; i < npaths; i++)
+                if (i != active && paths[i].up)
+                        return i;
+
+        return -1;
 }
 
 
 /*
- * udp_second() - run the UDP finite state-machine from the housekeeping timer
+ * make_socket() - make the UDP socket for each uplink path to the looked up destination
  */
-void udp_second(void)
+static int make_socket(void)
 {
-        switch (state) {
-                case UDP_STATE_IDLE:
-                        /* perform DNS lookup for destination */
-                        if (host_lookup())
-                                chgstate(UDP_STATE_STARTUP);
-                        else
-                                reset_connection();
-                        break;
+        int i;
 
-                case UDP_STATE_STARTUP:
-                        /* set up outgoing UDP */
-                        if (make_socket()) {
-                                rebind = rebind_interval ? rebind_interval : 0;
-                                chgstate(UDP_STATE_RUN);
-                        } else {
-                                reset_connection();
-                        }
-                        break;
-                
-                case UDP_STATE_RUN:
-                        /* rebind function is for CG-NAT encumbered connections that timeout */
-                        if (rebind) {
-                                --rebind;
-                        
-                                if (!rebind) {
-                                        if (udp_fd)
-                                                close(udp_fd);
-                                        chgstate(UDP_STATE_IDLE);
-                                }
-                        }
-                        break;
+        for (i = 0; i < npaths; i++)
+                path_up(i, open_path(&paths[i]));
 
-                case UDP_STATE_RETRY_WAIT:
-                        /* waiting to retry after an error/reset condition */
-                        if (retry) {
-                                --retry;
-                                
-                                if (!retry)
-                                        chgstate(UDP_STATE_IDLE);
-                        }
-                        break;
+        /* stay on the path we were using if it is still good (see udp_restart()) */
+        for (i = 0; !paths[active].up && i < npaths; i++)
+                active = i;
+
+        if (!paths[active].up) {
+                active = 0;
+                close_paths();
+                return 0;
         }
+
+        telemetry.uplink_active = active;
+        checked = mstime();
+
+        return 1;
 }
 
 
 /*
- * udp_reset() - reset the UDP session
+ * transmit() - send a message on a path
  */
-void udp_reset(void)
+static int transmit(udp_path_t *p, void *buf, int size)
 {
-        reset_connection();
+        int rc;
+
+        if (impaired)
+                rc = impair_sendto(p->fd, buf, size, &dest);
+        else
+                rc = sendto(p->fd, buf, size, 0, &dest, sizeof(dest));
+
+        if (rc >= 0)
+                ++p->sent;
+
+        return rc;
 }
 
 
 /*
- * udp_close() - shutdown UDP
+ * dest_socket() - make the socket for an extra destination that has been looked up
  */
-void udp_close(void)
+static int dest_socket(udp_dest_t *d)
+{
+        int fd;
+
+        if ((fd = socket(AF_INET, SOCK_DGRAM, 0)) < 0) {
+                if (debug)
+                        printf("dest_socket(): socket(): %s (%d)\n", strerror(errno), errno);
+                ++d->errors;
+                return 0;
+        }
+
+        if (d->qos) {
+                const int iptos = d->qos << 2;		/* QoS in top 6-bits of the IP header */
+
+                if (setsockopt(fd, IPPROTO_IP, IP_TOS, &iptos, sizeof(iptos)) < 0 && debug)
+                        printf("dest_socket(): setsockopt(): %s (%d)\n", strerror(errno), errno);
+        }
+
+        set_pacing(fd);
+        d->fd = fd;
+
+        if (debug)
+                printf("dest_socket(): destination %s (%s) port %u\n", d->host, inet_ntoa(d->addr.sin_addr), d->port);
+
+        return 1;
+}
+
+
+/*
+ * open_dest() - look up an extra destination and make its socket
+ */
+static int open_dest(udp_dest_t *d)
+{
+        struct hostent *h;
+
+        if ((h = gethostbyname(d->host)) == NULL) {
+                if (debug)
+                        printf("open_dest(): error resolving hostname: %s  errno: %s (%d)\n", d->host, hstrerror(h_errno), h_errno);
+                ++d->errors;
+                return 0;
+        }
+
+        memset(&d->addr, 0, sizeof(d->addr));
+        d->addr.sin_family = AF_INET;
+        d->addr.sin_addr = *(struct in_addr *)h->h_addr;
+        d->addr.sin_port = htons(d->port);
+
+        return dest_socket(d);
+}
+
+
+/*
+ * relookup_start() - look a host name up again in the background, an address needs no look-up
+ */
+static void relookup_start(lookup_t *l, const char *host)
+{
+        struct gaicb *list[1] = { &l->gai };
+        struct in_addr addr;
+
+        /* one still running is as good as a new one */
+        if (l->pending || inet_pton(AF_INET, host, &addr) == 1)
+                return;
+
+        memset(l, 0, sizeof(*l));
+        l->hints.ai_family = AF_INET;
+        l->hints.ai_socktype = SOCK_DGRAM;
+        l->gai.ar_name = host;
+        l->gai.ar_request = &l->hints;
+
+        if (getaddrinfo_a(GAI_NOWAIT, list, 1, NULL) == 0)
+                l->pending = 1;
+}
+
+
+/*
+ * relookup_done() - has a background look-up finished with an address other than addr,
+ * returns 1 with the new address in addr if so
+ */
+static int relookup_done(lookup_t *l, struct in_addr *addr)
 {
-        if (udp_fd) {
-                close(udp_fd);
-                udp_fd = 0;
+        struct in_addr found;
+        int rc;
+
+        if (!l->pending || (rc = gai_error(&l->gai)) == EAI_INPROGRESS)
+                return 0;
+
+        l->pending = 0;
+
+        if (rc != 0) {
+                if (debug)
+                        printf("relookup_done(): %s: %s\n", l->gai.ar_name, gai_strerror(rc));
+                return 0;
+        }
+
+        found = ((struct sockaddr_in *)l->gai.ar_result->ai_addr)->sin_addr;
+        freeaddrinfo(l->gai.ar_result);
+
+        if (found.s_addr == addr->s_addr)
+                return 0;
+
+        *addr = found;
+        return 1;
+}
+
+
+/*
+ * close_dests() - close the sockets for the extra destinations, they are made again by
+ * udp_second()
+ */
+static void close_dests(void)
+{
+        int i;
+
+        for (i = 0; i < ndests; i++) {
+                if (dests[i].fd >= 0) {
+                        impair_forget(dests[i].fd);
+                        close(dests[i].fd);
+                }
+
+                dests[i].fd = -1;
+        }
+}
+
+
+/*
+ * charge() - take bytes of a class (enum udp_class) from the uplink budget if the class may
+ * still send, returns zero if it may not
+ */
+static int charge(int class, int bytes)
+{
+        uint64_t now, added;
+
+        if (!budget)
+                return 1;
+
+        /* refill for the time since we last looked, keeping the part of a byte not yet earned */
+        now = ustime();
+        added = (now > refilled) ? (now - refilled) * budget / 1000000 : 0;
+
+        if (now < refilled || tokens + (int64_t)added >= burst) {
+                tokens = min(tokens + (int64_t)added, burst);
+                refilled = now;				/* full, the clock stepped back or a replay started */
+        } else if (added) {
+                tokens += added;
+                refilled += added * 1000000 / budget;
+        }
+
+        if (class == UDP_CLASS_CONTROL || tokens - bytes >= burst * reserve[class] / 100) {
+                tokens -= bytes;
+                return 1;
+        }
+
+        return 0;
+}
+
+
+/*
+ * wanted() - does a destination want a Mode-S frame
+ */
+static int wanted(const udp_dest_t *d, const uint8_t *data, int extended)
+{
+        uint8_t df = data[0] >> 3;
+
+        return ((extended ? d->es_dfs : d->ss_dfs) & (1U << df)) != 0;
+}
+
+
+/*
+ * dest_copy() - copy a message as sent to the aggregator for a destination, leaving out
+ * what it doesn't want, returns the length to sign or zero if there is nothing to send and
+ * the uplink budget class (enum udp_class) to charge it at in 'class'
+ */
+static int dest_copy(udp_dest_t *d, uint8_t *out, const uint8_t *in, int size, int *class)
+{
+        const radar_msg_t *mp = (const radar_msg_t *)in;
+        int body = size - AUTHTAG_LEN;
+        int i, n, len, want;
+
+        *class = UDP_CLASS_CONTROL;
+
+        switch (mp->opcode) {
+                case RADAR_OPCODE_MODE_AC:
+                case RADAR_OPCODE_MODE_S:
+                case RADAR_OPCODE_MODE_ES:
+                        /* single frames, Mode-A/C, short or extended by length */
+                        if (size == sizeof(radar_mode_ac_t)) {
+                                want = d->mode_ac;
+                                *class = UDP_CLASS_AC;
+                        } else if (size == sizeof(radar_mode_es_t)) {
+                                want = wanted(d, ((const radar_mode_es_t *)in)->data, 1);
+                                *class = udp_es_class(((const radar_mode_es_t *)in)->data);
+                        } else {
+                                want = wanted(d, ((const radar_mode_es_t *)in)->data, 0);
+                                *class = UDP_CLASS_SS;
+                        }
+
+                        if (!want) {
+                                ++d->filtered;
+                                return 0;
+                        }
+                        break;
+
+                case RADAR_OPCODE_MULTIFRAME:
+                        /* only the frames it wants, as often as not all of them */
+                        n = mp->data[0];
+                        *class = UDP_CLASS_ES_OTHER;
+                        len = sizeof(radar_msg_t) + 1;
+                        memcpy(out, in, len);
+                        out[len - 1] = 0;
+
+                        for (i = 0; i < n && len + (int)sizeof(es_t) <= body; i++) {
+                                const es_t *es = (const es_t *)&in[sizeof(radar_msg_t) + 1 + i * sizeof(es_t)];
+
+                                if (!wanted(d, es->data, 1)) {
+                                        ++d->filtered;
+                                        continue;
+                                }
+
+                                if (udp_es_class(es->data) == UDP_CLASS_ES)
+                                        *class = UDP_CLASS_ES;
+
+                                memcpy(&out[len], es, sizeof(es_t));
+                                len += sizeof(es_t);
+                                ++out[sizeof(radar_msg_t)];
+                        }
+
+                        return out[sizeof(radar_msg_t)] ? len : 0;
+
+                case RADAR_OPCODE_KEEPALIVE:
+                case RADAR_OPCODE_RADIO_STATS:
+                        break;
+
+                case RADAR_OPCODE_SYSTEM_TELEMETRY:
+                case RADAR_OPCODE_LATENCY:
+                        if (!d->telemetry) {
+                                ++d->filtered;
+                                return 0;
+                        }
+                        break;
+
+                default:
+                        /* FEC parity covers the aggregator's sequence numbers, settings and probes are its own */
+                        return 0;
+        }
+
+        memcpy(out, in, body);
+
+        return body;
+}
+
+
+/*
+ * fan_out() - send a copy of a message to each extra destination (-D), with its own key,
+ * sequence number and auth tag; the body is the one already made for the aggregator
+ */
+static void fan_out(const void *buf, int size)
+{
+        uint8_t out[UDP_RECV_SIZE];
+        int i, len, rc, class;
+
+        if (size > (int)sizeof(out) || size < (int)sizeof(radar_msg_t) + AUTHTAG_LEN)
+                return;
+
+        for (i = 0; i < ndests; i++) {
+                udp_dest_t *d = &dests[i];
+                radar_msg_t *mp = (radar_msg_t *)out;
+
+                if (d->fd < 0 || (len = dest_copy(d, out, buf, size, &class)) == 0)
+                        continue;
+
+                /* the same uplink, charged at its class after the aggregator's copy so it is shed first */
+                if (!charge(class, len + AUTHTAG_LEN + UDP_IP_OVERHEAD)) {
+                        ++d->shed;
+                        continue;
+                }
+
+                mp->key = d->key;
+                mp->seq = d->seq++;
+                authtag_sign_ctx(&d->auth, &out[len], AUTHTAG_LEN, out, len);
+                len += AUTHTAG_LEN;
+
+                if (impaired)
+                        rc = impair_sendto(d->fd, out, len, &d->addr);
+                else
+                        rc = sendto(d->fd, out, len, 0, (struct sockaddr *)&d->addr, sizeof(d->addr));
+
+                if (rc < 0) {
+                        if (debug)
+                                printf("fan_out(): %s: %s (%d)\n", d->host, strerror(errno), errno);
+
+                        ++d->errors;
+                        ++telemetry.fanout_errors;
+
+                        /* look it up and make the socket again at the next udp_second() */
+                        if (reset_udp) {
+                                impair_forget(d->fd);
+                                close(d->fd);
+                                d->fd = -1;
+                        }
+                        continue;
+                }
+
+                ++d->sent;
+                ++telemetry.fanout_sent;
+                PROBE1(packet_sent, len);
+        }
+}
+
+
+/*
+ * udp_send() - send a UDP/IP message to the aggregator, returns non-zero if it was sent
+ */
+int udp_send(void *buf, int size)
+{
+        if (simulate) {
+                simulate(buf, size);
+                return 1;
+        }
+
+        /* -D: the other destinations get theirs whatever happens to the aggregator's */
+        if (ndests)
+                fan_out(buf, size);
+
+        while (state == UDP_STATE_RUN) {
+                if (transmit(&paths[active], buf, size) >= 0) {
+                        /* send succeeded */
+                        PROBE1(packet_sent, size);
+                        ++stats.tx_count;
+                        stats.tx_bytes += size;
+
+                        /* debug dump */
+                        if (debug > 2)
+                                hex_dump("UDP", buf, size);
+
+                        return 1;
+                } else {
+                        /* send failed */
+                        PROBE2(packet_failed, size, errno);
+                        ++send_errors;
+
+                        if (debug)
+                                printf("udp_send(): failed: %s (%d)", strerror(errno), errno);
+
+                        /* with more than one path try the next best at once */
+                        if (npaths > 1) {
+                                if (fail_over())
+                                        continue;
+
+                                reset_connection();
+
+                        } else if (reset_udp) {
+                                reset_connection();
+                        }
+
+                        return 0;
+                }
+        }
+
+        PROBE2(packet_failed, size, 0);
+
+        return 0;
+}
+
+
+/*
+ * udp_send_critical() - send a message the aggregator can least do without, with -J
+ * also on the best standby path, returns non-zero if it was sent
+ */
+int udp_send_critical(void *buf, int size)
+{
+        int ok = udp_send(buf, size);
+        int i;
+
+        if (ok && dup_send && !simulate && state == UDP_STATE_RUN && (i = standby()) >= 0) {
+                if (transmit(&paths[i], buf, size) >= 0) {
+                        ++telemetry.uplink_dup;
+                        stats.tx_bytes += size;
+                } else {
+                        path_up(i, 0);
+                }
+        }
+
+        return ok;
+}
+
+
+/*
+ * udp_init() - initialise the UDP sub-system
+ */
+void udp_init(char * host, int qs, int rb)
+{
+        strcpy(hostname, host);
+        qos = qs;
+        rebind_interval = rb;
+
+        /* without -O a single path the kernel routes */
+        if (!npaths) {
+                strcpy(paths[0].name, "default");
+                paths[0].fd = -1;
+                npaths = 1;
+        }
+
+        telemetry.uplink_paths = npaths;
+        telemetry.fanout_dests = ndests;
+        chgstate(UDP_STATE_IDLE);
+}
+
+
+/*
+ * lookup() - look up the destination, from IDLE
+ */
+static void lookup(void)
+{
+        /* perform DNS lookup for destination */
+        if (host_lookup())
+                chgstate(UDP_STATE_STARTUP);
+        else
+                reset_connection();
+}
+
+
+/*
+ * start() - make the sockets for the looked up destination, from STARTUP
+ */
+static void start(void)
+{
+        /* set up outgoing UDP */
+        if (make_socket()) {
+                rebind = rebind_interval ? rebind_interval : 0;
+                chgstate(UDP_STATE_RUN);
+        } else {
+                reset_connection();
+        }
+}
+
+
+/*
+ * udp_second() - run the UDP finite state-machine from the housekeeping timer
+ */
+void udp_second(void)
+{
+        int i;
+
+        /* after a network change the aggregator may have moved: rebuild the sockets for it */
+        if (relookup_done(&lookups[0], &dest.sin_addr) && state == UDP_STATE_RUN) {
+                qlog("radar: %s is now %s, rebuilding the UDP sockets\n", hostname, inet_ntoa(dest.sin_addr));
+                close_paths();
+                start();
+        }
+
+        /* the extra destinations' sockets are not connected so a new address is all they need */
+        for (i = 0; i < ndests; i++)
+                relookup_done(&lookups[1 + i], &dests[i].addr.sin_addr);
+
+        /* extra destinations are looked up and opened on their own, every UDP_RETRY until they are */
+        for (i = 0; i < ndests && !simulate; i++)
+                if (dests[i].fd < 0 && dests[i].retry-- <= 0 && !open_dest(&dests[i]))
+                        dests[i].retry = UDP_RETRY;
+
+        switch (state) {
+                case UDP_STATE_IDLE:
+                        lookup();
+                        break;
+
+                case UDP_STATE_STARTUP:
+                        start();
+                        break;
+                
+                case UDP_STATE_RUN:
+                        /* rebind function is for CG-NAT encumbered connections that timeout */
+                        if (rebind) {
+                                --rebind;
+                        
+                                if (!rebind) {
+                                        close_paths();
+                                        close_dests();
+                                        chgstate(UDP_STATE_IDLE);
+                                }
+                        }
+                        break;
+
+                case UDP_STATE_RETRY_WAIT:
+                        /* waiting to retry after an error/reset condition */
+                        if (retry) {
+                                --retry;
+                                
+                                if (!retry)
+                                        chgstate(UDP_STATE_IDLE);
+                        }
+                        break;
+        }
+}
+
+
+/*
+ * udp_restart() - rebuild the sockets now, after an address or route change (see netlink.c),
+ * on the addresses we have while the names are looked up again in the background
+ */
+void udp_restart(void)
+{
+        int i;
+
+        if (simulate)
+                return;
+
+        close_paths();
+        close_dests();
+        trace_event(TRACE_EV_UDP_RESET, 0, 1);
+        ++telemetry.network_changes;
+
+        /* straight to STARTUP, without the once a second counting; never looked up is left to IDLE */
+        if (dest.sin_addr.s_addr != INADDR_ANY) {
+                relookup_start(&lookups[0], hostname);
+                chgstate(UDP_STATE_STARTUP);
+                start();
+        } else {
+                chgstate(UDP_STATE_IDLE);
+        }
+
+        for (i = 0; i < ndests; i++) {
+                /* not looked up yet, udp_second() carries on trying */
+                if (dests[i].addr.sin_addr.s_addr == INADDR_ANY)
+                        continue;
+
+                relookup_start(&lookups[1 + i], dests[i].host);
+
+                if (!dest_socket(&dests[i]))
+                        dests[i].retry = UDP_RETRY;
+        }
+}
+
+
+/*
+ * udp_recheck() - health check the uplink paths at the next udp_check()
+ */
+void udp_recheck(void)
+{
+        checked = 0;
+}
+
+
+/*
+ * udp_reset() - reset the UDP session
+ */
+void udp_reset(void)
+{
+        reset_connection();
+}
+
+
+/*
+ * udp_close() - shutdown UDP
+ */
+void udp_close(void)
+{
+        close_paths();
+        close_dests();
+}
+
+
+/*
+ * udp_state() - current state of the UDP state-machine
+ */
+enum udpstate udp_state(void)
+{
+        return state;
+}
+
+
+/*
+ * udp_errors() - number of sendto() failures since start-up
+ */
+uint32_t udp_errors(void)
+{
+        return send_errors;
+}
+
+
+/*
+ * udp_simulate() - hand every message to fn instead of sending it (see sim.c and radar-load.c)
+ */
+void udp_simulate(void (*fn)(void *, int))
+{
+        simulate = fn;
+}
+
+
+/*
+ * udp_impair() - send through the impairment simulator with an impairment spec (see impair.c)
+ */
+void udp_impair(const char *spec)
+{
+        impair_init(spec);
+        impaired = 1;
+}
+
+
+/*
+ * udp_run() - send any messages the impairment simulator has held that are now due
+ */
+void udp_run(void)
+{
+        if (impaired)
+                impair_run();
+}
+
+
+/*
+ * udp_timeout() - poll() timeout (mS) shortened to when udp_run() has work to do
+ */
+int udp_timeout(int ms)
+{
+        return impaired ? impair_timeout(ms) : ms;
+}
+
+
+/*
+ * udp_budget() - hold the uplink to kbps, bursting up to burst_bytes (0 for the default)
+ * and with pacing set also have the kernel pace the socket; kbps zero is no budget, and
+ * it may be changed while running
+ */
+void udp_budget(int kbps, int burst_bytes, int pacing)
+{
+        int i;
+
+        pace = pacing;
+        budget = (uint64_t)kbps * 1000 / 8;
+        burst = burst_bytes ? burst_bytes : max(budget * UDP_BURST_MS / 1000, UDP_BURST_MIN);
+        tokens = burst;
+        refilled = ustime();
+        stats.uplink_kbps = kbps;
+
+        for (i = 0; i < npaths; i++)
+                if (paths[i].fd >= 0)
+                        set_pacing(paths[i].fd);
+
+        for (i = 0; i < ndests; i++)
+                if (dests[i].fd >= 0)
+                        set_pacing(dests[i].fd);
+}
+
+
+/*
+ * udp_es_class() - shedding class of an Extended Squitter length frame
+ */
+int udp_es_class(const uint8_t *data)
+{
+        uint8_t df = data[0] >> 3;
+        uint8_t tc = data[4] >> 3;					/* ADS-B type code */
+
+        if (df == 20 || df == 21)
+                return UDP_CLASS_COMMB;
+
+        if ((df == 17 || df == 18) && tc >= 1 && tc <= 22)		/* identification, position, velocity */
+                return UDP_CLASS_ES;
+
+        return UDP_CLASS_ES_OTHER;
+}
+
+
+/*
+ * udp_admit() - may a frame of a class (enum udp_class) costing bytes on the wire be sent
+ * within the uplink budget; if so its cost is taken from the budget, if not it is counted
+ * as shed
+ */
+int udp_admit(int class, int bytes)
+{
+        if (charge(class, bytes))
+                return 1;
+
+        PROBE2(frame_shed, class, bytes);
+
+        switch (class) {
+                case UDP_CLASS_AC:		++stats.shed_ac; break;
+                case UDP_CLASS_SS:		++stats.shed_ss; break;
+                case UDP_CLASS_COMMB:		++stats.shed_commb; break;
+                case UDP_CLASS_ES_OTHER:	++stats.shed_es_other; break;
+                default:			++stats.shed_es; break;
+        }
+
+        return 0;
+}
+
+
+/*
+ * udp_add_path() - add an uplink path bound to an interface name or IPv4 source address,
+ * in order of preference
+ */
+void udp_add_path(const char *spec)
+{
+        udp_path_t *p;
+
+        if (npaths >= UDP_MAX_PATHS)
+                qerror("radar: too many uplink paths (maximum %d)\n", UDP_MAX_PATHS);
+
+        if (strlen(spec) > UDP_PATH_NAME_LEN)
+                qerror("radar: uplink path \"%s\" too long\n", spec);
+
+        p = &paths[npaths++];
+        memset(p, 0, sizeof(*p));
+        strcpy(p->name, spec);
+        p->fd = -1;
+        p->bound = 1;
+
+        if (inet_pton(AF_INET, spec, &p->addr) != 1) {
+                if (strlen(spec) >= IFNAMSIZ)
+                        qerror("radar: uplink path \"%s\" is not an interface or IPv4 address\n", spec);
+
+                p->addr.s_addr = INADDR_ANY;
+                strcpy(p->ifname, spec);
+        }
+}
+
+
+/*
+ * udp_add_dest() - add an extra destination (-D) from <host>[:<port>],key=<key>[,pass=<pass-phrase>]
+ * [,qos=<dscp>][,es=<mask>][,ss=<mask>][,ac=0|1][,tel=0|1]
+ */
+void udp_add_dest(const char *spec)
+{
+        char buf[HOSTNAME_LEN + PSK_LEN + 128];
+        char *tok, *save = NULL, *colon;
+        uint8_t hkey[AUTHTAG_KEY_LEN];
+        char pass[PSK_LEN+1] = "secret";
+        udp_dest_t *d;
+        int gotkey = 0;
+
+        if (ndests >= UDP_MAX_DESTS)
+                qerror("radar: too many destinations (maximum %d)\n", UDP_MAX_DESTS);
+
+        if (strlen(spec) >= sizeof(buf))
+                qerror("radar: destination \"%s\" too long\n", spec);
+
+        strcpy(buf, spec);
+
+        d = &dests[ndests];
+        memset(d, 0, sizeof(*d));
+        d->port = UDP_PORT;
+        d->es_dfs = 0xFFFFFFFF;
+        d->ss_dfs = 0xFFFFFFFF;
+        d->mode_ac = 1;
+        d->telemetry = 1;
+        d->fd = -1;
+        d->seq = 1;
+
+        /* host[:port] first */
+        tok = strtok_r(buf, ",", &save);
+
+        if (!tok || strlen(tok) > HOSTNAME_LEN)
+                qerror("radar: destination \"%s\" has no host or it is too long\n", spec);
+
+        if ((colon = strchr(tok, ':')) != NULL) {
+                *colon++ = '\0';
+
+                if (atoi(colon) < 1 || atoi(colon) > 65535)
+                        qerror("radar: destination \"%s\" has a bad port\n", spec);
+
+                d->port = atoi(colon);
+        }
+
+        strcpy(d->host, tok);
+
+        /* then <name>=<value> */
+        while ((tok = strtok_r(NULL, ",", &save)) != NULL) {
+                char *value = strchr(tok, '=');
+
+                if (!value)
+                        qerror("radar: destination \"%s\": expected <name>=<value> at \"%s\"\n", spec, tok);
+
+                *value++ = '\0';
+
+                if (strcmp(tok, "key") == 0) {
+                        if (strlen(value) != APIKEY_LEN)
+                                qerror("radar: destination API key wrong length (should be %d characters)\n", APIKEY_LEN);
+                        d->key = (uint64_t)strtoull(value, NULL, 16);
+                        gotkey = 1;
+                } else if (strcmp(tok, "pass") == 0) {
+                        if (strlen(value) > PSK_LEN)
+                                qerror("radar: destination pass-phrase (PSK) too long (max %d chars)\n", PSK_LEN);
+                        strcpy(pass, value);
+                } else if (strcmp(tok, "qos") == 0) {
+                        d->qos = atoi(value);
+                        if (d->qos > 63 || d->qos < 0)
+                                qerror("radar: destination QoS value must in in range 0-63\n");
+                } else if (strcmp(tok, "es") == 0) {
+                        d->es_dfs = strtoul(value, NULL, 0);
+                } else if (strcmp(tok, "ss") == 0) {
+                        d->ss_dfs = strtoul(value, NULL, 0);
+                } else if (strcmp(tok, "ac") == 0) {
+                        d->mode_ac = atoi(value);
+                } else if (strcmp(tok, "tel") == 0) {
+                        d->telemetry = atoi(value);
+                } else {
+                        qerror("radar: destination \"%s\": unknown setting \"%s\"\n", spec, tok);
+                }
+        }
+
+        if (!gotkey)
+                qerror("radar: destination \"%s\" has no API key (key=)\n", spec);
+
+        /* the pass-phrase is expanded and made ready for signing once */
+        authtag_expand(hkey, pass);
+        authtag_prepare(&d->auth, hkey);
+        memset(hkey, 0, sizeof(hkey));
+        memset(pass, 0, sizeof(pass));
+
+        ++ndests;
+}
+
+
+/*
+ * udp_dests() - number of extra destinations
+ */
+int udp_dests(void)
+{
+        return ndests;
+}
+
+
+/*
+ * udp_dest() - an extra destination by index
+ */
+const udp_dest_t *udp_dest(int i)
+{
+        return (i >= 0 && i < ndests) ? &dests[i] : NULL;
+}
+
+/*
+ * udp_dup_send() - also send critical messages on the best standby path
+ */
+void udp_dup_send(int on)
+{
+        dup_send = on;
+}
+
+
+/*
+ * udp_check() - health check the uplink paths, fail over and fail back, called after
+ * every poll() and does the work every UDP_CHECK_INTERVAL
+ */
+void udp_check(void)
+{
+        uint64_t now;
+        int i;
+
+        if (npaths < 2 || state != UDP_STATE_RUN || simulate)
+                return;
+
+        now = mstime();
+
+        if (now - checked < UDP_CHECK_INTERVAL)
+                return;
+
+
+        for (i = 0; i < npaths; i++) {
+                udp_path_t *p = &paths[i];
+
+                if (p->fd < 0 && !open_path(p))
+                        continue;
+
+                path_up(i, path_ok(p));
+        }
+
+        if (!paths[active].up) {
+                /* path in use has failed - move to the most preferred healthy path */
+                if (!fail_over())
+                        reset_connection();
+
+        } else {
+                /* fail back to a more preferred path once it has been healthy for long enough */
+                for (i = 0; i < active; i++) {
+                        if (paths[i].up && now - paths[i].healthy_since >= UDP_FAILBACK_HOLD) {
+                                switch_path(i, "fail back");
+                                break;
+                        }
+                }
+        }
+}
+
+
+/*
+ * udp_paths() - number of uplink paths
+ */
+int udp_paths(void)
+{
+        return npaths;
+}
+
+
+/*
+ * udp_active() - index of the uplink path in use
+ */
+int udp_active(void)
+{
+        return active;
+}
+
+
+/*
+ * udp_path() - an uplink path by index
+ */
+const udp_path_t *udp_path(int i)
+{
+        return (i >= 0 && i < npaths) ? &paths[i] : NULL;
+}
+
+
+/*
+ * udp_send_path() - send a message on a given uplink path whatever its health (probes),
+ * returns non-zero if it was sent
+ */
+int udp_send_path(int i, void *buf, int size)
+{
+        if (simulate || state != UDP_STATE_RUN || i < 0 || i >= npaths || paths[i].fd < 0)
+                return 0;
+
+        if (transmit(&paths[i], buf, size) < 0)
+                return 0;
+
+        PROBE1(packet_sent, size);
+
+        return 1;
+}
+
+
+/*
+ * udp_path_silent() - probes on a path are going unanswered (or not any more)
+ */
+void udp_path_silent(int i, int silent)
+{
+        if (i < 0 || i >= npaths || paths[i].silent == silent)
+                return;
+
+        if (silent)
+                qlog("radar: uplink path %d (%s) is not answering probes\n", i, paths[i].name);
+
+        paths[i].silent = silent;
+        udp_recheck();
+}
+
+
+/*
+ * udp_receive() - hand messages from the aggregator to fn with the index of the path
+ * they came in on
+ */
+void udp_receive(void (*fn)(int, void *, int))
+{
+        receiver = fn;
+}
+
+
+/*
+ * udp_poll_setup() - add the uplink sockets to the poll() list if anything wants to
+ * receive on them, returns the number added
+ */
+int udp_poll_setup(struct pollfd *fds)
+{
+        int i, n = 0;
+
+        if (!receiver || state != UDP_STATE_RUN)
+                return 0;
+
+        for (i = 0; i < npaths; i++) {
+                if (paths[i].fd >= 0) {
+                        fds[n].fd = paths[i].fd;
+                        fds[n].events = POLLIN;
+                        fds[n].revents = 0;
+                        ++n;
+                }
+        }
+
+        return n;
+}
+
+
+/*
+ * udp_poll_events() - read what the aggregator has sent, an error queued on a path's
+ * socket (an ICMP error) fails it
+ */
+void udp_poll_events(struct pollfd *fds, int n)
+{
+        uint8_t buf[UDP_RECV_SIZE];
+        int i, j;
+
+        for (i = 0; i < n; i++) {
+                if (!fds[i].revents)
+                        continue;
+
+                for (j = 0; j < npaths && paths[j].fd != fds[i].fd; j++)
+                        ;
+
+                if (j == npaths)
+                        continue;
+
+                for (;;) {
+                        struct sockaddr_in from;
+                        socklen_t fromlen = sizeof(from);
+                        int len = recvfrom(paths[j].fd, buf, sizeof(buf), MSG_DONTWAIT, (struct sockaddr *)&from, &fromlen);
+
+                        if (len < 0) {
+                                if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR && npaths > 1)
+                                        path_up(j, 0);
+                                break;
+                        }
+
+                        /* only the aggregator */
+                        if (from.sin_addr.s_addr == dest.sin_addr.s_addr && from.sin_port == dest.sin_port)
+                                receiver(j, buf, len);
+                }
         }
 }
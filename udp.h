@@ -6,9 +6,26 @@
 #ifndef _UDP_H
 #define _UDP_H
 
+#include <stdint.h>
+#include <poll.h>
+#include <net/if.h>
+#include <netinet/in.h>
+
+#include "defs.h"
+#include "authtag.h"
+
 #define UDP_HOST		"adsb-in.1090mhz.uk"	/* default host */
 #define UDP_PORT		5997			/* if not specified */
 #define UDP_RETRY		3			/* retry timer in seconds */
+#define UDP_IP_OVERHEAD		28			/* IPv4 and UDP header bytes counted against the budget */
+#define UDP_BURST_MS		100			/* default burst: this much of the budget */
+#define UDP_BURST_MIN		1500			/* smallest burst (bytes) */
+#define UDP_MAX_PATHS		4			/* preferred uplink plus up to three standby (-O) */
+#define UDP_PATH_NAME_LEN	31			/* interface name or source address */
+#define UDP_CHECK_INTERVAL	200			/* uplink path health check (milliseconds) */
+#define UDP_FAILBACK_HOLD	10000			/* preferred path must be healthy this long before fail back (milliseconds) */
+#define UDP_RECV_SIZE		1500			/* largest message we receive */
+#define UDP_MAX_DESTS		3			/* extra destinations (-D) besides the aggregator */
 
 
 /*
@@ -22,13 +39,94 @@ enum udpstate {
 };
 
 
+/*
+ * traffic classes shed under an uplink budget (-U), lowest priority first
+ */
+enum udp_class {
+        UDP_CLASS_AC,					/* Mode-A/C */
+        UDP_CLASS_SS,					/* Mode-S short squitters */
+        UDP_CLASS_COMMB,				/* DF20/21 Comm-B */
+        UDP_CLASS_ES_OTHER,				/* other Extended Squitter (status, target state, DF19/22...) */
+        UDP_CLASS_ES,					/* identification, position and velocity */
+        UDP_CLASS_CONTROL,				/* keepalive, stats and telemetry - never shed */
+        UDP_CLASSES
+};
+
+
+/*
+ * an uplink path - the preferred path is index zero and the others are standby
+ */
+typedef struct {
+        char name[UDP_PATH_NAME_LEN+1];			/* interface name or source address as given */
+        char ifname[IFNAMSIZ];				/* interface whose link state we watch, empty if none */
+        struct in_addr addr;				/* source address to bind to, INADDR_ANY for an interface */
+        int bound;					/* bound to an interface or address, rather than the default */
+        int fd;						/* socket, -1 if none */
+        int up;						/* healthy */
+        int silent;					/* probes unanswered on this path but not others (see probe.c) */
+        uint64_t healthy_since;				/* mstime() it became healthy */
+        uint32_t errors;				/* send and health check failures */
+        uint64_t sent;					/* messages sent */
+} udp_path_t;
+
+
+/*
+ * an extra destination that is sent a copy of what goes to the aggregator, signed for it (-D)
+ */
+typedef struct {
+        char host[HOSTNAME_LEN+1];			/* host name or address as given */
+        uint16_t port;
+        uint64_t key;					/* API key we send it */
+        authtag_ctx_t auth;				/* its pass-phrase, ready for signing */
+        int qos;					/* DSCP */
+        uint32_t es_dfs;				/* extended (112 bit) DFs it wants, bit n for DFn */
+        uint32_t ss_dfs;				/* short (56 bit) DFs it wants */
+        int mode_ac;					/* wants Mode-A/C */
+        int telemetry;					/* wants telemetry and latency summaries */
+        struct sockaddr_in addr;
+        int fd;						/* socket, -1 if none */
+        int retry;					/* seconds until we try to open it again */
+        uint32_t seq;					/* its own sequence numbers */
+        uint64_t sent;					/* messages sent */
+        uint64_t filtered;				/* messages, or frames of a multiframe, it doesn't want */
+        uint64_t shed;					/* copies shed to stay within the uplink budget (-U) */
+        uint32_t errors;				/* look-up and send failures */
+} udp_dest_t;
+
+
 /*
  * exported functions
  */
 void udp_init(char *, int, int);
 void udp_close(void);
 void udp_second(void);
-void udp_send(void *, int);
+int udp_send(void *, int);
 void udp_reset(void);
+void udp_restart(void);
+void udp_recheck(void);
+enum udpstate udp_state(void);
+uint32_t udp_errors(void);
+void udp_simulate(void (*)(void *, int));
+void udp_budget(int, int, int);
+int udp_admit(int, int);
+int udp_es_class(const uint8_t *);
+void udp_impair(const char *);
+void udp_run(void);
+int udp_timeout(int);
+void udp_add_path(const char *);
+void udp_dup_send(int);
+int udp_send_critical(void *, int);
+void udp_check(void);
+int udp_paths(void);
+int udp_active(void);
+const udp_path_t *udp_path(int);
+int udp_send_path(int, void *, int);
+void udp_path_silent(int, int);
+void udp_receive(void (*)(int, void *, int));
+int udp_poll_setup(struct pollfd *);
+void udp_poll_events(struct pollfd *, int);
+void udp_add_dest(const char *);
+int udp_dests(void);
+const udp_dest_t *udp_dest(int);
 
 #endif
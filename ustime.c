@@ -14,6 +14,23 @@
 
 #include "ustime.h"
 
+/*
+ * virtual clock for replaying a capture (see capture.c)
+ */
+static int virtual = 0;
+static uint64_t vnow;
+
+
+/*
+ * ustime_set() - stop following the system clock and set the time (uS)
+ */
+void ustime_set(uint64_t us)
+{
+        virtual = 1;
+        vnow = us;
+}
+
+
 /*
  * ustime() - return unix epoc time in micro-seconds
  */
@@ -22,6 +39,9 @@ uint64_t ustime(void)
         struct timeval tv;
         uint64_t us;
 
+        if (virtual)
+                return vnow;
+
         gettimeofday(&tv, NULL);
         us = (uint64_t)tv.tv_sec * 1000000 + (uint64_t)tv.tv_usec;
         
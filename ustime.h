@@ -9,5 +9,6 @@
 #include <stdint.h>
 
 uint64_t ustime(void);
+void ustime_set(uint64_t);
 
 #endif